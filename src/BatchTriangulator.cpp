@@ -0,0 +1,294 @@
+#include "BatchTriangulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+#include <boost/bind.hpp>
+
+#include "PointOfView.h"
+#include "PointsToTrack.h"
+#include "TracksOfPoints.h"
+#include "TrackStore.h"
+#include "CameraPinholeDistor.h"
+#include "TaskScheduler.h"
+
+namespace OpencvSfM{
+
+  using cv::Ptr;
+  using std::vector;
+
+  typedef Eigen::Matrix<double, 3, 4, Eigen::RowMajor> ProjectionMatrix;
+
+  static const double BAD_TRIANGULATION = 1e20;
+  static const size_t TRACKS_BY_CHUNK = 512;
+
+  //update the 3D positions of a batch:
+  static void setPositions( TrackStore& tracks, const vector<cv::Vec3d>& points,
+    const vector<double>& errors )
+  {
+    for( unsigned int t = 0; t < tracks.size( ); ++t )
+      if( errors[ t ] < BAD_TRIANGULATION )
+        tracks.set3DPosition( t, points[ t ] );
+  }
+  static void setPositions( vector<TrackOfPoints>& tracks,
+    const vector<cv::Vec3d>& points, const vector<double>& errors )
+  {
+    for( size_t t = 0; t < tracks.size( ); ++t )
+      if( errors[ t ] < BAD_TRIANGULATION )
+        tracks[ t ].set3DPosition( points[ t ] );
+  }
+
+  //points of a track seen by the wanted images:
+  template<typename Track>
+  static void imagesMasks( const Track& track, const vector<int>& images,
+    vector<bool>& masks )
+  {
+    unsigned int nb_points = track.getNbPoints( );
+    masks.resize( nb_points );
+    for( unsigned int i = 0; i < nb_points; ++i )
+      masks[ i ] = std::find( images.begin( ), images.end( ),
+        track.getImageIndex( i ) ) != images.end( );
+  }
+
+  BatchTriangulator::BatchTriangulator( const vector<PointOfView>& cameras,
+    const vector< Ptr<PointsToTrack> >& points_to_track, unsigned int seed )
+    :cameras_( cameras ), points_to_track_( points_to_track ), seed_( seed ),
+    nb_threads_( 0 )
+  {
+    projections_.resize( 12 * cameras_.size( ) );
+    pinhole_.resize( cameras_.size( ) );
+    for( size_t c = 0; c < cameras_.size( ); ++c )
+    {
+      cv::Mat_<double> P = cameras_[ c ].getProjectionMatrix( );
+      for( int i = 0; i < 12; ++i )
+        projections_[ 12 * c + i ] = P( i / 4, i % 4 );
+      //only pinhole cameras can be projected using P = K.[ R|t ]:
+      const Camera* device = cameras_[ c ].getIntraParameters( );
+      pinhole_[ c ] = dynamic_cast<const CameraPinhole*>( device ) != NULL &&
+        dynamic_cast<const CameraPinholeDistor*>( device ) == NULL;
+    }
+  }
+
+  template<typename Track>
+  void BatchTriangulator::getObservations( const Track& track,
+    const vector<bool>& masks, Buffers& buffers ) const
+  {
+    unsigned int nb_points = track.getNbPoints( );
+    bool has_mask = ( masks.size( ) == nb_points );
+    buffers.observations.resize( nb_points );
+    unsigned int nb_observations = 0;
+    for( unsigned int i = 0; i < nb_points; ++i )
+    {
+      if( has_mask && !masks[ i ] )
+        continue;
+      int num_camera, num_point;
+      track.getMatch( i, num_camera, num_point );
+      const cv::KeyPoint& kp = points_to_track_[ num_camera ]->getKeypoint( num_point );
+      Observation& observation = buffers.observations[ nb_observations++ ];
+      observation.camera = num_camera;
+      observation.x = kp.pt.x;
+      observation.y = kp.pt.y;
+    }
+    buffers.observations.resize( nb_observations );
+  }
+
+  double BatchTriangulator::solveSubset( Buffers& buffers, cv::Vec3d& point ) const
+  {
+    const vector<Observation>& observations = buffers.observations;
+    unsigned int nb_observations = observations.size( );
+    Eigen::Matrix4d normal = Eigen::Matrix4d::Zero( );
+    for( unsigned int i = 0; i < nb_observations; ++i )
+      if( buffers.subset[ i ] )
+      {
+        Eigen::Map<const Eigen::Vector4d> eq1( &buffers.equations[ 8 * i ] ),
+          eq2( &buffers.equations[ 8 * i + 4 ] );
+        normal.noalias( ) += eq1 * eq1.transpose( );
+        normal.noalias( ) += eq2 * eq2.transpose( );
+      }
+    //the solution is the eigenvector of the smallest eigenvalue:
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> solver( normal );
+    Eigen::Vector4d X = solver.eigenvectors( ).col( 0 );
+    if( fabs( X( 3 ) ) < 1e-12 )
+      return BAD_TRIANGULATION;//point at infinity
+    point[ 0 ] = X( 0 ) / X( 3 );
+    point[ 1 ] = X( 1 ) / X( 3 );
+    point[ 2 ] = X( 2 ) / X( 3 );
+
+    //mean reprojection error of the subset (like TrackOfPoints::errorEstimate):
+    double distance = 0;
+    unsigned int nb_views = 0;
+    Eigen::Vector4d point_h( point[ 0 ], point[ 1 ], point[ 2 ], 1.0 );
+    for( unsigned int i = 0; i < nb_observations; ++i )
+      if( buffers.subset[ i ] )
+      {
+        const Observation& observation = observations[ i ];
+        double proj_x, proj_y;
+        if( pinhole_[ observation.camera ] )
+        {
+          Eigen::Map<const ProjectionMatrix> P(
+            &projections_[ 12 * observation.camera ] );
+          Eigen::Vector3d proj = P * point_h;
+          proj_x = proj( 0 ) / proj( 2 );
+          proj_y = proj( 1 ) / proj( 2 );
+        }
+        else
+        {
+          cv::Vec2d proj;
+          cameras_[ observation.camera ].project3DPointsIntoImage( &point, &proj, 1 );
+          proj_x = proj[ 0 ];
+          proj_y = proj[ 1 ];
+        }
+        distance += sqrt( ( observation.x - proj_x ) * ( observation.x - proj_x ) +
+          ( observation.y - proj_y ) * ( observation.y - proj_y ) );
+        nb_views++;
+      }
+    return distance / nb_views;
+  }
+
+  double BatchTriangulator::solve( bool robust, double reproj_error,
+    cv::RNG& rng, Buffers& buffers, cv::Vec3d& point ) const
+  {
+    const vector<Observation>& observations = buffers.observations;
+    unsigned int nb_observations = observations.size( );
+    if( nb_observations < 2 )
+      return BAD_TRIANGULATION;
+
+    //equations of the DLT: x.P3 - P1 and y.P3 - P2, normalized so that
+    //each view has the same weight:
+    buffers.equations.resize( 8 * nb_observations );
+    buffers.subset.resize( nb_observations );
+    for( unsigned int i = 0; i < nb_observations; ++i )
+    {
+      const Observation& observation = observations[ i ];
+      Eigen::Map<const ProjectionMatrix> P( &projections_[ 12 * observation.camera ] );
+      Eigen::Map<Eigen::Vector4d> eq1( &buffers.equations[ 8 * i ] ),
+        eq2( &buffers.equations[ 8 * i + 4 ] );
+      eq1 = observation.x * P.row( 2 ).transpose( ) - P.row( 0 ).transpose( );
+      eq2 = observation.y * P.row( 2 ).transpose( ) - P.row( 1 ).transpose( );
+      double norm1 = eq1.norm( ), norm2 = eq2.norm( );
+      if( norm1 > 0 )
+        eq1 /= norm1;
+      if( norm2 > 0 )
+        eq2 /= norm2;
+    }
+
+    if( !robust )
+    {
+      std::fill( buffers.subset.begin( ), buffers.subset.end( ), 1 );
+      return solveSubset( buffers, point );
+    }
+
+    double best_distance = BAD_TRIANGULATION;
+    cv::Vec3d current_point;
+    for( unsigned int num_iter = 0; num_iter + 1 < nb_observations; ++num_iter )
+    {
+      unsigned int nb_vals = 0;
+      for( unsigned int i = 0; i < nb_observations; ++i )
+      {
+        buffers.subset[ i ] = ( rng( 2 ) != 0 );
+        nb_vals += buffers.subset[ i ];
+      }
+      while( nb_vals < 2 )
+      {
+        unsigned int val = rng( nb_observations );
+        while( buffers.subset[ val ] )
+          val = ( val + 1 ) % nb_observations;
+        buffers.subset[ val ] = 1;
+        nb_vals++;
+      }
+
+      double distance = solveSubset( buffers, current_point );
+      if( distance < best_distance )
+      {
+        point = current_point;
+        best_distance = distance;
+        if( best_distance < reproj_error )
+          break;
+      }
+    }
+    return best_distance;
+  }
+
+  template<typename Tracks>
+  void BatchTriangulator::triangulateChunk( const Tracks* tracks,
+    const Selection* selection, bool robust, double reproj_error,
+    vector<cv::Vec3d>* points, vector<double>* errors,
+    size_t begin, size_t end ) const
+  {
+    Buffers buffers;
+    for( size_t t = begin; t < end; ++t )
+    {
+      size_t idx = selection->tracks == NULL ? t : ( *selection->tracks )[ t ];
+      if( selection->images != NULL )
+        imagesMasks( ( *tracks )[ idx ], *selection->images, buffers.masks );
+      getObservations( ( *tracks )[ idx ], buffers.masks, buffers );
+      cv::RNG rng = getRNG( idx );
+      ( *errors )[ t ] = solve( robust, reproj_error, rng, buffers,
+        ( *points )[ t ] );
+    }
+  }
+
+  template<typename Tracks>
+  void BatchTriangulator::triangulateBatch( const Tracks& tracks,
+    const Selection& selection, bool robust, double reproj_error,
+    vector<cv::Vec3d>& points, vector<double>& errors ) const
+  {
+    size_t nb_tracks = selection.tracks == NULL ?
+      tracks.size( ) : selection.tracks->size( );
+    points.resize( nb_tracks );
+    errors.resize( nb_tracks );
+    if( nb_threads_ == 1 || nb_tracks <= TRACKS_BY_CHUNK )
+    {
+      triangulateChunk( &tracks, &selection, robust, reproj_error, &points,
+        &errors, 0, nb_tracks );
+      return;
+    }
+    //tracks are independent, each chunk writes its own part of the outputs:
+    TaskScheduler scheduler( nb_threads_ );
+    scheduler.parallelFor( nb_tracks, TRACKS_BY_CHUNK, boost::bind(
+      &BatchTriangulator::triangulateChunk<Tracks>, this, &tracks, &selection,
+      robust, reproj_error, &points, &errors, _1, _2 ) );
+  }
+
+  void BatchTriangulator::triangulate( TrackStore& tracks,
+    vector<double>& errors, bool robust, double reproj_error ) const
+  {
+    Selection every_tracks = { NULL, NULL };
+    vector<cv::Vec3d> points;
+    triangulateBatch( tracks, every_tracks, robust, reproj_error, points, errors );
+    setPositions( tracks, points, errors );
+  }
+
+  void BatchTriangulator::triangulate( vector<TrackOfPoints>& tracks,
+    vector<double>& errors, bool robust, double reproj_error ) const
+  {
+    Selection every_tracks = { NULL, NULL };
+    vector<cv::Vec3d> points;
+    triangulateBatch( tracks, every_tracks, robust, reproj_error, points, errors );
+    setPositions( tracks, points, errors );
+  }
+
+  void BatchTriangulator::triangulate( const vector<TrackOfPoints>& tracks,
+    const vector<size_t>& selected, const vector<int>& images,
+    vector<cv::Vec3d>& points, vector<double>& errors, bool robust,
+    double reproj_error ) const
+  {
+    Selection selection = { &selected, &images };
+    triangulateBatch( tracks, selection, robust, reproj_error, points, errors );
+  }
+
+  double BatchTriangulator::triangulate( TrackOfPoints& track,
+    cv::Vec3d& point, unsigned int idx, bool robust, double reproj_error,
+    const vector<bool>& masks ) const
+  {
+    Buffers buffers;
+    getObservations( track, masks, buffers );
+    cv::RNG rng = getRNG( idx );
+    double distance = solve( robust, reproj_error, rng, buffers, point );
+    if( distance < BAD_TRIANGULATION )
+      track.set3DPosition( point );
+    return distance;
+  }
+
+}
@@ -0,0 +1,211 @@
+#ifndef _GSOC_SFM_BATCH_TRIANGULATOR_H
+#define _GSOC_SFM_BATCH_TRIANGULATOR_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include "opencv2/core/core.hpp"
+
+namespace OpencvSfM{
+  class SFM_EXPORTS PointOfView;
+  class SFM_EXPORTS PointsToTrack;
+  class SFM_EXPORTS TrackOfPoints;
+  class SFM_EXPORTS TrackStore;
+
+  /**
+  * \brief Triangulation of a batch of tracks.
+  *
+  * TrackOfPoints::triangulateLinear solves a 3n x (4+n) system with an SVD
+  * for each call, and the reprojection error is computed with temporary
+  * matrices. Here, each observation gives two equations of the DLT which
+  * are accumulated into a 4x4 normal matrix (fixed size Eigen types), so
+  * the 3D point is the eigenvector of the smallest eigenvalue of this
+  * matrix. Projection matrices are extracted once for every cameras, and
+  * the buffers are reused between tracks: the loop over tracks doesn't
+  * allocate memory (errors of distorted cameras are computed with
+  * PointOfView::project3DPointsIntoImage, which doesn't allocate either).
+  *
+  * The robust mode uses the same strategy than
+  * TrackOfPoints::triangulateRobust (n-1 random subsets of views, stop
+  * as soon as the reprojection error is lower than reproj_error), with a
+  * random generator seeded by the seed of the triangulator and the index
+  * of the track. Batches are split in chunks of tracks processed by
+  * several threads: as each track has its own random stream, results are
+  * the same whatever the number of threads.
+  */
+  class SFM_EXPORTS BatchTriangulator
+  {
+  public:
+    /**
+    * Create a triangulator. Cameras and points are given by address and
+    * must not change while the triangulator is used.
+    * @param cameras cameras used to compute projection of 3D points
+    * @param points_to_track 2D points of each image
+    * @param seed seed of the random generators of the robust estimation
+    */
+    BatchTriangulator( const std::vector<PointOfView>& cameras,
+      const std::vector< cv::Ptr<PointsToTrack> >& points_to_track,
+      unsigned int seed = 0 );
+
+    /**
+    * Change the number of threads used by the batches
+    * @param nb_threads number of threads (0 to use every cores)
+    */
+    inline void setNbThreads( unsigned int nb_threads )
+    { nb_threads_ = nb_threads; };
+
+    /**
+    * Triangulate every tracks of a store, using every points of the tracks
+    * (like TrackOfPoints::triangulateLinear without mask)
+    * @param tracks tracks to triangulate (3D positions are updated)
+    * @param errors [out] mean reprojection error of each track (1e20 if
+    * the track can't be triangulated)
+    * @param robust use random subsets of views to reject outliers
+    * @param reproj_error threshold used to stop the robust estimation
+    */
+    void triangulate( TrackStore& tracks, std::vector<double>& errors,
+      bool robust = true, double reproj_error = 4 ) const;
+    /**
+    * Triangulate every tracks of a list
+    * @param tracks tracks to triangulate (3D positions are updated)
+    * @param errors [out] mean reprojection error of each track (1e20 if
+    * the track can't be triangulated)
+    * @param robust use random subsets of views to reject outliers
+    * @param reproj_error threshold used to stop the robust estimation
+    */
+    void triangulate( std::vector<TrackOfPoints>& tracks,
+      std::vector<double>& errors, bool robust = true,
+      double reproj_error = 4 ) const;
+    /**
+    * Triangulate some tracks of a list using only the points of some
+    * images, without changing the tracks
+    * @param tracks tracks of the sequence
+    * @param selected indexes of the tracks to triangulate
+    * @param images indexes of the images to use
+    * @param points [out] 3D coordinates of each selected track
+    * @param errors [out] mean reprojection error of each selected track
+    * (1e20 if the track can't be triangulated)
+    * @param robust use random subsets of views to reject outliers
+    * @param reproj_error threshold used to stop the robust estimation
+    */
+    void triangulate( const std::vector<TrackOfPoints>& tracks,
+      const std::vector<size_t>& selected, const std::vector<int>& images,
+      std::vector<cv::Vec3d>& points, std::vector<double>& errors,
+      bool robust = true, double reproj_error = 4 ) const;
+    /**
+    * Triangulate a single track
+    * @param track track to triangulate (3D position is updated)
+    * @param point [out] 3D coordinates of the track
+    * @param idx index of the track, used to seed the random generator
+    * @param robust use random subsets of views to reject outliers
+    * @param reproj_error threshold used to stop the robust estimation
+    * @param masks points of the track to use (ignored if its size is not
+    * the number of points of the track, like TrackOfPoints::triangulateLinear)
+    * @return mean reprojection error (1e20 if the track can't be triangulated)
+    */
+    double triangulate( TrackOfPoints& track, cv::Vec3d& point,
+      unsigned int idx, bool robust = true, double reproj_error = 4,
+      const std::vector<bool>& masks = std::vector<bool>( ) ) const;
+
+  protected:
+    /**
+    * \brief A 2D point seen by a camera
+    */
+    struct Observation
+    {
+      unsigned int camera;///<Index of the camera
+      double x;///<Coordinates of the point (pixels)
+      double y;///<Coordinates of the point (pixels)
+    };
+    /**
+    * \brief Buffers reused between tracks
+    */
+    struct Buffers
+    {
+      std::vector<Observation> observations;///<Points of the current track
+      std::vector<double> equations;///<Two DLT equations (8 values) by point
+      std::vector<unsigned char> subset;///<Points used by the current model
+      std::vector<bool> masks;///<Points of the current track seen by the wanted images
+    };
+    /**
+    * \brief Tracks of a batch to triangulate and images to use
+    */
+    struct Selection
+    {
+      const std::vector<size_t>* tracks;///<Indexes of the tracks (NULL for every tracks)
+      const std::vector<int>* images;///<Images to use (NULL for every images)
+    };
+
+    /**
+    * Triangulate the tracks [ begin, end ) of a batch, without changing them
+    * @param tracks tracks to triangulate (TrackStore or list of TrackOfPoints)
+    * @param selection tracks of the batch and images to use
+    * @param robust use random subsets of views to reject outliers
+    * @param reproj_error threshold used to stop the robust estimation
+    * @param points [out] 3D coordinates of each track
+    * @param errors [out] mean reprojection error of each track
+    */
+    template<typename Tracks>
+    void triangulateChunk( const Tracks* tracks, const Selection* selection,
+      bool robust, double reproj_error, std::vector<cv::Vec3d>* points,
+      std::vector<double>* errors, size_t begin, size_t end ) const;
+    /**
+    * Triangulate every tracks of a batch using several threads
+    * @param tracks tracks to triangulate (TrackStore or list of TrackOfPoints)
+    * @param selection tracks of the batch and images to use
+    * @param points [out] 3D coordinates of each track
+    * @param errors [out] mean reprojection error of each track
+    */
+    template<typename Tracks>
+    void triangulateBatch( const Tracks& tracks, const Selection& selection,
+      bool robust, double reproj_error, std::vector<cv::Vec3d>& points,
+      std::vector<double>& errors ) const;
+    /**
+    * Get the random generator of a track
+    * @param idx index of the track
+    */
+    inline cv::RNG getRNG( unsigned int idx ) const
+    {
+      return cv::RNG( ( ( boost::uint64_t )seed_ << 32 ) + idx + 1 );
+    };
+    /**
+    * Get the points of a track
+    * @param track track to read (TrackOfPoints or TrackStore::TrackView)
+    * @param masks points of the track to use (ignored if its size is not
+    * the number of points)
+    * @param buffers [out] observations of the track
+    */
+    template<typename Track>
+    void getObservations( const Track& track, const std::vector<bool>& masks,
+      Buffers& buffers ) const;
+    /**
+    * Triangulate the observations stored into buffers
+    * @param robust use random subsets of views to reject outliers
+    * @param reproj_error threshold used to stop the robust estimation
+    * @param rng random generator used by the robust estimation
+    * @param buffers observations and temporary buffers
+    * @param point [out] 3D coordinates
+    * @return mean reprojection error (1e20 if the point can't be triangulated)
+    */
+    double solve( bool robust, double reproj_error, cv::RNG& rng,
+      Buffers& buffers, cv::Vec3d& point ) const;
+    /**
+    * Triangulate using the subset of observations stored into buffers
+    * @param buffers observations, equations and subset
+    * @param point [out] 3D coordinates
+    * @return mean reprojection error of the subset
+    */
+    double solveSubset( Buffers& buffers, cv::Vec3d& point ) const;
+
+    const std::vector<PointOfView>& cameras_;///<Cameras of the sequence
+    const std::vector< cv::Ptr<PointsToTrack> >& points_to_track_;///<2D points of each image
+    std::vector<double> projections_;///<Projection matrix of each camera (12 values, row major)
+    std::vector<bool> pinhole_;///<Can the camera be projected using its matrix?
+    unsigned int seed_;///<Seed of the random generators
+    unsigned int nb_threads_;///<Number of threads of batches (0 for every cores)
+  };
+
+}
+
+#endif
@@ -1,7 +1,9 @@
 #include "Boost_Matching.h"
 
 #include "CameraPinholeDistor.h"
+#include "FundamentalEstimator.h"
 #include <iostream>
+#include <cfloat>
 
 namespace OpencvSfM{
 
@@ -9,148 +11,304 @@ namespace OpencvSfM{
   using cv::Mat;
   using std::vector;
 
-  size_t MatchingThread::size_list;
-  std::vector< cv::Ptr< PointsToTrack > >* MatchingThread::matches_ = NULL;
-  vector< cv::Mat > MatchingThread::masks;
-  unsigned int MatchingThread::mininum_points_matches=50;
-  PointsMatcher* MatchingThread::match_algorithm = NULL;
-  double MatchingThread::total_matches = 0;
-  double MatchingThread::current_match_ = 0;
-  bool MatchingThread::print_progress_ = true;
+  MatchingContext::MatchingContext( SequenceAnalyzer* seq_analyser,
+    unsigned int mininum_points_matches, bool print_progress )
+  {
+    this->seq_analyser = seq_analyser;
+    this->matches_ = &seq_analyser->points_to_track_;
+    this->size_list = matches_->size( );
+    this->match_algorithm = seq_analyser->match_algorithm_;
+    this->mininum_points_matches = mininum_points_matches;
+    this->print_progress_ = print_progress;
+    this->tracks_builder = NULL;
 
-  DECLARE_MUTEX( MatchingThread::thread_concurr );
-  DECLARE_MUTEX( MatchingThread::thread_unicity );
+    double nbMatches = size_list;
+    total_matches = nbMatches * ( nbMatches - 1 ) / 2.0;
+    current_match_ = 0;
 
+    INIT_MUTEX( thread_unicity );
+  }
 
-  MatchingThread::MatchingThread(cv::Ptr<  SequenceAnalyzer> seq_analyser,
-    unsigned int i)
+  void MatchingContext::holdDescriptors( unsigned int img )
   {
-    this->i = i;
-    this->seq_analyser = seq_analyser;
-    this->seq_analyser.addref();//avoid ptr deletion...
+    P_MUTEX( thread_unicity );
+    bool first_use = !descriptors_held[ img ];
+    descriptors_held[ img ] = true;
+    V_MUTEX( thread_unicity );
+    ( *matches_ )[ img ]->computeKeypointsAndDesc( false );
+    if( first_use )//reference of the session, until the last pair:
+      ( *matches_ )[ img ]->computeKeypointsAndDesc( false );
   }
 
-  void MatchingThread::operator()()
+  void MatchingContext::releaseDescriptors( unsigned int img )
   {
-    Ptr<PointsToTrack> points_to_track_i=( *matches_ )[i];
-    double error_allowed = MAX( seq_analyser->images_[ i ].rows,
-      seq_analyser->images_[ i ].cols ) * 0.004;
-
-    points_to_track_i->computeKeypointsAndDesc( false );
-
+    ( *matches_ )[ img ]->free_descriptors( );
     P_MUTEX( thread_unicity );
-    Ptr<PointsMatcher> point_matcher = match_algorithm->clone( true );
-    point_matcher->add( points_to_track_i );
+    bool last_pair = --pending_pairs[ img ] == 0;
     V_MUTEX( thread_unicity );
-    point_matcher->train( );
+    if( last_pair )//save memory...
+      ( *matches_ )[ img ]->free_descriptors( );
+  }
 
-    unsigned int j=i+1;
-    while ( j < size_list )
+  void DetectionThread::operator()()
+  {
+    if( keep_descriptors )
+      points->computeKeypointsAndDesc( false );
+    else if( points->getKeypoints( ).empty( ) )
     {
-      Ptr<PointsToTrack> points_to_track_j=( *matches_ )[j];
+      points->computeKeypointsAndDesc( false );
+      points->free_descriptors( );
+    }
+  }
 
-      points_to_track_j->computeKeypointsAndDesc( false );
+  //distance between two descriptors (Hamming for binary ones, else L2):
+  static float descriptorDistance( const Mat& desc1, int row1,
+    const Mat& desc2, int row2 )
+  {
+    if( desc1.depth( ) != CV_8U )
+      return ( float )cv::norm( desc1.row( row1 ), desc2.row( row2 ) );
+    const uchar* ptr1 = desc1.ptr( row1 ), *ptr2 = desc2.ptr( row2 );
+    int nb_bytes = desc1.cols * desc1.channels( ), dist = 0;
+    for( int k = 0; k < nb_bytes; ++k )
+      for( uchar bits = ptr1[ k ] ^ ptr2[ k ]; bits != 0; bits &= bits - 1 )
+        dist++;
+    return ( float )dist;
+  }
 
-      P_MUTEX( thread_unicity );
-      current_match_++;
-      if( print_progress_ )
+  //epipolar line in image i of a point of image j (x_i^T * F * x_j = 0), or
+  //if transposed, epipolar line in image j of a point of image i:
+  static inline cv::Vec3f epipolarLine( const cv::Mat_<double>& F,
+    const cv::Point2f& pt, bool transposed )
+  {
+    if( transposed )
+      return cv::Vec3f( ( float )( F( 0, 0 ) * pt.x + F( 1, 0 ) * pt.y + F( 2, 0 ) ),
+        ( float )( F( 0, 1 ) * pt.x + F( 1, 1 ) * pt.y + F( 2, 1 ) ),
+        ( float )( F( 0, 2 ) * pt.x + F( 1, 2 ) * pt.y + F( 2, 2 ) ) );
+    return cv::Vec3f( ( float )( F( 0, 0 ) * pt.x + F( 0, 1 ) * pt.y + F( 0, 2 ) ),
+      ( float )( F( 1, 0 ) * pt.x + F( 1, 1 ) * pt.y + F( 1, 2 ) ),
+      ( float )( F( 2, 0 ) * pt.x + F( 2, 1 ) * pt.y + F( 2, 2 ) ) );
+  }
+
+  /**
+  * Check the reciprocity of the matches found from the points of image j,
+  * instead of matching every points of image i with image j: the point of
+  * image i of each match must not be closer to an other point of image j
+  * close to its epipolar line than to its query.
+  * @return number of matches removed (from matches)
+  */
+  static unsigned int reciprocityInBand( const cv::Mat_<double>& F,
+    const Mat& desc_i, const vector<cv::KeyPoint>& keypoints_i,
+    const Mat& desc_j, const vector<cv::KeyPoint>& keypoints_j,
+    const KeypointsGrid& grid_j, float band,
+    vector< cv::DMatch >& matches, unsigned int& nb_comparisons )
+  {
+    vector<unsigned int> candidates;
+    size_t nb_kept = 0;
+    for( size_t m = 0; m < matches.size( ); ++m )
+    {
+      const cv::DMatch& match = matches[ m ];
+      float distance = descriptorDistance( desc_j, match.queryIdx,
+        desc_i, match.trainIdx );
+      grid_j.findNearLine( epipolarLine( F, keypoints_i[ match.trainIdx ].pt,
+        true ), band, keypoints_j, candidates );
+      bool reciprocal = true;
+      for( size_t c = 0; c < candidates.size( ) && reciprocal; ++c )
       {
-        if( ( ((int) ((current_match_*100)/total_matches) )%10 ) == 0 )
-          if( ((int) current_match_) % ((int) (total_matches / 100) + 1 ) == 0)
-            std::cout<<(int)((current_match_*100)/total_matches)<<" %"<<std::endl;
+        int q = candidates[ c ];
+        if( q == match.queryIdx || q >= desc_j.rows )
+          continue;
+        nb_comparisons++;
+        reciprocal = descriptorDistance( desc_j, q, desc_i, match.trainIdx ) >=
+          distance;
       }
-      Ptr<PointsMatcher> point_matcher1 = match_algorithm->clone( true );
-      point_matcher1->add( points_to_track_j );
-      V_MUTEX( thread_unicity );
-      point_matcher1->train( );
-
-      vector< cv::DMatch > matches_i_j;
-      point_matcher->crossMatch( point_matcher1, matches_i_j, masks );
-      //point_matcher->match( points_to_track_j,matches_i_j );
-
-      //First compute points matches:
-      unsigned int size_match=matches_i_j.size( );
-      vector<cv::Point2f> srcP;
-      vector<cv::Point2f> destP;
-      vector<uchar> status;
-
-      if( size_match>8 )
+      if( reciprocal )
+        matches[ nb_kept++ ] = match;
+    }
+    unsigned int nb_removed = matches.size( ) - nb_kept;
+    matches.resize( nb_kept );
+    return nb_removed;
+  }
+
+  /**
+  * Match the points of image j not yet matched with the points of image i
+  * close to their epipolar line (x_i^T * F * x_j = 0). A match is kept if
+  * it passes a ratio test against the other points of the band and is not
+  * worse than the matches already found.
+  * @return number of new matches (added to matches)
+  */
+  static unsigned int guidedMatching( const cv::Mat_<double>& F,
+    const Mat& desc_i, const vector<cv::KeyPoint>& keypoints_i,
+    const KeypointsGrid& grid_i, const Mat& desc_j,
+    const vector<cv::KeyPoint>& keypoints_j, float band,
+    vector< cv::DMatch >& matches, unsigned int& nb_comparisons )
+  {
+    int nb_queries = MIN( desc_j.rows, ( int )keypoints_j.size( ) );
+    vector<bool> matched_i( desc_i.rows, false ), matched_j( nb_queries, false );
+    float max_distance = 0;
+    for( size_t m = 0; m < matches.size( ); ++m )
+    {
+      const cv::DMatch& match = matches[ m ];
+      matched_j[ match.queryIdx ] = true;
+      matched_i[ match.trainIdx ] = true;
+      max_distance = MAX( max_distance, descriptorDistance( desc_j,
+        match.queryIdx, desc_i, match.trainIdx ) );
+    }
+
+    //each point of image i keeps its best query:
+    vector< cv::DMatch > best_matches( desc_i.rows, cv::DMatch( -1, -1, FLT_MAX ) );
+    vector<unsigned int> candidates;
+    for( int q = 0; q < nb_queries; ++q )
+    {
+      if( matched_j[ q ] )
+        continue;
+      grid_i.findNearLine( epipolarLine( F, keypoints_j[ q ].pt, false ),
+        band, keypoints_i, candidates );
+
+      float best = FLT_MAX, second = FLT_MAX;
+      int best_idx = -1;
+      for( size_t c = 0; c < candidates.size( ); ++c )
       {
-        std::clog<<"Using match, found "<<matches_i_j.size( )<<
-          " matches between "<<i<<" "<<j<<std::endl;
-        //vector<KeyPoint> points1 = point_matcher->;
-        for( size_t cpt = 0; cpt < size_match; ++cpt )
+        int t = candidates[ c ];
+        if( t >= desc_i.rows || matched_i[ t ] )
+          continue;
+        float dist = descriptorDistance( desc_j, q, desc_i, t );
+        nb_comparisons++;
+        if( dist < best )
         {
-          const cv::DMatch& match = matches_i_j[ cpt ];
-          const cv::KeyPoint &key1 = points_to_track_j->getKeypoint(
-            matches_i_j[ cpt ].queryIdx );
-          const cv::KeyPoint &key2 = point_matcher->getKeypoint(
-            matches_i_j[ cpt ].trainIdx );
-          srcP.push_back( cv::Point2f( key1.pt.x,key1.pt.y ) );
-          destP.push_back( cv::Point2f( key2.pt.x,key2.pt.y ) );
-          status.push_back( 1 );
+          second = best;
+          best = dist;
+          best_idx = t;
         }
+        else if( dist < second )
+          second = dist;
+      }
+      if( best_idx < 0 || best > max_distance ||
+        ( second < FLT_MAX && best > 0.8f * second ) )
+        continue;
+      if( best < best_matches[ best_idx ].distance )
+        best_matches[ best_idx ] = cv::DMatch( q, best_idx, best );
+    }
 
-        //free some memory:
-        //point_matcher1->clear();
-        points_to_track_j->free_descriptors();
+    unsigned int nb_new = 0;
+    for( size_t t = 0; t < best_matches.size( ); ++t )
+      if( best_matches[ t ].queryIdx >= 0 )
+      {
+        matches.push_back( best_matches[ t ] );
+        nb_new++;
+      }
+    return nb_new;
+  }
 
-        Mat fundam = cv::findFundamentalMat( srcP, destP, status,
-          cv::FM_RANSAC, error_allowed );
+  MatchingThread::MatchingThread( MatchingContext* context,
+    unsigned int i, unsigned int j )
+  {
+    this->i = i;
+    this->j = j;
+    this->context = context;
+  }
 
-        unsigned int nbErrors = 0, nb_iter=0;
-        //refine the mathing :
-        size_match = status.size( );
-        for( size_t cpt = 0; cpt < size_match; ++cpt )
-        {
-        if( status[ cpt ] == 0 )
-        {
-          size_match--;
-          status[ cpt ] = status[ size_match ];
-          status.pop_back( );
-          srcP[ cpt ] = srcP[ size_match ];
-          srcP.pop_back( );
-          destP[ cpt ] = destP[ size_match ];
-          destP.pop_back( );
-          matches_i_j[ cpt ] = matches_i_j[ size_match ];
-          matches_i_j.pop_back( );
-          cpt--;
-          ++nbErrors;
-        }
+  void MatchingThread::operator()()
+  {
+    MatchingContext& ctx = *context;
+    Ptr<PointsToTrack> points_to_track_i=( *ctx.matches_ )[i];
+    Ptr<PointsToTrack> points_to_track_j=( *ctx.matches_ )[j];
+    cv::Size image_size = ctx.seq_analyser->getImageSize( i );
+    double error_allowed = MAX( image_size.height, image_size.width ) * 0.004;
+
+    ctx.holdDescriptors( i );
+    ctx.holdDescriptors( j );
+
+    P_MUTEX( ctx.thread_unicity );
+    ctx.current_match_++;
+    if( ctx.print_progress_ )
+    {
+      if( ( ((int) ((ctx.current_match_*100)/ctx.total_matches) )%10 ) == 0 )
+        if( ((int) ctx.current_match_) % ((int) (ctx.total_matches / 100) + 1 ) == 0)
+          std::cout<<(int)((ctx.current_match_*100)/ctx.total_matches)<<" %"<<std::endl;
+    }
+    V_MUTEX( ctx.thread_unicity );
+    //each image is trained once and shared by every pairs:
+    MatchersCache& matchers_cache = *ctx.seq_analyser->matchers_cache_;
+    Ptr<PointsMatcher> match_algorithm = ctx.seq_analyser->match_algorithm_;
+    Ptr<PointsMatcher> point_matcher = matchers_cache.getMatcher( i,
+      points_to_track_i, match_algorithm );
+
+    vector< cv::DMatch > matches_i_j;
+    bool guided = ctx.seq_analyser->guided_matching_;
+    if( guided )
+    {//one direction only, the reverse is checked along the epipolar lines:
+      point_matcher->match( points_to_track_j, matches_i_j, ctx.masks );
+    }
+    else
+    {
+      Ptr<PointsMatcher> point_matcher1 = matchers_cache.getMatcher( j,
+        points_to_track_j, match_algorithm );
+      point_matcher->crossMatch( point_matcher1, matches_i_j, ctx.masks );
+    }
+
+    //First compute points matches:
+    unsigned int size_match=matches_i_j.size( );
+    vector<cv::Point2f> srcP;
+    vector<cv::Point2f> destP;
+    vector<uchar> status;
+    vector<float> quality;
+
+    if( size_match>8 )
+    {
+      std::clog<<"Using match, found "<<matches_i_j.size( )<<
+        " matches between "<<i<<" "<<j<<std::endl;
+      //vector<KeyPoint> points1 = point_matcher->;
+      for( size_t cpt = 0; cpt < size_match; ++cpt )
+      {
+        const cv::DMatch& match = matches_i_j[ cpt ];
+        const cv::KeyPoint &key1 = points_to_track_j->getKeypoint(
+          matches_i_j[ cpt ].queryIdx );
+        const cv::KeyPoint &key2 = point_matcher->getKeypoint(
+          matches_i_j[ cpt ].trainIdx );
+        srcP.push_back( cv::Point2f( key1.pt.x,key1.pt.y ) );
+        destP.push_back( cv::Point2f( key2.pt.x,key2.pt.y ) );
+        quality.push_back( match.distance );
+        status.push_back( 1 );
       }
 
-        while( nbErrors > 40 && nb_iter < 3 &&
-          matches_i_j.size( ) > mininum_points_matches )
-        {
-          fundam = cv::findFundamentalMat( srcP, destP, status,
-            cv::FM_RANSAC, error_allowed*1.5 );
-
-          //refine the mathing :
-          nbErrors =0 ;
-          size_match = status.size( );
-          for( size_t cpt = 0; cpt < size_match; ++cpt ){
-            if( status[ cpt ] == 0 )
-            {
-              size_match--;
-              status[ cpt ] = status[ size_match ];
-              status.pop_back( );
-              srcP[ cpt ] = srcP[ size_match ];
-              srcP.pop_back( );
-              destP[ cpt ] = destP[ size_match ];
-              destP.pop_back( );
-              matches_i_j[ cpt ] = matches_i_j[ size_match ];
-              matches_i_j.pop_back( );
-              cpt--;
-              ++nbErrors;
-            }
-          }
-          nb_iter++;
-        };
+      //samples are drawn from the best matches first (PROSAC):
+      FundamentalEstimator estimator( error_allowed );
+      Mat fundam = estimator.estimate( srcP, destP, status, quality );
+      unsigned int nb_estimator_iter = estimator.getNbIterations( );
 
-        //refine the mathing:
-        fundam = cv::findFundamentalMat( srcP, destP, status, cv::FM_LMEDS );
+      unsigned int nbErrors = 0, nb_iter=0;
+      //refine the mathing :
+      size_match = status.size( );
+      for( size_t cpt = 0; cpt < size_match; ++cpt )
+      {
+      if( status[ cpt ] == 0 )
+      {
+        size_match--;
+        status[ cpt ] = status[ size_match ];
+        status.pop_back( );
+        srcP[ cpt ] = srcP[ size_match ];
+        srcP.pop_back( );
+        destP[ cpt ] = destP[ size_match ];
+        destP.pop_back( );
+        matches_i_j[ cpt ] = matches_i_j[ size_match ];
+        matches_i_j.pop_back( );
+        cpt--;
+        ++nbErrors;
+      }
+    }
+
+      while( nbErrors > 40 && nb_iter < 3 &&
+        matches_i_j.size( ) > ctx.mininum_points_matches )
+      {
+        quality.resize( matches_i_j.size( ) );
+        for( size_t cpt = 0; cpt < matches_i_j.size( ); ++cpt )
+          quality[ cpt ] = matches_i_j[ cpt ].distance;
+        estimator.setThreshold( error_allowed*1.5 );
+        fundam = estimator.estimate( srcP, destP, status, quality );
+        nb_estimator_iter += estimator.getNbIterations( );
 
         //refine the mathing :
+        nbErrors =0 ;
         size_match = status.size( );
         for( size_t cpt = 0; cpt < size_match; ++cpt ){
           if( status[ cpt ] == 0 )
@@ -168,37 +326,87 @@ namespace OpencvSfM{
             ++nbErrors;
           }
         }
+        nb_iter++;
+      };
 
-        if( matches_i_j.size( ) > mininum_points_matches )
-        {
-          Mat * copy_of_fund = new cv::Mat();
-          *copy_of_fund = fundam.clone();
-          P_MUTEX( thread_unicity );
-          seq_analyser->list_fundamental_[i][j-i] = cv::Ptr< cv::Mat >(
-            copy_of_fund );
-          seq_analyser->addMatches( matches_i_j,i,j );
-          std::clog<<"; find "<<matches_i_j.size( )<<
-            " real matches"<<std::endl;
-          V_MUTEX( thread_unicity );
-        }
-        else
+      std::clog<<"Fundamental matrix between "<<i<<" "<<j<<": "<<
+        nb_estimator_iter<<" iterations ("<<nb_iter + 1<<" estimations)";
+
+      //refine the mathing (the estimator may have found no consensus):
+      if( srcP.size( ) >= 8 )
+        fundam = cv::findFundamentalMat( srcP, destP, status, cv::FM_LMEDS );
+
+      //refine the mathing :
+      size_match = status.size( );
+      for( size_t cpt = 0; cpt < size_match; ++cpt ){
+        if( status[ cpt ] == 0 )
         {
-          std::clog<<"Between "<<i<<" "<<j<<", can't find real matches"<<std::endl;
+          size_match--;
+          status[ cpt ] = status[ size_match ];
+          status.pop_back( );
+          srcP[ cpt ] = srcP[ size_match ];
+          srcP.pop_back( );
+          destP[ cpt ] = destP[ size_match ];
+          destP.pop_back( );
+          matches_i_j[ cpt ] = matches_i_j[ size_match ];
+          matches_i_j.pop_back( );
+          cpt--;
+          ++nbErrors;
         }
+      }
 
+      Mat desc_i = points_to_track_i->getDescriptors( ),
+        desc_j = points_to_track_j->getDescriptors( );
+      if( guided && fundam.rows == 3 && fundam.cols == 3 &&
+        desc_i.type( ) == desc_j.type( ) &&
+        matches_i_j.size( ) > ctx.mininum_points_matches )
+      {//search the reverse and other matches only along the epipolar lines
+        //(the grids are locked once for every queries of this pair):
+        const KeypointsGrid& grid_i = points_to_track_i->getKeypointsGrid( );
+        const KeypointsGrid& grid_j = points_to_track_j->getKeypointsGrid( );
+        cv::Mat_<double> F = fundam;
+        unsigned int nb_comparisons = 0;
+        unsigned int nb_removed = reciprocityInBand( F, desc_i,
+          points_to_track_i->getKeypoints( ), desc_j,
+          points_to_track_j->getKeypoints( ), grid_j, ( float )error_allowed,
+          matches_i_j, nb_comparisons );
+        unsigned int nb_guided = guidedMatching( F, desc_i,
+          points_to_track_i->getKeypoints( ), grid_i, desc_j,
+          points_to_track_j->getKeypoints( ), ( float )error_allowed,
+          matches_i_j, nb_comparisons );
+        std::clog<<"; guided matching: "<<nb_removed<<" not reciprocal, "<<
+          nb_guided<<" new matches ("<<nb_comparisons<<
+          " descriptors comparisons)";
+      }
+      else if( guided )
+        matches_i_j.clear( );//the reciprocity can't be checked
+
+      if( !fundam.empty( ) &&
+        matches_i_j.size( ) > ctx.mininum_points_matches )
+      {
+        Mat * copy_of_fund = new cv::Mat();
+        *copy_of_fund = fundam.clone();
+        //each task has its own slot, no need to lock:
+        ctx.seq_analyser->list_fundamental_[i][j-i] = cv::Ptr< cv::Mat >(
+          copy_of_fund );
+        ctx.tracks_builder->addMatches( matches_i_j,i,j );
+        std::clog<<"; find "<<matches_i_j.size( )<<
+          " real matches"<<std::endl;
       }
       else
       {
-        std::clog<<"Using crossMatch, found only "<<matches_i_j.size( )<<
-          " matches between "<<i<<" "<<j<<std::endl;
+        std::clog<<"Between "<<i<<" "<<j<<", can't find real matches"<<std::endl;
       }
-      j++;
+
+    }
+    else
+    {
+      std::clog<<"Using crossMatch, found only "<<matches_i_j.size( )<<
+        " matches between "<<i<<" "<<j<<std::endl;
     }
 
-    P_MUTEX( thread_unicity );
-    point_matcher->clear();
-    points_to_track_i->free_descriptors();//save memory...
-    V_MUTEX( thread_unicity );
-    V_MUTEX( MatchingThread::thread_concurr );//wake up waiting thread
+    //the matchers belong to the cache, which releases them when needed:
+    ctx.releaseDescriptors( i );
+    ctx.releaseDescriptors( j );
   };
 }
@@ -7,39 +7,105 @@
 #include "opencv2/core/core.hpp"
 
 #include "SequenceAnalyzer.h"
+#include "ConcurrentTracksBuilder.h"
 
 namespace OpencvSfM{
 
   /**
-  *  \brief This struct is used by boost::thread object to compute match.
-  * I used some semaphore to ensure the matching process work well.
+  *  \brief Every data shared by the tasks of one matching session.
+  *
+  * Each call to SequenceAnalyzer::computeMatches creates its own context,
+  * so several sequences can be matched at the same time in one process.
+  */
+  struct MatchingContext{
+    SequenceAnalyzer* seq_analyser;///<This object contains every sequence related info (images, points, tracks...)
+    size_t size_list;///<size of list images of points.
+    std::vector< cv::Mat > masks;///<List of mask to hide some points in the matching computation.
+    std::vector< cv::Ptr< PointsToTrack > >* matches_;///<List of every Points for track (points of other images to match)
+    unsigned int mininum_points_matches;///<Minimum matches between two images to accept the matches
+    PointsMatcher* match_algorithm;///<The algorithm to use for matching.
+    double total_matches;///<Total of matches where are trying to find
+    double current_match_;///<Current iteration of algorithm.
+    bool print_progress_;///<If true, the progress will be shown
+    ConcurrentTracksBuilder* tracks_builder;///<Workers add their matches here, without locking
+    std::vector< unsigned int > pending_pairs;///<For each image, number of pairs not yet matched
+    std::vector< bool > descriptors_held;///<For each image, true if the session holds its descriptors
+
+    DECLARE_MUTEX( thread_unicity );///<Used around critical sections of this session
+
+    /**
+    * Create the context of a matching session.
+    * @param seq_analyser the sequence to match
+    * @param mininum_points_matches Minimum matches between two images to accept the matches
+    * @param print_progress If true, the progress will be shown
+    */
+    MatchingContext( SequenceAnalyzer* seq_analyser,
+      unsigned int mininum_points_matches, bool print_progress );
+
+    /**
+    * Compute the descriptors of an image if needed, before a matching task
+    * uses them. The first task of an image also takes a reference for the
+    * session, so the descriptors are kept until its last pair is matched.
+    * @param img index of the image
+    */
+    void holdDescriptors( unsigned int img );
+    /**
+    * Release the descriptors of an image after a matching task. The
+    * descriptors are freed once every pair of this image is matched.
+    * @param img index of the image
+    */
+    void releaseDescriptors( unsigned int img );
+  };
+
+  /**
+  *  \brief This struct is used by the TaskScheduler to detect the keypoints
+  * of one image before the matching (the tracks builder needs to know the
+  * number of keypoints of every image). The descriptors are computed too, as
+  * the extractor can remove some keypoints. If keep_descriptors is true,
+  * they are kept until the caller calls free_descriptors( ) (the pairs
+  * selection uses them), else they are freed and computed again by the
+  * first matching task of the image.
+  */
+  struct DetectionThread{
+    cv::Ptr< PointsToTrack > points;///<Points of the image
+    bool keep_descriptors;///<If true, the descriptors are not freed
+
+    /**
+    * Constructor of a detection task.
+    * @param points Points of the image
+    * @param keep_descriptors If true, the descriptors are not freed
+    */
+    DetectionThread( cv::Ptr< PointsToTrack > points, bool keep_descriptors )
+      :points( points ), keep_descriptors( keep_descriptors ){};
+
+    /**
+    * Task implementation: compute the keypoints and descriptors if not
+    * already done...
+    */
+    void operator()();
+  };
+
+  /**
+  *  \brief This struct is used by the TaskScheduler to compute the matches
+  * between two images (the unit of work is one pair of images).
+  * Every shared data is stored into a MatchingContext.
   */
   struct MatchingThread{
-    unsigned int i;///<Index of source image. This image will be matched against every other
-    cv::Ptr<SequenceAnalyzer> seq_analyser;///<This object contains every sequence related info (images, points, tracks...)
-
-    static size_t size_list;///<size of list images of points. It's the same for every thread, so set once for every thread before runing computation.
-    static std::vector< cv::Mat > masks;///<List of mask to hide some points in the matching computation.
-    static std::vector< cv::Ptr< PointsToTrack > >* matches_;///<List of every Points for track (points of other images to match)
-    static unsigned int mininum_points_matches;///<Minimum matches between two images to accept the matches
-    static PointsMatcher* match_algorithm;///<The algorithm to use for matching.
-    static double total_matches;///<Total of matches where are trying to find
-    static double current_match_;///<Current iteration of algorithm.
-    static bool print_progress_;///<If true, the progress will be shown
-
-    //semaphore to synchronize threads:
-    CREATE_STATIC_MUTEX( thread_concurr );///<Used to start as many thread as processors
-    CREATE_STATIC_MUTEX( thread_unicity );///<Used around critical sections
+    unsigned int i;///<Index of source image.
+    unsigned int j;///<Index of destination image (j>i).
+    MatchingContext* context;///<Data shared by every task of the session
 
     /**
-    * Constructor of a thread.
-    * @param seq_analyser the sequence related infos
-    * @param i Index of source image. This image will be matched against every other
+    * Constructor of a matching task.
+    * @param context the data of the matching session
+    * @param i Index of source image.
+    * @param j Index of destination image.
     */
-    MatchingThread(cv::Ptr<SequenceAnalyzer> seq_analyser,unsigned int i);
+    MatchingThread( MatchingContext* context,
+      unsigned int i, unsigned int j );
 
     /**
-    * Thread implementation...
+    * Task implementation: match image i with image j...
     */
     void operator()();
   };
@@ -0,0 +1,182 @@
+#include "BucketedFeatureDetector.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+namespace OpencvSfM{
+
+  using cv::Mat;
+  using cv::KeyPoint;
+  using std::vector;
+
+  //used to sort the keypoints of a cell, best first:
+  static inline bool compareResponse( const KeyPoint& kp1, const KeyPoint& kp2 )
+  {
+    return kp1.response > kp2.response;
+  }
+
+  BucketedFeatureDetector::BucketedFeatureDetector(
+    cv::Ptr<cv::FeatureDetector> detector, unsigned int max_keypoints,
+    int grid_rows, int grid_cols, int border )
+    :detector_( detector ), max_keypoints_( max_keypoints ),
+    grid_rows_( grid_rows ), grid_cols_( grid_cols ), border_( border ),
+    nb_threads_( 0 )
+  {
+    CV_Assert( !detector_.empty( ) && grid_rows_ > 0 && grid_cols_ > 0 &&
+      border_ >= 0 );
+    INIT_MUTEX( adjusters_mutex_ );
+    //each cell adapts its own threshold:
+    cv::AdjusterAdapter* adjuster =
+      dynamic_cast<cv::AdjusterAdapter*>( ( cv::FeatureDetector* )detector_ );
+    if( adjuster != NULL )
+      for( int c = 0; c < grid_rows_ * grid_cols_; ++c )
+        cell_adjusters_.push_back( adjuster->clone( ) );
+  }
+
+  cv::Ptr<cv::FeatureDetector> BucketedFeatureDetector::withBudget(
+    cv::Ptr<cv::FeatureDetector> detector, unsigned int max_keypoints,
+    int grid_rows, int grid_cols )
+  {
+    CV_Assert( !detector.empty( ) );
+    //don't wrap a bucketed detector twice:
+    BucketedFeatureDetector* bucketed =
+      dynamic_cast<BucketedFeatureDetector*>( ( cv::FeatureDetector* )detector );
+    if( bucketed != NULL )
+      detector = bucketed->getDetector( );
+    if( max_keypoints == 0 )
+      return detector;
+    return cv::Ptr<cv::FeatureDetector>( new BucketedFeatureDetector( detector,
+      max_keypoints, grid_rows, grid_cols ) );
+  }
+
+  bool BucketedFeatureDetector::empty( ) const
+  {
+    return detector_.empty( ) || detector_->empty( );
+  }
+
+  void BucketedFeatureDetector::detectCells( const Mat& image, const Mat& mask,
+    vector< vector<KeyPoint> >& cells ) const
+  {
+    if( nb_threads_ == 1 || cells.size( ) < 2 )
+    {
+      detectCellsRange( &image, &mask, &cells, 0, cells.size( ) );
+      return;
+    }
+    //cells are independent, each task writes its own cells:
+    TaskScheduler scheduler( nb_threads_ );
+    scheduler.parallelFor( cells.size( ), 1, boost::bind(
+      &BucketedFeatureDetector::detectCellsRange, this, &image, &mask,
+      &cells, _1, _2 ) );
+  }
+
+  void BucketedFeatureDetector::detectCellsRange( const Mat* image,
+    const Mat* mask, vector< vector<KeyPoint> >* cells,
+    size_t begin, size_t end ) const
+  {
+    int quota = MAX( ( int )( max_keypoints_ / cells->size( ) ), 1 );
+    for( int c = ( int )begin; c < ( int )end; ++c )
+    {
+      int row = c / grid_cols_, col = c % grid_cols_;
+      int x_begin = col * image->cols / grid_cols_,
+        x_end = ( col + 1 ) * image->cols / grid_cols_,
+        y_begin = row * image->rows / grid_rows_,
+        y_end = ( row + 1 ) * image->rows / grid_rows_;
+      cv::Rect roi( x_begin - border_, y_begin - border_,
+        x_end - x_begin + 2 * border_, y_end - y_begin + 2 * border_ );
+      roi &= cv::Rect( 0, 0, image->cols, image->rows );
+      if( roi.width <= 0 || roi.height <= 0 )
+        continue;
+
+      //detect with the current threshold of the cell (other images may
+      //update it at the same time, the last one wins):
+      cv::Ptr<cv::AdjusterAdapter> adjuster;
+      const cv::FeatureDetector* detector = detector_;
+      if( !cell_adjusters_.empty( ) && max_keypoints_ > 0 )
+      {
+        P_MUTEX( adjusters_mutex_ );
+        adjuster = cell_adjusters_[ c ]->clone( );
+        V_MUTEX( adjusters_mutex_ );
+        detector = adjuster;
+      }
+      vector<KeyPoint> keypoints;
+      detector->detect( ( *image )( roi ), keypoints,
+        mask->empty( ) ? Mat( ) : ( *mask )( roi ) );
+      //keep only the points of this cell (the border belongs to other cells):
+      vector<KeyPoint>& cell = ( *cells )[ c ];
+      for( size_t i = 0; i < keypoints.size( ); ++i )
+      {
+        KeyPoint& kp = keypoints[ i ];
+        kp.pt.x += roi.x;
+        kp.pt.y += roi.y;
+        if( kp.pt.x >= x_begin && kp.pt.x < x_end &&
+          kp.pt.y >= y_begin && kp.pt.y < y_end )
+          cell.push_back( kp );
+      }
+      std::stable_sort( cell.begin( ), cell.end( ), compareResponse );
+
+      //aim at one to two times the quota for the next images:
+      if( !adjuster.empty( ) )
+      {
+        int nb_detected = cell.size( );
+        if( nb_detected < quota )
+          adjuster->tooFew( quota, nb_detected );
+        else if( nb_detected > 2 * quota )
+          adjuster->tooMany( 2 * quota, nb_detected );
+        P_MUTEX( adjusters_mutex_ );
+        cell_adjusters_[ c ] = adjuster;
+        V_MUTEX( adjusters_mutex_ );
+      }
+    }
+  }
+
+  void BucketedFeatureDetector::detectImpl( const Mat& image,
+    vector<KeyPoint>& keypoints, const Mat& mask ) const
+  {
+    keypoints.clear( );
+    int nb_cells = grid_rows_ * grid_cols_;
+    vector< vector<KeyPoint> > cells( nb_cells );
+
+    detectCells( image, mask, cells );
+
+    //share the budget between cells: the quota a cell can't use is
+    //given to the cells having more points:
+    size_t nb_points = 0;
+    for( int c = 0; c < nb_cells; ++c )
+      nb_points += cells[ c ].size( );
+    vector<size_t> quota( nb_cells );
+    if( max_keypoints_ == 0 || nb_points <= max_keypoints_ )
+    {
+      for( int c = 0; c < nb_cells; ++c )
+        quota[ c ] = cells[ c ].size( );
+    }
+    else
+    {
+      size_t remaining = max_keypoints_;
+      while( remaining > 0 )
+      {
+        size_t nb_unsatisfied = 0;
+        for( int c = 0; c < nb_cells; ++c )
+          if( cells[ c ].size( ) > quota[ c ] )
+            nb_unsatisfied++;
+        if( nb_unsatisfied == 0 )
+          break;
+        size_t share = MAX( remaining / nb_unsatisfied, 1 );
+        for( int c = 0; c < nb_cells && remaining > 0; ++c )
+        {
+          size_t added = MIN( MIN( share, cells[ c ].size( ) - quota[ c ] ),
+            remaining );
+          quota[ c ] += added;
+          remaining -= added;
+        }
+      }
+    }
+
+    keypoints.reserve( MIN( nb_points, max_keypoints_ == 0 ?
+      nb_points : ( size_t )max_keypoints_ ) );
+    for( int c = 0; c < nb_cells; ++c )
+      keypoints.insert( keypoints.end( ), cells[ c ].begin( ),
+        cells[ c ].begin( ) + quota[ c ] );
+  }
+
+}
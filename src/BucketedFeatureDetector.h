@@ -0,0 +1,122 @@
+#ifndef _GSOC_SFM_BUCKETED_FEATURE_DETECTOR_H
+#define _GSOC_SFM_BUCKETED_FEATURE_DETECTOR_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include "opencv2/features2d/features2d.hpp"
+#include "config_SFM.h"  //SEMAPHORE
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Feature detector which spreads the keypoints over the image and
+  * bounds their number.
+  *
+  * The image is tiled into grid_rows x grid_cols cells and the wrapped
+  * detector is run on each cell (with a border, so detectors ignoring
+  * image borders still find points near the cells boundaries). Cells are
+  * detected in parallel, except if the caller already processes images in
+  * parallel (FeaturesPipeline sets one thread). Each cell then keeps its
+  * best keypoints by response: cells share the global budget, and the
+  * quota a cell can't use (not enough points) is given to the other
+  * cells. The response of the last kept keypoint is the threshold of the
+  * cell, so textured cells get a higher threshold than flat ones and the
+  * total number of keypoints is the budget (or less if the whole image
+  * has fewer points).
+  *
+  * If the wrapped detector is a cv::AdjusterAdapter (FastAdjuster,
+  * StarAdjuster, SurfAdjuster...), each cell has its own copy, and its
+  * threshold is raised or lowered after each detection to find between
+  * one and two times the quota of the cell. The next images (frames of a
+  * sequence look alike) detect fewer useless keypoints in the first place.
+  * Else the wrapped detector should have a low threshold, as thresholds
+  * can only be raised by the selection.
+  */
+  class SFM_EXPORTS BucketedFeatureDetector : public cv::FeatureDetector
+  {
+  public:
+    /**
+    * Create a bucketed detector
+    * @param detector detector run on each cell
+    * @param max_keypoints global budget of keypoints (0 for no limit)
+    * @param grid_rows number of cells in a column
+    * @param grid_cols number of cells in a row
+    * @param border size in pixels of the border added around each cell
+    */
+    BucketedFeatureDetector( cv::Ptr<cv::FeatureDetector> detector,
+      unsigned int max_keypoints = 5000, int grid_rows = 4, int grid_cols = 4,
+      int border = 16 );
+
+    /**
+    * Wrap a detector into a BucketedFeatureDetector. If the detector is
+    * already bucketed, its wrapped detector is used (no double wrapping).
+    * @param detector detector to wrap
+    * @param max_keypoints global budget of keypoints (0 to get the detector alone)
+    * @param grid_rows number of cells in a column
+    * @param grid_cols number of cells in a row
+    * @return the bucketed detector, or the detector alone if max_keypoints is 0
+    */
+    static cv::Ptr<cv::FeatureDetector> withBudget(
+      cv::Ptr<cv::FeatureDetector> detector, unsigned int max_keypoints,
+      int grid_rows = 4, int grid_cols = 4 );
+
+    /**
+    * Get the wrapped detector
+    * @return detector run on each cell
+    */
+    inline cv::Ptr<cv::FeatureDetector> getDetector( ) const
+    { return detector_; };
+    /**
+    * Get the global budget of keypoints
+    * @return maximum number of keypoints (0 for no limit)
+    */
+    inline unsigned int getMaxKeypoints( ) const { return max_keypoints_; };
+    /**
+    * Change the global budget of keypoints
+    * @param max_keypoints maximum number of keypoints (0 for no limit)
+    */
+    inline void setMaxKeypoints( unsigned int max_keypoints )
+    { max_keypoints_ = max_keypoints; };
+    /**
+    * Change the number of threads used to detect the cells of an image
+    * @param nb_threads number of threads (0 to use every cores)
+    */
+    inline void setNbThreads( unsigned int nb_threads )
+    { nb_threads_ = nb_threads; };
+
+    virtual bool empty( ) const;
+
+  protected:
+    virtual void detectImpl( const cv::Mat& image,
+      std::vector<cv::KeyPoint>& keypoints, const cv::Mat& mask = cv::Mat( ) ) const;
+    /**
+    * Detect the keypoints of every cells
+    * @param cells [out] keypoints of each cell, sorted by response
+    */
+    void detectCells( const cv::Mat& image, const cv::Mat& mask,
+      std::vector< std::vector<cv::KeyPoint> >& cells ) const;
+    /**
+    * Detect the keypoints of a range of cells (one task of detectCells)
+    * @param cells [out] keypoints of each cell, sorted by response
+    * @param begin first cell
+    * @param end cell after the last one
+    */
+    void detectCellsRange( const cv::Mat* image, const cv::Mat* mask,
+      std::vector< std::vector<cv::KeyPoint> >* cells,
+      size_t begin, size_t end ) const;
+
+    cv::Ptr<cv::FeatureDetector> detector_;///<detector run on each cell
+    unsigned int max_keypoints_;///<global budget of keypoints
+    int grid_rows_;///<number of cells in a column
+    int grid_cols_;///<number of cells in a row
+    int border_;///<border added around each cell
+    unsigned int nb_threads_;///<Number of threads detecting the cells (0 for every cores)
+    ///Copy of the wrapped detector for each cell, if it's an AdjusterAdapter
+    mutable std::vector< cv::Ptr<cv::AdjusterAdapter> > cell_adjusters_;
+    mutable DECLARE_MUTEX( adjusters_mutex_ );///<protect cell_adjusters_
+  };
+
+}
+
+#endif
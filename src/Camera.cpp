@@ -1,5 +1,7 @@
 #include "Camera.h"
 
+#include <algorithm>
+
 using cv::Mat;
 using cv::Vec3d;
 using cv::Range;
@@ -30,4 +32,14 @@ namespace OpencvSfM{
     return cv::Ptr<Camera>( NULL );
   }
 
+  void Camera::normImageToPixelBatch( const cv::Vec2d* points,
+    cv::Vec2d* pixels, size_t nb_points ) const
+  {
+    if( nb_points == 0 )
+      return;
+    vector<cv::Vec2d> pixels_tmp = normImageToPixelCoordinates(
+      vector<cv::Vec2d>( points, points + nb_points ) );
+    std::copy( pixels_tmp.begin( ), pixels_tmp.end( ), pixels );
+  }
+
 }
\ No newline at end of file
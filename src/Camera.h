@@ -102,6 +102,17 @@ namespace OpencvSfM{
     virtual std::vector<cv::Vec2d> normImageToPixelCoordinates(
       std::vector<cv::Vec2d> points ) const=0;
     /**
+    * Batch version of normImageToPixelCoordinates, working on contiguous
+    * buffers. points and pixels can be the same buffer. The default
+    * implementation uses the vector version, cameras should override it
+    * with a version which doesn't allocate memory.
+    * @param points 2D points in normalized image coordinates.
+    * @param pixels [out] 2D points in pixel image coordinates.
+    * @param nb_points number of points to convert
+    */
+    virtual void normImageToPixelBatch( const cv::Vec2d* points,
+      cv::Vec2d* pixels, size_t nb_points ) const;
+    /**
     * This method return the intra parameters of the camera
     * @return Matrix K of intra parameters
     */
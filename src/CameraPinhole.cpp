@@ -147,21 +147,31 @@ namespace OpencvSfM{
 
   vector<Vec2d> CameraPinhole::normImageToPixelCoordinates( std::vector< cv::Vec2d > points ) const
   {
-    vector<Vec2d> newCoordinates;
-    //for each 2D point, use intra params to compute 2D point:
-    double* ptrIntraParam=( double* )intra_params_.data;
+    vector<Vec2d> newCoordinates( points.size( ) );
+    if( !points.empty( ) )
+      normImageToPixelBatch( &points[ 0 ], &newCoordinates[ 0 ], points.size( ) );
+    return newCoordinates;
+  }
 
-    vector<Vec2d>::iterator point=points.begin( );
-    while( point!=points.end( ) )
+  void CameraPinhole::normImageToPixelBatch( const cv::Vec2d* points,
+    cv::Vec2d* pixels, size_t nb_points ) const
+  {
+    //Same as pixelToNormImageCoordinates, faster than using matrix multiplication.
+    //Coefficients are copied into locals so the loop has no dependency
+    //between points (and can be vectorized by the compiler):
+    const double* ptrIntraParam=( const double* )intra_params_.data;
+    const double inv_w = 1.0 / ptrIntraParam[ 8 ];
+    const double k0 = ptrIntraParam[ 0 ] * inv_w, k1 = ptrIntraParam[ 1 ] * inv_w,
+      k2 = ptrIntraParam[ 2 ] * inv_w, k4 = ptrIntraParam[ 4 ] * inv_w,
+      k5 = ptrIntraParam[ 5 ] * inv_w;
+    const double* in = points->val;
+    double* out = pixels->val;
+    for( size_t i = 0; i < 2 * nb_points; i += 2 )
     {
-      ///////////////////////////////////////////////////////////////////
-      //Same as pixelToNormImageCoordinates, faster than using matrix multiplication:
-      newCoordinates.push_back( Vec2d( (ptrIntraParam[ 0 ] * ( *point )[ 0 ] + ptrIntraParam[ 1 ] * ( *point )[ 1 ] + ptrIntraParam[ 2 ]) / ptrIntraParam[ 8 ],
-        (ptrIntraParam[ 4 ] * ( *point )[ 1 ] + ptrIntraParam[ 5 ] ) / ptrIntraParam[ 8 ]));
-
-      point++;
+      double x = in[ i ], y = in[ i + 1 ];
+      out[ i ] = k0 * x + k1 * y + k2;
+      out[ i + 1 ] = k4 * y + k5;
     }
-    return newCoordinates;
   }
 
   double CameraPinhole::getFocal( ) const
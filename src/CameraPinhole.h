@@ -82,7 +82,7 @@ namespace OpencvSfM{
     * @param newParams matrix of new parameters ( 3*3 )
     * @param intraValues values which are useful in matrix
     */
-    void updateIntrinsicMatrix( cv::Mat newParams,unsigned char intraValues=FOCAL_PARAM|SKEW_PARAM|PRINCIPAL_POINT_PARAM );
+    virtual void updateIntrinsicMatrix( cv::Mat newParams,unsigned char intraValues=FOCAL_PARAM|SKEW_PARAM|PRINCIPAL_POINT_PARAM );
 
     /**
     * This method can transform points from image to 3D rays
@@ -102,6 +102,15 @@ namespace OpencvSfM{
     */
     virtual std::vector<cv::Vec2d> normImageToPixelCoordinates( std::vector<cv::Vec2d> points ) const;
     /**
+    * Batch conversion from normalized image coordinates to pixel coordinates
+    * (no memory allocation, points and pixels can be the same buffer)
+    * @param points 2D points in normalized image coordinates.
+    * @param pixels [out] 2D points in pixel image coordinates.
+    * @param nb_points number of points to convert
+    */
+    virtual void normImageToPixelBatch( const cv::Vec2d* points,
+      cv::Vec2d* pixels, size_t nb_points ) const;
+    /**
     * This method return the intra parameters of the camera
     * @return Matrix K of intra parameters
     */
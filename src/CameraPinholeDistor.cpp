@@ -1,5 +1,13 @@
 #include "CameraPinholeDistor.h"
 
+#include <cmath>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || \
+  ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SFM_DISTORTION_SSE2 1
+#endif
+
 using std::vector;
 using cv::Mat;
 using cv::Vec2d;
@@ -13,7 +21,8 @@ namespace OpencvSfM{
     cv::Vec6d radial_dist, unsigned char nbRadialParam,
     cv::Vec2d tangential_dist, int img_w, int img_h,
     unsigned char wantedEstimation )
-    :CameraPinhole( intra_params, img_w, img_h, wantedEstimation )
+    :CameraPinhole( intra_params, img_w, img_h, wantedEstimation ),
+    map_step_( 0 )
   {
     updateDistortionParameters( radial_dist,nbRadialParam,tangential_dist );
   }
@@ -26,7 +35,7 @@ namespace OpencvSfM{
     cv::Vec2d tangential_dist, int img_w, int img_h,
     unsigned char wantedEstimation )
     :CameraPinhole( objectPoints,imagePoints,imageSize,aspectRatio,
-     img_w, img_h, wantedEstimation )
+     img_w, img_h, wantedEstimation ), map_step_( 0 )
   {
     updateDistortionParameters( radial_dist,nbRadialParam,tangential_dist );
   }
@@ -49,6 +58,16 @@ namespace OpencvSfM{
   {
     CameraPinhole::updateIntrinsic( values, nbVal, add );
     //TODO!
+    if( !undistortion_map_.empty( ) )
+      buildUndistortionMap( map_step_ );//not valid anymore
+  }
+
+  void CameraPinholeDistor::updateIntrinsicMatrix( cv::Mat newParams,
+    unsigned char intraValues )
+  {
+    CameraPinhole::updateIntrinsicMatrix( newParams, intraValues );
+    if( !undistortion_map_.empty( ) )
+      buildUndistortionMap( map_step_ );//not valid anymore
   }
 
   void CameraPinholeDistor::updateDistortionParameters(
@@ -82,6 +101,23 @@ namespace OpencvSfM{
         }
       }
     }
+    if( !undistortion_map_.empty( ) )
+      buildUndistortionMap( map_step_ );//not valid anymore
+  }
+
+  void CameraPinholeDistor::buildUndistortionMap( int step )
+  {
+    CV_Assert( step > 0 );
+    map_step_ = step;
+    //the grid covers the whole image:
+    int nb_cols = ( img_width + step - 1 ) / step + 1,
+      nb_rows = ( img_height + step - 1 ) / step + 1;
+    vector<Vec2d> nodes( nb_cols * nb_rows ), undistordedNodes;
+    for( int i = 0; i < nb_rows; ++i )
+      for( int j = 0; j < nb_cols; ++j )
+        nodes[ i * nb_cols + j ] = Vec2d( j * step, i * step );
+    cv::undistortPoints( nodes,undistordedNodes,this->intra_params_,this->distortionVector );
+    undistortion_map_ = Mat( undistordedNodes ).reshape( 2, nb_rows ).clone( );
   }
 
   std::vector< cv::Vec4d > CameraPinholeDistor::convertFromImageTo3Dray( 
@@ -95,51 +131,115 @@ namespace OpencvSfM{
     std::vector< cv::Vec2d > points ) const
   {
     vector<Vec2d> undistordedPoints;
-    //rectify the distorion, but keep points in pixels coordinates:
-    cv::undistortPoints( points,undistordedPoints,this->intra_params_,this->distortionVector );
+    if( undistortion_map_.empty( ) )
+    {
+      //rectify the distorion, but keep points in pixels coordinates:
+      cv::undistortPoints( points,undistordedPoints,this->intra_params_,this->distortionVector );
+      return undistordedPoints;
+    }
+
+    //bilinear interpolation of the lookup table:
+    undistordedPoints.resize( points.size( ) );
+    vector<Vec2d> outside;
+    vector<size_t> outside_idx;
+    double inv_step = 1.0 / map_step_;
+    int last_col = undistortion_map_.cols - 1, last_row = undistortion_map_.rows - 1;
+    for( size_t p = 0; p < points.size( ); ++p )
+    {
+      double fx = points[ p ][ 0 ] * inv_step, fy = points[ p ][ 1 ] * inv_step;
+      int j = ( int )floor( fx ), i = ( int )floor( fy );
+      if( j < 0 || i < 0 || j >= last_col || i >= last_row )
+      {
+        outside.push_back( points[ p ] );
+        outside_idx.push_back( p );
+        continue;
+      }
+      double ax = fx - j, ay = fy - i;
+      const Vec2d* row1 = undistortion_map_.ptr<Vec2d>( i ) + j;
+      const Vec2d* row2 = undistortion_map_.ptr<Vec2d>( i + 1 ) + j;
+      undistordedPoints[ p ] =
+        ( row1[ 0 ] * ( 1 - ax ) + row1[ 1 ] * ax ) * ( 1 - ay ) +
+        ( row2[ 0 ] * ( 1 - ax ) + row2[ 1 ] * ax ) * ay;
+    }
+    if( !outside.empty( ) )
+    {
+      vector<Vec2d> undistordedOutside;
+      cv::undistortPoints( outside,undistordedOutside,this->intra_params_,this->distortionVector );
+      for( size_t p = 0; p < outside.size( ); ++p )
+        undistordedPoints[ outside_idx[ p ] ] = undistordedOutside[ p ];
+    }
     return undistordedPoints;
   }
 
   vector<Vec2d> CameraPinholeDistor::normImageToPixelCoordinates( 
     std::vector<cv::Vec2d> points ) const
   {
+    vector<Vec2d> pointsPixelCoord( points.size( ) );
+    if( !points.empty( ) )
+      normImageToPixelBatch( &points[ 0 ], &pointsPixelCoord[ 0 ], points.size( ) );
+    return pointsPixelCoord;
+  }
 
-    vector<Vec2d> redistortedPoints;
-
-    double r2, icdist, deltaX, deltaY;
-    double xn, yn, xc, yc;
-
-    for (unsigned int i = 0; i < points.size(); i++) {
-        // Extract normalized, undistorted point co-ordinates
-        xn = points.at(i)[0];
-        yn = points.at(i)[1];
-
-        //printf("%s << (xn, yn) = (%f, %f)\n", __FUNCTION__, xn, yn);
-
-        // Determine radial distance from centre
-        r2 = xn*xn + yn*yn;
-
-        // Determine distortion factors (might only work for rational model at this stage)
-        icdist = (1 + ((radial_dist_[5]*r2 + radial_dist_[4])*r2 + radial_dist_[3])*r2)/
-          (1 + ((radial_dist_[2]*r2 + radial_dist_[1])*r2 + radial_dist_[0])*r2);
-        deltaX = 2*tangential_dist_[0]*xn*yn + tangential_dist_[1]*(r2 + 2*xn*xn);
-        deltaY = tangential_dist_[0]*(r2 + 2*yn*yn) + 2*tangential_dist_[1]*xn*yn;
-
-        // Distort the points, but keep them in normalized co-ordinate system
-        xc = (xn/icdist) + deltaX;
-        yc = (yn/icdist) + deltaY;
+  void CameraPinholeDistor::normImageToPixelBatch( const cv::Vec2d* points,
+    cv::Vec2d* pixels, size_t nb_points ) const
+  {
+    //coefficients into locals, the loops are branch free:
+    const double k1 = radial_dist_[ 0 ], k2 = radial_dist_[ 1 ],
+      k3 = radial_dist_[ 2 ], k4 = radial_dist_[ 3 ], k5 = radial_dist_[ 4 ],
+      k6 = radial_dist_[ 5 ];
+    const double p1 = tangential_dist_[ 0 ], p2 = tangential_dist_[ 1 ];
+    const double* in = points->val;
+    double* out = pixels->val;
+    size_t i = 0;
+#ifdef SFM_DISTORTION_SSE2
+    //2 points by iteration: x and y coordinates are deinterleaved
+    const __m128d one = _mm_set1_pd( 1.0 ), two = _mm_set1_pd( 2.0 ),
+      v_k1 = _mm_set1_pd( k1 ), v_k2 = _mm_set1_pd( k2 ), v_k3 = _mm_set1_pd( k3 ),
+      v_k4 = _mm_set1_pd( k4 ), v_k5 = _mm_set1_pd( k5 ), v_k6 = _mm_set1_pd( k6 ),
+      v_p1 = _mm_set1_pd( p1 ), v_p2 = _mm_set1_pd( p2 ),
+      v_2p1 = _mm_set1_pd( 2 * p1 ), v_2p2 = _mm_set1_pd( 2 * p2 );
+    for( ; i + 2 <= nb_points; i += 2 )
+    {
+      __m128d pt1 = _mm_loadu_pd( in + 2 * i ), pt2 = _mm_loadu_pd( in + 2 * i + 2 );
+      __m128d xn = _mm_unpacklo_pd( pt1, pt2 ), yn = _mm_unpackhi_pd( pt1, pt2 );
+      __m128d xx = _mm_mul_pd( xn, xn ), yy = _mm_mul_pd( yn, yn ),
+        xy = _mm_mul_pd( xn, yn ), r2 = _mm_add_pd( xx, yy );
+      __m128d num = _mm_add_pd( one, _mm_mul_pd( _mm_add_pd( _mm_mul_pd(
+        _mm_add_pd( _mm_mul_pd( v_k3, r2 ), v_k2 ), r2 ), v_k1 ), r2 ) );
+      __m128d den = _mm_add_pd( one, _mm_mul_pd( _mm_add_pd( _mm_mul_pd(
+        _mm_add_pd( _mm_mul_pd( v_k6, r2 ), v_k5 ), r2 ), v_k4 ), r2 ) );
+      __m128d scale = _mm_div_pd( num, den );
+      __m128d deltaX = _mm_add_pd( _mm_mul_pd( v_2p1, xy ),
+        _mm_mul_pd( v_p2, _mm_add_pd( r2, _mm_mul_pd( two, xx ) ) ) );
+      __m128d deltaY = _mm_add_pd( _mm_mul_pd( v_p1,
+        _mm_add_pd( r2, _mm_mul_pd( two, yy ) ) ), _mm_mul_pd( v_2p2, xy ) );
+      __m128d xc = _mm_add_pd( _mm_mul_pd( xn, scale ), deltaX ),
+        yc = _mm_add_pd( _mm_mul_pd( yn, scale ), deltaY );
+      _mm_storeu_pd( out + 2 * i, _mm_unpacklo_pd( xc, yc ) );
+      _mm_storeu_pd( out + 2 * i + 2, _mm_unpackhi_pd( xc, yc ) );
+    }
+#endif
+    for( ; i < nb_points; ++i )
+    {
+      // Extract normalized, undistorted point co-ordinates
+      double xn = in[ 2 * i ], yn = in[ 2 * i + 1 ];
 
-        redistortedPoints.push_back(cv::Point2d(xc, yc));
+      // Determine radial distance from centre
+      double r2 = xn*xn + yn*yn;
 
-        //printf("%s << (xc, yc) = (%f, %f)\n", __FUNCTION__, xc, yc);
+      // Determine distortion factors (might only work for rational model at this stage)
+      double scale = (1 + ((k3*r2 + k2)*r2 + k1)*r2)/
+        (1 + ((k6*r2 + k5)*r2 + k4)*r2);
+      double deltaX = 2*p1*xn*yn + p2*(r2 + 2*xn*xn);
+      double deltaY = p1*(r2 + 2*yn*yn) + 2*p2*xn*yn;
 
+      // Distort the points, but keep them in normalized co-ordinate system
+      out[ 2 * i ] = xn*scale + deltaX;
+      out[ 2 * i + 1 ] = yn*scale + deltaY;
     }
 
     // Convert these re-distorted but normalized points back to pixel co-ordinates
-    vector<Vec2d> pointsPixelCoord =
-      CameraPinhole::normImageToPixelCoordinates( redistortedPoints );
-
-    return pointsPixelCoord;
+    CameraPinhole::normImageToPixelBatch( pixels, pixels, nb_points );
   }
 
   cv::Ptr<Camera> CameraPinholeDistor::read( const cv::FileNode& node )
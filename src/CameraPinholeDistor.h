@@ -28,6 +28,8 @@ namespace OpencvSfM{
     cv::Vec<double, 2> tangential_dist_;///<used to store tangential dist parameters ( /f$p_1/f$ and /f$p_2/f$ )
     unsigned char nb_tangent_params_;///<N umbers of tangeancial distorition parameters (0, 1 or 2)
     cv::Mat distortionVector;///<vector of distortion coefficients ( k_1, k_2, p_1, p_2[ , k_3[ , k_4, k_5, k_6 ]] ) of 4, 5 or 8 elements
+    cv::Mat undistortion_map_;///<normalized coordinates of a grid of pixels ( CV_64FC2 ), empty if not used
+    int map_step_;///<distance ( in pixels ) between two nodes of undistortion_map_
  
   public:
     /**
@@ -85,6 +87,13 @@ namespace OpencvSfM{
     * @param add_to_intra if true, the vector is the delta to apply to each intra values
     */
     virtual void updateIntrinsic( double* values, uchar nbVal, bool add_to_intra );
+    /**
+    * this method can be used to update the intra parameters (the lookup
+    * table of buildUndistortionMap is rebuilt if used).
+    * @param newParams matrix of new parameters ( 3*3 )
+    * @param intraValues values which are useful in matrix
+    */
+    virtual void updateIntrinsicMatrix( cv::Mat newParams,unsigned char intraValues=FOCAL_PARAM|SKEW_PARAM|PRINCIPAL_POINT_PARAM );
 
     /**
     * this method can be used to update the intra parameters.
@@ -96,6 +105,28 @@ namespace OpencvSfM{
     void updateDistortionParameters( const cv::Vec6d& radial_dist, unsigned char nbRadialParam,const cv::Vec2d& tangential_dist,
       unsigned char wantedEstimation=RADIAL_PARAM|TANGEANT_PARAM );
 
+    /**
+    * Build a lookup table used by pixelToNormImageCoordinates: the points
+    * of a grid covering the image are undistorted once ( using
+    * cv::undistortPoints ), then each point is undistorted with a bilinear
+    * interpolation of the 4 nodes around it. Points outside of the grid
+    * still use cv::undistortPoints.
+    * The table is rebuilt when distortion or intra parameters are changed
+    * with updateDistortionParameters, updateIntrinsic or
+    * updateIntrinsicMatrix.
+    * @param step distance ( in pixels ) between two nodes of the grid
+    */
+    void buildUndistortionMap( int step = 4 );
+    /**
+    * Don't use the lookup table anymore (and release it)
+    */
+    inline void releaseUndistortionMap( ) { undistortion_map_.release( ); };
+    /**
+    * Is the lookup table used by pixelToNormImageCoordinates?
+    * @return true if buildUndistortionMap was called
+    */
+    inline bool hasUndistortionMap( ) const { return !undistortion_map_.empty( ); };
+
     /**
     * This method can transform points from image to 3D rays
     */
@@ -113,6 +144,17 @@ namespace OpencvSfM{
     * @return 2D points in pixel image coordinates.
     */
     virtual std::vector<cv::Vec2d> normImageToPixelCoordinates( std::vector<cv::Vec2d> points ) const;
+    /**
+    * Batch conversion from normalized image coordinates to pixel coordinates,
+    * distortion included (no memory allocation, points and pixels can be
+    * the same buffer). The distortion is computed 2 points at a time with
+    * SSE2 when available.
+    * @param points 2D points in normalized image coordinates.
+    * @param pixels [out] 2D points in pixel image coordinates.
+    * @param nb_points number of points to convert
+    */
+    virtual void normImageToPixelBatch( const cv::Vec2d* points,
+      cv::Vec2d* pixels, size_t nb_points ) const;
     
     /**
     * Create a new camera from a YAML file.
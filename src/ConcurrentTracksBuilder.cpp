@@ -0,0 +1,135 @@
+#include "ConcurrentTracksBuilder.h"
+
+#include <algorithm>
+
+namespace OpencvSfM{
+
+  using std::vector;
+
+  ConcurrentTracksBuilder::ConcurrentTracksBuilder(
+    const vector< unsigned int >& nb_points_per_image )
+  {
+    unsigned int nb_nodes = 0;
+    for( size_t i = 0; i < nb_points_per_image.size( ); ++i )
+    {
+      offsets_.push_back( nb_nodes );
+      nb_nodes += nb_points_per_image[ i ];
+    }
+    offsets_.push_back( nb_nodes );
+    CV_Assert( nb_nodes < ( 1u << 31 ) );
+
+    parent_.resize( nb_nodes );
+    degree_.resize( nb_nodes, 0 );
+    for( unsigned int i = 0; i < nb_nodes; ++i )
+      parent_[ i ] = ( atomic_int )i;
+  }
+
+  unsigned int ConcurrentTracksBuilder::nodeIndex( unsigned int image,
+    unsigned int point ) const
+  {
+    CV_Assert( image + 1 < offsets_.size( ) );
+    unsigned int node = offsets_[ image ] + point;
+    CV_Assert( node < offsets_[ image + 1 ] );
+    return node;
+  }
+
+  atomic_int ConcurrentTracksBuilder::find( atomic_int node )
+  {
+    volatile atomic_int* parent = &parent_[ 0 ];
+    while( true )
+    {
+      atomic_int p = parent[ node ];
+      if( p == node )
+        return node;
+      atomic_int grand_parent = parent[ p ];
+      if( grand_parent != p )//path halving, fails silently if someone else did it:
+        atomicCompareAndSwap( parent + node, p, grand_parent );
+      node = p;
+    }
+  }
+
+  void ConcurrentTracksBuilder::unite( atomic_int node1, atomic_int node2 )
+  {
+    volatile atomic_int* parent = &parent_[ 0 ];
+    while( true )
+    {
+      node1 = find( node1 );
+      node2 = find( node2 );
+      if( node1 == node2 )
+        return;
+      if( node1 < node2 )
+        std::swap( node1, node2 );
+      //node1 is the biggest root, link it to node2 if it's still a root:
+      if( atomicCompareAndSwap( parent + node1, node1, node2 ) == node1 )
+        return;
+    }
+  }
+
+  void ConcurrentTracksBuilder::addMatches(
+    const vector< cv::DMatch >& matches, unsigned int img1, unsigned int img2 )
+  {
+    volatile atomic_int* degree = &degree_[ 0 ];
+    vector< cv::DMatch >::const_iterator match_it = matches.begin( );
+    vector< cv::DMatch >::const_iterator match_it_end = matches.end( );
+    while( match_it != match_it_end )
+    {
+      atomic_int node1 = nodeIndex( img1, match_it->trainIdx );
+      atomic_int node2 = nodeIndex( img2, match_it->queryIdx );
+      atomicAdd( degree + node1, 1 );
+      atomicAdd( degree + node2, 1 );
+      unite( node1, node2 );
+      match_it++;
+    }
+  }
+
+  void ConcurrentTracksBuilder::buildTracks(
+    vector< TrackOfPoints >& tracks ) const
+  {
+    memoryBarrier( );//be sure we see the last links of every workers
+
+    unsigned int nb_nodes = parent_.size( );
+    size_t first_track = tracks.size( );
+    //index of the track of each root (only valid for roots):
+    vector< int > track_of_root( nb_nodes, -1 );
+    //number of matches and nodes of each new track:
+    vector< unsigned int > nb_edges, nb_nodes_track;
+
+    //nodes are sorted by image then by point, and the root of a set is its
+    //smallest node, so the root is always seen before the other nodes:
+    unsigned int image = 0;
+    for( unsigned int node = 0; node < nb_nodes; ++node )
+    {
+      while( node >= offsets_[ image + 1 ] )
+        image++;
+      if( degree_[ node ] == 0 )
+        continue;//not matched
+
+      atomic_int root = ( atomic_int )node;
+      while( parent_[ root ] != root )
+        root = parent_[ root ];
+
+      if( track_of_root[ root ] < 0 )
+      {
+        track_of_root[ root ] = tracks.size( ) - first_track;
+        tracks.push_back( TrackOfPoints( ) );
+        nb_edges.push_back( 0 );
+        nb_nodes_track.push_back( 0 );
+      }
+      unsigned int idx_track = track_of_root[ root ];
+      //use addMatch to have the same behavior with inconsistent tracks:
+      tracks[ first_track + idx_track ].addMatch( image,
+        node - offsets_[ image ] );
+      nb_edges[ idx_track ] += degree_[ node ];
+      nb_nodes_track[ idx_track ]++;
+    }
+
+    //consistance is the number of matches which didn't add a point:
+    for( size_t t = 0; t < nb_edges.size( ); ++t )
+    {
+      TrackOfPoints& track = tracks[ first_track + t ];
+      if( track.track_consistance >= 0 )
+        track.track_consistance = nb_edges[ t ] / 2 - ( nb_nodes_track[ t ] - 1 );
+    }
+  }
+
+}
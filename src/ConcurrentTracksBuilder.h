@@ -0,0 +1,96 @@
+#ifndef _GSOC_SFM_CONCURRENT_TRACKS_BUILDER_H
+#define _GSOC_SFM_CONCURRENT_TRACKS_BUILDER_H 1
+
+#include "macro.h" //SFM_EXPORTS
+#include "atomic_ops.h"
+
+#include <vector>
+#include "opencv2/features2d/features2d.hpp"
+
+#include "TracksOfPoints.h"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Lock-free union-find used to build tracks while pairwise matching
+  * runs in several threads.
+  *
+  * Each (image, keypoint) couple is a node of the union-find. Workers add
+  * their matches without any global lock (links are done using compare and
+  * swap), and the tracks are materialized once, when every worker is done.
+  *
+  * The tracks are the connected components of the matches graph: this is
+  * what SequenceAnalyzer::addMatches followed by
+  * TrackOfPoints::fusionDuplicates computes, but here the result doesn't
+  * depend on the order the pairs of images are matched.
+  */
+  class SFM_EXPORTS ConcurrentTracksBuilder
+  {
+  public:
+    /**
+    * Create an union-find able to store every keypoints of the sequence.
+    * @param nb_points_per_image number of keypoints of each image. Keypoints
+    * can't be added to images once the builder is created.
+    */
+    ConcurrentTracksBuilder(
+      const std::vector< unsigned int >& nb_points_per_image );
+
+    /**
+    * Add matches between two images. This function is thread safe and
+    * lock-free, it can be called by every matching worker at the same time.
+    * @param matches list of matches (trainIdx in img1, queryIdx in img2)
+    * @param img1 index of train image
+    * @param img2 index of query image
+    */
+    void addMatches( const std::vector< cv::DMatch >& matches,
+      unsigned int img1, unsigned int img2 );
+
+    /**
+    * Create the tracks from the union-find. Should be called once every
+    * worker has finished (it's not thread safe).
+    *
+    * Tracks are sorted by their first (image, point) and the points of a
+    * track are sorted by image. As with TrackOfPoints::addMatch, if a track
+    * has two different points in the same image, it is inconsistent, else
+    * its consistance is the number of redundant matches.
+    * @param tracks [out] the new tracks are added at the end of this vector
+    */
+    void buildTracks( std::vector< TrackOfPoints >& tracks ) const;
+
+    /**
+    * Get the number of nodes of this union-find
+    * @return number of keypoints of the sequence
+    */
+    inline unsigned int getNbNodes( ) const { return parent_.size( ); };
+
+  protected:
+    /**
+    * Get the index of a node from its image and point indexes
+    * @param image index of image
+    * @param point index of point in this image
+    * @return index of node
+    */
+    unsigned int nodeIndex( unsigned int image, unsigned int point ) const;
+    /**
+    * Find the root of a node using path halving (thread safe).
+    * @param node index of node
+    * @return index of root (the smallest node of the set)
+    */
+    atomic_int find( atomic_int node );
+    /**
+    * Merge the sets of two nodes (thread safe). The root with the biggest
+    * index is linked to the other, so the root of a set is always its smallest
+    * node and the result doesn't depend on the order of calls.
+    * @param node1 first node
+    * @param node2 second node
+    */
+    void unite( atomic_int node1, atomic_int node2 );
+
+    std::vector< unsigned int > offsets_;///<Index of first node of each image (and total number of nodes at the end)
+    std::vector< atomic_int > parent_;///<Parent of each node (root if parent_[ i ] == i)
+    std::vector< atomic_int > degree_;///<Number of matches using each node
+  };
+
+}
+
+#endif
@@ -12,6 +12,7 @@
 
 #include <pcl/io/vtk_io.h>
 #include <sstream>
+#include <algorithm>
 
 #include "EuclideanEstimator.h"
 #include "StructureEstimator.h"
@@ -19,6 +20,8 @@
 #include "Visualizer.h"
 #include "PCL_mapping.h"
 #include "bundle_related.h"
+#include "TrackStore.h"
+#include "PointsMatcherHamming.h"
 
 using std::vector;
 using cv::Ptr;
@@ -159,23 +162,34 @@ namespace OpencvSfM{
     vector<int> idx_cameras;
     idx_cameras.push_back( index_origin );
 
+    //index of the tracks seen by each camera, so we don't have to test
+    //every tracks for every cameras:
+    TracksIndex index( point_computed_ );
+
+    vector<int> nbCam( n, 0 );
+    for(size_t k =0; k<nb_cam; ++k)
+    {
+      if( camera_computed_[ k ] )
+      {
+        const vector<TracksIndex::Observation>& observations =
+          index.getObservations( k );
+        for( size_t cpt = 0; cpt < observations.size( ); ++cpt )
+          nbCam[ observations[ cpt ].track ]++;
+      }
+    }
     std::vector<bool> pointOK;
+    vector<int> idx_real( n, -1 );//index of each 3D point in the bundle
     int nbPoints = 0;
     for ( j = 0; j < n; ++j )
     {//for each 3D point:
       //test if at least 2 views see this point:
-      int nbCam = 0;
-      for(size_t k =0; k<nb_cam; ++k)
-      {
-        if(camera_computed_[ k ] && point_computed_[ j ].containImage( k ))
-          nbCam++;
-      }
-      pointOK.push_back( nbCam>=2 );
+      pointOK.push_back( nbCam[ j ]>=2 );
       if(pointOK[j])
-        nbPoints++;
+        idx_real[ j ] = nbPoints++;
     }
 
     int nz_count = 0;
+    vector<int> nb_projection_point( nbPoints, 0 );
     for ( i = 0; i < nb_cam; ++i )
     {//for each camera:
       if( camera_computed_[ i ] )
@@ -184,16 +198,16 @@ namespace OpencvSfM{
           idx_cameras.push_back(i);
         m++;//increament of camera count
 
-        int nb_projection = 0;
-        for ( j = 0; j < n; ++j )
-        {//for each 3D point:
-          if( pointOK[j])
+        const vector<TracksIndex::Observation>& observations =
+          index.getObservations( i );
+        for( size_t cpt = 0; cpt < observations.size( ); ++cpt )
+        {//for each 3D point seen by this camera:
+          if( pointOK[ observations[ cpt ].track ] )
           {
-            if( point_computed_[ j ].containImage( i ) )
-              nb_projection++;
+            nb_projection_point[ idx_real[ observations[ cpt ].track ] ]++;
+            nz_count++;
           }
         }
-        nz_count += nb_projection;
       }
     }
     n=nbPoints;
@@ -236,25 +250,29 @@ namespace OpencvSfM{
     }
 
     //now add the projections and 3D points:
-    idx_visible = 0;
-    int j_real = 0;
-    for ( j = 0; j < point_computed_.size(); ++j )
-    {//for each 3D point:
-      if( pointOK[j])
+    //projections are stored point by point, so compute where the
+    //projections of each point start:
+    vector<int> first_projection( n, 0 );
+    for ( j = 1; j < n; ++j )
+      first_projection[ j ] = first_projection[ j-1 ] + nb_projection_point[ j-1 ];
+    std::fill( vmask, vmask + n*m, 0 );
+    for ( i=0; i < m; ++i )
+    {//for each camera (cameras are visited in order, like projections of a point):
+      int idx_cam = idx_cameras[i];
+      const vector<TracksIndex::Observation>& observations =
+        index.getObservations( idx_cam );
+      for( size_t cpt = 0; cpt < observations.size( ); ++cpt )
       {
-        for ( i=0; i < m; ++i )
-        {//for each camera:
-          int idx_cam = idx_cameras[i];
-          vmask[ i+j_real*m ] = point_computed_[ j ].containImage( idx_cam );
-          if( vmask[ i+j_real*m ] )
-          {
-            cv::KeyPoint pt = points_to_track[ idx_cam ]->getKeypoint(
-              point_computed_[ j ].getPointIndex( idx_cam ) );
-            x[ idx_visible++ ] = pt.pt.x;
-            x[ idx_visible++ ] = pt.pt.y;
-          }
+        int j_real = idx_real[ observations[ cpt ].track ];
+        if( j_real >= 0 )
+        {
+          vmask[ i+j_real*m ] = 1;
+          cv::KeyPoint pt = points_to_track[ idx_cam ]->getKeypoint(
+            observations[ cpt ].point );
+          idx_visible = 2 * ( first_projection[ j_real ]++ );
+          x[ idx_visible++ ] = pt.pt.x;
+          x[ idx_visible++ ] = pt.pt.y;
         }
-        j_real++;
       }
     }
     double* points3D_values = p_local;
@@ -289,7 +307,7 @@ namespace OpencvSfM{
     idx_visible = 0;
     double max_distance = 0;
     double max_depth = 0;
-    j_real = 0;
+    int j_real = 0;
     for ( j = 0; j < point_computed_.size(); ++j )
     {//for each 3D point:
       if( pointOK[j])
@@ -458,12 +476,12 @@ namespace OpencvSfM{
     unsigned int i = 0, j = 0,
       nb_cam = camera_computed_.size( );
     vector< Ptr< PointsToTrack > > &points_to_track = sequence_.getPoints( );
-    vector< TrackOfPoints > real_track;
+    vector< unsigned int > real_track;//indexes into point_computed_, no copy
     //keep only tracks having image:
 
     for(i=0; i<n; i++)
       if( point_computed_[i].containImage(image) )
-        real_track.push_back(point_computed_[i]);
+        real_track.push_back( i );
     n = real_track.size();
 
     //now for fun show the sequence on images:
@@ -483,7 +501,7 @@ namespace OpencvSfM{
         int nb_projection = 0;
         for ( j = 0; j < n; ++j )
         {//for each 3D point:
-          if( real_track[ j ].containImage( i ) )
+          if( point_computed_[ real_track[ j ] ].containImage( i ) )
             nb_projection++;
         }
         nz_count += nb_projection;
@@ -498,7 +516,7 @@ namespace OpencvSfM{
     int nb_projection = 0;
     for ( j = 0; j < n; ++j )
     {//for each 3D point:
-      if( real_track[ j ].containImage( image ) )
+      if( point_computed_[ real_track[ j ] ].containImage( image ) )
         nb_projection++;
     }
     nz_count += nb_projection;
@@ -543,14 +561,15 @@ namespace OpencvSfM{
     unsigned int idx_visible = 0;
     for ( j = 0; j < n; ++j )
     {//for each 3D point:
+      const TrackOfPoints& track = point_computed_[ real_track[ j ] ];
       for ( i=0; i < m; ++i )
       {//for each camera:
         int idx_cam = idx_cameras[i];
-        vmask[ i+j*m ] = real_track[ j ].containImage( idx_cam );
+        vmask[ i+j*m ] = track.containImage( idx_cam );
         if( vmask[ i+j*m ] )
         {
           cv::KeyPoint pt = points_to_track[ idx_cam ]->getKeypoint(
-            real_track[ j ].getPointIndex( idx_cam ) );
+            track.getPointIndex( idx_cam ) );
           x[ idx_visible++ ] = pt.pt.x;
           x[ idx_visible++ ] = pt.pt.y;
         }
@@ -559,7 +578,7 @@ namespace OpencvSfM{
     double* points3D_values = p_local;
     for ( j = 0; j < n; ++j )
     {//for each 3D point:
-      cv::Vec3d cv3DPoint = real_track[ j ];
+      cv::Vec3d cv3DPoint = point_computed_[ real_track[ j ] ];
       *(p_local++) = cv3DPoint[ 0 ];
       *(p_local++) = cv3DPoint[ 1 ];
       *(p_local++) = cv3DPoint[ 2 ];
@@ -661,13 +680,13 @@ namespace OpencvSfM{
     //for each points:
     unsigned int key_size = tracks.size( );
     unsigned int i;
-    vector<TrackOfPoints> matches;
+    vector< unsigned int > matches;//indexes into tracks, no copy
 
     for ( i=0; i < key_size; ++i )
     {
       TrackOfPoints &track = tracks[ i ];
       if( track.containImage( image1 ) && track.containImage( image2 ) )
-        matches.push_back( track );
+        matches.push_back( i );
     }
     x1.resize( 2,matches.size( ) );
     x2.resize( 2,matches.size( ) );
@@ -676,8 +695,7 @@ namespace OpencvSfM{
     vector<cv::Vec2d> pointImg1,pointImg2;
     for ( i=0; i < key_size; ++i )
     {
-      TrackOfPoints &track = matches[ i ];
-      cv::DMatch match = track.toDMatch( image1, image2 );
+      cv::DMatch match = tracks[ matches[ i ] ].toDMatch( image1, image2 );
 
       pointImg1.push_back( cv::Vec2d( point_img1->getKeypoint( match.trainIdx ).pt.x,
         point_img1->getKeypoint( match.trainIdx ).pt.y ) );
@@ -741,12 +759,14 @@ namespace OpencvSfM{
   void EuclideanEstimator::addMoreMatches(int img1, int img2,
     std::string detect, std::string extractor )
   {
-    std::string methodMatch = "FlannBased";
-    if( extractor.find("ORB")!=std::string::npos ||
-      extractor.find("BRIEF")!=std::string::npos)
-      methodMatch = "BruteForce-Hamming";
-    Ptr<PointsMatcher> point_matcher =
-      new PointsMatcher( cv::DescriptorMatcher::create( methodMatch ) );
+    //binary descriptors use the SIMD Hamming matcher, without ratio test
+    //nor mutual check to keep the same matches than BruteForce-Hamming
+    //(simple_matching already cross checks them):
+    bool binary_desc = extractor.find("ORB")!=std::string::npos ||
+      extractor.find("BRIEF")!=std::string::npos;
+    Ptr<PointsMatcher> point_matcher = binary_desc ?
+      PointsMatcherHamming::create( 1.0f, false ) :
+      PointsMatcher::create( "FlannBased" );
 
     Ptr<PointsToTrack> pointCollection = Ptr<PointsToTrack>(
       new PointsToTrackWithImage( img1, sequence_.getImage(img1), detect, extractor ));
@@ -757,8 +777,7 @@ namespace OpencvSfM{
     point_matcher->train();
 
     pointCollection1->computeKeypointsAndDesc( true );
-    Ptr<PointsMatcher> point_matcher1 =
-      new PointsMatcher( cv::DescriptorMatcher::create( methodMatch ) );
+    Ptr<PointsMatcher> point_matcher1 = point_matcher->clone( true );
     point_matcher1->add( pointCollection1 );
     point_matcher1->train( );
 
@@ -920,12 +939,12 @@ namespace OpencvSfM{
     initialReconstruction( img1, img2 );
 
     //try to find more matches:
-    std::vector< TrackOfPoints > point_before = point_computed_;
+    TrackStore point_before( point_computed_ );
     cout<<"before"<<point_computed_.size()<<endl;
     addMoreMatches( img1, img2 );
     cout<<"after"<<point_computed_.size()<<endl;
     if( point_before.size() > point_computed_.size() )
-      point_computed_ = point_before;
+      point_before.toTracks( point_computed_ );
 
 
     //bundleAdjustement();
@@ -934,6 +953,10 @@ namespace OpencvSfM{
     //and 3D estimation from these 2 first cameras...
     //Find for other cameras position:
     vector<ImageLink> images_close;
+    //the structure is updated incrementally once indexed (see below):
+    vector<TrackOfPoints> pair_structure;
+    StructureIndex structure_index;
+    bool structure_indexed = false;
     int nbIter = 0;
     while( nbMatches>10 && images_computed.size()<cameras_.size() && nbIter<20 )
     {
@@ -981,21 +1004,30 @@ namespace OpencvSfM{
 
         if( new_id_image >= 0 )
         {
+          //initialReconstruction replaces point_computed_ by the structure
+          //of the pair, keep the global structure aside (swaps are O(1)):
+          point_computed_.swap( pair_structure );
           initialReconstruction( old_id_image, new_id_image );
-          if( cameraResection( new_id_image, 50*(nbIter/4.0+1.0) ) )
+          bool resection_ok = cameraResection( new_id_image, 50*(nbIter/4.0+1.0) );
+          point_computed_.swap( pair_structure );
+          if( resection_ok )
           {
             images_computed.push_back( new_id_image );
-            
-            std::vector< TrackOfPoints > point_before = point_computed_;
-            cout<<"before"<<point_computed_.size()<<endl;
-            //addMoreMatches( old_id_image, new_id_image );
-            cout<<"after"<<point_computed_.size()<<endl;
-            if( point_computed_.size() < point_before.size() )
-              point_computed_ = point_before;
-              
-            //Triangulate the points:
+            //addMoreMatches( old_id_image, new_id_image ) would change
+            //every tracks, so structure_indexed should be reset...
+
+            //Triangulate the points: only the tracks seen by the new image
+            //can change, the other ones keep their 3D points:
             StructureEstimator se( &sequence_, &this->cameras_ );
-            point_computed_ = se.computeStructure( images_computed, 2 );
+            if( !structure_indexed )
+            {
+              point_computed_ = se.computeStructure( images_computed, 2,
+                &structure_index );
+              structure_indexed = true;
+            }
+            else
+              se.updateStructure( images_computed, new_id_image,
+                point_computed_, structure_index, 2 );
           }
           else
           {
@@ -0,0 +1,427 @@
+#include "FeaturesPipeline.h"
+#include "PointsToTrackWithImage.h"
+#include "BucketedFeatureDetector.h"
+
+#include <boost/bind.hpp>
+#include <exception>
+
+namespace OpencvSfM{
+
+  using cv::Ptr;
+  using cv::Mat;
+  using std::vector;
+
+  FeaturesPipeline::FeaturesPipeline( MotionProcessor source,
+    cv::Ptr<cv::FeatureDetector> feature_detector,
+    cv::Ptr<cv::DescriptorExtractor> descriptor_extractor,
+    unsigned int queue_capacity )
+    :source_( source ), feature_detector_( feature_detector ),
+    descriptor_extractor_( descriptor_extractor )
+  {
+    CV_Assert( !feature_detector_.empty( ) && !descriptor_extractor_.empty( ) );
+    queue_capacity_ = MAX( queue_capacity, 1 );
+    started_ = false;
+    stop_ = false;
+    start_ticks_ = end_ticks_ = 0;
+    next_frame_ = 0;
+    nb_ended_ = 0;
+
+    //by default, detection is the slowest stage:
+    unsigned int nb_cores = MAX( boost::thread::hardware_concurrency( ), 1 );
+    nb_threads_[ DECODE_STAGE ] = MAX( nb_cores / 4, 1 );
+    nb_threads_[ CONVERT_STAGE ] = MAX( nb_cores / 8, 1 );
+    nb_threads_[ DETECT_STAGE ] = MAX( nb_cores / 2, 1 );
+    nb_threads_[ DESCRIBE_STAGE ] = MAX( nb_cores / 4, 1 );
+    for( int s = 0; s < NB_STAGES; ++s )
+      nb_processed_[ s ] = 0;
+    for( int s = 0; s <= NB_STAGES; ++s )
+      max_depth_[ s ] = 0;
+  }
+
+  FeaturesPipeline::~FeaturesPipeline( )
+  {
+    if( started_ )
+      stop( );
+  }
+
+  void FeaturesPipeline::setNbThreads( Stage stage, unsigned int nb_threads )
+  {
+    if( started_ )
+      CV_Error( CV_StsError, "The pipeline is already started!" );
+    CV_Assert( stage < NB_STAGES );
+    nb_threads_[ stage ] = MAX( nb_threads, 1 );
+  }
+
+  void FeaturesPipeline::setKeypointsBudget( unsigned int max_keypoints,
+    int grid_rows, int grid_cols )
+  {
+    if( started_ )
+      CV_Error( CV_StsError, "The pipeline is already started!" );
+    feature_detector_ = BucketedFeatureDetector::withBudget( feature_detector_,
+      max_keypoints, grid_rows, grid_cols );
+  }
+
+  void FeaturesPipeline::start( )
+  {
+    if( started_ )
+      CV_Error( CV_StsError, "The pipeline is already started!" );
+    //frames of a video can only be read one after the other:
+    if( !source_.isRandomAccess( ) )
+      nb_threads_[ DECODE_STAGE ] = 1;
+    limitNbThreads( );
+    //frames are already detected in parallel, cells don't need threads:
+    BucketedFeatureDetector* bucketed = dynamic_cast<BucketedFeatureDetector*>(
+      ( cv::FeatureDetector* )feature_detector_ );
+    if( bucketed != NULL )
+      bucketed->setNbThreads( 1 );
+
+    signals_.assign( NB_STAGES + 1, vector< Ptr< Signal > >( ) );
+    for( int s = 0; s <= NB_STAGES; ++s )
+    {
+      unsigned int nb_workers = s == NB_STAGES ? 1 : nb_threads_[ s ];
+      for( unsigned int w = 0; w < nb_workers; ++w )
+        signals_[ s ].push_back( Ptr< Signal >( new Signal( ) ) );
+    }
+    queues_.assign( NB_STAGES + 1,
+      vector< vector< Ptr< FrameQueue > > >( ) );
+    for( int s = 1; s <= NB_STAGES; ++s )
+    {
+      unsigned int nb_consumers = s == NB_STAGES ? 1 : nb_threads_[ s ];
+      queues_[ s ].resize( nb_consumers );
+      for( unsigned int c = 0; c < nb_consumers; ++c )
+        for( unsigned int p = 0; p < nb_threads_[ s - 1 ]; ++p )
+          queues_[ s ][ c ].push_back(
+            Ptr< FrameQueue >( new FrameQueue( queue_capacity_ ) ) );
+    }
+
+    started_ = true;
+    start_ticks_ = cv::getTickCount( );
+    for( unsigned int w = 0; w < nb_threads_[ DECODE_STAGE ]; ++w )
+      workers_.create_thread(
+      boost::bind( &FeaturesPipeline::decodeLoop, this, w ) );
+    for( unsigned int s = CONVERT_STAGE; s < NB_STAGES; ++s )
+      for( unsigned int w = 0; w < nb_threads_[ s ]; ++w )
+        workers_.create_thread(
+        boost::bind( &FeaturesPipeline::workerLoop, this, s, w ) );
+  }
+
+  void FeaturesPipeline::limitNbThreads( )
+  {
+    unsigned int nb_cores = MAX( boost::thread::hardware_concurrency( ), 1 );
+    unsigned int nb_threads = 0;
+    for( int s = 0; s < NB_STAGES; ++s )
+      nb_threads += nb_threads_[ s ];
+    while( nb_threads > nb_cores )
+    {
+      int biggest = 0;
+      for( int s = 1; s < NB_STAGES; ++s )
+        if( nb_threads_[ s ] > nb_threads_[ biggest ] )
+          biggest = s;
+      if( nb_threads_[ biggest ] <= 1 )
+        break;//one thread by stage is the minimum
+      nb_threads_[ biggest ]--;
+      nb_threads--;
+    }
+  }
+
+  void FeaturesPipeline::stop( )
+  {
+    stop_ = true;
+    for( size_t s = 0; s < signals_.size( ); ++s )
+      for( size_t w = 0; w < signals_[ s ].size( ); ++w )
+      {
+        boost::mutex::scoped_lock lock( signals_[ s ][ w ]->mutex );
+        signals_[ s ][ w ]->condition.notify_all( );
+      }
+    workers_.join_all( );
+    if( end_ticks_ == 0 )
+      end_ticks_ = cv::getTickCount( );
+  }
+
+  void FeaturesPipeline::decodeLoop( unsigned int worker )
+  {
+    unsigned int nb_decoders = nb_threads_[ DECODE_STAGE ];
+    bool random_access = source_.isRandomAccess( );
+    //VideoCapture reuses its buffer for the next frame:
+    bool need_copy = source_.getTypeOfInput( ) == IS_VIDEO ||
+      source_.getTypeOfInput( ) == IS_WEBCAM;
+
+    for( int idx = worker; !stop_; idx += nb_decoders )
+    {
+      FrameItem item( idx );
+      try
+      {
+        if( random_access )
+          item.image = source_.getRawFrame( ( unsigned int )idx );
+        else
+        {
+          item.image = source_.getRawFrame( );
+          if( need_copy )
+            item.image = item.image.clone( );
+        }
+      }
+      catch( std::exception& e )
+      {
+        boost::mutex::scoped_lock lock( error_mutex_ );
+        if( error_.empty( ) )
+          error_ = e.what( );
+        item.failed = true;
+      }
+      if( !item.failed && item.image.empty( ) )
+        break;//end of the sequence
+      atomicAdd( &nb_processed_[ DECODE_STAGE ], 1 );
+      if( !send( DECODE_STAGE, worker, item ) || item.failed )
+        break;
+    }
+    sendEnd( DECODE_STAGE, worker );
+  }
+
+  void FeaturesPipeline::workerLoop( unsigned int stage, unsigned int worker )
+  {
+    vector< Ptr< FrameQueue > >& inputs = queues_[ stage ][ worker ];
+    size_t nb_inputs = inputs.size( ), nb_ended = 0;
+    vector< bool > ended( nb_inputs, false );
+    FrameItem item;
+    while( nb_ended < nb_inputs && !stop_ )
+    {
+      bool found = false;
+      for( size_t p = 0; p < nb_inputs; ++p )
+      {
+        if( ended[ p ] || !inputs[ p ]->pop( item ) )
+          continue;
+        found = true;
+        notify( stage - 1, ( unsigned int )p );//its queue is not full
+        if( item.index < 0 )
+        {//this producer has finished (its queue is FIFO):
+          ended[ p ] = true;
+          nb_ended++;
+          continue;
+        }
+        process( stage, item );
+        if( !send( stage, worker, item ) )
+          return;
+      }
+      if( !found )
+        waitForInput( stage, worker );
+    }
+    sendEnd( stage, worker );
+  }
+
+  void FeaturesPipeline::waitForInput( unsigned int stage, unsigned int worker )
+  {
+    vector< Ptr< FrameQueue > >& inputs = queues_[ stage ][ worker ];
+    Signal& signal = *signals_[ stage ][ worker ];
+    boost::mutex::scoped_lock lock( signal.mutex );
+    while( !stop_ )
+    {
+      //producers push then notify under this mutex, so no wake up is lost:
+      for( size_t p = 0; p < inputs.size( ); ++p )
+        if( inputs[ p ]->size( ) > 0 )
+          return;
+      signal.condition.wait( lock );
+    }
+  }
+
+  void FeaturesPipeline::notify( unsigned int stage, unsigned int worker )
+  {
+    Signal& signal = *signals_[ stage ][ worker ];
+    boost::mutex::scoped_lock lock( signal.mutex );
+    signal.condition.notify_one( );
+  }
+
+  void FeaturesPipeline::process( unsigned int stage, FrameItem& item )
+  {
+    if( item.failed )
+      return;
+    try
+    {
+      switch( stage )
+      {
+      case CONVERT_STAGE:
+        item.image = source_.convertFrame( item.image );
+        break;
+      case DETECT_STAGE:
+        {
+          {//PointsToTrack constructor updates a global counter:
+            boost::mutex::scoped_lock lock( error_mutex_ );
+            item.points = Ptr<PointsToTrack>( new PointsToTrackWithImage(
+              item.index, item.image, feature_detector_, descriptor_extractor_ ) );
+          }
+          item.points->computeKeypoints( );//and colors of points
+        }
+        break;
+      case DESCRIBE_STAGE:
+        item.points->computeDescriptors( );
+        break;
+      }
+      atomicAdd( &nb_processed_[ stage ], 1 );
+    }
+    catch( std::exception& e )
+    {
+      boost::mutex::scoped_lock lock( error_mutex_ );
+      if( error_.empty( ) )
+        error_ = e.what( );
+      item.failed = true;
+    }
+  }
+
+  bool FeaturesPipeline::send( unsigned int stage, unsigned int worker,
+    const FrameItem& item )
+  {
+    unsigned int next = stage + 1;
+    unsigned int consumer = next == NB_STAGES ? 0 :
+      ( unsigned int )item.index % nb_threads_[ next ];
+    if( !push( stage, worker, consumer, item ) )
+      return false;
+    FrameQueue& queue = *queues_[ next ][ consumer ][ worker ];
+    atomic_int depth = ( atomic_int )queue.size( ), max_depth = max_depth_[ next ];
+    while( depth > max_depth )
+    {
+      atomic_int previous = atomicCompareAndSwap( &max_depth_[ next ],
+        max_depth, depth );
+      if( previous == max_depth )
+        break;
+      max_depth = previous;
+    }
+    return true;
+  }
+
+  bool FeaturesPipeline::push( unsigned int stage, unsigned int worker,
+    unsigned int consumer, const FrameItem& item )
+  {
+    FrameQueue& queue = *queues_[ stage + 1 ][ consumer ][ worker ];
+    if( !queue.push( item ) )
+    {//sleep until the consumer pops a frame of this queue:
+      Signal& signal = *signals_[ stage ][ worker ];
+      boost::mutex::scoped_lock lock( signal.mutex );
+      while( !queue.push( item ) )
+      {
+        if( stop_ )
+          return false;
+        signal.condition.wait( lock );
+      }
+    }
+    notify( stage + 1, consumer );
+    return true;
+  }
+
+  void FeaturesPipeline::sendEnd( unsigned int stage, unsigned int worker )
+  {
+    unsigned int next = stage + 1;
+    for( size_t c = 0; c < queues_[ next ].size( ); ++c )
+      if( !push( stage, worker, ( unsigned int )c, FrameItem( -1 ) ) )
+        return;
+  }
+
+  bool FeaturesPipeline::getNextFrame( cv::Mat& image, cv::Ptr<PointsToTrack>& points )
+  {
+    if( !started_ )
+      CV_Error( CV_StsError, "The pipeline is not started!" );
+    vector< Ptr< FrameQueue > >& inputs = queues_[ NB_STAGES ][ 0 ];
+    bool failed = false;
+    while( !failed )
+    {
+      std::map< int, FrameItem >::iterator it = waiting_frames_.find( next_frame_ );
+      if( it != waiting_frames_.end( ) )
+      {
+        image = it->second.image;
+        points = it->second.points;
+        waiting_frames_.erase( it );
+        next_frame_++;
+        return true;
+      }
+      //if a frame is missing, the sequence stops here (as with getFrame):
+      if( nb_ended_ >= inputs.size( ) || stop_ )
+        break;
+
+      bool found = false;
+      FrameItem item;
+      for( size_t p = 0; p < inputs.size( ); ++p )
+      {
+        if( !inputs[ p ]->pop( item ) )
+          continue;
+        found = true;
+        notify( NB_STAGES - 1, ( unsigned int )p );//its queue is not full
+        if( item.index < 0 )
+          nb_ended_++;
+        else if( item.failed )
+          failed = true;
+        else
+          waiting_frames_[ item.index ] = item;
+      }
+      if( !found )
+        waitForInput( NB_STAGES, 0 );
+    }
+
+    stop( );
+    waiting_frames_.clear( );
+    if( failed )
+      CV_Error( CV_StsError, "FeaturesPipeline: " + error_ );
+    return false;
+  }
+
+  unsigned int FeaturesPipeline::getNbProcessed( Stage stage ) const
+  {
+    CV_Assert( stage < NB_STAGES );
+    return ( unsigned int )nb_processed_[ stage ];
+  }
+
+  double FeaturesPipeline::getThroughput( Stage stage ) const
+  {
+    if( !started_ )
+      return 0;
+    int64 end = end_ticks_ != 0 ? end_ticks_ : cv::getTickCount( );
+    double elapsed = ( end - start_ticks_ ) / cv::getTickFrequency( );
+    return elapsed > 0 ? getNbProcessed( stage ) / elapsed : 0;
+  }
+
+  unsigned int FeaturesPipeline::getQueueDepth( Stage stage ) const
+  {
+    CV_Assert( stage <= NB_STAGES );
+    unsigned int depth = 0;
+    if( !started_ )
+      return depth;
+    for( size_t c = 0; c < queues_[ stage ].size( ); ++c )
+      for( size_t p = 0; p < queues_[ stage ][ c ].size( ); ++p )
+        depth += queues_[ stage ][ c ][ p ]->size( );
+    return depth;
+  }
+
+  unsigned int FeaturesPipeline::getMaxQueueDepth( Stage stage ) const
+  {
+    CV_Assert( stage <= NB_STAGES );
+    return ( unsigned int )max_depth_[ stage ];
+  }
+
+  std::string FeaturesPipeline::getStageName( Stage stage )
+  {
+    switch( stage )
+    {
+    case DECODE_STAGE:
+      return "decode";
+    case CONVERT_STAGE:
+      return "convert";
+    case DETECT_STAGE:
+      return "detect";
+    case DESCRIBE_STAGE:
+      return "describe";
+    default:
+      return "output";
+    }
+  }
+
+  void FeaturesPipeline::printStatistics( std::ostream& out ) const
+  {
+    for( int s = 0; s < NB_STAGES; ++s )
+    {
+      Stage stage = ( Stage )s;
+      out<<"Pipeline stage "<<getStageName( stage )<<": "<<nb_threads_[ s ]<<
+        " threads, "<<getNbProcessed( stage )<<" frames ("<<
+        getThroughput( stage )<<" fps), max queue depth "<<
+        getMaxQueueDepth( stage )<<std::endl;
+    }
+    out<<"Pipeline output: max queue depth "<<
+      getMaxQueueDepth( NB_STAGES )<<std::endl;
+  }
+
+}
@@ -0,0 +1,264 @@
+#ifndef _GSOC_SFM_FEATURES_PIPELINE_H
+#define _GSOC_SFM_FEATURES_PIPELINE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+#include "atomic_ops.h"
+#include "SPSCQueue.h"
+#include "MotionProcessor.h"
+#include "PointsToTrack.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "opencv2/features2d/features2d.hpp"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Multi-threaded pipeline which reads the frames of a
+  * MotionProcessor and computes their points to track.
+  *
+  * The work is split into four stages: decoding (getRawFrame), colors and
+  * size conversions (convertFrame), keypoints detection (with the colors
+  * of points) and descriptors extraction. Each stage has its own workers,
+  * and each worker of a stage is connected to each worker of the next
+  * stage by a bounded lock-free SPSCQueue, so slow stages get more threads
+  * and the number of frames in memory stays bounded. A worker with nothing
+  * to do (empty inputs or full output) sleeps on a condition variable
+  * until its neighbours push or pop a frame. The total number of workers
+  * is limited to the number of cores.
+  *
+  * Frame i is always sent to the worker i % n of the next stage, and
+  * getNextFrame gives the frames in the order of the sequence.
+  * Decoding can use several threads only when the source is random
+  * access (directory or list of files).
+  */
+  class SFM_EXPORTS FeaturesPipeline
+  {
+  public:
+    /**
+    * Stages of the pipeline
+    */
+    enum Stage
+    {
+      DECODE_STAGE = 0,///<read the frames (imread or VideoCapture)
+      CONVERT_STAGE,///<colors and size conversions
+      DETECT_STAGE,///<keypoints detection and colors of points
+      DESCRIBE_STAGE,///<descriptors extraction
+      NB_STAGES
+    };
+
+    /**
+    * Create a pipeline (threads are started by start( )).
+    * @param source frames to process (from the first frame for a directory
+    * or a list of files, from the current position else)
+    * @param feature_detector algorithm to use for features detection (shared by the workers)
+    * @param descriptor_extractor algorithm to use for descriptors extraction (shared by the workers)
+    * @param queue_capacity maximum number of frames in each queue
+    */
+    FeaturesPipeline( MotionProcessor source,
+      cv::Ptr<cv::FeatureDetector> feature_detector,
+      cv::Ptr<cv::DescriptorExtractor> descriptor_extractor,
+      unsigned int queue_capacity = 4 );
+    /**
+    * Stop the workers (frames not yet read are lost)
+    */
+    ~FeaturesPipeline( );
+
+    /**
+    * Set the number of threads of a stage. Should be called before start( ).
+    * Decoding of video or webcam always uses one thread. When started, if
+    * the stages have more threads than cores, the biggest stages lose some
+    * threads (each stage keeps at least one thread).
+    * @param stage wanted stage
+    * @param nb_threads number of threads of this stage (at least 1)
+    */
+    void setNbThreads( Stage stage, unsigned int nb_threads );
+    /**
+    * Bound the number of keypoints of each frame: the detector is wrapped
+    * into a BucketedFeatureDetector which spreads the keypoints over a
+    * grid. Should be called before start( ).
+    * @param max_keypoints keypoints budget of each frame (0 to use the detector alone)
+    * @param grid_rows number of cells in a column
+    * @param grid_cols number of cells in a row
+    */
+    void setKeypointsBudget( unsigned int max_keypoints,
+      int grid_rows = 4, int grid_cols = 4 );
+    /**
+    * Get the number of threads of a stage
+    * @param stage wanted stage
+    * @return number of threads of this stage
+    */
+    inline unsigned int getNbThreads( Stage stage ) const
+    { return nb_threads_[ stage ]; };
+    /**
+    * Get the source of frames
+    * @return the MotionProcessor used by the pipeline
+    */
+    inline MotionProcessor& getSource( ) { return source_; };
+    /**
+    * Get the feature detector used by the pipeline
+    * @return feature detector
+    */
+    inline cv::Ptr<cv::FeatureDetector> getFeatureDetector( ) const
+    { return feature_detector_; };
+    /**
+    * Get the descriptor extractor used by the pipeline
+    * @return descriptor extractor
+    */
+    inline cv::Ptr<cv::DescriptorExtractor> getDescriptorExtractor( ) const
+    { return descriptor_extractor_; };
+
+    /**
+    * Start the workers of every stages
+    */
+    void start( );
+    /**
+    * Wait for the next frame of the sequence. If a worker failed, the
+    * pipeline is stopped and the error is reported using CV_Error.
+    * @param image output, the converted frame
+    * @param points output, its keypoints, descriptors and colors of points
+    * @return false if the sequence is finished
+    */
+    bool getNextFrame( cv::Mat& image, cv::Ptr<PointsToTrack>& points );
+
+    /**
+    * Get the number of frames processed by a stage
+    * @param stage wanted stage
+    * @return number of frames
+    */
+    unsigned int getNbProcessed( Stage stage ) const;
+    /**
+    * Get the throughput of a stage since start( )
+    * @param stage wanted stage
+    * @return number of frames per second
+    */
+    double getThroughput( Stage stage ) const;
+    /**
+    * Get the number of frames waiting in the input queues of a stage
+    * (NB_STAGES for the frames waiting for getNextFrame).
+    * @param stage wanted stage
+    * @return current depth of the input queues
+    */
+    unsigned int getQueueDepth( Stage stage ) const;
+    /**
+    * Get the maximum number of frames which were waiting in one of the
+    * input queues of a stage (NB_STAGES for the frames waiting for
+    * getNextFrame). If it stays at the capacity, the stage is too slow.
+    * @param stage wanted stage
+    * @return maximum depth of an input queue
+    */
+    unsigned int getMaxQueueDepth( Stage stage ) const;
+    /**
+    * Print the threads, throughput and queues depth of each stage
+    * @param out output stream
+    */
+    void printStatistics( std::ostream& out ) const;
+    /**
+    * Get the name of a stage
+    * @param stage wanted stage
+    * @return name of the stage
+    */
+    static std::string getStageName( Stage stage );
+
+  protected:
+    /**
+    * A frame going through the pipeline (index -1 marks the end of a worker)
+    */
+    struct FrameItem
+    {
+      int index;///<index of the frame in the sequence
+      bool failed;///<true if a stage failed to process this frame
+      cv::Mat image;///<the frame
+      cv::Ptr<PointsToTrack> points;///<points of the frame
+      FrameItem( int idx = -1 ) : index( idx ), failed( false ) { };
+    };
+    typedef SPSCQueue< FrameItem > FrameQueue;
+    /**
+    * Used by a worker to sleep until one of its input queues is not empty
+    * or one of its output queues is not full.
+    */
+    struct Signal
+    {
+      boost::mutex mutex;///<protect the wait of the worker
+      boost::condition_variable condition;///<notified when a neighbour pushes or pops a frame
+    };
+
+    void decodeLoop( unsigned int worker );
+    void workerLoop( unsigned int stage, unsigned int worker );
+    /**
+    * Do the job of a stage on a frame
+    */
+    void process( unsigned int stage, FrameItem& item );
+    /**
+    * Send a frame to the next stage, waiting if the queue is full.
+    * @return false if the pipeline is stopped
+    */
+    bool send( unsigned int stage, unsigned int worker, const FrameItem& item );
+    /**
+    * Push a frame into the queue of a worker of the next stage, waiting if
+    * the queue is full, then wake up this worker.
+    * @return false if the pipeline is stopped
+    */
+    bool push( unsigned int stage, unsigned int worker, unsigned int consumer,
+      const FrameItem& item );
+    /**
+    * Wait until an input queue of a worker is not empty (or the pipeline
+    * is stopped).
+    */
+    void waitForInput( unsigned int stage, unsigned int worker );
+    /**
+    * Wake up a worker (after a push into its inputs or a pop from its outputs)
+    */
+    void notify( unsigned int stage, unsigned int worker );
+    /**
+    * Reduce the threads of the biggest stages until there is no more
+    * threads than cores.
+    */
+    void limitNbThreads( );
+    /**
+    * Send the end marker of a worker to every worker of the next stage
+    */
+    void sendEnd( unsigned int stage, unsigned int worker );
+    /**
+    * Stop and join the workers
+    */
+    void stop( );
+
+    MotionProcessor source_;///<frames to process
+    cv::Ptr<cv::FeatureDetector> feature_detector_;///<shared by the detection workers
+    cv::Ptr<cv::DescriptorExtractor> descriptor_extractor_;///<shared by the description workers
+    unsigned int queue_capacity_;///<size of each queue
+    unsigned int nb_threads_[ NB_STAGES ];///<number of workers of each stage
+    /**
+    * queues_[ s ][ c ][ p ] links worker p of stage s-1 to worker c of
+    * stage s. queues_[ NB_STAGES ] are the queues read by getNextFrame.
+    */
+    std::vector< std::vector< std::vector< cv::Ptr< FrameQueue > > > > queues_;
+    /**
+    * signals_[ s ][ w ] wakes up worker w of stage s, signals_[ NB_STAGES ]
+    * wakes up getNextFrame.
+    */
+    std::vector< std::vector< cv::Ptr< Signal > > > signals_;
+    boost::thread_group workers_;///<workers of every stages
+    bool started_;///<true once start( ) is called
+    volatile bool stop_;///<true to ask workers to stop
+    volatile atomic_int nb_processed_[ NB_STAGES ];///<frames processed by each stage
+    volatile atomic_int max_depth_[ NB_STAGES + 1 ];///<maximum depth of an input queue of each stage
+    int64 start_ticks_;///<tick count when the pipeline started
+    int64 end_ticks_;///<tick count when the last frame was read (0 if not finished)
+
+    boost::mutex error_mutex_;///<protect error_ and the creation of points
+    std::string error_;///<first error of a worker
+    std::map< int, FrameItem > waiting_frames_;///<frames received out of order by getNextFrame
+    int next_frame_;///<index of the next frame given by getNextFrame
+    unsigned int nb_ended_;///<number of description workers which have finished
+  };
+
+}
+
+#endif
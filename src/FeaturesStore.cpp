@@ -0,0 +1,283 @@
+#include "FeaturesStore.h"
+#include "PointsToTrack.h"
+
+#include <cstring>
+#include <fstream>
+
+#if ( defined WIN32 || defined _WIN32 || defined WINCE )
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace OpencvSfM{
+
+  using cv::Ptr;
+  using cv::Mat;
+  using cv::KeyPoint;
+  using std::vector;
+  using boost::uint32_t;
+  using boost::uint64_t;
+
+  //header: magic, version, number of images and a reserved value:
+  static const char store_magic[ 4 ] = { 'S', 'F', 'M', 'F' };
+  static const size_t header_size = 16;
+
+  size_t FeaturesStore::align( size_t offset )
+  {
+    return ( offset + 15 ) & ~( size_t )15;
+  }
+
+  void FeaturesStore::getSections( const ImageEntry& entry,
+    size_t& descriptors_offset, size_t& colors_offset, size_t& end_offset )
+  {
+    size_t nb_points = entry.nb_points;
+    descriptors_offset = align( ( size_t )entry.offset +
+      nb_points * sizeof( StoredKeypoint ) );
+    size_t descriptors_size = entry.desc_cols <= 0 ? 0 :
+      nb_points * entry.desc_cols * CV_ELEM_SIZE( entry.desc_type );
+    colors_offset = align( descriptors_offset + descriptors_size );
+    end_offset = colors_offset +
+      ( entry.has_colors ? nb_points * sizeof( uint32_t ) : 0 );
+  }
+
+  static void writePadding( std::ofstream& out, size_t& offset )
+  {
+    static const char zeros[ 16 ] = { 0 };
+    size_t aligned = ( offset + 15 ) & ~( size_t )15;
+    out.write( zeros, aligned - offset );
+    offset = aligned;
+  }
+
+  void FeaturesStore::write( const std::string& filename,
+    const vector< Ptr< PointsToTrack > >& points )
+  {
+    std::ofstream out( filename.c_str( ), std::ios::out | std::ios::binary );
+    if( !out )
+      CV_Error( CV_StsError, "FeaturesStore: can't create " + filename );
+
+    //the offset table is written once every images are written:
+    uint32_t nb_images = ( uint32_t )points.size( );
+    vector< ImageEntry > entries( nb_images );
+    out.write( store_magic, 4 );
+    uint32_t header[ 3 ] = { VERSION, nb_images, 0 };
+    out.write( ( const char* )header, sizeof( header ) );
+    if( nb_images > 0 )
+      out.write( ( const char* )&entries[ 0 ], nb_images * sizeof( ImageEntry ) );
+    size_t offset = header_size + nb_images * sizeof( ImageEntry );
+
+    for( uint32_t i = 0; i < nb_images; ++i )
+    {
+      writePadding( out, offset );//each image starts on 16 bytes
+      PointsToTrack& ptt = *points[ i ];
+      ptt.computeKeypointsAndDesc( false );
+      const vector< KeyPoint >& keypoints = ptt.getKeypoints( );
+      Mat descriptors = ptt.getDescriptors( );
+      CV_Assert( descriptors.empty( ) ||
+        descriptors.rows == ( int )keypoints.size( ) );
+
+      ImageEntry& entry = entries[ i ];
+      memset( &entry, 0, sizeof( entry ) );
+      entry.offset = offset;
+      entry.nb_points = ( uint32_t )keypoints.size( );
+      entry.image_index = ptt.getIndexImage( );
+      entry.desc_type = descriptors.empty( ) ? 0 : descriptors.type( );
+      entry.desc_cols = descriptors.empty( ) ? 0 : descriptors.cols;
+      entry.has_colors = 1;
+
+      vector< StoredKeypoint > stored( keypoints.size( ) );
+      for( size_t k = 0; k < keypoints.size( ); ++k )
+      {
+        const KeyPoint& kpt = keypoints[ k ];
+        StoredKeypoint& s = stored[ k ];
+        s.x = kpt.pt.x;
+        s.y = kpt.pt.y;
+        s.size = kpt.size;
+        s.angle = kpt.angle;
+        s.response = kpt.response;
+        s.octave = kpt.octave;
+        s.class_id = kpt.class_id;
+      }
+      if( !stored.empty( ) )
+        out.write( ( const char* )&stored[ 0 ], stored.size( ) * sizeof( StoredKeypoint ) );
+      offset += stored.size( ) * sizeof( StoredKeypoint );
+      writePadding( out, offset );
+
+      size_t row_size = descriptors.cols * descriptors.elemSize( );
+      for( int r = 0; r < descriptors.rows; ++r )
+        out.write( ( const char* )descriptors.ptr( r ), row_size );
+      offset += descriptors.rows * row_size;
+      writePadding( out, offset );
+
+      vector< uint32_t > colors( keypoints.size( ) );
+      for( size_t k = 0; k < keypoints.size( ); ++k )
+        colors[ k ] = ptt.getColor( ( unsigned int )k );
+      if( !colors.empty( ) )
+        out.write( ( const char* )&colors[ 0 ], colors.size( ) * sizeof( uint32_t ) );
+      offset += colors.size( ) * sizeof( uint32_t );
+
+      ptt.free_descriptors( );
+    }
+
+    out.seekp( header_size );
+    if( nb_images > 0 )
+      out.write( ( const char* )&entries[ 0 ], nb_images * sizeof( ImageEntry ) );
+    if( !out )
+      CV_Error( CV_StsError, "FeaturesStore: can't write " + filename );
+  }
+
+  FeaturesStore::FeaturesStore( const std::string& filename )
+  {
+    data_ = NULL;
+    size_ = 0;
+#if ( defined WIN32 || defined _WIN32 || defined WINCE )
+    mapping_handle_ = NULL;
+    file_handle_ = CreateFileA( filename.c_str( ), GENERIC_READ, FILE_SHARE_READ,
+      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file_handle_ == INVALID_HANDLE_VALUE )
+      CV_Error( CV_StsError, "FeaturesStore: can't open " + filename );
+    LARGE_INTEGER file_size;
+    if( GetFileSizeEx( file_handle_, &file_size ) )
+      size_ = ( size_t )file_size.QuadPart;
+    if( size_ > 0 )
+      mapping_handle_ = CreateFileMappingA( file_handle_, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( mapping_handle_ != NULL )
+      data_ = ( const uchar* )MapViewOfFile( mapping_handle_, FILE_MAP_READ, 0, 0, 0 );
+    if( data_ == NULL )
+    {
+      if( mapping_handle_ != NULL )
+        CloseHandle( mapping_handle_ );
+      CloseHandle( file_handle_ );
+      CV_Error( CV_StsError, "FeaturesStore: can't map " + filename );
+    }
+#else
+    int fd = ::open( filename.c_str( ), O_RDONLY );
+    if( fd < 0 )
+      CV_Error( CV_StsError, "FeaturesStore: can't open " + filename );
+    struct stat file_stat;
+    void* mapping = MAP_FAILED;
+    if( fstat( fd, &file_stat ) == 0 && file_stat.st_size > 0 )
+    {
+      size_ = ( size_t )file_stat.st_size;
+      mapping = mmap( NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    ::close( fd );//the mapping stays valid
+    if( mapping == MAP_FAILED )
+      CV_Error( CV_StsError, "FeaturesStore: can't map " + filename );
+    data_ = ( const uchar* )mapping;
+#endif
+
+    //check the header and the offset table before using them:
+    std::string error;
+    if( size_ < header_size || memcmp( data_, store_magic, 4 ) != 0 )
+      error = " is not a features store!";
+    else
+    {
+      uint32_t header[ 3 ];
+      memcpy( header, data_ + 4, sizeof( header ) );
+      if( header[ 0 ] != VERSION )
+        error = " has an unsupported version!";
+      else if( ( size_ - header_size ) / sizeof( ImageEntry ) < header[ 1 ] )
+        error = " is truncated!";
+      else
+      {
+        entries_.resize( header[ 1 ] );
+        if( !entries_.empty( ) )
+          memcpy( &entries_[ 0 ], data_ + header_size,
+          entries_.size( ) * sizeof( ImageEntry ) );
+        size_t descriptors_offset, colors_offset, end_offset;
+        for( size_t i = 0; i < entries_.size( ) && error.empty( ); ++i )
+        {
+          getSections( entries_[ i ], descriptors_offset, colors_offset, end_offset );
+          if( entries_[ i ].offset != align( ( size_t )entries_[ i ].offset ) ||
+            end_offset > size_ || end_offset < ( size_t )entries_[ i ].offset )
+            error = " is corrupted!";
+        }
+      }
+    }
+    if( !error.empty( ) )
+    {
+      unmap( );
+      CV_Error( CV_StsError, "FeaturesStore: " + filename + error );
+    }
+  }
+
+  FeaturesStore::~FeaturesStore( )
+  {
+    unmap( );
+  }
+
+  void FeaturesStore::unmap( )
+  {
+    if( data_ == NULL )
+      return;
+#if ( defined WIN32 || defined _WIN32 || defined WINCE )
+    UnmapViewOfFile( data_ );
+    CloseHandle( mapping_handle_ );
+    CloseHandle( file_handle_ );
+#else
+    munmap( ( void* )data_, size_ );
+#endif
+    data_ = NULL;
+  }
+
+  unsigned int FeaturesStore::getNbPoints( unsigned int idx ) const
+  {
+    CV_Assert( idx < entries_.size( ) );
+    return entries_[ idx ].nb_points;
+  }
+
+  int FeaturesStore::getImageIndex( unsigned int idx ) const
+  {
+    CV_Assert( idx < entries_.size( ) );
+    return entries_[ idx ].image_index;
+  }
+
+  void FeaturesStore::getKeypoints( unsigned int idx,
+    vector< KeyPoint >& keypoints ) const
+  {
+    CV_Assert( idx < entries_.size( ) );
+    const ImageEntry& entry = entries_[ idx ];
+    keypoints.resize( entry.nb_points );
+    StoredKeypoint s;
+    const uchar* ptr = data_ + entry.offset;
+    for( uint32_t k = 0; k < entry.nb_points; ++k )
+    {
+      memcpy( &s, ptr + k * sizeof( StoredKeypoint ), sizeof( s ) );
+      keypoints[ k ] = KeyPoint( s.x, s.y, s.size, s.angle, s.response,
+        s.octave, s.class_id );
+    }
+  }
+
+  cv::Mat FeaturesStore::getDescriptors( unsigned int idx ) const
+  {
+    CV_Assert( idx < entries_.size( ) );
+    const ImageEntry& entry = entries_[ idx ];
+    if( entry.desc_cols <= 0 || entry.nb_points == 0 )
+      return Mat( );
+    size_t descriptors_offset, colors_offset, end_offset;
+    getSections( entry, descriptors_offset, colors_offset, end_offset );
+    return Mat( entry.nb_points, entry.desc_cols, entry.desc_type,
+      ( void* )( data_ + descriptors_offset ) );
+  }
+
+  void FeaturesStore::getColors( unsigned int idx,
+    vector< unsigned int >& colors ) const
+  {
+    CV_Assert( idx < entries_.size( ) );
+    const ImageEntry& entry = entries_[ idx ];
+    colors.clear( );
+    if( !entry.has_colors )
+      return;
+    size_t descriptors_offset, colors_offset, end_offset;
+    getSections( entry, descriptors_offset, colors_offset, end_offset );
+    colors.resize( entry.nb_points );
+    if( !colors.empty( ) )
+      memcpy( &colors[ 0 ], data_ + colors_offset,
+      colors.size( ) * sizeof( uint32_t ) );
+  }
+
+}
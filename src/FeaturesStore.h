@@ -0,0 +1,138 @@
+#ifndef _GSOC_SFM_FEATURES_STORE_H
+#define _GSOC_SFM_FEATURES_STORE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include "opencv2/features2d/features2d.hpp"
+
+namespace OpencvSfM{
+  class SFM_EXPORTS PointsToTrack;
+
+  /**
+  * \brief Binary file storing the keypoints, descriptors and colors of
+  * every images of a sequence, faster and smaller than the YAML format.
+  *
+  * The file starts with a header (magic "SFMF", version, number of
+  * images) followed by an offset table with one entry per image. The
+  * data of each image (keypoints, then descriptors, then colors) is
+  * aligned on 16 bytes. The file is memory mapped when opened and the
+  * descriptors are never copied: getDescriptors returns a cv::Mat header
+  * using the mapped memory, so the store must stay opened while they are
+  * used (PointsToTrack::read keeps a reference to the store).
+  *
+  * Values are stored with the byte order of the machine which wrote the
+  * file. The YAML format stays available for interchange.
+  */
+  class SFM_EXPORTS FeaturesStore
+  {
+  public:
+    static const boost::uint32_t VERSION = 1;///<current version of the file format
+
+    /**
+    * Write the points of a sequence into a binary file. Missing keypoints
+    * and descriptors are computed first.
+    * @param filename name of the file to create
+    * @param points points of each image
+    */
+    static void write( const std::string& filename,
+      const std::vector< cv::Ptr< PointsToTrack > >& points );
+
+    /**
+    * Open and map a binary file (see write)
+    * @param filename name of the file to open
+    */
+    FeaturesStore( const std::string& filename );
+    /**
+    * Unmap the file
+    */
+    ~FeaturesStore( );
+
+    /**
+    * Get the number of images stored in the file
+    * @return number of images
+    */
+    inline unsigned int getNbImages( ) const
+    { return ( unsigned int )entries_.size( ); };
+    /**
+    * Get the number of points of an image
+    * @param idx index of the image in the file
+    * @return number of points
+    */
+    unsigned int getNbPoints( unsigned int idx ) const;
+    /**
+    * Get the index of an image in the sequence (see PointsToTrack::getIndexImage)
+    * @param idx index of the image in the file
+    * @return index of the image in the sequence
+    */
+    int getImageIndex( unsigned int idx ) const;
+    /**
+    * Get the keypoints of an image (they are copied)
+    * @param idx index of the image in the file
+    * @param keypoints output, keypoints of the image
+    */
+    void getKeypoints( unsigned int idx, std::vector< cv::KeyPoint >& keypoints ) const;
+    /**
+    * Get the descriptors of an image, without copy.
+    * @param idx index of the image in the file
+    * @return read-only descriptors using the mapped memory (empty if none)
+    */
+    cv::Mat getDescriptors( unsigned int idx ) const;
+    /**
+    * Get the colors of the points of an image
+    * @param idx index of the image in the file
+    * @param colors output, colors packed into the RGB format (empty if not stored)
+    */
+    void getColors( unsigned int idx, std::vector< unsigned int >& colors ) const;
+
+  protected:
+    /**
+    * Entry of the offset table (32 bytes)
+    */
+    struct ImageEntry
+    {
+      boost::uint64_t offset;///<position of the data of this image in the file
+      boost::uint32_t nb_points;///<number of keypoints
+      boost::int32_t image_index;///<index of the image in the sequence
+      boost::int32_t desc_type;///<OpenCV type of descriptors
+      boost::int32_t desc_cols;///<size of descriptors (0 if no descriptors)
+      boost::uint32_t has_colors;///<1 if colors are stored
+      boost::uint32_t reserved;///<0
+    };
+    /**
+    * Keypoint as stored into the file (28 bytes)
+    */
+    struct StoredKeypoint
+    {
+      float x, y, size, angle, response;
+      boost::int32_t octave, class_id;
+    };
+
+    static size_t align( size_t offset );
+    /**
+    * Release the mapping of the file
+    */
+    void unmap( );
+    /**
+    * Compute the position of the descriptors and of the colors of an image
+    */
+    static void getSections( const ImageEntry& entry,
+      size_t& descriptors_offset, size_t& colors_offset, size_t& end_offset );
+
+    std::vector< ImageEntry > entries_;///<offset table
+    const uchar* data_;///<mapped file
+    size_t size_;///<size of the mapped file
+#if ( defined WIN32 || defined _WIN32 || defined WINCE )
+    void* file_handle_;///<handle of the file
+    void* mapping_handle_;///<handle of the mapping
+#endif
+  private:
+    FeaturesStore( const FeaturesStore& );//not copyable (the mapping is owned)
+    FeaturesStore& operator=( const FeaturesStore& );
+  };
+
+}
+
+#endif
@@ -0,0 +1,276 @@
+#include "FundamentalEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || \
+  ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SFM_FUNDAMENTAL_SSE2 1
+#endif
+
+namespace OpencvSfM{
+
+  using cv::Mat;
+  using cv::Point2f;
+  using std::vector;
+
+  static const unsigned int SAMPLE_SIZE = 7;
+  static const unsigned int PRECHECK_SIZE = 1;///<matches tested before scoring a model
+
+  //used to sort the matches by quality, best (lowest) first:
+  struct QualityOrder
+  {
+    const vector<float>& quality;
+    QualityOrder( const vector<float>& q ):quality( q ){};
+    bool operator()( unsigned int idx1, unsigned int idx2 ) const
+    {
+      return quality[ idx1 ] < quality[ idx2 ];
+    }
+  };
+
+  //number of iterations needed to reach the confidence with this ratio. A
+  //sample gives the good model if its SAMPLE_SIZE matches are inliers, and
+  //this model is scored only if the PRECHECK_SIZE matches of the pre-check
+  //are inliers too, so the probability of success of an iteration is
+  //inlier_ratio^( SAMPLE_SIZE + PRECHECK_SIZE ):
+  static unsigned int neededIterations( double confidence,
+    double inlier_ratio, unsigned int max_iterations )
+  {
+    double proba_good_sample = pow( inlier_ratio,
+      ( int )( SAMPLE_SIZE + PRECHECK_SIZE ) );
+    if( proba_good_sample <= DBL_EPSILON )
+      return max_iterations;
+    if( proba_good_sample >= 1.0 )
+      return 1;
+    double nb_iter = log( 1.0 - confidence ) / log( 1.0 - proba_good_sample );
+    if( nb_iter >= max_iterations )
+      return max_iterations;
+    return MAX( ( unsigned int )ceil( nb_iter ), 1 );
+  }
+
+#ifdef SFM_FUNDAMENTAL_SSE2
+  //convert 2 consecutive floats into doubles:
+  static inline __m128d loadTwoFloats( const float* ptr )
+  {
+    return _mm_cvtps_pd( _mm_castsi128_ps(
+      _mm_loadl_epi64( ( const __m128i* )ptr ) ) );
+  }
+#endif
+
+  FundamentalEstimator::FundamentalEstimator( double threshold,
+    double confidence, unsigned int max_iterations )
+    :threshold_( threshold ), confidence_( confidence ),
+    max_iterations_( max_iterations ), nb_iterations_( 0 ), nb_rejected_( 0 ),
+    nb_inliers_( 0 )
+  {
+    CV_Assert( threshold_ > 0 && confidence_ > 0 && confidence_ < 1 &&
+      max_iterations_ > 0 );
+  }
+
+  bool FundamentalEstimator::isInlier( const double* F, unsigned int idx ) const
+  {
+    float x1 = x1_[ idx ], y1 = y1_[ idx ], x2 = x2_[ idx ], y2 = y2_[ idx ];
+    double a = F[ 0 ] * x1 + F[ 1 ] * y1 + F[ 2 ],
+      b = F[ 3 ] * x1 + F[ 4 ] * y1 + F[ 5 ],
+      c = F[ 6 ] * x1 + F[ 7 ] * y1 + F[ 8 ],
+      a2 = F[ 0 ] * x2 + F[ 3 ] * y2 + F[ 6 ],
+      b2 = F[ 1 ] * x2 + F[ 4 ] * y2 + F[ 7 ];
+    double err = x2 * a + y2 * b + c;
+    //Sampson distance, without division:
+    return err * err <= threshold_ * threshold_ *
+      ( a * a + b * b + a2 * a2 + b2 * b2 );
+  }
+
+  unsigned int FundamentalEstimator::countInliers( const double* F,
+    unsigned int min_count ) const
+  {
+    unsigned int nb_points = ( unsigned int )x1_.size( ), nb_inliers = 0, k = 0;
+#ifdef SFM_FUNDAMENTAL_SSE2
+    //same operations (in the same order) than isInlier, 2 by 2 in double
+    //precision, so both always classify a match the same way:
+    static const unsigned char bits_count[ 4 ] = { 0, 1, 1, 2 };
+    __m128d f0 = _mm_set1_pd( F[ 0 ] ), f1 = _mm_set1_pd( F[ 1 ] ),
+      f2 = _mm_set1_pd( F[ 2 ] ), f3 = _mm_set1_pd( F[ 3 ] ),
+      f4 = _mm_set1_pd( F[ 4 ] ), f5 = _mm_set1_pd( F[ 5 ] ),
+      f6 = _mm_set1_pd( F[ 6 ] ), f7 = _mm_set1_pd( F[ 7 ] ),
+      f8 = _mm_set1_pd( F[ 8 ] ),
+      threshold2 = _mm_set1_pd( threshold_ * threshold_ );
+    const float *px1 = &x1_[ 0 ], *py1 = &y1_[ 0 ], *px2 = &x2_[ 0 ],
+      *py2 = &y2_[ 0 ];
+    for( ; k + 2 <= nb_points; k += 2 )
+    {
+      __m128d x1 = loadTwoFloats( px1 + k ), y1 = loadTwoFloats( py1 + k ),
+        x2 = loadTwoFloats( px2 + k ), y2 = loadTwoFloats( py2 + k );
+      __m128d a = _mm_add_pd( _mm_add_pd( _mm_mul_pd( f0, x1 ),
+        _mm_mul_pd( f1, y1 ) ), f2 );
+      __m128d b = _mm_add_pd( _mm_add_pd( _mm_mul_pd( f3, x1 ),
+        _mm_mul_pd( f4, y1 ) ), f5 );
+      __m128d c = _mm_add_pd( _mm_add_pd( _mm_mul_pd( f6, x1 ),
+        _mm_mul_pd( f7, y1 ) ), f8 );
+      __m128d a2 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( f0, x2 ),
+        _mm_mul_pd( f3, y2 ) ), f6 );
+      __m128d b2 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( f1, x2 ),
+        _mm_mul_pd( f4, y2 ) ), f7 );
+      __m128d err = _mm_add_pd( _mm_add_pd( _mm_mul_pd( x2, a ),
+        _mm_mul_pd( y2, b ) ), c );
+      __m128d denom = _mm_add_pd( _mm_add_pd( _mm_add_pd(
+        _mm_mul_pd( a, a ), _mm_mul_pd( b, b ) ), _mm_mul_pd( a2, a2 ) ),
+        _mm_mul_pd( b2, b2 ) );
+      __m128d inliers = _mm_cmple_pd( _mm_mul_pd( err, err ),
+        _mm_mul_pd( threshold2, denom ) );
+      nb_inliers += bits_count[ _mm_movemask_pd( inliers ) ];
+      //this model can't be better than the current best:
+      if( ( k & 255 ) == 254 && nb_inliers + nb_points - k - 2 <= min_count )
+        return nb_inliers;
+    }
+#endif
+    for( ; k < nb_points; ++k )
+      if( isInlier( F, k ) )
+        nb_inliers++;
+    return nb_inliers;
+  }
+
+  Mat FundamentalEstimator::estimate( const vector<Point2f>& points1,
+    const vector<Point2f>& points2, vector<uchar>& status,
+    const vector<float>& quality )
+  {
+    CV_Assert( points1.size( ) == points2.size( ) &&
+      ( quality.empty( ) || quality.size( ) == points1.size( ) ) );
+    unsigned int nb_points = ( unsigned int )points1.size( );
+    nb_iterations_ = nb_rejected_ = nb_inliers_ = 0;
+    status.assign( nb_points, 0 );
+    if( nb_points <= SAMPLE_SIZE )
+      return Mat( );
+
+    //store the coordinates by decreasing quality (structure of arrays):
+    vector<unsigned int> order( nb_points );
+    for( unsigned int i = 0; i < nb_points; ++i )
+      order[ i ] = i;
+    if( !quality.empty( ) )
+      std::stable_sort( order.begin( ), order.end( ), QualityOrder( quality ) );
+    x1_.resize( nb_points ); y1_.resize( nb_points );
+    x2_.resize( nb_points ); y2_.resize( nb_points );
+    for( unsigned int i = 0; i < nb_points; ++i )
+    {
+      x1_[ i ] = points1[ order[ i ] ].x; y1_[ i ] = points1[ order[ i ] ].y;
+      x2_[ i ] = points2[ order[ i ] ].x; y2_[ i ] = points2[ order[ i ] ].y;
+    }
+
+    //PROSAC growth function: the n best matches are used while the number
+    //of samples drawn is lower than T'_n (see Chum & Matas, CVPR 2005):
+    unsigned int n = SAMPLE_SIZE, T_n_prime = 1;
+    double T_n = max_iterations_;
+    for( unsigned int i = 0; i < SAMPLE_SIZE; ++i )
+      T_n *= ( double )( n - i ) / ( nb_points - i );
+
+    cv::RNG rng( 0xffffffff );//deterministic results
+    vector<Point2f> sample1( SAMPLE_SIZE ), sample2( SAMPLE_SIZE );
+    unsigned int sample[ SAMPLE_SIZE ];
+    Mat best_model;
+    unsigned int best_count = 0, limit = max_iterations_;
+    while( nb_iterations_ < limit )
+    {
+      nb_iterations_++;
+      if( nb_iterations_ > T_n_prime && n < nb_points )
+      {
+        double T_n_next = T_n * ( n + 1 ) / ( n + 1 - SAMPLE_SIZE );
+        n++;
+        T_n_prime += ( unsigned int )ceil( T_n_next - T_n );
+        T_n = T_n_next;
+      }
+      //the n-th match is always in the sample until T'_n is reached:
+      unsigned int nb_drawn = SAMPLE_SIZE, range = n;
+      if( T_n_prime >= nb_iterations_ )
+      {
+        sample[ --nb_drawn ] = n - 1;
+        range = n - 1;
+      }
+      for( unsigned int i = 0; i < nb_drawn; ++i )
+      {
+        unsigned int idx, j;
+        do
+        {
+          idx = ( unsigned int )rng.uniform( 0, ( int )range );
+          for( j = 0; j < i && sample[ j ] != idx; ++j )
+            ;
+        }while( j < i );
+        sample[ i ] = idx;
+      }
+      for( unsigned int i = 0; i < SAMPLE_SIZE; ++i )
+      {
+        sample1[ i ] = Point2f( x1_[ sample[ i ] ], y1_[ sample[ i ] ] );
+        sample2[ i ] = Point2f( x2_[ sample[ i ] ], y2_[ sample[ i ] ] );
+      }
+
+      //up to 3 models for 7 points:
+      Mat models = cv::findFundamentalMat( Mat( sample1 ), Mat( sample2 ),
+        cv::FM_7POINT );
+      for( int m = 0; m + 3 <= models.rows; m += 3 )
+      {
+        Mat model = models.rowRange( m, m + 3 ).clone( );
+        double model_norm = cv::norm( model );
+        if( model_norm <= DBL_EPSILON )
+          continue;
+        model /= model_norm;
+        const double* F = model.ptr<double>( );
+
+        //pre-check on random candidates:
+        bool rejected = false;
+        for( unsigned int c = 0; c < PRECHECK_SIZE && !rejected; ++c )
+          rejected = !isInlier( F, ( unsigned int )rng.uniform( 0, ( int )n ) );
+        if( rejected )
+        {
+          nb_rejected_++;
+          continue;
+        }
+
+        unsigned int count = countInliers( F, best_count );
+        if( count > best_count )
+        {
+          best_count = count;
+          best_model = model;
+          limit = MIN( limit, neededIterations( confidence_,
+            ( double )best_count / nb_points, max_iterations_ ) );
+        }
+      }
+    }
+    if( best_model.empty( ) )
+      return Mat( );
+
+    //refine using every inliers:
+    vector<Point2f> inliers1, inliers2;
+    for( unsigned int i = 0; i < nb_points; ++i )
+      if( isInlier( best_model.ptr<double>( ), i ) )
+      {
+        inliers1.push_back( Point2f( x1_[ i ], y1_[ i ] ) );
+        inliers2.push_back( Point2f( x2_[ i ], y2_[ i ] ) );
+      }
+    if( inliers1.size( ) >= 8 )
+    {
+      Mat refined = cv::findFundamentalMat( Mat( inliers1 ), Mat( inliers2 ),
+        cv::FM_8POINT );
+      if( refined.rows == 3 && refined.cols == 3 )
+      {
+        double refined_norm = cv::norm( refined );
+        if( refined_norm > DBL_EPSILON )
+        {
+          refined /= refined_norm;
+          if( countInliers( refined.ptr<double>( ), 0 ) >= best_count )
+            best_model = refined;
+        }
+      }
+    }
+
+    for( unsigned int i = 0; i < nb_points; ++i )
+      if( isInlier( best_model.ptr<double>( ), i ) )
+      {
+        status[ order[ i ] ] = 1;
+        nb_inliers_++;
+      }
+    return best_model;
+  }
+
+}
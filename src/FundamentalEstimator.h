@@ -0,0 +1,110 @@
+#ifndef _GSOC_SFM_FUNDAMENTAL_ESTIMATOR_H
+#define _GSOC_SFM_FUNDAMENTAL_ESTIMATOR_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Robust estimation of a fundamental matrix from noisy matches.
+  *
+  * Samples of 7 matches are drawn with PROSAC: when a quality is given for
+  * each match (a descriptor distance, lower is better), the first samples
+  * use only the best matches and the set of candidates grows until it
+  * reaches every matches (it is then a classical RANSAC). Each model is
+  * first checked on a random match of the candidates and is only scored on
+  * every matches if this match is an inlier. The number of iterations is
+  * updated from the inlier ratio of the best model (taking into account
+  * the good models rejected by the pre-check), so the search stops as
+  * soon as the wanted confidence is reached. Residuals (Sampson distances)
+  * are computed 2 by 2 with SSE2 when available, in double precision like
+  * the scalar code.
+  *
+  * The best model is finally refined with the 8-point algorithm on its
+  * inliers. As with cv::findFundamentalMat, points2^T * F * points1 = 0.
+  *
+  * An estimator can be reused, but not shared by several threads.
+  */
+  class SFM_EXPORTS FundamentalEstimator
+  {
+  public:
+    /**
+    * Create a robust estimator
+    * @param threshold maximum distance (in pixels) between a point and its
+    * epipolar line for an inlier
+    * @param confidence wanted probability of finding the best model
+    * @param max_iterations maximum number of samples
+    */
+    FundamentalEstimator( double threshold = 1.0, double confidence = 0.99,
+      unsigned int max_iterations = 2000 );
+
+    /**
+    * Estimate the fundamental matrix of a set of matches
+    * @param points1 points of the first image
+    * @param points2 matching points of the second image
+    * @param status [out] 1 for inliers, 0 for outliers
+    * @param quality if not empty, quality of each match (lower is better)
+    * @return the 3x3 fundamental matrix (CV_64F), empty if not enough matches
+    */
+    cv::Mat estimate( const std::vector<cv::Point2f>& points1,
+      const std::vector<cv::Point2f>& points2, std::vector<uchar>& status,
+      const std::vector<float>& quality = std::vector<float>( ) );
+
+    /**
+    * Change the inlier threshold
+    * @param threshold maximum distance (in pixels) to the epipolar line
+    */
+    inline void setThreshold( double threshold ) { threshold_ = threshold; };
+    /**
+    * Get the inlier threshold
+    * @return maximum distance (in pixels) to the epipolar line
+    */
+    inline double getThreshold( ) const { return threshold_; };
+    /**
+    * Get the number of samples drawn by the last estimation
+    * @return number of iterations
+    */
+    inline unsigned int getNbIterations( ) const { return nb_iterations_; };
+    /**
+    * Get the number of models rejected by the pre-check during the last
+    * estimation (they were not scored on every matches)
+    * @return number of rejected models
+    */
+    inline unsigned int getNbRejected( ) const { return nb_rejected_; };
+    /**
+    * Get the number of inliers of the last estimation
+    * @return number of inliers
+    */
+    inline unsigned int getNbInliers( ) const { return nb_inliers_; };
+
+  protected:
+    /**
+    * Test if a match is an inlier of a model
+    * @param F model (9 values, row major)
+    * @param idx index of the match (in sorted order)
+    */
+    bool isInlier( const double* F, unsigned int idx ) const;
+    /**
+    * Count the inliers of a model. Stops as soon as the model can't have
+    * more than min_count inliers.
+    * @param F model (9 values, row major)
+    * @param min_count number of inliers to beat
+    * @return number of inliers (or less if min_count can't be reached)
+    */
+    unsigned int countInliers( const double* F, unsigned int min_count ) const;
+
+    double threshold_;///<maximum distance to the epipolar line
+    double confidence_;///<wanted probability of finding the best model
+    unsigned int max_iterations_;///<maximum number of samples
+    unsigned int nb_iterations_;///<number of samples of the last estimation
+    unsigned int nb_rejected_;///<models rejected by the pre-check
+    unsigned int nb_inliers_;///<number of inliers of the last estimation
+    std::vector<float> x1_, y1_, x2_, y2_;///<coordinates sorted by quality
+  };
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "KeypointsGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace OpencvSfM{
+
+  using std::vector;
+  using cv::KeyPoint;
+
+  KeypointsGrid::KeypointsGrid( float cell_size )
+    :cell_size_( cell_size )
+  {
+    CV_Assert( cell_size_ > 0 );
+    clear( );
+  }
+
+  void KeypointsGrid::clear( )
+  {
+    cells_.clear( );
+    nb_points_ = 0;
+    min_x_ = min_y_ = 0;
+    max_x_ = max_y_ = -1;
+  }
+
+  void KeypointsGrid::add( const cv::Point2f& point, unsigned int idx )
+  {
+    int x = cellOf( point.x ), y = cellOf( point.y );
+    if( nb_points_ == 0 )
+    {
+      min_x_ = max_x_ = x;
+      min_y_ = max_y_ = y;
+    }
+    else
+    {
+      min_x_ = std::min( min_x_, x );
+      max_x_ = std::max( max_x_, x );
+      min_y_ = std::min( min_y_, y );
+      max_y_ = std::max( max_y_, y );
+    }
+    cells_[ key( x, y ) ].push_back( idx );
+    nb_points_++;
+  }
+
+  int KeypointsGrid::findNearest( const cv::Point2f& point,
+    const vector<KeyPoint>& keypoints, float max_dist, float* dist ) const
+  {
+    int best = -1;
+    float best_dist = 0;
+    if( nb_points_ == 0 )
+      return best;
+    int x = cellOf( point.x ), y = cellOf( point.y );
+    //rings of cells around the query, up to the bounding box (or max_dist):
+    int max_ring = std::max( std::max( x - min_x_, max_x_ - x ),
+      std::max( y - min_y_, max_y_ - y ) );
+    if( max_dist >= 0 )
+      max_ring = std::min( max_ring, ( int )ceil( max_dist / cell_size_ ) );
+
+    for( int ring = 0; ring <= max_ring; ++ring )
+    {
+      //only the cells of this ring inside the bounding box are visited:
+      int y_begin = std::max( y - ring, min_y_ ), y_end = std::min( y + ring, max_y_ ),
+        x_begin = std::max( x - ring, min_x_ ), x_end = std::min( x + ring, max_x_ );
+      for( int cy = y_begin; cy <= y_end; ++cy )
+      {
+        bool border_row = cy == y - ring || cy == y + ring;
+        for( int cx = x_begin; cx <= x_end; ++cx )
+        {
+          if( !border_row && cx != x - ring && cx != x + ring )
+          {//inside of the ring, already visited:
+            if( cx < x + ring )
+              cx = x + ring - 1;
+            continue;
+          }
+          Cells::const_iterator cell = cells_.find( key( cx, cy ) );
+          if( cell == cells_.end( ) )
+            continue;
+          const vector<unsigned int>& points = cell->second;
+          for( size_t i = 0; i < points.size( ); ++i )
+          {
+            const cv::Point2f& pt = keypoints[ points[ i ] ].pt;
+            float d = ( point.x - pt.x ) * ( point.x - pt.x ) +
+              ( point.y - pt.y ) * ( point.y - pt.y );
+            if( best < 0 || d < best_dist ||
+              ( d == best_dist && ( int )points[ i ] < best ) )
+            {
+              best = points[ i ];
+              best_dist = d;
+            }
+          }
+        }
+      }
+      //points of the next rings are at least ring*cell_size_ away:
+      float next_dist = ring * cell_size_;
+      if( best >= 0 && best_dist < next_dist * next_dist )
+        break;
+    }
+
+    if( best >= 0 && max_dist >= 0 && best_dist > max_dist * max_dist )
+      best = -1;
+    if( best >= 0 && dist != NULL )
+      *dist = sqrt( best_dist );
+    return best;
+  }
+
+  void KeypointsGrid::findInRadius( const cv::Point2f& point, float radius,
+    const vector<KeyPoint>& keypoints, vector<unsigned int>& indexes ) const
+  {
+    indexes.clear( );
+    if( nb_points_ == 0 || radius < 0 )
+      return;
+    int x_begin = std::max( cellOf( point.x - radius ), min_x_ ),
+      x_end = std::min( cellOf( point.x + radius ), max_x_ ),
+      y_begin = std::max( cellOf( point.y - radius ), min_y_ ),
+      y_end = std::min( cellOf( point.y + radius ), max_y_ );
+    float radius2 = radius * radius;
+    for( int cy = y_begin; cy <= y_end; ++cy )
+      for( int cx = x_begin; cx <= x_end; ++cx )
+      {
+        Cells::const_iterator cell = cells_.find( key( cx, cy ) );
+        if( cell == cells_.end( ) )
+          continue;
+        const vector<unsigned int>& points = cell->second;
+        for( size_t i = 0; i < points.size( ); ++i )
+        {
+          const cv::Point2f& pt = keypoints[ points[ i ] ].pt;
+          float d = ( point.x - pt.x ) * ( point.x - pt.x ) +
+            ( point.y - pt.y ) * ( point.y - pt.y );
+          if( d <= radius2 )
+            indexes.push_back( points[ i ] );
+        }
+      }
+    std::sort( indexes.begin( ), indexes.end( ) );
+  }
+
+  void KeypointsGrid::findNearLine( const cv::Vec3f& line, float band,
+    const vector<KeyPoint>& keypoints, vector<unsigned int>& indexes ) const
+  {
+    indexes.clear( );
+    float norm = sqrt( line[ 0 ] * line[ 0 ] + line[ 1 ] * line[ 1 ] );
+    if( nb_points_ == 0 || band < 0 || norm <= 0 )
+      return;
+    float a = line[ 0 ] / norm, b = line[ 1 ] / norm, c = line[ 2 ] / norm;
+    //walk along the axis the line is the closest to: for each column (or
+    //row) of cells, only the cells crossed by the band are visited:
+    bool along_x = fabs( b ) >= fabs( a );
+    float u_coef = along_x ? a : b, v_coef = along_x ? b : a;
+    int u_begin = along_x ? min_x_ : min_y_, u_end = along_x ? max_x_ : max_y_,
+      v_min_cell = along_x ? min_y_ : min_x_, v_max_cell = along_x ? max_y_ : max_x_;
+    float v_band = band / fabs( v_coef );
+    for( int u = u_begin; u <= u_end; ++u )
+    {
+      float v0 = -( u_coef * u * cell_size_ + c ) / v_coef,
+        v1 = -( u_coef * ( u + 1 ) * cell_size_ + c ) / v_coef;
+      float v_min = std::max( std::min( v0, v1 ) - v_band, v_min_cell * cell_size_ ),
+        v_max = std::min( std::max( v0, v1 ) + v_band, ( v_max_cell + 1 ) * cell_size_ );
+      if( v_min > v_max )
+        continue;
+      int v_end = std::min( cellOf( v_max ), v_max_cell );
+      for( int v = std::max( cellOf( v_min ), v_min_cell ); v <= v_end; ++v )
+      {
+        Cells::const_iterator cell = cells_.find( along_x ? key( u, v ) : key( v, u ) );
+        if( cell == cells_.end( ) )
+          continue;
+        const vector<unsigned int>& points = cell->second;
+        for( size_t i = 0; i < points.size( ); ++i )
+        {
+          const cv::Point2f& pt = keypoints[ points[ i ] ].pt;
+          if( fabs( a * pt.x + b * pt.y + c ) <= band )
+            indexes.push_back( points[ i ] );
+        }
+      }
+    }
+    std::sort( indexes.begin( ), indexes.end( ) );
+  }
+
+}
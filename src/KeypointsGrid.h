@@ -0,0 +1,104 @@
+#ifndef _GSOC_SFM_KEYPOINTS_GRID_H
+#define _GSOC_SFM_KEYPOINTS_GRID_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include "opencv2/features2d/features2d.hpp"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Uniform grid used to find keypoints close to a 2D position.
+  *
+  * Each non-empty cell of the grid stores the indexes of the keypoints it
+  * contains (cells are hashed, so points can be anywhere in the plane).
+  * Points can be added one by one, and a query only visits the cells
+  * close to the wanted position instead of scanning every keypoint.
+  *
+  * The grid only stores indexes: the coordinates are read from the list
+  * of keypoints given to the queries, which must be the indexed one.
+  */
+  class SFM_EXPORTS KeypointsGrid
+  {
+  public:
+    /**
+    * Create an empty grid
+    * @param cell_size size of a cell in pixels
+    */
+    KeypointsGrid( float cell_size = 16.0f );
+
+    /**
+    * Remove every points of the grid
+    */
+    void clear( );
+    /**
+    * Add a point to the grid
+    * @param point coordinates of the point
+    * @param idx index of the point in the list of keypoints
+    */
+    void add( const cv::Point2f& point, unsigned int idx );
+    /**
+    * Get the number of indexed points
+    * @return number of points added since the last clear
+    */
+    inline size_t size( ) const { return nb_points_; };
+
+    /**
+    * Find the closest keypoint from a position. If several keypoints are
+    * at the same distance, the lowest index is returned.
+    * @param point query position
+    * @param keypoints indexed keypoints
+    * @param max_dist only points with a distance <= max_dist are searched (<0 for no limit)
+    * @param dist [out] if not NULL, distance of the point found
+    * @return index of the closest keypoint, -1 if none
+    */
+    int findNearest( const cv::Point2f& point,
+      const std::vector<cv::KeyPoint>& keypoints,
+      float max_dist = -1, float* dist = NULL ) const;
+    /**
+    * Find every keypoints inside a circle
+    * @param point center of the circle
+    * @param radius radius of the circle
+    * @param keypoints indexed keypoints
+    * @param indexes [out] sorted indexes of keypoints with a distance <= radius
+    */
+    void findInRadius( const cv::Point2f& point, float radius,
+      const std::vector<cv::KeyPoint>& keypoints,
+      std::vector<unsigned int>& indexes ) const;
+    /**
+    * Find every keypoints close to a line (for instance an epipolar line).
+    * Only the cells crossed by the band around the line are visited.
+    * @param line coefficients (a, b, c) of the line a*x + b*y + c = 0
+    * @param band maximum distance between a keypoint and the line
+    * @param keypoints indexed keypoints
+    * @param indexes [out] sorted indexes of keypoints with a distance <= band
+    */
+    void findNearLine( const cv::Vec3f& line, float band,
+      const std::vector<cv::KeyPoint>& keypoints,
+      std::vector<unsigned int>& indexes ) const;
+
+  protected:
+    /**
+    * Get the key of a cell
+    */
+    static inline boost::uint64_t key( int x, int y )
+    {
+      return ( ( boost::uint64_t )( boost::uint32_t )x << 32 ) |
+        ( boost::uint64_t )( boost::uint32_t )y;
+    };
+    inline int cellOf( float coord ) const
+    { return ( int )floor( coord / cell_size_ ); };
+
+    typedef boost::unordered_map< boost::uint64_t, std::vector<unsigned int> > Cells;
+    float cell_size_;///<size of a cell in pixels
+    Cells cells_;///<indexes of points of each non-empty cell
+    size_t nb_points_;///<number of indexed points
+    int min_x_, min_y_, max_x_, max_y_;///<bounding box of non-empty cells
+  };
+
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include "PointsMatcher.h"
 #include "PointsToTrack.h"
 #include "PointsToTrackWithImage.h"
+#include "FundamentalEstimator.h"
 
 namespace OpencvSfM{
   using cv::Mat;
@@ -48,7 +49,7 @@ namespace OpencvSfM{
     //simple_matcher->match( pointCollection_[0], matches, masks );
     PointsMatcher::match( queryPoints,matches );
 
-    P_MUTEX( thread_concurr );
+    //the trained matcher is not used anymore, everything below is local:
 
 
     //////////////////////////////////////////////////////////////////////////
@@ -56,24 +57,23 @@ namespace OpencvSfM{
 
     //First compute points matches:
     int size_match=matches.size( );
-    Mat srcP( 1,size_match,CV_32FC2 );
-    Mat destP( 1,size_match,CV_32FC2 );
+    vector<cv::Point2f> srcP( size_match );
+    vector<cv::Point2f> destP( size_match );
+    vector<float> quality( size_match );
     vector<uchar> status;
 
     //vector<KeyPoint> points1 = point_matcher->;
     for( int i = 0; i < size_match; i ++ ){
-      const KeyPoint &key1 = pointCollection_[0]->getKeypoint(
-        matches[ i ].trainIdx );
-      const KeyPoint &key2 = queryPoints->getKeypoint(
-        matches[ i ].queryIdx );
-      srcP.at<float[ 2 ]>( 0,i )[ 0 ] = key1.pt.x;
-      srcP.at<float[ 2 ]>( 0,i )[ 1 ] = key1.pt.y;
-      destP.at<float[ 2 ]>( 0,i )[ 0 ] = key2.pt.x;
-      destP.at<float[ 2 ]>( 0,i )[ 1 ] = key2.pt.y;
-      status.push_back( 1 );
+      srcP[ i ] = pointCollection_[0]->getKeypoint( matches[ i ].trainIdx ).pt;
+      destP[ i ] = queryPoints->getKeypoint( matches[ i ].queryIdx ).pt;
+      quality[ i ] = matches[ i ].distance;
     }
-    
-    Mat fundam = cv::findFundamentalMat( srcP, destP, status, cv::FM_RANSAC, 1 );
+
+    //samples are drawn from the best matches first (PROSAC):
+    FundamentalEstimator estimator( 1.0 );
+    Mat fundam = estimator.estimate( srcP, destP, status, quality );
+    if( fundam.empty( ) )
+      status.assign( size_match, 1 );//not enough matches to filter them
 
     //refine the mathing :
     for( int i = 0; i < size_match; ++i ){
@@ -93,6 +93,7 @@ namespace OpencvSfM{
     vector<cv::Point2f> keyPointsOut;
     vector<float> error;
 
+    //released images (streaming mode) are read again for this match only:
     cv::Mat img1 = pointCollection_[0]->getImage();
     cv::Mat img2 = queryPoints->getImage();
     CV_Assert( !img1.empty() && !img2.empty() );
@@ -205,7 +206,6 @@ namespace OpencvSfM{
       if( dist<max_distance_ )
         matches.push_back( cv::DMatch(idx_min, idx_to_add[cpt], dist_min) );
     }*/
-    V_MUTEX( thread_concurr );
   }
 
   void MatcherSparseFlow::knnMatch( cv::Ptr<PointsToTrack> queryPoints,
@@ -0,0 +1,133 @@
+#include "MatchersCache.h"
+
+namespace OpencvSfM{
+
+  using cv::Ptr;
+  using std::vector;
+
+  MatchersCache::CacheEntry::CacheEntry( )
+  {
+    memory = 0;
+    in_lru = false;
+    INIT_MUTEX( training );
+  }
+
+  MatchersCache::MatchersCache( size_t memory_budget )
+  {
+    memory_budget_ = memory_budget;
+    memory_used_ = 0;
+    nb_hits_ = nb_misses_ = nb_evictions_ = 0;
+    INIT_MUTEX( cache_mutex );
+  }
+
+  Ptr<PointsMatcher> MatchersCache::getMatcher( unsigned int idx_image,
+    Ptr<PointsToTrack> points, Ptr<PointsMatcher> algorithm )
+  {
+    P_MUTEX( cache_mutex );
+    if( idx_image >= entries_.size( ) )
+      entries_.resize( idx_image + 1 );
+    if( entries_[ idx_image ].empty( ) )
+      entries_[ idx_image ] = Ptr<CacheEntry>( new CacheEntry( ) );
+    Ptr<CacheEntry> entry = entries_[ idx_image ];
+    V_MUTEX( cache_mutex );
+
+    //if an other thread is training this matcher, wait for it:
+    P_MUTEX( entry->training );
+    P_MUTEX( cache_mutex );
+    Ptr<PointsMatcher> matcher = entry->matcher;
+    if( !matcher.empty( ) &&
+      ( PointsToTrack* )entry->points == ( PointsToTrack* )points )
+    {
+      nb_hits_++;
+      touch( idx_image );
+      V_MUTEX( cache_mutex );
+      V_MUTEX( entry->training );
+      return matcher;
+    }
+    if( !matcher.empty( ) )
+    {//the points of this image have changed, forget the old matcher:
+      memory_used_ -= entry->memory;
+      lru_.erase( entry->lru_pos );
+      entry->in_lru = false;
+    }
+    nb_misses_++;
+    V_MUTEX( cache_mutex );
+
+    //other images can be trained at the same time:
+    matcher = algorithm->clone( true );
+    matcher->add( points );
+    matcher->train( );
+
+    P_MUTEX( cache_mutex );
+    entry->matcher = matcher;
+    entry->points = points;
+    entry->memory = matcher->getMemoryUsage( );
+    memory_used_ += entry->memory;
+    touch( idx_image );
+    evict( );
+    V_MUTEX( cache_mutex );
+    V_MUTEX( entry->training );
+
+    return matcher;
+  }
+
+  void MatchersCache::clear( )
+  {
+    P_MUTEX( cache_mutex );
+    for( size_t i = 0; i < entries_.size( ); ++i )
+    {
+      if( !entries_[ i ].empty( ) )
+      {
+        entries_[ i ]->matcher.release( );
+        entries_[ i ]->points.release( );
+        entries_[ i ]->memory = 0;
+        entries_[ i ]->in_lru = false;
+      }
+    }
+    lru_.clear( );
+    memory_used_ = 0;
+    V_MUTEX( cache_mutex );
+  }
+
+  void MatchersCache::setMemoryBudget( size_t memory_budget )
+  {
+    P_MUTEX( cache_mutex );
+    memory_budget_ = memory_budget;
+    evict( );
+    V_MUTEX( cache_mutex );
+  }
+
+  void MatchersCache::resetStatistics( )
+  {
+    P_MUTEX( cache_mutex );
+    nb_hits_ = nb_misses_ = nb_evictions_ = 0;
+    V_MUTEX( cache_mutex );
+  }
+
+  void MatchersCache::touch( unsigned int idx_image )
+  {
+    CacheEntry& entry = *entries_[ idx_image ];
+    if( entry.in_lru )
+      lru_.erase( entry.lru_pos );
+    lru_.push_front( idx_image );
+    entry.lru_pos = lru_.begin( );
+    entry.in_lru = true;
+  }
+
+  void MatchersCache::evict( )
+  {
+    while( memory_used_ > memory_budget_ && lru_.size( ) > 1 )
+    {
+      CacheEntry& entry = *entries_[ lru_.back( ) ];
+      lru_.pop_back( );
+      //threads using this matcher still have a Ptr on it:
+      entry.matcher.release( );
+      entry.points.release( );
+      memory_used_ -= entry.memory;
+      entry.memory = 0;
+      entry.in_lru = false;
+      nb_evictions_++;
+    }
+  }
+
+}
@@ -0,0 +1,131 @@
+#ifndef _GSOC_SFM_MATCHERS_CACHE_H
+#define _GSOC_SFM_MATCHERS_CACHE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <list>
+
+#include "config_SFM.h"  //SEMAPHORE
+#include "PointsMatcher.h"
+#include "PointsToTrack.h"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Cache of trained matchers, one for each image of a sequence.
+  *
+  * Training a matcher (for instance building a FLANN index) is expensive
+  * and each image is matched with every other one, so the trained matcher
+  * of an image is kept and shared by every pair using this image.
+  *
+  * The memory used by the cached matchers is bounded: when the budget is
+  * exceeded, the least recently used matchers are released (and trained
+  * again if they are needed later). getMatcher can be called from several
+  * threads, a matcher is trained only once even if it's asked at the same
+  * time by several threads.
+  */
+  class SFM_EXPORTS MatchersCache
+  {
+  public:
+    /**
+    * Create an empty cache
+    * @param memory_budget maximum memory (in bytes) used by the trained matchers
+    */
+    MatchersCache( size_t memory_budget = 512 * 1024 * 1024 );
+
+    /**
+    * Get the trained matcher of an image. If the matcher is not in the
+    * cache (or was trained with other points), a clone of algorithm is
+    * trained with points and added to the cache.
+    * @param idx_image index of the image
+    * @param points points of this image
+    * @param algorithm matcher to clone if the trained matcher is not cached
+    * @return a trained matcher of the points of this image
+    */
+    cv::Ptr<PointsMatcher> getMatcher( unsigned int idx_image,
+      cv::Ptr<PointsToTrack> points, cv::Ptr<PointsMatcher> algorithm );
+    /**
+    * Release every cached matchers
+    */
+    void clear( );
+    /**
+    * Set the maximum memory used by the trained matchers. If needed, some
+    * matchers are released now.
+    * @param memory_budget maximum memory in bytes
+    */
+    void setMemoryBudget( size_t memory_budget );
+    /**
+    * Get the maximum memory used by the trained matchers
+    * @return budget in bytes
+    */
+    inline size_t getMemoryBudget( ) const { return memory_budget_; };
+    /**
+    * Get the memory used by the cached matchers
+    * @return memory in bytes
+    */
+    inline size_t getMemoryUsage( ) const { return memory_used_; };
+    /**
+    * Set hits, misses and evictions counters to 0
+    */
+    void resetStatistics( );
+    /**
+    * Get the number of requests answered with a cached matcher
+    * @return number of hits since the last resetStatistics( )
+    */
+    inline unsigned int getNbHits( ) const { return nb_hits_; };
+    /**
+    * Get the number of matchers trained
+    * @return number of misses since the last resetStatistics( )
+    */
+    inline unsigned int getNbMisses( ) const { return nb_misses_; };
+    /**
+    * Get the number of matchers released because of the memory budget
+    * @return number of evictions since the last resetStatistics( )
+    */
+    inline unsigned int getNbEvictions( ) const { return nb_evictions_; };
+
+  protected:
+    /**
+    * \brief The cached matcher of an image.
+    */
+    struct CacheEntry
+    {
+      cv::Ptr<PointsMatcher> matcher;///<trained matcher (empty if not cached)
+      cv::Ptr<PointsToTrack> points;///<points used to train the matcher
+      size_t memory;///<memory used by matcher
+      bool in_lru;///<true if the entry is in lru_
+      std::list<unsigned int>::iterator lru_pos;///<position in lru_
+      /**
+      * Only one thread can train the matcher of an image.
+      */
+      DECLARE_MUTEX( training );
+
+      CacheEntry( );
+    };
+
+    /**
+    * Move an entry at the beginning of the LRU list
+    * (cache_mutex has to be locked)
+    */
+    void touch( unsigned int idx_image );
+    /**
+    * Release the least recently used matchers until the memory budget is
+    * respected. The most recent matcher is always kept.
+    * (cache_mutex has to be locked)
+    */
+    void evict( );
+
+    DECLARE_MUTEX( cache_mutex );///<protect every members
+    std::vector< cv::Ptr< CacheEntry > > entries_;///<entry of each image
+    std::list< unsigned int > lru_;///<cached images, most recently used first
+    size_t memory_budget_;///<maximum memory used by the trained matchers
+    size_t memory_used_;///<memory used by the trained matchers
+    unsigned int nb_hits_;///<number of requests answered with a cached matcher
+    unsigned int nb_misses_;///<number of matchers trained
+    unsigned int nb_evictions_;///<number of matchers released
+  };
+
+}
+
+#endif
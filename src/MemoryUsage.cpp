@@ -0,0 +1,34 @@
+#include "MemoryUsage.h"
+
+#if ( defined WIN32 || defined _WIN32 || defined WINCE )
+#include <windows.h>
+#include <psapi.h>
+#if defined _MSC_VER
+#pragma comment( lib, "psapi.lib" )
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+namespace OpencvSfM{
+
+  size_t getPeakMemoryUsage( )
+  {
+#if ( defined WIN32 || defined _WIN32 || defined WINCE )
+    PROCESS_MEMORY_COUNTERS counters;
+    if( GetProcessMemoryInfo( GetCurrentProcess( ), &counters, sizeof( counters ) ) )
+      return ( size_t )counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+      return 0;
+#if defined __APPLE__
+    return ( size_t )usage.ru_maxrss;//already in bytes
+#else
+    return ( size_t )usage.ru_maxrss * 1024;//in kilobytes
+#endif
+#endif
+  }
+
+}
@@ -0,0 +1,19 @@
+#ifndef _GSOC_SFM_MEMORY_USAGE_H
+#define _GSOC_SFM_MEMORY_USAGE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <cstddef>
+
+namespace OpencvSfM{
+
+  /**
+  * Get the peak resident set size (maximum physical memory used) of the
+  * process since its start.
+  * @return peak memory usage in bytes, 0 if not available on this system
+  */
+  SFM_EXPORTS size_t getPeakMemoryUsage( );
+
+}
+
+#endif
@@ -129,6 +129,36 @@ namespace OpencvSfM{
   };
 
   cv::Mat MotionProcessor::getFrame( )
+  {
+    return convertFrame( getRawFrame( ) );
+  }
+
+  FramesReader::FramesReader( const MotionProcessor& source )
+    :source_( source )
+  {
+    CV_Assert( source_.isBidirectional( ) );
+    INIT_MUTEX( reading_lock_ );
+  }
+
+  cv::Mat FramesReader::getFrame( unsigned int idx )
+  {
+    if( source_.isRandomAccess( ) )
+      return source_.convertFrame( source_.getRawFrame( idx ) );
+    P_MUTEX( reading_lock_ );
+    source_.setProperty( CV_CAP_PROP_POS_FRAMES, idx );
+    Mat frame = source_.getFrame( );
+    V_MUTEX( reading_lock_ );
+    return frame;
+  }
+
+  cv::Mat MotionProcessor::getRawFrame( unsigned int idx ) const
+  {
+    if( !isRandomAccess( ) || idx >= nameOfFiles_.size( ) )
+      return Mat( );
+    return imread( nameOfFiles_[ idx ],convertToRGB_ );
+  }
+
+  cv::Mat MotionProcessor::getRawFrame( )
   {
     Mat imgTmp;
 
@@ -190,7 +220,11 @@ namespace OpencvSfM{
         break;
       }
     }
+    return imgTmp;
+  }
 
+  cv::Mat MotionProcessor::convertFrame( cv::Mat imgTmp ) const
+  {
     if( !imgTmp.empty( ) )
     {
       //now we ensure the file as the good properties:
@@ -246,7 +280,8 @@ namespace OpencvSfM{
       break;
     case CV_CAP_PROP_POS_FRAMES:// 0-based index of the frame to be decoded/captured next
       {
-        if( type_of_input_==IS_LIST_FILES||type_of_input_==IS_SINGLE_FILE )
+        if( type_of_input_==IS_LIST_FILES||type_of_input_==IS_SINGLE_FILE||
+          type_of_input_==IS_DIRECTORY )
         {
           if( _value>=0&&_value<=nameOfFiles_.size( ) )
             numFrame_=( unsigned int )_value;
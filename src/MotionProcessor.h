@@ -4,6 +4,7 @@
 #include "macro.h" //SFM_EXPORTS
 
 #include "opencv2/highgui/highgui.hpp"
+#include "config_SFM.h"//semaphore...
 #include <vector>
 #include <string>
 
@@ -71,6 +72,14 @@ namespace OpencvSfM{
       return type_of_input_ != IS_WEBCAM;
     }
     /**
+    * Get the type of the input source
+    * @return type of input ( webcam, video file, list of files... )
+    */
+    inline TypeOfMotionProcessor getTypeOfInput( ) const
+    {
+      return type_of_input_;
+    }
+    /**
     * You can attach this motion handler to a webcam
     * use this method to set it as the input source!
     * @param idWebCam id of the webcam
@@ -108,6 +117,37 @@ namespace OpencvSfM{
     */
     cv::Mat getFrame( );
     /**
+    * Get the next frame, without the colors and size conversions of
+    * getFrame( ) (see convertFrame).
+    * @return The current frame, empty if the video is finished.
+    */
+    cv::Mat getRawFrame( );
+    /**
+    * Get a frame of a directory or of a list of files without changing
+    * the current position, so it can be called from several threads.
+    * Colors and size conversions are not done (see convertFrame).
+    * @param idx index of the wanted frame
+    * @return the frame, empty if idx is out of range or if the source is not random access
+    */
+    cv::Mat getRawFrame( unsigned int idx ) const;
+    /**
+    * Apply the colors and size conversions wanted (see setProperty) to a
+    * frame returned by getRawFrame.
+    * @param frame raw frame
+    * @return converted frame
+    */
+    cv::Mat convertFrame( cv::Mat frame ) const;
+    /**
+    * Use this function to know if any frame can be read directly, without
+    * reading the previous ones (directory or static list of files).
+    * @return true if getRawFrame( idx ) can be used
+    */
+    inline bool isRandomAccess( ) const
+    {
+      return type_of_input_ == IS_DIRECTORY ||
+        ( type_of_input_ == IS_LIST_FILES && suffix_ == "Not a dynamic list" );
+    }
+    /**
     * use this method to change the properties of pictures retrived by this MotionProcessor.
     * the properties are the same than VideoCapture ( see http://opencv.willowgarage.com/documentation/cpp/reading_and_writing_images_and_video.html#cv-videocapture-get )
     * @param idProp Property identifier
@@ -122,6 +162,32 @@ namespace OpencvSfM{
     */
     double getProperty( int idProp );
   };
+
+  /*! \brief This class reads again the frames of a finite sequence when
+  * they are needed, so they don't have to be kept in memory (see the
+  * streaming mode of SequenceAnalyzer).
+  * It can be shared by several objects and threads: frames of random access
+  * sources are read in parallel, frames of videos one after the other.
+  */
+  class SFM_EXPORTS FramesReader
+  {
+  protected:
+    MotionProcessor source_;///<copy of the sequence
+    DECLARE_MUTEX( reading_lock_ );///<protect the position of videos
+  public:
+    /**
+    * Create a reader of the frames of a sequence.
+    * @param source sequence (copied), it has to be bidirectional
+    */
+    FramesReader( const MotionProcessor& source );
+    /**
+    * Read a frame again, with the conversions of the sequence.
+    * The frame is not kept by the reader.
+    * @param idx index of the frame
+    * @return the frame, empty if idx is out of range
+    */
+    cv::Mat getFrame( unsigned int idx );
+  };
 }
 
 #endif
\ No newline at end of file
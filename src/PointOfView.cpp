@@ -141,101 +141,61 @@ namespace OpencvSfM{
 
   cv::Vec2d PointOfView::project3DPointIntoImage( cv::Vec3d point ) const
   {
-    //As we don't know what type of camera we use ( with/without disportion, fisheyes... )
-    //we can't use classic projection matrix P = K . [ R|t ]
-    //Instead, we first compute points transformation into camera's system and then compute
-    //pixel coordinate using camera device function.
-
-    //As we need Mat object to compute projection, we create temporary objects:
-    Mat mat3DNorm( 4,1,CV_64F );
-    double* point3DNorm=( double* )mat3DNorm.data;
-    Mat mat2DNorm( 3,1,CV_64F );
-    double* point2DNorm=( double* )mat2DNorm.data;
-
-    vector<Vec2d> pointsOut;
-    point3DNorm[ 0 ] = point[ 0 ];
-    point3DNorm[ 1 ] = point[ 1 ];
-    point3DNorm[ 2 ] = point[ 2 ];
-    point3DNorm[ 3 ] = 1;
-
-    //transform points into camera's coordinates:
-    mat2DNorm = ( projection_matrix_ * mat3DNorm );
-    pointsOut.push_back( Vec2d( point2DNorm[ 0 ]/point2DNorm[ 2 ],point2DNorm[ 1 ]/point2DNorm[ 2 ] ));
-
-    //transform points into pixel coordinates using camera intra parameters:
-    pointsOut = device_->normImageToPixelCoordinates( pointsOut );
-    Vec2d pointOut = pointsOut[ 0 ];
-    return pointsOut[ 0 ];
+    Vec2d pointOut;
+    project3DPointsIntoImage( &point, &pointOut, 1 );
+    return pointOut;
   }
   std::vector< cv::Vec2d > PointOfView::project3DPointsIntoImage(
     std::vector< cv::Vec3d > points ) const
   {
-    //As we don't know what type of camera we use ( with/without disportion, fisheyes... )
-    //we can't use classic projection matrix P = K . [ R|t ]
-    //Instead, we first compute points transformation into camera's system and then compute
-    //pixel coordinate using camera device function.
-
-    //As we need Mat object to compute projection, we create temporary objects:
-    Mat mat3DNorm( 4,1,CV_64F );
-    double* point3DNorm=( double* )mat3DNorm.data;
-    Mat mat2DNorm( 3,1,CV_64F );
-    double* point2DNorm=( double* )mat2DNorm.data;
-
-    vector<Vec2d> pointsOut;
-    vector<Vec3d>::iterator point=points.begin( );
+    vector<Vec2d> pointsOut( points.size( ) );
+    if( !points.empty( ) )
+      project3DPointsIntoImage( &points[ 0 ], &pointsOut[ 0 ], points.size( ) );
+    return pointsOut;
+  }
+  std::vector< cv::Vec2d > PointOfView::project3DPointsIntoImage(
+    std::vector<TrackOfPoints> points ) const
+  {
+    vector<Vec3d> points3D;
+    points3D.reserve( points.size( ) );
+    vector<TrackOfPoints>::iterator point=points.begin( );
     while( point!=points.end( ) )
     {
-      point3DNorm[ 0 ] = ( *point )[ 0 ];
-      point3DNorm[ 1 ] = ( *point )[ 1 ];
-      point3DNorm[ 2 ] = ( *point )[ 2 ];
-      point3DNorm[ 3 ] = 1;
-
-      //transform points into camera's coordinates:
-      mat2DNorm = ( projection_matrix_ * mat3DNorm );
-
-      pointsOut.push_back( Vec2d( point2DNorm[ 0 ]/point2DNorm[ 2 ],point2DNorm[ 1 ]/point2DNorm[ 2 ] ));
-
+      cv::Ptr<Vec3d> convert_from_track = point->get3DPosition();
+      if( !convert_from_track.empty() )
+        points3D.push_back( *convert_from_track );
       point++;
     }
-    //transform points into pixel coordinates using camera intra parameters:
-    return device_->normImageToPixelCoordinates( pointsOut );
+    return project3DPointsIntoImage( points3D );
   }
-  std::vector< cv::Vec2d > PointOfView::project3DPointsIntoImage(
-    std::vector<TrackOfPoints> points ) const
+  void PointOfView::project3DPointsIntoImage( const cv::Vec3d* points,
+    cv::Vec2d* pixels, size_t nb_points ) const
   {
     //As we don't know what type of camera we use ( with/without disportion, fisheyes... )
     //we can't use classic projection matrix P = K . [ R|t ]
     //Instead, we first compute points transformation into camera's system and then compute
     //pixel coordinate using camera device function.
-
-    //As we need Mat object to compute projection, we create temporary objects:
-    Mat mat3DNorm( 4,1,CV_64F );
-    double* point3DNorm=( double* )mat3DNorm.data;
-    Mat mat2DNorm( 3,1,CV_64F );
-    double* point2DNorm=( double* )mat2DNorm.data;
-
-    vector<Vec2d> pointsOut;
-    vector<TrackOfPoints>::iterator point=points.begin( );
-    while( point!=points.end( ) )
+    const double* P0 = projection_matrix_.ptr<double>( 0 );
+    const double* P1 = projection_matrix_.ptr<double>( 1 );
+    const double* P2 = projection_matrix_.ptr<double>( 2 );
+    const double r00 = P0[ 0 ], r01 = P0[ 1 ], r02 = P0[ 2 ], t0 = P0[ 3 ],
+      r10 = P1[ 0 ], r11 = P1[ 1 ], r12 = P1[ 2 ], t1 = P1[ 3 ],
+      r20 = P2[ 0 ], r21 = P2[ 1 ], r22 = P2[ 2 ], t2 = P2[ 3 ];
+
+    //transform points into camera's coordinates (the pixels buffer is used
+    //to store normalized coordinates):
+    const double* in = points->val;
+    double* out = pixels->val;
+    for( size_t i = 0; i < nb_points; ++i )
     {
-      cv::Ptr<Vec3d> convert_from_track = point->get3DPosition();
-      if( !convert_from_track.empty() )
-      {
-        point3DNorm[ 0 ] = (*convert_from_track)[ 0 ];
-        point3DNorm[ 1 ] = (*convert_from_track)[ 1 ];
-        point3DNorm[ 2 ] = (*convert_from_track)[ 2 ];
-        point3DNorm[ 3 ] = 1;
-
-        //transform points into camera's coordinates:
-        mat2DNorm = ( projection_matrix_ * mat3DNorm );
-
-        pointsOut.push_back( Vec2d( point2DNorm[ 0 ]/point2DNorm[ 2 ],point2DNorm[ 1 ]/point2DNorm[ 2 ] ));
-      }
-
-      point++;
+      double X = in[ 3 * i ], Y = in[ 3 * i + 1 ], Z = in[ 3 * i + 2 ];
+      double inv_z = 1.0 / ( r20 * X + r21 * Y + r22 * Z + t2 );
+      out[ 2 * i ] = ( r00 * X + r01 * Y + r02 * Z + t0 ) * inv_z;
+      out[ 2 * i + 1 ] = ( r10 * X + r11 * Y + r12 * Z + t1 ) * inv_z;
     }
+
     //transform points into pixel coordinates using camera intra parameters:
-    return device_->normImageToPixelCoordinates( pointsOut );
+    device_->normImageToPixelBatch( pixels, pixels, nb_points );
   }
 
   bool PointOfView::pointInFrontOfCamera( cv::Vec4d point ) const
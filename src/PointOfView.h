@@ -108,6 +108,16 @@ namespace OpencvSfM{
     */
     virtual cv::Vec2d project3DPointIntoImage( cv::Vec3d point ) const;
     /**
+    * Batch projection of 3D points from world coordinates to pixel image
+    * coordinates. Works on contiguous buffers and doesn't allocate memory
+    * (if the camera implements Camera::normImageToPixelBatch).
+    * @param points 3D points in world coordinates.
+    * @param pixels [out] 2D points in pixel image coordinates.
+    * @param nb_points number of points to project
+    */
+    void project3DPointsIntoImage( const cv::Vec3d* points, cv::Vec2d* pixels,
+      size_t nb_points ) const;
+    /**
     * This method test is 3D point is in front of Camera ( can be view with the camera )
     * @param point 3D point in world coordinates ( homogeneous, that is 4 values ).
     * @return true if point can be seen with this point of view
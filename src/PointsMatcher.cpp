@@ -21,20 +21,26 @@ namespace OpencvSfM{
   {
     CV_DbgAssert( !matcher.empty( ) );
     matcher_ = matcher;
+    is_trained_ = false;
     INIT_MUTEX( thread_concurr );
+    INIT_MUTEX( training_concurr );
   }
 
   PointsMatcher::PointsMatcher( )
   {
     matcher_ = NULL;
+    is_trained_ = false;
     INIT_MUTEX( thread_concurr );
+    INIT_MUTEX( training_concurr );
   }
 
   PointsMatcher::PointsMatcher( const PointsMatcher& copy )
   {
     INIT_MUTEX( thread_concurr );
+    INIT_MUTEX( training_concurr );
     pointCollection_=copy.pointCollection_;
     matcher_ = copy.matcher_->clone( true );
+    is_trained_ = false;//the training data are not copied
   }
 
   PointsMatcher::~PointsMatcher( void )
@@ -52,6 +58,7 @@ namespace OpencvSfM{
   {
     P_MUTEX( thread_concurr );
     pointCollection_.push_back( pointCollection );
+    is_trained_ = false;
     V_MUTEX( thread_concurr );
   }
 
@@ -59,6 +66,7 @@ namespace OpencvSfM{
   {
     P_MUTEX( thread_concurr );
     matcher_->clear( );
+    is_trained_ = false;
     /*
     for(size_t i = 0; i<pointCollection_.size(); ++i)
       pointCollection_[i]->free_descriptors();
@@ -91,9 +99,31 @@ namespace OpencvSfM{
 
     matcher_->add( pointsDesc );
     matcher_->train( );
+    is_trained_ = true;
     V_MUTEX( thread_concurr );
   }
 
+  void PointsMatcher::trainIfNeeded( )
+  {
+    if( is_trained_ )
+      return;
+    P_MUTEX( training_concurr );
+    if( !is_trained_ )
+      train( );
+    V_MUTEX( training_concurr );
+  }
+
+  size_t PointsMatcher::getMemoryUsage( ) const
+  {
+    if( matcher_.empty( ) )
+      return 0;
+    size_t memory = 0;
+    const vector<Mat>& descriptors = matcher_->getTrainDescriptors( );
+    for( size_t i = 0; i < descriptors.size( ); ++i )
+      memory += descriptors[ i ].total( ) * descriptors[ i ].elemSize( );
+    return memory;
+  }
+
   bool PointsMatcher::isMaskSupported( )
   {
     return matcher_->isMaskSupported( );
@@ -103,9 +133,9 @@ namespace OpencvSfM{
     std::vector<cv::DMatch>& matches,
     const std::vector<cv::Mat>& masks )
   {
-    train( );
+    trainIfNeeded( );
 
-    P_MUTEX( thread_concurr );
+    //the trained matcher is only read, no need to lock:
     queryPoints->computeKeypointsAndDesc( false );
 
     vector<KeyPoint> keyPoints=queryPoints->getKeypoints( );
@@ -115,7 +145,6 @@ namespace OpencvSfM{
     CV_DbgAssert( !descMat.empty( ) );
 
     matcher_->match( descMat, matches, masks );
-    V_MUTEX( thread_concurr );
 
     queryPoints->free_descriptors();
   }
@@ -124,9 +153,9 @@ namespace OpencvSfM{
     vector<vector<DMatch> >& matches, int knn,
     const vector<Mat>& masks, bool compactResult )
   {
-    train( );
+    trainIfNeeded( );
 
-    P_MUTEX( thread_concurr );
+    //the trained matcher is only read, no need to lock:
     queryPoints->computeKeypointsAndDesc( false );
 
     vector<KeyPoint> keyPoints=queryPoints->getKeypoints( );
@@ -136,7 +165,6 @@ namespace OpencvSfM{
     CV_DbgAssert( !descMat.empty( ) );
 
     matcher_->knnMatch( descMat, matches, knn, masks, compactResult );
-    V_MUTEX( thread_concurr );
 
     queryPoints->free_descriptors();
   }
@@ -145,9 +173,9 @@ namespace OpencvSfM{
     vector<vector<DMatch> >& matches, float maxDistance,
     const vector<Mat>& masks, bool compactResult )
   {
-    train( );
+    trainIfNeeded( );
 
-    P_MUTEX( thread_concurr );
+    //the trained matcher is only read, no need to lock:
     queryPoints->computeKeypointsAndDesc( false );
 
     vector<KeyPoint> keyPoints=queryPoints->getKeypoints( );
@@ -157,7 +185,6 @@ namespace OpencvSfM{
     CV_DbgAssert( !descMat.empty( ) );
 
     matcher_->radiusMatch( descMat, matches, maxDistance, masks, compactResult );
-    V_MUTEX( thread_concurr );
 
     queryPoints->free_descriptors();
   }
@@ -182,7 +209,7 @@ namespace OpencvSfM{
     vector<DMatch>& matches,
     const std::vector<cv::Mat>& masks )
   {
-    train( );
+    trainIfNeeded( );
 
     //TODO: for now this function only work with matcher having only one picture
     CV_DbgAssert( this->pointCollection_.size( )==1 );
@@ -197,22 +224,29 @@ namespace OpencvSfM{
 
     //now construct the vector of DMatch, but in the other way ( 2 -> 1 ):
     vector<DMatch> matchesOtherWay;
-    P_MUTEX( thread_concurr );
     otherMatcher->match( pointCollection_[ 0 ], matchesOtherWay, masks );
-    V_MUTEX( thread_concurr );
 
-    //now check for reciprocity:
+    //now check for reciprocity. match() gives at most one match per query
+    //point, so reverse_match[ k ] is the point of the other image matched
+    //with the k-th point of this image (or -1):
     size_t nbPoints = matches.size( ),
       nbPoints1 = matchesOtherWay.size( );
+    int max_idx = -1;
+    for( size_t j=0; j<nbPoints1; ++j )
+      max_idx = std::max( max_idx, matchesOtherWay[ j ].queryIdx );
+    vector<int> reverse_match( max_idx + 1, -1 );
+    for( size_t j=0; j<nbPoints1; ++j )
+    {
+      const DMatch& d2=matchesOtherWay[ j ];
+      if( d2.queryIdx >= 0 )
+        reverse_match[ d2.queryIdx ] = d2.trainIdx;
+    }
+
     for( size_t i=0; i<nbPoints; i++ )
     {
-      DMatch d1=matches[ i ];
-      bool found = false;
-      for( size_t j=0; j<nbPoints1 && !found ; ++j )
-      {
-        DMatch d2=matchesOtherWay[ j ];
-        found = (d1.trainIdx == d2.queryIdx) && (d1.queryIdx == d2.trainIdx);
-      }
+      const DMatch& d1=matches[ i ];
+      bool found = d1.trainIdx >= 0 && d1.trainIdx <= max_idx &&
+        reverse_match[ d1.trainIdx ] == d1.queryIdx;
       if( !found )
       {
         //remove the current match!
@@ -320,6 +354,25 @@ namespace OpencvSfM{
     fs << "]";
   }
 
+  void PointsMatcher::read( cv::Ptr<FeaturesStore> store,
+    PointsMatcher& points )
+  {
+    CV_Assert( !store.empty( ) );
+    unsigned int nb_images = store->getNbImages( );
+    for( unsigned int i = 0; i < nb_images; ++i )
+    {
+      Ptr<PointsToTrack> ptt_tmp = Ptr<PointsToTrack>( new PointsToTrack( i ));
+      PointsToTrack::read( store, i, *ptt_tmp );
+      points.pointCollection_.push_back( ptt_tmp );
+    }
+  }
+
+  void PointsMatcher::write( const std::string& filename,
+    const PointsMatcher& points )
+  {
+    FeaturesStore::write( filename, points.pointCollection_ );
+  }
+
   
   PointsMatcherOpticalFlow::PointsMatcherOpticalFlow( std::string name_of_algo,
     double dist_allowed )
@@ -360,8 +413,7 @@ namespace OpencvSfM{
     std::vector<cv::DMatch>& matches,
     const std::vector<cv::Mat>& masks )
   {
-    P_MUTEX( thread_concurr );
-
+    //nothing to train, keypoints are computed under the lock of PointsToTrack:
     if(pointCollection_[0]->getKeypoints( ).empty())
       pointCollection_[0]->computeKeypoints();
     const vector<KeyPoint>& keyPoints=pointCollection_[0]->getKeypoints( );
@@ -370,6 +422,7 @@ namespace OpencvSfM{
     vector<uchar> status;
     vector<float> error;
 
+    //released images (streaming mode) are read again for this match only:
     cv::Mat img1 = pointCollection_[0]->getImage();
     cv::Mat img2 = queryPoints->getImage();
     CV_Assert( !img1.empty() && !img2.empty()  );
@@ -430,7 +483,6 @@ namespace OpencvSfM{
         matches.push_back( cv::DMatch(idx_min, cpt, dist_min) );//not really the correct dist...
       }
     }
-    V_MUTEX( thread_concurr );
   }
 
   void PointsMatcherOpticalFlow::knnMatch(  Ptr<PointsToTrack> queryPoints,
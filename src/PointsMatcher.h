@@ -10,6 +10,7 @@
 
 namespace OpencvSfM{
   class SFM_EXPORTS PointsToTrack;
+  class SFM_EXPORTS FeaturesStore;
   /*! \brief A class used for matching descriptors that can be described as vectors in a finite-dimensional space
   *
   * Any Matcher that inherit from DescriptorMatcher can be used ( For example, you can use FlannBasedMatcher or BruteForceMatcher ).
@@ -57,6 +58,24 @@ namespace OpencvSfM{
     */
     virtual void train( );
     /**
+    * Use to know if the training data are up to date (train() was called
+    * since the last add() or clear()). Matching methods only train the
+    * matcher when this is false.
+    * @return true if the matcher is trained
+    */
+    inline bool isTrained( ) const { return is_trained_; };
+    /**
+    * Train the matcher if it's not trained yet. If several threads call
+    * this method at the same time, the matcher is trained only once.
+    */
+    void trainIfNeeded( );
+    /**
+    * Estimate the memory used by the training data of this matcher
+    * (the train descriptors, the search structures are not counted).
+    * @return memory in bytes
+    */
+    virtual size_t getMemoryUsage( ) const;
+    /**
     * Use this method to know if mask are supported with current matcher
     * @return true if matcher can use mask
     */
@@ -112,6 +131,8 @@ namespace OpencvSfM{
     /**
     * Using an other matchers given in parameters, recompute a matching in inverse order
     * and keep only matches which are two-ways.
+    * otherMatcher is not trained again if it's already trained, and the
+    * reciprocity is checked in linear time using a lookup table.
     * @param otherMatcher Query set of points and descriptors.
     * @param matches First guess of matches... Will be updated to contain only
     * two-way matches ( can be empty ).
@@ -166,6 +187,20 @@ namespace OpencvSfM{
     */
     static void write( cv::FileStorage& fs, const PointsMatcher& points );
 
+    /**
+    * Load the matches from a binary FeaturesStore (descriptors are not copied).
+    * @param store previously opened binary file
+    * @param points output
+    */
+    static void read( cv::Ptr<FeaturesStore> store, PointsMatcher& points );
+
+    /**
+    * Save the matches into a binary FeaturesStore, faster than YAML.
+    * @param filename name of the file to create
+    * @param points sequence to save...
+    */
+    static void write( const std::string& filename, const PointsMatcher& points );
+
     /**
     * Get a keypoint
     * @param numKey index of the wanted point
@@ -177,9 +212,13 @@ namespace OpencvSfM{
     
     /**
     * In order to be able to match points in threads, we have to
-    * take care of interprocess access.
+    * take care of interprocess access. Only the training data are
+    * protected: searches on a trained matcher only read them, so several
+    * threads can use the same trained matcher at the same time (the
+    * matcher shouldn't be trained again while it's used).
     */
     DECLARE_MUTEX( thread_concurr );
+    DECLARE_MUTEX( training_concurr );///<Only one thread trains the matcher in trainIfNeeded
 
     /**
     * This constructor is only available for inherited classes!
@@ -188,6 +227,7 @@ namespace OpencvSfM{
 
     cv::Ptr<cv::DescriptorMatcher> matcher_;///<Algorithm used to find matches...
     std::vector< cv::Ptr< PointsToTrack > > pointCollection_;///<Vector of points used to compute matches...
+    bool is_trained_;///<true if matcher_ is trained with the current pointCollection_
   };
   
   /*! \brief A class used for matching points between two images
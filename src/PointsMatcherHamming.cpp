@@ -0,0 +1,569 @@
+#include "PointsMatcherHamming.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "PointsToTrack.h"
+
+//////////////////////////////////////////////////////////////////////////
+//SIMD kernels are compiled with target attributes (GCC, clang) so the
+//rest of the library doesn't need -mavx2. The CPU is tested at runtime.
+//////////////////////////////////////////////////////////////////////////
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#  if defined( __clang__ )
+#    if __clang_major__ >= 4
+#      define SFM_HAMMING_AVX2 1
+#    endif
+#    if __clang_major__ >= 8
+#      define SFM_HAMMING_AVX512 1
+#    endif
+#  elif defined( __GNUC__ )
+#    if __GNUC__ >= 5
+#      define SFM_HAMMING_AVX2 1
+#    endif
+#    if __GNUC__ >= 8
+#      define SFM_HAMMING_AVX512 1
+#    endif
+#  elif defined( _MSC_VER ) && _MSC_VER >= 1700
+#    define SFM_HAMMING_AVX2 1
+#  endif
+#endif
+
+#if defined( SFM_HAMMING_AVX2 ) || defined( SFM_HAMMING_AVX512 )
+#  include <immintrin.h>
+#  if defined( _MSC_VER )
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined( _MSC_VER )
+#  define SFM_TARGET_AVX2
+#else
+#  define SFM_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#  define SFM_TARGET_AVX512 __attribute__(( target( "avx2,avx512f,avx512vpopcntdq" ) ))
+#endif
+
+namespace OpencvSfM{
+  using cv::Mat;
+  using cv::Ptr;
+  using std::vector;
+  using cv::DMatch;
+  using boost::uint64_t;
+
+  //number of trains (and queries) processed by block. A block of trains
+  //(512*32 bytes for ORB) and a block of queries stay in L1/L2 cache:
+  static const size_t TRAIN_BLOCK = 512;
+  static const size_t QUERY_BLOCK = 32;
+
+  /**
+  * A kernel computes the distances between one query and nb_trains
+  * consecutive train descriptors of nb_words 64 bits words.
+  */
+  typedef void ( *HammingKernelFunc )( const uint64_t* query,
+    const uint64_t* trains, size_t nb_trains, size_t nb_words,
+    unsigned int* distances );
+
+  static inline unsigned int popcount64( uint64_t x )
+  {
+    x = x - ( ( x >> 1 ) & 0x5555555555555555ULL );
+    x = ( x & 0x3333333333333333ULL ) + ( ( x >> 2 ) & 0x3333333333333333ULL );
+    x = ( x + ( x >> 4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+    return ( unsigned int )( ( x * 0x0101010101010101ULL ) >> 56 );
+  }
+
+  static void hammingScalar( const uint64_t* query, const uint64_t* trains,
+    size_t nb_trains, size_t nb_words, unsigned int* distances )
+  {
+    for( size_t t = 0; t < nb_trains; ++t, trains += nb_words )
+    {
+      unsigned int dist = 0;
+      for( size_t w = 0; w < nb_words; ++w )
+        dist += popcount64( query[ w ] ^ trains[ w ] );
+      distances[ t ] = dist;
+    }
+  }
+
+#ifdef SFM_HAMMING_AVX2
+  //popcount of each byte using a nibble lookup table, then sum of the
+  //bytes into four 64 bits integers:
+  SFM_TARGET_AVX2 static inline __m256i popcountAVX2( __m256i x )
+  {
+    const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+    const __m256i low_mask = _mm256_set1_epi8( 0x0f );
+    __m256i lo = _mm256_and_si256( x, low_mask );
+    __m256i hi = _mm256_and_si256( _mm256_srli_epi16( x, 4 ), low_mask );
+    __m256i cnt = _mm256_add_epi8( _mm256_shuffle_epi8( lookup, lo ),
+      _mm256_shuffle_epi8( lookup, hi ) );
+    return _mm256_sad_epu8( cnt, _mm256_setzero_si256( ) );
+  }
+
+  SFM_TARGET_AVX2 static inline unsigned int sumAVX2( __m256i acc )
+  {
+    __m128i s = _mm_add_epi64( _mm256_castsi256_si128( acc ),
+      _mm256_extracti128_si256( acc, 1 ) );
+    s = _mm_add_epi64( s, _mm_unpackhi_epi64( s, s ) );
+    return ( unsigned int )_mm_cvtsi128_si32( s );
+  }
+
+  SFM_TARGET_AVX2 static void hammingAVX2( const uint64_t* query,
+    const uint64_t* trains, size_t nb_trains, size_t nb_words,
+    unsigned int* distances )
+  {
+    if( nb_words == 4 )
+    {//256 bits descriptors (ORB, BRIEF-32): the query stays in a register
+      __m256i q = _mm256_loadu_si256( ( const __m256i* )query );
+      for( size_t t = 0; t < nb_trains; ++t, trains += 4 )
+      {
+        __m256i x = _mm256_xor_si256( q,
+          _mm256_loadu_si256( ( const __m256i* )trains ) );
+        distances[ t ] = sumAVX2( popcountAVX2( x ) );
+      }
+      return;
+    }
+    for( size_t t = 0; t < nb_trains; ++t, trains += nb_words )
+    {
+      __m256i acc = _mm256_setzero_si256( );
+      for( size_t w = 0; w < nb_words; w += 4 )
+      {
+        __m256i x = _mm256_xor_si256(
+          _mm256_loadu_si256( ( const __m256i* )( query + w ) ),
+          _mm256_loadu_si256( ( const __m256i* )( trains + w ) ) );
+        acc = _mm256_add_epi64( acc, popcountAVX2( x ) );
+      }
+      distances[ t ] = sumAVX2( acc );
+    }
+  }
+#endif
+
+#ifdef SFM_HAMMING_AVX512
+  SFM_TARGET_AVX512 static void hammingAVX512( const uint64_t* query,
+    const uint64_t* trains, size_t nb_trains, size_t nb_words,
+    unsigned int* distances )
+  {
+    if( nb_words == 4 )
+    {//two 256 bits trains in each register, 8 trains at a time:
+      __m256i q256 = _mm256_loadu_si256( ( const __m256i* )query );
+      __m512i q = _mm512_inserti64x4( _mm512_castsi256_si512( q256 ), q256, 1 );
+      const __m256i order = _mm256_setr_epi32( 0, 2, 1, 3, 4, 6, 5, 7 );
+      size_t t = 0;
+      for( ; t + 8 <= nb_trains; t += 8, trains += 32 )
+      {
+        __m512i a = _mm512_popcnt_epi64( _mm512_xor_si512( q,
+          _mm512_loadu_si512( trains ) ) );
+        __m512i b = _mm512_popcnt_epi64( _mm512_xor_si512( q,
+          _mm512_loadu_si512( trains + 8 ) ) );
+        __m512i c = _mm512_popcnt_epi64( _mm512_xor_si512( q,
+          _mm512_loadu_si512( trains + 16 ) ) );
+        __m512i d = _mm512_popcnt_epi64( _mm512_xor_si512( q,
+          _mm512_loadu_si512( trains + 24 ) ) );
+        //sum the two words of each 128 bits lane:
+        __m512i ab = _mm512_add_epi64( _mm512_unpacklo_epi64( a, b ),
+          _mm512_unpackhi_epi64( a, b ) );
+        __m512i cd = _mm512_add_epi64( _mm512_unpacklo_epi64( c, d ),
+          _mm512_unpackhi_epi64( c, d ) );
+        //then the two lanes of each train:
+        __m512i sum = _mm512_add_epi64(
+          _mm512_shuffle_i64x2( ab, cd, _MM_SHUFFLE( 2, 0, 2, 0 ) ),
+          _mm512_shuffle_i64x2( ab, cd, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+        //sum contains trains 0,2,1,3,4,6,5,7:
+        _mm256_storeu_si256( ( __m256i* )( distances + t ),
+          _mm256_permutevar8x32_epi32( _mm512_cvtepi64_epi32( sum ), order ) );
+      }
+      for( ; t < nb_trains; ++t, trains += 4 )
+      {
+        __m512i cnt = _mm512_popcnt_epi64( _mm512_xor_si512( q,
+          _mm512_maskz_loadu_epi64( 0x0F, trains ) ) );
+        distances[ t ] = ( unsigned int )
+          _mm512_mask_reduce_add_epi64( 0x0F, cnt );
+      }
+      return;
+    }
+    //nb_words is a multiple of 4, so the last load is half or full:
+    for( size_t t = 0; t < nb_trains; ++t, trains += nb_words )
+    {
+      __m512i acc = _mm512_setzero_si512( );
+      for( size_t w = 0; w < nb_words; w += 8 )
+      {
+        __mmask8 mask = ( w + 8 <= nb_words ) ? 0xFF : 0x0F;
+        __m512i x = _mm512_xor_si512(
+          _mm512_maskz_loadu_epi64( mask, query + w ),
+          _mm512_maskz_loadu_epi64( mask, trains + w ) );
+        acc = _mm512_add_epi64( acc, _mm512_popcnt_epi64( x ) );
+      }
+      distances[ t ] = ( unsigned int )_mm512_reduce_add_epi64( acc );
+    }
+  }
+#endif
+
+  static HammingKernelFunc getKernelFunc( PointsMatcherHamming::KernelType kernel )
+  {
+    switch( kernel )
+    {
+#ifdef SFM_HAMMING_AVX2
+    case PointsMatcherHamming::KERNEL_AVX2:
+      return hammingAVX2;
+#endif
+#ifdef SFM_HAMMING_AVX512
+    case PointsMatcherHamming::KERNEL_AVX512:
+      return hammingAVX512;
+#endif
+    default:
+      return hammingScalar;
+    }
+  }
+
+  bool PointsMatcherHamming::isKernelSupported( KernelType kernel )
+  {
+    switch( kernel )
+    {
+    case KERNEL_AUTO:
+    case KERNEL_SCALAR:
+      return true;
+#if defined( SFM_HAMMING_AVX2 ) && defined( _MSC_VER )
+    case KERNEL_AVX2:
+      {
+        int info[ 4 ];
+        __cpuid( info, 0 );
+        if( info[ 0 ] < 7 )
+          return false;
+        __cpuid( info, 1 );
+        //the OS has to save the AVX registers:
+        if( ( info[ 2 ] & ( 1 << 27 ) ) == 0 || ( _xgetbv( 0 ) & 6 ) != 6 )
+          return false;
+        __cpuidex( info, 7, 0 );
+        return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+      }
+#elif defined( SFM_HAMMING_AVX2 )
+    case KERNEL_AVX2:
+      __builtin_cpu_init( );
+      return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+#ifdef SFM_HAMMING_AVX512
+    case KERNEL_AVX512:
+      __builtin_cpu_init( );
+      return __builtin_cpu_supports( "avx512f" ) &&
+        __builtin_cpu_supports( "avx512vpopcntdq" );
+#endif
+    default:
+      return false;
+    }
+  }
+
+  PointsMatcherHamming::KernelType PointsMatcherHamming::getBestKernel( )
+  {
+    if( isKernelSupported( KERNEL_AVX512 ) )
+      return KERNEL_AVX512;
+    if( isKernelSupported( KERNEL_AVX2 ) )
+      return KERNEL_AVX2;
+    return KERNEL_SCALAR;
+  }
+
+  std::string PointsMatcherHamming::getKernelName( KernelType kernel )
+  {
+    switch( kernel )
+    {
+    case KERNEL_SCALAR:
+      return "scalar";
+    case KERNEL_AVX2:
+      return "AVX2";
+    case KERNEL_AVX512:
+      return "AVX-512";
+    default:
+      return getKernelName( getBestKernel( ) );
+    }
+  }
+
+  PointsMatcherHamming::PointsMatcherHamming( float ratio,
+    bool mutual_check, KernelType kernel )
+  {
+    ratio_ = ratio;
+    mutual_check_ = mutual_check;
+    nb_words_ = 0;
+    setKernel( kernel );
+  }
+
+  void PointsMatcherHamming::setKernel( KernelType kernel )
+  {
+    if( kernel == KERNEL_AUTO )
+      kernel = getBestKernel( );
+    if( !isKernelSupported( kernel ) )
+      CV_Error( CV_StsNotImplemented,
+        "This Hamming kernel can't be used on this CPU!" );
+    kernel_ = kernel;
+  }
+
+  void PointsMatcherHamming::clear( )
+  {
+    P_MUTEX( thread_concurr );
+    train_desc_.clear( );
+    images_start_.clear( );
+    nb_words_ = 0;
+    is_trained_ = false;
+    V_MUTEX( thread_concurr );
+  }
+
+  size_t PointsMatcherHamming::packDescriptors( Ptr<PointsToTrack> points,
+    vector<uint64_t>& packed, size_t& nb_words ) const
+  {
+    points->computeKeypointsAndDesc( false );
+    Mat desc = points->getDescriptors( );
+    points->free_descriptors( );//save memory, desc keep the data alive
+    if( desc.empty( ) )
+      return 0;
+    if( desc.depth( ) != CV_8U || desc.channels( ) != 1 )
+      CV_Error( CV_StsUnsupportedFormat,
+        "PointsMatcherHamming needs binary descriptors (CV_8U)!" );
+
+    //round to the upper multiple of 256 bits:
+    size_t desc_words = ( ( desc.cols + 31 ) / 32 ) * 4;
+    if( nb_words == 0 )
+      nb_words = desc_words;
+    else if( nb_words != desc_words )
+      CV_Error( CV_StsBadArg, "Descriptors don't have the same size!" );
+
+    size_t first = packed.size( );
+    packed.resize( first + desc.rows * nb_words, 0 );
+    for( int r = 0; r < desc.rows; ++r )
+      memcpy( &packed[ first + r * nb_words ], desc.ptr<uchar>( r ),
+        desc.cols );
+    return desc.rows;
+  }
+
+  void PointsMatcherHamming::train( )
+  {
+    P_MUTEX( thread_concurr );
+    train_desc_.clear( );
+    images_start_.clear( );
+    nb_words_ = 0;
+    for( size_t i = 0; i < pointCollection_.size( ); ++i )
+    {
+      images_start_.push_back( nb_words_ == 0 ? 0 :
+        train_desc_.size( ) / nb_words_ );
+      packDescriptors( pointCollection_[ i ], train_desc_, nb_words_ );
+    }
+    is_trained_ = true;
+    V_MUTEX( thread_concurr );
+  }
+
+  bool PointsMatcherHamming::isMaskSupported( )
+  {
+    return false;
+  }
+
+  bool PointsMatcherHamming::empty( ) const
+  {
+    return pointCollection_.empty( );
+  }
+
+  size_t PointsMatcherHamming::getMemoryUsage( ) const
+  {
+    return train_desc_.size( ) * sizeof( uint64_t );
+  }
+
+  Ptr<PointsMatcher> PointsMatcherHamming::clone( bool emptyTrainData )
+  {
+    P_MUTEX( thread_concurr );
+    PointsMatcherHamming* outPointMatcher =
+      new PointsMatcherHamming( ratio_, mutual_check_, kernel_ );
+    if( !emptyTrainData )
+      outPointMatcher->pointCollection_ = pointCollection_;
+    V_MUTEX( thread_concurr );
+
+    return outPointMatcher;
+  }
+
+  DMatch PointsMatcherHamming::toDMatch( int query_idx, size_t train_idx,
+    unsigned int distance ) const
+  {
+    //find the points collection of this train descriptor:
+    int img_idx = ( int )( std::upper_bound( images_start_.begin( ),
+      images_start_.end( ), train_idx ) - images_start_.begin( ) ) - 1;
+    return DMatch( query_idx, ( int )( train_idx - images_start_[ img_idx ] ),
+      img_idx, ( float )distance );
+  }
+
+  void PointsMatcherHamming::match( Ptr<PointsToTrack> queryPoints,
+    vector<DMatch>& matches, const vector<Mat>& masks )
+  {
+    trainIfNeeded( );
+
+    //the packed trains are only read, no need to lock:
+    vector<uint64_t> query_desc;
+    size_t nb_words = nb_words_;
+    size_t nb_queries = packDescriptors( queryPoints, query_desc, nb_words );
+    size_t nb_trains = nb_words_ == 0 ? 0 : train_desc_.size( ) / nb_words_;
+    HammingKernelFunc kernel = getKernelFunc( kernel_ );
+
+    //best and second best train of each query:
+    vector<unsigned int> best_dist( nb_queries, UINT_MAX ),
+      second_dist( nb_queries, UINT_MAX );
+    vector<int> best_train( nb_queries, -1 );
+    //best query of each train (for the mutual check):
+    vector<unsigned int> train_best_dist( mutual_check_ ? nb_trains : 0, UINT_MAX );
+    vector<int> train_best_query( mutual_check_ ? nb_trains : 0, -1 );
+    vector<unsigned int> distances( TRAIN_BLOCK );
+
+    //Trains and queries are visited in increasing order, so when several
+    //points have the same distance the first one is kept (like OpenCV):
+    for( size_t q_start = 0; q_start < nb_queries; q_start += QUERY_BLOCK )
+    {
+      size_t q_end = std::min( q_start + QUERY_BLOCK, nb_queries );
+      for( size_t t_start = 0; t_start < nb_trains; t_start += TRAIN_BLOCK )
+      {
+        size_t t_count = std::min( TRAIN_BLOCK, nb_trains - t_start );
+        const uint64_t* trains = &train_desc_[ t_start * nb_words_ ];
+        for( size_t q = q_start; q < q_end; ++q )
+        {
+          kernel( &query_desc[ q * nb_words_ ], trains, t_count, nb_words_,
+            &distances[ 0 ] );
+          unsigned int best = best_dist[ q ], second = second_dist[ q ];
+          int best_idx = best_train[ q ];
+          for( size_t t = 0; t < t_count; ++t )
+          {
+            unsigned int dist = distances[ t ];
+            if( dist < best )
+            {
+              second = best;
+              best = dist;
+              best_idx = ( int )( t_start + t );
+            }
+            else if( dist < second )
+              second = dist;
+            if( mutual_check_ && dist < train_best_dist[ t_start + t ] )
+            {
+              train_best_dist[ t_start + t ] = dist;
+              train_best_query[ t_start + t ] = ( int )q;
+            }
+          }
+          best_dist[ q ] = best;
+          second_dist[ q ] = second;
+          best_train[ q ] = best_idx;
+        }
+      }
+    }
+
+    for( size_t q = 0; q < nb_queries; ++q )
+    {
+      if( best_train[ q ] < 0 )
+        continue;
+      if( ratio_ < 1.0f && second_dist[ q ] != UINT_MAX &&
+        best_dist[ q ] >= ratio_ * second_dist[ q ] )
+        continue;
+      if( mutual_check_ && train_best_query[ best_train[ q ] ] != ( int )q )
+        continue;
+      matches.push_back( toDMatch( ( int )q, best_train[ q ], best_dist[ q ] ) );
+    }
+  }
+
+  void PointsMatcherHamming::knnMatch( Ptr<PointsToTrack> queryPoints,
+    vector<vector<DMatch> >& matches, int knn,
+    const vector<Mat>& masks, bool compactResult )
+  {
+    trainIfNeeded( );
+
+    //the packed trains are only read, no need to lock:
+    vector<uint64_t> query_desc;
+    size_t nb_words = nb_words_;
+    size_t nb_queries = packDescriptors( queryPoints, query_desc, nb_words );
+    size_t nb_trains = nb_words_ == 0 ? 0 : train_desc_.size( ) / nb_words_;
+    size_t k = std::min( ( size_t )MAX( knn, 0 ), nb_trains );
+    HammingKernelFunc kernel = getKernelFunc( kernel_ );
+
+    //k best (distance, train) of each query, sorted by distance:
+    vector< std::pair< unsigned int, size_t > > best( nb_queries * k,
+      std::make_pair( UINT_MAX, nb_trains ) );
+    vector<unsigned int> distances( TRAIN_BLOCK );
+    for( size_t q_start = 0; q_start < nb_queries && k > 0; q_start += QUERY_BLOCK )
+    {
+      size_t q_end = std::min( q_start + QUERY_BLOCK, nb_queries );
+      for( size_t t_start = 0; t_start < nb_trains; t_start += TRAIN_BLOCK )
+      {
+        size_t t_count = std::min( TRAIN_BLOCK, nb_trains - t_start );
+        const uint64_t* trains = &train_desc_[ t_start * nb_words_ ];
+        for( size_t q = q_start; q < q_end; ++q )
+        {
+          kernel( &query_desc[ q * nb_words_ ], trains, t_count, nb_words_,
+            &distances[ 0 ] );
+          std::pair< unsigned int, size_t >* best_q = &best[ q * k ];
+          for( size_t t = 0; t < t_count; ++t )
+          {
+            unsigned int dist = distances[ t ];
+            if( dist >= best_q[ k - 1 ].first )
+              continue;
+            //insertion in the sorted list:
+            size_t pos = k - 1;
+            while( pos > 0 && best_q[ pos - 1 ].first > dist )
+            {
+              best_q[ pos ] = best_q[ pos - 1 ];
+              pos--;
+            }
+            best_q[ pos ] = std::make_pair( dist, t_start + t );
+          }
+        }
+      }
+    }
+
+    for( size_t q = 0; q < nb_queries; ++q )
+    {
+      vector<DMatch> matches_q;
+      for( size_t n = 0; n < k; ++n )
+        matches_q.push_back( toDMatch( ( int )q, best[ q * k + n ].second,
+          best[ q * k + n ].first ) );
+      if( !compactResult || !matches_q.empty( ) )
+        matches.push_back( matches_q );
+    }
+  }
+
+  //used to sort the matches of radiusMatch:
+  static inline bool compareDistance( const DMatch& m1, const DMatch& m2 )
+  {
+    return m1.distance < m2.distance;
+  }
+
+  void PointsMatcherHamming::radiusMatch( Ptr<PointsToTrack> queryPoints,
+    vector<vector<DMatch> >& matches, float maxDistance,
+    const vector<Mat>& masks, bool compactResult )
+  {
+    trainIfNeeded( );
+
+    //the packed trains are only read, no need to lock:
+    vector<uint64_t> query_desc;
+    size_t nb_words = nb_words_;
+    size_t nb_queries = packDescriptors( queryPoints, query_desc, nb_words );
+    size_t nb_trains = nb_words_ == 0 ? 0 : train_desc_.size( ) / nb_words_;
+    HammingKernelFunc kernel = getKernelFunc( kernel_ );
+
+    vector< vector<DMatch> > matches_q( nb_queries );
+    vector<unsigned int> distances( TRAIN_BLOCK );
+    for( size_t q_start = 0; q_start < nb_queries; q_start += QUERY_BLOCK )
+    {
+      size_t q_end = std::min( q_start + QUERY_BLOCK, nb_queries );
+      for( size_t t_start = 0; t_start < nb_trains; t_start += TRAIN_BLOCK )
+      {
+        size_t t_count = std::min( TRAIN_BLOCK, nb_trains - t_start );
+        const uint64_t* trains = &train_desc_[ t_start * nb_words_ ];
+        for( size_t q = q_start; q < q_end; ++q )
+        {
+          kernel( &query_desc[ q * nb_words_ ], trains, t_count, nb_words_,
+            &distances[ 0 ] );
+          for( size_t t = 0; t < t_count; ++t )
+            if( distances[ t ] < maxDistance )
+              matches_q[ q ].push_back( toDMatch( ( int )q, t_start + t,
+                distances[ t ] ) );
+        }
+      }
+    }
+
+    for( size_t q = 0; q < nb_queries; ++q )
+    {
+      std::stable_sort( matches_q[ q ].begin( ), matches_q[ q ].end( ),
+        compareDistance );
+      if( !compactResult || !matches_q[ q ].empty( ) )
+        matches.push_back( matches_q[ q ] );
+    }
+  }
+
+}
@@ -0,0 +1,194 @@
+#ifndef _GSOC_SFM_POINTSMATCHERHAMMING_H
+#define _GSOC_SFM_POINTSMATCHERHAMMING_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include "opencv2/features2d/features2d.hpp"
+#include <vector>
+#include <string>
+#include <boost/cstdint.hpp>
+
+#include "config_SFM.h"  //SEMAPHORE
+#include "PointsMatcher.h"
+
+
+namespace OpencvSfM{
+
+  /*! \brief A brute force matcher for binary descriptors (ORB, BRIEF...)
+  *
+  * Descriptors are packed into 256 bits chunks and the Hamming distances
+  * are computed with AVX-512 (VPOPCNTQ) or AVX2 kernels when the CPU has
+  * them, else with a portable scalar kernel. The kernel is chosen at
+  * runtime. Queries and train descriptors are processed by blocks, so a
+  * block of train descriptors stays in cache while every query of a block
+  * is compared with it.
+  *
+  * match( ) can filter the matches with a ratio test (distance to the
+  * best point has to be smaller than ratio * distance to the second one)
+  * and a mutual check (the query point has to be the best match of its
+  * train point too). With a ratio of 1 and without mutual check, the
+  * matches are the same than the ones of cv::BruteForceMatcher<Hamming>.
+  *
+  * Searches only read the packed train descriptors, so a trained matcher
+  * can be used by several threads at the same time without locking.
+  */
+  class SFM_EXPORTS PointsMatcherHamming : public PointsMatcher
+  {
+  public:
+    /**
+    * Kernels used to compute the Hamming distances
+    */
+    enum KernelType
+    {
+      KERNEL_AUTO = 0,///<best kernel available on this CPU
+      KERNEL_SCALAR,///<portable code, 64 bits at a time
+      KERNEL_AVX2,///<256 bits at a time, popcount using a lookup table
+      KERNEL_AVX512///<512 bits at a time, using VPOPCNTQ
+    };
+
+    /**
+    * Construct a new binary descriptors matcher.
+    * @param ratio ratio test used by match( ), set to 1 to keep every best match
+    * @param mutual_check if true, match( ) keeps only the query points
+    * which are the best match of their train point
+    * @param kernel kernel used to compute distances
+    */
+    PointsMatcherHamming( float ratio = 0.8f, bool mutual_check = true,
+      KernelType kernel = KERNEL_AUTO );
+
+    /**
+    * Use this function to create a binary descriptors matcher
+    * @param ratio ratio test used by match( ), set to 1 to keep every best match
+    * @param mutual_check if true, match( ) keeps only the query points
+    * which are the best match of their train point
+    * @return a new PointsMatcher
+    */
+    static cv::Ptr<PointsMatcher> create( float ratio = 0.8f,
+      bool mutual_check = true )
+    {
+      return cv::Ptr<PointsMatcher>( new PointsMatcherHamming(
+        ratio, mutual_check ) );
+    };
+    /**
+    * Use to know if a kernel can be used on this CPU (and was compiled).
+    * @param kernel wanted kernel
+    * @return true if the kernel can be used
+    */
+    static bool isKernelSupported( KernelType kernel );
+    /**
+    * Get the best kernel available on this CPU
+    * @return best kernel (never KERNEL_AUTO)
+    */
+    static KernelType getBestKernel( );
+    /**
+    * Get the name of a kernel (to print it)
+    * @param kernel wanted kernel
+    * @return name of the kernel
+    */
+    static std::string getKernelName( KernelType kernel );
+    /**
+    * Change the kernel used to compute distances
+    * @param kernel new kernel, has to be supported by this CPU
+    */
+    void setKernel( KernelType kernel );
+    /**
+    * Get the kernel used to compute distances
+    * @return current kernel (never KERNEL_AUTO)
+    */
+    inline KernelType getKernel( ) const { return kernel_; };
+
+    /**
+    * If needed, you can clear the training data using this method.
+    */
+    virtual void clear( );
+    /**
+    * Pack the descriptors of each points collection.
+    */
+    virtual void train( );
+    /**
+    * Use this method to know if mask are supported with current matcher
+    * @return false, masks are not supported
+    */
+    virtual bool isMaskSupported( );
+    /**
+    * Use to know if matching are available
+    * @return true if matching has been performed
+    */
+    virtual bool empty( ) const;
+    /**
+    * Estimate the memory used by the packed train descriptors
+    * @return memory in bytes
+    */
+    virtual size_t getMemoryUsage( ) const;
+    /**
+    * Clone the matcher.
+    * @param emptyTrainData IIf emptyTrainData is false the method create deep copy of the object, i.e. copies both parameters and train data. If emptyTrainData is true the method create object copy with current parameters but with empty train data..
+    * @return An other PointsMatcher instance
+    */
+    virtual cv::Ptr<PointsMatcher> clone( bool emptyTrainData=true );
+    /**
+    * Find the best match of each query descriptor, filtered with the
+    * ratio test and the mutual check.
+    * @param queryPoints  Query set of points and descriptors.
+    * @param matches Mathes. Query points without a match passing the tests
+    * are not in this vector.
+    * @param masks not used
+    */
+    virtual void match( cv::Ptr<PointsToTrack> queryPoints,
+      std::vector<cv::DMatch>& matches,
+      const std::vector<cv::Mat>& masks = std::vector<cv::Mat>( ) );
+    /**
+    * Find the k best matches for each descriptor from a query set with train descriptors.
+    * The ratio test and the mutual check are not used.
+    * @param queryPoints  Query set of points and descriptors.
+    * @param matches Mathes. Each matches[ i ] is k or less matches for the same query descriptor.
+    * @param k Count of best matches will be found per each query descriptor ( or less if it's not possible ).
+    * @param masks not used
+    * @param compactResult If true, matches vector will not contain empty
+    * vectors (only possible when there is no train descriptors)
+    */
+    virtual void knnMatch( cv::Ptr<PointsToTrack> queryPoints,
+      std::vector<std::vector<cv::DMatch> >& matches, int k,
+      const std::vector<cv::Mat>& masks = std::vector<cv::Mat>( ), bool compactResult = true );
+    /**
+    * Find the best matches for each query descriptor which have distance less than given threshold.
+    * The ratio test and the mutual check are not used.
+    * @param queryPoints  Query set of points and descriptors.
+    * @param matches Each matches[ i ] is the list of matches for the same query descriptor, sorted by distance.
+    * @param maxDistance The threshold to found match distances.
+    * @param masks not used
+    * @param compactResult If true, matches vector will not contain query
+    * descriptors without matches.
+    */
+    virtual void radiusMatch( cv::Ptr<PointsToTrack> queryPoints,std::vector<std::vector<cv::DMatch> >& matches, float maxDistance,
+      const std::vector<cv::Mat>& masks = std::vector<cv::Mat>( ), bool compactResult = true );
+
+  protected:
+    /**
+    * Compute the descriptors of a points collection and pack them into
+    * 256 bits chunks.
+    * @param points points collection
+    * @param packed output, nb_words words for each descriptor
+    * @param nb_words number of words of a packed descriptor (set by this
+    * method if it's 0, else the descriptors have to have this size)
+    * @return number of descriptors
+    */
+    size_t packDescriptors( cv::Ptr<PointsToTrack> points,
+      std::vector<boost::uint64_t>& packed, size_t& nb_words ) const;
+    /**
+    * Convert an index in train_desc_ into a DMatch
+    */
+    cv::DMatch toDMatch( int query_idx, size_t train_idx,
+      unsigned int distance ) const;
+
+    float ratio_;///<ratio test of match( )
+    bool mutual_check_;///<if true, match( ) checks the matches in both ways
+    KernelType kernel_;///<kernel used to compute distances
+    size_t nb_words_;///<number of 64 bits words of a packed descriptor (multiple of 4)
+    std::vector<boost::uint64_t> train_desc_;///<packed descriptors of every train points
+    std::vector<size_t> images_start_;///<index of the first descriptor of each points collection
+  };
+
+}
+
+#endif
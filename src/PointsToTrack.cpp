@@ -23,6 +23,8 @@ namespace OpencvSfM{
 
     PointsToTrack::glob_number_images_++;
     nb_workers_ = 0;
+    frame_index_ = 0;
+    grid_valid_ = false;
     INIT_MUTEX(worker_exclusion);
   }
 
@@ -39,6 +41,32 @@ namespace OpencvSfM{
     V_MUTEX(worker_exclusion);
   }
 
+  void PointsToTrack::releaseImage( cv::Ptr<FramesReader> frames_reader,
+    unsigned int frame_index )
+  {
+    CV_Assert( !frames_reader.empty( ) );
+    P_MUTEX(worker_exclusion);
+    frames_reader_ = frames_reader;
+    frame_index_ = frame_index;
+    imageToAnalyse_.release( );
+    V_MUTEX(worker_exclusion);
+  }
+
+  bool PointsToTrack::impl_readImage_( )
+  {
+    if( !imageToAnalyse_.empty( ) || frames_reader_.empty( ) )
+      return false;
+    imageToAnalyse_ = frames_reader_->getFrame( frame_index_ );
+    return true;
+  }
+
+  cv::Mat PointsToTrack::getImage( )
+  {
+    if( !imageToAnalyse_.empty( ) || frames_reader_.empty( ) )
+      return imageToAnalyse_;
+    return frames_reader_->getFrame( frame_index_ );
+  }
+
   PointsToTrack::~PointsToTrack( void )
   {
     keypoints_.clear( );
@@ -55,10 +83,10 @@ namespace OpencvSfM{
     {
       need_keypoints = keypoints_.empty( );
       need_descriptors = need_keypoints || descriptors_.empty( );
-      if( need_keypoints )
-        impl_computeKeypoints_();
     }
-    else
+    //a released image is read again only for this computation:
+    bool image_read = ( need_keypoints || need_descriptors ) && impl_readImage_( );
+    if( need_keypoints )
       impl_computeKeypoints_();
 
     if( need_keypoints )//as points have been computed, refilter them:
@@ -68,38 +96,63 @@ namespace OpencvSfM{
 
     if( need_descriptors )
       impl_computeDescriptors_();
+    if( need_keypoints || need_descriptors )
+      grid_valid_ = false;//keypoints_ may have changed
+    if( image_read )
+      imageToAnalyse_.release( );
     V_MUTEX(worker_exclusion);
     return keypoints_.size( );
   }
 
   void PointsToTrack::impl_filterByDistance_( double dist_min )
   {
-    return;
-    bool discard_data = false;
     size_t nb_points = keypoints_.size();
+    if( dist_min <= 0 || nb_points < 2 )
+      return;
+    //the kept points are indexed in a grid with cells of size dist_min, so
+    //only the neighbour cells are tested (the first point of a group is kept):
+    KeypointsGrid kept_points( ( float )dist_min );
+    bool has_descriptors = descriptors_.rows == ( int )nb_points;
+    bool has_colors = RGB_values_.size( ) == nb_points;
+    if( has_descriptors &&
+      ( descriptors_.refcount == NULL || *descriptors_.refcount > 1 ) )
+      descriptors_ = descriptors_.clone( );//the rows will be moved in place
+    size_t nb_kept = 0;
     for(size_t i = 0; i<nb_points ; ++i)
     {
-      const cv::KeyPoint& kp = keypoints_[i];
-      for(size_t j = i+1; j<nb_points ; ++j)
+      float dist;
+      if( kept_points.findNearest( keypoints_[ i ].pt, keypoints_,
+        ( float )dist_min, &dist ) >= 0 && dist < dist_min )
+        continue;//we have to remove this point!
+      if( nb_kept != i )
       {
-        const cv::KeyPoint& kp1 = keypoints_[j];
-        float dist = sqrt( (kp.pt.x - kp1.pt.x)*(kp.pt.x - kp1.pt.x)
-          + (kp.pt.y - kp1.pt.y) * (kp.pt.y - kp1.pt.y) );
-        if( dist<dist_min )
+        keypoints_[ nb_kept ] = keypoints_[ i ];
+        if( has_descriptors )
         {
-          //we have to remove this point!
-          discard_data = true;
-          nb_points--;
-          keypoints_[ j ] = keypoints_[ nb_points ];
-          j--;
-          keypoints_.pop_back();
+          Mat row_kept = descriptors_.row( nb_kept );
+          descriptors_.row( i ).copyTo( row_kept );
         }
+        if( has_colors )
+          RGB_values_[ nb_kept ] = RGB_values_[ i ];
       }
+      kept_points.add( keypoints_[ nb_kept ].pt, nb_kept );
+      nb_kept++;
     }
-    if( discard_data )
-    {
-      if( nb_workers_>=1 && descriptors_.empty( ) )
-        impl_computeDescriptors_();//recompute the descriptors...
+    if( nb_kept == nb_points )
+      return;
+
+    grid_valid_ = false;
+    keypoints_.resize( nb_kept );
+    if( has_descriptors )
+      descriptors_ = descriptors_.rowRange( 0, nb_kept );
+    if( has_colors )
+      RGB_values_.resize( nb_kept );
+    if( nb_workers_>=1 && descriptors_.empty( ) )
+    {//recompute the descriptors...
+      bool image_read = impl_readImage_( );
+      impl_computeDescriptors_();
+      if( image_read )
+        imageToAnalyse_.release( );
     }
   }
   void PointsToTrack::filterByDistance( double dist_min )
@@ -112,7 +165,11 @@ namespace OpencvSfM{
   int PointsToTrack::computeKeypoints( )
   {
     P_MUTEX(worker_exclusion);
+    bool image_read = impl_readImage_( );
     impl_computeKeypoints_();
+    if( image_read )
+      imageToAnalyse_.release( );
+    grid_valid_ = false;
     V_MUTEX(worker_exclusion);
     filterByDistance( 3 );
     return keypoints_.size( );
@@ -122,7 +179,11 @@ namespace OpencvSfM{
   {
     P_MUTEX(worker_exclusion);
     nb_workers_++;
+    bool image_read = impl_readImage_( );
     impl_computeDescriptors_();
+    if( image_read )
+      imageToAnalyse_.release( );
+    grid_valid_ = false;//keypoints_ may have changed
     V_MUTEX(worker_exclusion);
   }
 
@@ -131,32 +192,27 @@ namespace OpencvSfM{
     if( keypoints.size()==0 )
       return;//nothing to do...
     P_MUTEX(worker_exclusion);
+    //add the descriptors first, so the filter below can keep them in sync:
+    if( !computeMissingDescriptor && !descriptors_.empty( ) &&
+      descriptors.rows == ( int )keypoints.size( ) )
+    {
+      Mat newDescriptors( this->descriptors_.rows + descriptors.rows,
+        this->descriptors_.cols, this->descriptors_.type( ) );
+      Mat old_rows = newDescriptors.rowRange( 0, this->descriptors_.rows ),
+        new_rows = newDescriptors.rowRange( this->descriptors_.rows,
+        newDescriptors.rows );
+      this->descriptors_.copyTo( old_rows );
+      descriptors.copyTo( new_rows );
+      this->descriptors_=newDescriptors;
+    }
     //add the keypoints to the end of our points vector:
     this->keypoints_.insert( this->keypoints_.end( ),keypoints.begin( ),keypoints.end( ) );
 
     V_MUTEX(worker_exclusion);
     filterByDistance( 3 );
 
-    if( !computeMissingDescriptor )
-    {
-      if( !descriptors_.empty( ) )
-      {
-        Mat newDescriptors( this->keypoints_.size( ), this->descriptors_.cols,
-          this->descriptors_.type( ) );
-        newDescriptors(
-          cv::Rect( 0, 0, this->descriptors_.cols,this->descriptors_.rows ) ) =
-          this->descriptors_;
-
-        newDescriptors( cv::Rect( 0, this->descriptors_.rows,
-          this->descriptors_.cols,descriptors.rows ) ) = descriptors;
-
-        this->descriptors_=newDescriptors;
-      }
-    }
-    else
-    {
+    if( computeMissingDescriptor )
       this->computeDescriptors( );
-    }
   }
   void PointsToTrack::printPointsOnImage( const Mat &image, Mat& outImg, const Scalar& color/*=Scalar::all( -1 )*/, int flags/*=DrawMatchesFlags::DEFAULT*/ ) const
   {
@@ -225,6 +281,22 @@ namespace OpencvSfM{
     fs << "]" << "}" << "}";
   }
 
+  void PointsToTrack::read( cv::Ptr<FeaturesStore> store, unsigned int idx,
+    PointsToTrack& points )
+  {
+    CV_Assert( !store.empty( ) && idx < store->getNbImages( ) );
+    store->getKeypoints( idx, points.keypoints_ );
+    points.descriptors_ = store->getDescriptors( idx );
+    store->getColors( idx, points.RGB_values_ );
+    points.corresponding_image_ = store->getImageIndex( idx );
+    points.store_ = store;
+    points.grid_valid_ = false;
+
+    //as the loaded PointsToTrack can't recompute the descriptors_, set the nbworkers
+    //to a high value (this will disable free_descriptors to release descriptor ;)
+    points.nb_workers_ = 999999;
+  }
+
   void PointsToTrack::getKeyMatches( const std::vector<TrackOfPoints>& matches,
     int otherImage, std::vector<cv::Point2f>& pointsVals ) const
   {
@@ -245,24 +317,66 @@ namespace OpencvSfM{
     }
   }
 
-  size_t PointsToTrack::getClosestKeypoint( cv::Point2f point )
+  void PointsToTrack::impl_updateGrid_( )
+  {
+    if( !grid_valid_ || grid_.size( ) > keypoints_.size( ) )
+    {
+      grid_.clear( );
+      grid_valid_ = true;
+    }
+    //keypoints are only appended, index the new ones:
+    for( size_t i = grid_.size( ); i < keypoints_.size( ); ++i )
+      grid_.add( keypoints_[ i ].pt, ( unsigned int )i );
+  }
+
+  unsigned int PointsToTrack::addKeypoint( const cv::KeyPoint point, double min_dist )
   {
     P_MUTEX(worker_exclusion);
-    size_t nb_points = keypoints_.size(),
-      idx_min = 0;
-    float dist_min = 1e10;
-    for(size_t i = 0; i<nb_points ; ++i)
+    impl_updateGrid_( );
+    //only the points closer than min_dist are searched:
+    int close_p = grid_.findNearest( point.pt, keypoints_, ( float )min_dist );
+    if( close_p < 0 )
     {
-      const cv::KeyPoint& kp = keypoints_[i];
-      float dist = sqrt( (point.x - kp.pt.x)*(point.x - kp.pt.x)
-        + (point.y - kp.pt.y) * (point.y - kp.pt.y) );
-      if( dist<dist_min )
-      {
-        dist_min = dist;
-        idx_min = i;
-      }
+      keypoints_.push_back( point );
+      close_p = keypoints_.size() - 1;
+      grid_.add( point.pt, close_p );
     }
     V_MUTEX(worker_exclusion);
-    return idx_min;
+    return close_p;
+  }
+
+  size_t PointsToTrack::getClosestKeypoint( cv::Point2f point )
+  {
+    P_MUTEX(worker_exclusion);
+    impl_updateGrid_( );
+    int idx_min = grid_.findNearest( point, keypoints_ );
+    V_MUTEX(worker_exclusion);
+    return idx_min < 0 ? 0 : idx_min;
   };
+
+  void PointsToTrack::getKeypointsInRadius( cv::Point2f point, float radius,
+    std::vector<unsigned int>& indexes )
+  {
+    P_MUTEX(worker_exclusion);
+    impl_updateGrid_( );
+    grid_.findInRadius( point, radius, keypoints_, indexes );
+    V_MUTEX(worker_exclusion);
+  }
+
+  void PointsToTrack::getKeypointsNearLine( cv::Vec3f line, float band,
+    std::vector<unsigned int>& indexes )
+  {
+    P_MUTEX(worker_exclusion);
+    impl_updateGrid_( );
+    grid_.findNearLine( line, band, keypoints_, indexes );
+    V_MUTEX(worker_exclusion);
+  }
+
+  const KeypointsGrid& PointsToTrack::getKeypointsGrid( )
+  {
+    P_MUTEX(worker_exclusion);
+    impl_updateGrid_( );
+    V_MUTEX(worker_exclusion);
+    return grid_;
+  }
 }
@@ -7,6 +7,9 @@
 #include "opencv2/features2d/features2d.hpp"
 
 #include "config_SFM.h"//semaphore...
+#include "FeaturesStore.h"
+#include "KeypointsGrid.h"
+#include "MotionProcessor.h"
 
 
 namespace OpencvSfM{
@@ -57,6 +60,11 @@ namespace OpencvSfM{
     */
     std::vector<unsigned int> RGB_values_;
     int corresponding_image_;///<index of frame when available
+    cv::Ptr<FeaturesStore> store_;///<when loaded from a FeaturesStore, keep the mapped descriptors_ alive
+    cv::Ptr<FramesReader> frames_reader_;///<when the image is released, used to read it again
+    unsigned int frame_index_;///<index of the image in frames_reader_
+    KeypointsGrid grid_;///<spatial index of the first grid_.size( ) keypoints_
+    bool grid_valid_;///<false when keypoints_ may have changed since they were indexed
     static int glob_number_images_;///<total numbers of images!
 
     /**
@@ -76,6 +84,17 @@ namespace OpencvSfM{
     * @param dist_min minimum distance allowed between points
     */
     void impl_filterByDistance_( double dist_min );
+    /**
+    * Index the keypoints added since the last call (or every keypoints if
+    * they have changed) into grid_. Not thread safe!
+    */
+    void impl_updateGrid_( );
+    /**
+    * If the image was released (see releaseImage), read it again into
+    * imageToAnalyse_. Not thread safe!
+    * @return true if the image was read: the caller has to release it
+    */
+    bool impl_readImage_( );
     
   public:
     /**
@@ -95,6 +114,15 @@ namespace OpencvSfM{
     * @param force if true, the descriptors are removed
     */
     void free_descriptors( bool force = false );
+    /**
+    * To preserve memory, release the image used to compute the points.
+    * When the descriptors are needed again, the image is read from
+    * frames_reader, only for the time of the computation.
+    * @param frames_reader source of the image
+    * @param frame_index index of the image in frames_reader
+    */
+    void releaseImage( cv::Ptr<FramesReader> frames_reader,
+      unsigned int frame_index );
 
     /**
     * This method is used to compute both Keypoints and descriptors...
@@ -127,37 +155,16 @@ namespace OpencvSfM{
     * the index of the closest point...
     * @return index of the added keypoint.
     */
-    inline unsigned int addKeypoint( const cv::KeyPoint point, double min_dist=1.0 )
-    {
-      double dist = 1e6;
-      P_MUTEX(worker_exclusion);
-      size_t nb_points = keypoints_.size(),
-        close_p = 0;
-      float dist_min = 1e10;
-      for(size_t i = 0; i<nb_points ; ++i)
-      {
-        const cv::KeyPoint& kp = keypoints_[i];
-        float dist = sqrt( (point.pt.x - kp.pt.x)*(point.pt.x - kp.pt.x)
-          + (point.pt.y - kp.pt.y) * (point.pt.y - kp.pt.y) );
-        if( dist<dist_min )
-        {
-          dist_min = dist;
-          close_p = i;
-        }
-      }
-      if( dist_min > min_dist )
-      {
-        keypoints_.push_back( point );
-        close_p = keypoints_.size() - 1;
-      }
-      V_MUTEX(worker_exclusion);
-      return close_p;
-    };
+    unsigned int addKeypoint( const cv::KeyPoint point, double min_dist=1.0 );
     /**
     * this method return the points coordinates and sometimes orientation and size
     * @return points coordinates and when available orientation and size
     */
-    inline std::vector<cv::KeyPoint>& getModifiableKeypoints( ) {return keypoints_;};
+    inline std::vector<cv::KeyPoint>& getModifiableKeypoints( )
+    {
+      grid_valid_ = false;//the caller may move the points
+      return keypoints_;
+    };
     /**
     * this method return the points coordinates and sometimes orientation and size
     * @return points coordinates and when available orientation and size
@@ -183,20 +190,50 @@ namespace OpencvSfM{
       return keypoints_[ index ];
     };
     /**
-    * this method return the closest points from parameter
+    * this method return the closest points from parameter (using a grid
+    * of keypoints, so only the points close to the query are tested)
     * @param point coordinate of the point to search for
     * @return index of the point
     */
     size_t getClosestKeypoint( cv::Point2f point );
     /**
+    * this method return the points inside a circle
+    * @param point center of the circle
+    * @param radius radius of the circle
+    * @param indexes [out] sorted indexes of the points
+    */
+    void getKeypointsInRadius( cv::Point2f point, float radius,
+      std::vector<unsigned int>& indexes );
+    /**
+    * this method return the points close to a line (an epipolar line...)
+    * @param line coefficients (a, b, c) of the line a*x + b*y + c = 0
+    * @param band maximum distance between a point and the line
+    * @param indexes [out] sorted indexes of the points
+    */
+    void getKeypointsNearLine( cv::Vec3f line, float band,
+      std::vector<unsigned int>& indexes );
+    /**
+    * this method return the grid indexing the keypoints (updated if
+    * needed), to make many queries with only one lock. The grid is valid
+    * until the keypoints change.
+    * @return spatial index of the keypoints
+    */
+    const KeypointsGrid& getKeypointsGrid( );
+    /**
     * this method return the descritors for each points in a matrix with size ( n*m ), where n is the number of points and m is the desciptor size.
     * @return descritors for each points in a matrix with size ( n*m ), where n is the number of points and m is the desciptor size.
     */
     cv::Mat getDescriptors( ) const {return descriptors_;};
     /**
-    * Get the image used to compute points
+    * Get the index of the image where points are detected
+    * @return index of frame
     */
-    inline cv::Mat getImage( ){return imageToAnalyse_;};
+    inline int getIndexImage( ) const {return corresponding_image_;};
+    /**
+    * Get the image used to compute points. If it was released (see
+    * releaseImage), it is read again but not kept.
+    */
+    cv::Mat getImage( );
     /**
     * To show the points on image, use this function to draw points on it.
     * @param image Source image.
@@ -238,6 +275,17 @@ namespace OpencvSfM{
     * @param points sequence to save...
     */
     static void write( cv::FileStorage& fs, const PointsToTrack& points );
+
+    /**
+    * Load the points of an image from a binary FeaturesStore. Descriptors
+    * are not copied: they use the mapped file, which stays opened as long
+    * as the points are used.
+    * @param store previously opened binary file
+    * @param idx index of the image in the file
+    * @param points output
+    */
+    static void read( cv::Ptr<FeaturesStore> store, unsigned int idx,
+      PointsToTrack& points );
   };
 }
 /*
@@ -0,0 +1,101 @@
+#ifndef _GSOC_SFM_SPSC_QUEUE_H
+#define _GSOC_SFM_SPSC_QUEUE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+#include "atomic_ops.h"
+
+#include <vector>
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Bounded lock-free queue for exactly one producer thread and one
+  * consumer thread.
+  *
+  * The items are stored in a ring buffer. The producer only writes tail_
+  * and the consumer only writes head_, so no compare and swap is needed:
+  * a memory barrier between the copy of the item and the update of the
+  * index is enough. Both indexes are on different cache lines so the two
+  * threads don't invalidate each other's cache at each operation.
+  */
+  template< typename T >
+  class SPSCQueue
+  {
+  public:
+    /**
+    * Create an empty queue
+    * @param capacity maximum number of items in the queue
+    */
+    SPSCQueue( unsigned int capacity )
+      :items_( capacity + 1 ), head_( 0 ), tail_( 0 )
+    {
+    }
+
+    /**
+    * Add an item at the end of the queue (only the producer can call it).
+    * @param item item to add
+    * @return false if the queue is full (nothing is done)
+    */
+    bool push( const T& item )
+    {
+      atomic_int tail = tail_;
+      atomic_int next = nextIndex( tail );
+      if( next == head_ )
+        return false;
+      items_[ tail ] = item;
+      memoryBarrier( );//item must be written before being published
+      tail_ = next;
+      return true;
+    }
+    /**
+    * Remove the first item of the queue (only the consumer can call it).
+    * @param item output, the removed item
+    * @return false if the queue is empty (item is not modified)
+    */
+    bool pop( T& item )
+    {
+      atomic_int head = head_;
+      if( head == tail_ )
+        return false;
+      memoryBarrier( );//don't read the item before the index
+      item = items_[ head ];
+      items_[ head ] = T( );//release the resources of the item now
+      memoryBarrier( );
+      head_ = nextIndex( head );
+      return true;
+    }
+
+    /**
+    * Get the number of items in the queue. As the other thread can change
+    * it at the same time, it's only an estimation.
+    * @return number of items in the queue
+    */
+    inline unsigned int size( ) const
+    {
+      atomic_int nb = tail_ - head_;
+      return ( unsigned int )( nb < 0 ? nb + ( atomic_int )items_.size( ) : nb );
+    }
+    /**
+    * Get the maximum number of items of the queue
+    * @return capacity of the queue
+    */
+    inline unsigned int capacity( ) const
+    {
+      return ( unsigned int )items_.size( ) - 1;
+    }
+
+  protected:
+    inline atomic_int nextIndex( atomic_int index ) const
+    {
+      return index + 1 == ( atomic_int )items_.size( ) ? 0 : index + 1;
+    }
+
+    std::vector< T > items_;///<ring buffer (one slot is always empty)
+    volatile atomic_int head_;///<index of the first item (written by the consumer)
+    char padding_[ 64 ];///<keep head_ and tail_ on different cache lines
+    volatile atomic_int tail_;///<index of the next free slot (written by the producer)
+  };
+
+}
+
+#endif
@@ -3,13 +3,24 @@
 
 #include <iostream>
 #include <sstream>
+#include <set>
+#include <algorithm>
+#include <functional>
 
 #include "SequenceAnalyzer.h"
 #include "Boost_Matching.h"
+#include "TaskScheduler.h"
+#include "VocabularyTree.h"
+#include "MemoryUsage.h"
+#include "FeaturesPipeline.h"
+#include "TrackStore.h"
+#include "BucketedFeatureDetector.h"
 #include "Camera.h"
 
 #include "config_SFM.h"  //SEMAPHORE
 
+#include "opencv2/imgproc/imgproc.hpp"
+
 using cv::Ptr;
 using cv::Mat;
 using cv::DMatch;
@@ -29,7 +40,13 @@ namespace OpencvSfM{
     cv::Ptr<PointsMatcher> match_algorithm )
     :match_algorithm_( match_algorithm ),
     feature_detector_( feature_detector ),
-    descriptor_extractor_( descriptor_extractor )
+    descriptor_extractor_( descriptor_extractor ),
+    matchers_cache_( new MatchersCache( ) ),
+    tracks_index_valid_( false ),
+    nb_candidates_( 0 ),
+    temporal_window_( 0 ),
+    nb_loop_candidates_( 0 ),
+    guided_matching_( false )
   {
 
   }
@@ -37,10 +54,17 @@ namespace OpencvSfM{
   SequenceAnalyzer::SequenceAnalyzer( MotionProcessor input_sequence,
     cv::Ptr< cv::FeatureDetector > feature_detector,
     cv::Ptr< cv::DescriptorExtractor > descriptor_extractor,
-    cv::Ptr< PointsMatcher > match_algorithm )
+    cv::Ptr< PointsMatcher > match_algorithm, bool streaming,
+    bool printProgress, unsigned int max_keypoints )
     :match_algorithm_( match_algorithm ),
     feature_detector_( feature_detector ),
-    descriptor_extractor_( descriptor_extractor )
+    descriptor_extractor_( descriptor_extractor ),
+    matchers_cache_( new MatchersCache( ) ),
+    tracks_index_valid_( false ),
+    nb_candidates_( 0 ),
+    temporal_window_( 0 ),
+    nb_loop_candidates_( 0 ),
+    guided_matching_( false )
   {
     //only finite sequences can be used:
     CV_DbgAssert( input_sequence.isBidirectional( ) );
@@ -49,22 +73,85 @@ namespace OpencvSfM{
 
     //load entire sequence! Can be problematic but if a user want to have
     //more controls, he can use the other constructor...
+    FeaturesPipeline pipeline( input_sequence, feature_detector,
+      descriptor_extractor );
+    pipeline.setKeypointsBudget( max_keypoints );
+    //images added later use the same budget:
+    feature_detector_ = pipeline.getFeatureDetector( );
+    loadSequence( pipeline, streaming, printProgress );
+  }
+
+  SequenceAnalyzer::SequenceAnalyzer( FeaturesPipeline& pipeline,
+    cv::Ptr< PointsMatcher > match_algorithm, bool streaming,
+    bool printProgress )
+    :match_algorithm_( match_algorithm ),
+    feature_detector_( pipeline.getFeatureDetector( ) ),
+    descriptor_extractor_( pipeline.getDescriptorExtractor( ) ),
+    matchers_cache_( new MatchersCache( ) ),
+    tracks_index_valid_( false ),
+    nb_candidates_( 0 ),
+    temporal_window_( 0 ),
+    nb_loop_candidates_( 0 ),
+    guided_matching_( false )
+  {
+    loadSequence( pipeline, streaming, printProgress );
+  }
 
+  void SequenceAnalyzer::loadSequence( FeaturesPipeline& pipeline,
+    bool streaming, bool printProgress )
+  {
+    MotionProcessor& input_sequence = pipeline.getSource( );
+    //consecutive frames of a video overlap, distant ones rarely:
+    if( input_sequence.getTypeOfInput( ) == IS_VIDEO ||
+      input_sequence.getTypeOfInput( ) == IS_WEBCAM )
+      setTemporalWindow( 10, 2 );
+    //In streaming mode, only points are kept and images are read again
+    //when needed, so the memory doesn't depend on the size of images:
+    if( streaming && !input_sequence.isBidirectional( ) )
+    {
+      std::clog<<"Streaming: the frames of a webcam can't be read again, "<<
+        "images are kept in memory"<<std::endl;
+      streaming = false;
+    }
+    if( streaming )
+      image_source_ = new FramesReader( input_sequence );
+
+    //frames are decoded and their points computed by the pipeline threads:
+    pipeline.start( );
     int nbFrame=0;
-    Mat currentImage=input_sequence.getFrame( );
-    while ( !currentImage.empty( ) )// && nbFrame<50 )
+    Mat currentImage;
+    Ptr<PointsToTrack> points;
+    while ( pipeline.getNextFrame( currentImage, points ) )
     {
-      addImageToPipeline( currentImage );
+      addImageToPipeline( currentImage, points );
+      if( streaming )
+      {//descriptors are computed again from the frame when needed:
+        images_size_.push_back( currentImage.size( ) );
+        images_.back( ).release( );
+        points_to_track_.back( )->releaseImage( image_source_,
+          images_.size( ) - 1 );
+        points_to_track_.back( )->free_descriptors( );
+      }
       nbFrame++;
-      currentImage=input_sequence.getFrame( );
     }
+    if( printProgress )
+      pipeline.printStatistics( std::clog );
+    if( streaming )
+      std::clog<<"Streaming: "<<nbFrame<<" frames loaded, peak memory usage: "<<
+        getPeakMemoryUsage( )/( 1024*1024 )<<" MB"<<std::endl;
   }
 
   SequenceAnalyzer::SequenceAnalyzer(
     std::vector< cv::Ptr< PointsToTrack > > &points_to_track,
     std::vector< cv::Mat > *images,
     cv::Ptr<PointsMatcher> match_algorithm )
-    :points_to_track_( points_to_track )
+    :points_to_track_( points_to_track ),
+    matchers_cache_( new MatchersCache( ) ),
+    tracks_index_valid_( false ),
+    nb_candidates_( 0 ),
+    temporal_window_( 0 ),
+    nb_loop_candidates_( 0 ),
+    guided_matching_( false )
   {
     if( match_algorithm.empty() )
       match_algorithm_ = new PointsMatcher( 
@@ -79,6 +166,12 @@ namespace OpencvSfM{
   SequenceAnalyzer::SequenceAnalyzer( cv::FileNode file,
     std::vector<cv::Mat> *images,
     cv::Ptr<PointsMatcher> match_algorithm )
+    :matchers_cache_( new MatchersCache( ) ),
+    tracks_index_valid_( false ),
+    nb_candidates_( 0 ),
+    temporal_window_( 0 ),
+    nb_loop_candidates_( 0 ),
+    guided_matching_( false )
   {
     if( match_algorithm.empty() )
       match_algorithm_ = new PointsMatcher(
@@ -90,10 +183,54 @@ namespace OpencvSfM{
     read( file,*this );
   }
 
+  SequenceAnalyzer::SequenceAnalyzer( cv::Ptr<FeaturesStore> store,
+    std::vector<cv::Mat> *images,
+    cv::Ptr<PointsMatcher> match_algorithm )
+    :matchers_cache_( new MatchersCache( ) ),
+    tracks_index_valid_( false ),
+    nb_candidates_( 0 ),
+    temporal_window_( 0 ),
+    nb_loop_candidates_( 0 ),
+    guided_matching_( false )
+  {
+    if( match_algorithm.empty() )
+      match_algorithm_ = new PointsMatcher(
+      Ptr<cv::DescriptorMatcher>( new cv::FlannBasedMatcher( ) ) );
+    else
+      match_algorithm_ = match_algorithm;
+    if( images != NULL)
+      images_ = (*images);
+    CV_Assert( !store.empty( ) );
+    unsigned int nb_pictures = store->getNbImages( );
+    for( unsigned int i = 0; i < nb_pictures; i++ )
+    {
+      Ptr<PointsToTrack> ptt = Ptr<PointsToTrack>( new PointsToTrack( i ));
+      PointsToTrack::read( store, i, *ptt );
+      points_to_track_.push_back( ptt );
+    }
+  }
+
   SequenceAnalyzer::~SequenceAnalyzer( void )
   {
   }
 
+  void SequenceAnalyzer::setKeypointsBudget( unsigned int max_keypoints,
+    int grid_rows, int grid_cols )
+  {
+    CV_Assert( !feature_detector_.empty( ) );
+    feature_detector_ = BucketedFeatureDetector::withBudget( feature_detector_,
+      max_keypoints, grid_rows, grid_cols );
+  }
+
+  cv::Mat SequenceAnalyzer::getImage( int idx )
+  {
+    CV_Assert( idx >= 0 && ( size_t )idx < images_.size( ) );
+    if( !images_[ idx ].empty( ) || image_source_.empty( ) )
+      return images_[ idx ];
+    //streaming mode: read the image again (not kept in memory)
+    return image_source_->getFrame( idx );
+  }
+
   void SequenceAnalyzer::addImageToPipeline( cv::Mat image, cv::Ptr<PointsToTrack> points )
   {
     if( points.empty( ) )
@@ -137,15 +274,13 @@ namespace OpencvSfM{
       points_to_track_.begin( ),
       end_matches_it = points_to_track_.end( );
 
-    Ptr<PointsMatcher> point_matcher = match_algorithm_->clone( true );
-    point_matcher->add( points );
-    point_matcher->train( );
+    Ptr<PointsMatcher> point_matcher = matchers_cache_->getMatcher(
+      points_to_track_.size( ) - 1, points, match_algorithm_ );
     int i = 0;
     while ( matches_it != end_matches_it )
     {
-      Ptr<PointsMatcher> point_matcher1 = match_algorithm_->clone( true );
-      point_matcher1->add( points_to_track_[i] );
-      point_matcher1->train( );
+      Ptr<PointsMatcher> point_matcher1 = matchers_cache_->getMatcher(
+        i, points_to_track_[i], match_algorithm_ );
 
 
       std::vector< cv::DMatch > matches = SequenceAnalyzer::simple_matching(
@@ -182,57 +317,70 @@ namespace OpencvSfM{
         }
       }
       TrackOfPoints::fusionDuplicates( tracks_ );
+      tracks_index_valid_ = false;
       //////////////////////////////////////////////////////////////////////////
   }
 
   void SequenceAnalyzer::computeMatches( uchar nbMaxThread, bool printProgress )
   {
-    //First compute missing features descriptors:
-    vector< Ptr< PointsToTrack > >::iterator matches_it =
-      points_to_track_.begin( ),
-      end_matches_it = points_to_track_.end( );
-    MatchingThread::size_list = points_to_track_.size();
-    MatchingThread::match_algorithm = match_algorithm_;
-
-    MatchingThread::matches_ = &points_to_track_;
-
-    double nbMatches = points_to_track_.size();
-    MatchingThread::total_matches = nbMatches * nbMatches / 2.0;
-    MatchingThread::current_match_ = 0;
-    MatchingThread::print_progress_ = printProgress;
+    //every data of this matching session is stored here (nothing static,
+    //so other sequences can be matched at the same time):
+    MatchingContext context( this, mininum_points_matches, printProgress );
+    matchers_cache_->resetStatistics( );
 
     //then init the fundamental matrix list:
     list_fundamental_.clear();
 
-    for( size_t cpt = 0; cpt<MatchingThread::size_list; ++cpt )
+    for( size_t cpt = 0; cpt<context.size_list; ++cpt )
       list_fundamental_.push_back(
-      vector< cv::Ptr<Mat> > ( MatchingThread::size_list - cpt + 1 ) );
-
-    //Try to match each picture with other:
-    vector<Mat> masks;
+      vector< cv::Ptr<Mat> > ( context.size_list - cpt + 1 ) );
 
-    MatchingThread::mininum_points_matches = mininum_points_matches;
     unsigned int nb_proc = MIN( nbMaxThread, boost::thread::hardware_concurrency() );
-    INIT_SEMAPHORE( MatchingThread::thread_concurr, nb_proc );
-    INIT_MUTEX( MatchingThread::thread_unicity );
-
-    unsigned int i=0;
-
-    while ( matches_it != end_matches_it )
+    TaskScheduler scheduler( nb_proc );
+
+    //The tracks builder needs the number of keypoints of each image. The
+    //descriptors are kept only if the pairs selection needs them:
+    bool keep_descriptors = pairsSelectionNeedsDescriptors( );
+    for( unsigned int i = 0; i < context.size_list; ++i )
+      scheduler.submit( DetectionThread( points_to_track_[ i ],
+        keep_descriptors ) );
+    scheduler.wait( );
+    vector< unsigned int > nb_points;
+    for( unsigned int i = 0; i < context.size_list; ++i )
+      nb_points.push_back( points_to_track_[ i ]->getKeypoints( ).size( ) );
+    ConcurrentTracksBuilder tracks_builder( nb_points );
+    context.tracks_builder = &tracks_builder;
+
+    //Try to match each picture with other. The unit of work is a pair of
+    //images, so the load is balanced between workers (image 0 has to be
+    //matched with n-1 images, the last one with none):
+    vector< std::pair< unsigned int, unsigned int > > pairs;
+    selectPairsToMatch( pairs );
+    context.total_matches = pairs.size( );
+    //the descriptors of an image are freed after its last pair:
+    context.pending_pairs.assign( context.size_list, 0 );
+    context.descriptors_held.assign( context.size_list, keep_descriptors );
+    for( size_t p = 0; p < pairs.size( ); ++p )
     {
-      //can we start a new thread?
-      P_MUTEX( MatchingThread::thread_concurr );
-      //create local values for the thead:
-      MatchingThread match_thread(this, i );
-      //start the thread:
-      boost::thread myThread(match_thread);
-
-      i++;
-      matches_it++;
+      context.pending_pairs[ pairs[ p ].first ]++;
+      context.pending_pairs[ pairs[ p ].second ]++;
     }
-    for(unsigned int wait_endThread = 0;
-      wait_endThread<nb_proc ; ++wait_endThread)
-      P_MUTEX( MatchingThread::thread_concurr );//wait for last threads
+    if( keep_descriptors )
+      for( unsigned int i = 0; i < context.size_list; ++i )
+        if( context.pending_pairs[ i ] == 0 )
+          points_to_track_[ i ]->free_descriptors( );
+    for( size_t p = 0; p < pairs.size( ); ++p )
+      scheduler.submit( MatchingThread( &context, pairs[ p ].first,
+        pairs[ p ].second ) );
+    scheduler.join( );//wait for last matches and stop workers
+    std::clog<<"Matchers cache: "<<matchers_cache_->getNbHits( )<<" hits, "<<
+      matchers_cache_->getNbMisses( )<<" misses, "<<
+      matchers_cache_->getNbEvictions( )<<" evictions ("<<
+      matchers_cache_->getMemoryUsage( )/( 1024*1024 )<<" MB used)"<<std::endl;
+
+    //now create the tracks (connected components of the matches graph):
+    bool had_tracks = !tracks_.empty( );
+    tracks_builder.buildTracks( tracks_ );
 
     //compute the color of each matches:
     unsigned int max_tracks = tracks_.size();
@@ -257,7 +405,161 @@ namespace OpencvSfM{
       tmp.color = (unsigned int)(
         ((R<<16) & 0x00FF0000) | ((R<<8) & 0x0000FF00)| (B & 0x000000FF));
     }
-    TrackOfPoints::fusionDuplicates( tracks_ );
+    //new tracks can't share points, but they can with the previous ones:
+    if( had_tracks )
+      TrackOfPoints::fusionDuplicates( tracks_ );
+    tracks_index_valid_ = false;
+  }
+
+  //keep at most max_rows rows, regularly spaced:
+  static Mat sampleRows( const Mat& descriptors, unsigned int max_rows )
+  {
+    if( descriptors.rows <= ( int )max_rows )
+      return descriptors;
+    Mat out( max_rows, descriptors.cols, descriptors.type( ) );
+    double step = ( double )descriptors.rows / max_rows;
+    for( unsigned int r = 0; r < max_rows; ++r )
+      descriptors.row( ( int )( r * step ) ).copyTo( out.row( r ) );
+    return out;
+  }
+
+  void SequenceAnalyzer::selectPairsToMatch(
+    vector< std::pair< unsigned int, unsigned int > >& pairs )
+  {
+    //size of the vocabulary tree training set:
+    static const unsigned int max_training_descriptors = 100000;
+
+    unsigned int nb_images = points_to_track_.size( );
+    pairs.clear( );
+    if( temporal_window_ > 0 )
+    {
+      selectSequentialPairs( pairs );
+      return;
+    }
+    if( nb_candidates_ == 0 || nb_candidates_ + 1 >= nb_images )
+    {
+      for( unsigned int i = 0; i < nb_images; ++i )
+        for( unsigned int j = i + 1; j < nb_images; ++j )
+          pairs.push_back( std::make_pair( i, j ) );
+      return;
+    }
+
+    //train the tree with some descriptors of each image (they are already
+    //computed by computeMatches, and kept until the last pair of each image):
+    unsigned int max_per_image = MAX( max_training_descriptors / nb_images, 1 );
+    vector<Mat> samples( nb_images );
+    int nb_rows = 0, nb_cols = 0;
+    for( unsigned int i = 0; i < nb_images; ++i )
+    {
+      samples[ i ] = sampleRows( VocabularyTree::convertDescriptors(
+        points_to_track_[ i ]->getDescriptors( ) ), max_per_image );
+      nb_rows += samples[ i ].rows;
+      if( !samples[ i ].empty( ) )
+        nb_cols = samples[ i ].cols;
+    }
+    Mat training( nb_rows, nb_cols, CV_32F );
+    nb_rows = 0;
+    for( unsigned int i = 0; i < nb_images; ++i )
+    {
+      if( samples[ i ].empty( ) )
+        continue;
+      samples[ i ].copyTo( training.rowRange( nb_rows,
+        nb_rows + samples[ i ].rows ) );
+      nb_rows += samples[ i ].rows;
+    }
+    samples.clear( );
+    VocabularyTree tree;
+    tree.build( training );
+    training.release( );
+
+    //then score the images:
+    for( unsigned int i = 0; i < nb_images; ++i )
+      tree.addImage( VocabularyTree::convertDescriptors(
+        points_to_track_[ i ]->getDescriptors( ) ) );
+    tree.computeWeights( );
+
+    //a pair is matched if one of the images is a candidate of the other:
+    std::set< std::pair< unsigned int, unsigned int > > selected_pairs;
+    vector< unsigned int > best;
+    for( unsigned int i = 0; i < nb_images; ++i )
+    {
+      tree.getBestImages( i, nb_candidates_, best );
+      for( size_t b = 0; b < best.size( ); ++b )
+        selected_pairs.insert( std::make_pair( MIN( i, best[ b ] ),
+          MAX( i, best[ b ] ) ) );
+    }
+    pairs.assign( selected_pairs.begin( ), selected_pairs.end( ) );
+    std::clog<<"Vocabulary tree: "<<pairs.size( )<<" pairs to match instead of "<<
+      nb_images * ( nb_images - 1 ) / 2<<" ("<<tree.getNbWords( )<<" words)"<<std::endl;
+  }
+
+  //global descriptor of an image: zero mean, unit norm grayscale thumbnail
+  static Mat computeThumbnail( const Mat& image )
+  {
+    static const int thumbnail_size = 16;
+    Mat gray, small_img, thumbnail;
+    if( image.channels( ) == 3 )
+      cv::cvtColor( image, gray, CV_BGR2GRAY );
+    else
+      gray = image;
+    cv::resize( gray, small_img, cv::Size( thumbnail_size, thumbnail_size ),
+      0, 0, cv::INTER_AREA );
+    small_img.reshape( 1, 1 ).convertTo( thumbnail, CV_32F );
+    thumbnail -= cv::mean( thumbnail );
+    double norm = cv::norm( thumbnail );
+    if( norm > 0 )
+      thumbnail /= norm;
+    return thumbnail;
+  }
+
+  void SequenceAnalyzer::selectSequentialPairs(
+    vector< std::pair< unsigned int, unsigned int > >& pairs )
+  {
+    //minimal correlation between thumbnails of a loop closure:
+    static const float min_loop_score = 0.8f;
+
+    unsigned int nb_images = points_to_track_.size( );
+    std::set< std::pair< unsigned int, unsigned int > > selected_pairs;
+    for( unsigned int i = 0; i < nb_images; ++i )
+      for( unsigned int j = i + 1; j < nb_images && j <= i + temporal_window_; ++j )
+        selected_pairs.insert( std::make_pair( i, j ) );
+    size_t nb_sequential = selected_pairs.size( );
+
+    //key frames are compared with older key frames outside of the window
+    //(images are needed, else no loop can be detected):
+    vector< unsigned int > key_frames;
+    vector< Mat > thumbnails;
+    for( unsigned int i = 0; i < nb_images && nb_loop_candidates_ > 0;
+      i += temporal_window_ )
+    {
+      Mat image = i < images_.size( ) ? getImage( i ) : Mat( );
+      if( image.empty( ) )
+        continue;
+      key_frames.push_back( i );
+      thumbnails.push_back( computeThumbnail( image ) );
+    }
+    vector< std::pair< float, unsigned int > > candidates;
+    for( size_t k = 0; k < key_frames.size( ); ++k )
+    {
+      candidates.clear( );
+      for( size_t j = 0; j < k; ++j )
+      {
+        if( key_frames[ j ] + temporal_window_ >= key_frames[ k ] )
+          break;
+        float score = ( float )thumbnails[ k ].dot( thumbnails[ j ] );
+        if( score >= min_loop_score )
+          candidates.push_back( std::make_pair( score, key_frames[ j ] ) );
+      }
+      size_t nb_best = MIN( ( size_t )nb_loop_candidates_, candidates.size( ) );
+      std::partial_sort( candidates.begin( ), candidates.begin( ) + nb_best,
+        candidates.end( ), std::greater< std::pair< float, unsigned int > >( ) );
+      for( size_t b = 0; b < nb_best; ++b )
+        selected_pairs.insert( std::make_pair( candidates[ b ].second, key_frames[ k ] ) );
+    }
+    pairs.assign( selected_pairs.begin( ), selected_pairs.end( ) );
+    std::clog<<"Temporal window: "<<pairs.size( )<<" pairs to match ("<<
+      pairs.size( ) - nb_sequential<<" loop closures) instead of "<<
+      nb_images * ( nb_images - 1 ) / 2<<std::endl;
   }
 
   void SequenceAnalyzer::keepOnlyCorrectMatches(
@@ -287,6 +589,7 @@ namespace OpencvSfM{
     unsigned int img1, unsigned int img2 )
   {
     //add to tracks_ the new matches:
+    getTracksIndex( );//be sure the index is up to date
 
     vector<DMatch>::iterator match_it = newMatches.begin( );
     vector<DMatch>::iterator match_it_end = newMatches.end( );
@@ -295,40 +598,38 @@ namespace OpencvSfM{
     {
       DMatch &point_matcher = ( *match_it );
 
-      bool is_found=false;
-      vector<TrackOfPoints>::iterator tracks_it = tracks_.begin( );
-      while ( tracks_it != tracks_.end( ) && !is_found )
-      {
-        TrackOfPoints& track = ( *tracks_it );
-
-        if( track.containPoint( img1,point_matcher.trainIdx ))
-        {
-          track.addMatch( img2,point_matcher.queryIdx );
-          is_found=true;
-        }
-        else
-        {
-          if( track.containPoint( img2,point_matcher.queryIdx ))
-          {
-            track.addMatch( img1,point_matcher.trainIdx );
-            is_found=true;
-          }
-        }
-        tracks_it++;
-      }
-      if( !is_found )
+      //the first track containing one of the two points is used:
+      int track1 = tracks_index_.getTrack( img1,point_matcher.trainIdx );
+      int track2 = tracks_index_.getTrack( img2,point_matcher.queryIdx );
+      if( track1 >= 0 && ( track2 < 0 || track1 <= track2 ) )
+        addMatchToTrack( track1, img2, point_matcher.queryIdx );
+      else if( track2 >= 0 )
+        addMatchToTrack( track2, img1, point_matcher.trainIdx );
+      else
       {
         //it's a new point match, create a new track:
         TrackOfPoints newTrack;
         newTrack.addMatch( img1,point_matcher.trainIdx );
         newTrack.addMatch( img2,point_matcher.queryIdx );
         tracks_.push_back( newTrack );
+        tracks_index_.addTrack( newTrack, tracks_.size( ) - 1 );
       }
 
       match_it++;
     }
   }
 
+  void SequenceAnalyzer::addMatchToTrack( unsigned int idx_track,
+    unsigned int image, unsigned int point )
+  {
+    TrackOfPoints& track = tracks_[ idx_track ];
+    size_t nb_points = track.images_indexes_.size( );
+    track.addMatch( image, point );
+    //if a good point was added, update the index:
+    if( track.images_indexes_.size( ) > nb_points && track.good_values.back( ) )
+      tracks_index_.addPoint( idx_track, image, point );
+  }
+
   void SequenceAnalyzer::addTracks( std::vector< TrackOfPoints > &newTracks )
   {
 
@@ -338,6 +639,8 @@ namespace OpencvSfM{
     while ( match_it != match_it_end )
     {
       tracks_.push_back( *match_it );
+      if( tracks_index_valid_ )
+        tracks_index_.addTrack( tracks_.back( ), tracks_.size( ) - 1 );
 
       match_it++;
     }
@@ -359,23 +662,15 @@ namespace OpencvSfM{
       {
         vector<DMatch> matches_to_print;
         //add to matches_to_print only points of img it and it+1:
-
-        vector<TrackOfPoints>::iterator match_it = tracks_.begin( );
-        vector<TrackOfPoints>::iterator match_it_end = tracks_.end( );
-
-        while ( match_it != match_it_end )
-        {
-          if( match_it->containImage( it ) &&
-            match_it->containImage( it1 ) )
-          {
-            matches_to_print.push_back( match_it->toDMatch( it,it1 ));
-          }
-          match_it++;
-        }
+        vector<unsigned int> tracks_between;
+        getTracksIndex( ).getTracksBetween( it, it1, tracks_between );
+        for( size_t t = 0; t < tracks_between.size( ); ++t )
+          matches_to_print.push_back(
+            tracks_[ tracks_between[ t ] ].toDMatch( it,it1 ) );
 
         if( matches_to_print.size()>0 )
         {
-          Mat firstImg=images_[ it ];
+          Mat firstImg=getImage( it );
           Mat outImg;
 
           PointsMatcher::drawMatches( firstImg, points_to_track_[ it ]->getKeypoints( ),
@@ -405,30 +700,27 @@ namespace OpencvSfM{
     matches_to_print.assign( points_to_track_.size( ), vector<DMatch>() );
     //add to matches_to_print only points of img it and it+1:
 
-    vector<TrackOfPoints>::iterator match_it = tracks_.begin( );
-    vector<TrackOfPoints>::iterator match_it_end = tracks_.end( );
+    const vector<TracksIndex::Observation>& observations =
+      getTracksIndex( ).getObservations( img_to_show );
     unsigned int i = 0;
-    while ( match_it != match_it_end )
+    for( size_t t = 0; t < observations.size( ); ++t )
     {
-      if( match_it->containImage( img_to_show ) )
+      const TrackOfPoints& track = tracks_[ observations[ t ].track ];
+      for(i = 0; i<track.images_indexes_.size(); i++)
       {
-        for(i = 0; i<match_it->images_indexes_.size(); i++)
+        if(track.images_indexes_[i] != img_to_show)
         {
-          if(match_it->images_indexes_[i] != img_to_show)
-          {
-            matches_to_print[ match_it->images_indexes_[i] ].
-              push_back( match_it->toDMatch( img_to_show, match_it->images_indexes_[i] ));
-          }
+          matches_to_print[ track.images_indexes_[i] ].
+            push_back( track.toDMatch( img_to_show, track.images_indexes_[i] ));
         }
       }
-      match_it++;
     }
 
     for(i = 0; i<matches_to_print.size(); i++)
     {
       if( matches_to_print[i].size()>0 )
       {
-        Mat firstImg=images_[ it ];
+        Mat firstImg=getImage( it );
         Mat outImg;
 
         PointsMatcher::drawMatches( firstImg, points_to_track_[ img_to_show ]->getKeypoints( ),
@@ -453,22 +745,16 @@ namespace OpencvSfM{
 
     vector<DMatch> matches_to_print,matches_to_print1;
     //add to matches_to_print only points of img1 and img2:
-
-    vector<TrackOfPoints>::iterator match_it = tracks_.begin( );
-    vector<TrackOfPoints>::iterator match_it_end = tracks_.end( );
-
-    while ( match_it != match_it_end )
+    vector<unsigned int> tracks_between;
+    getTracksIndex( ).getTracksBetween( img1, img2, tracks_between );
+    for( size_t t = 0; t < tracks_between.size( ); ++t )
     {
-      if( match_it->containImage( img1 ) &&
-        match_it->containImage( img2 ) )
-      {
-        matches_to_print.push_back( match_it->toDMatch( img1,img2 ));
-        matches_to_print1.push_back( match_it->toDMatch( img2,img1 ));
-      }
-      match_it++;
+      const TrackOfPoints& track = tracks_[ tracks_between[ t ] ];
+      matches_to_print.push_back( track.toDMatch( img1,img2 ));
+      matches_to_print1.push_back( track.toDMatch( img2,img1 ));
     }
     if( img.empty() )
-      img = images_[ img1 ];
+      img = getImage( img1 );
     Mat outImg,outImg1;
     PointsMatcher::drawMatches( img, points_to_track_[ img1 ]->getKeypoints( ),
       points_to_track_[ img2 ]->getKeypoints( ),
@@ -480,7 +766,7 @@ namespace OpencvSfM{
 
     if(should_print)
     {
-    PointsMatcher::drawMatches( images_[ img2 ], points_to_track_[ img2 ]->getKeypoints( ),
+    PointsMatcher::drawMatches( getImage( img2 ), points_to_track_[ img2 ]->getKeypoints( ),
       points_to_track_[ img1 ]->getKeypoints( ),
       matches_to_print1, outImg1,
       cv::Scalar::all( -1 ), cv::Scalar::all( -1 ), vector<char>( ),
@@ -584,6 +870,7 @@ namespace OpencvSfM{
       me.tracks_.push_back( track );
       it++;
     }
+    me.tracks_index_valid_ = false;
   }
 
   void SequenceAnalyzer::write( cv::FileStorage& fs, const SequenceAnalyzer& me )
@@ -643,6 +930,41 @@ namespace OpencvSfM{
     fs << "]" << "}";
   }
 
+  void SequenceAnalyzer::writeFeatures( const std::string& filename ) const
+  {
+    FeaturesStore::write( filename, points_to_track_ );
+  }
+
+  void SequenceAnalyzer::writeTracks( const std::string& filename ) const
+  {
+    TrackStore store( tracks_ );
+    store.write( filename );
+  }
+
+  void SequenceAnalyzer::readTracks( const std::string& filename )
+  {
+    TrackStore store;
+    store.read( filename );
+    vector<TrackOfPoints> tracks;
+    store.toTracks( tracks );
+    //points are referenced by index, check they exist:
+    for( size_t t = 0; t < tracks.size( ); ++t )
+    {
+      const TrackOfPoints& track = tracks[ t ];
+      for( size_t p = 0; p < track.images_indexes_.size( ); ++p )
+      {
+        unsigned int idImage = track.images_indexes_[ p ];
+        if( idImage >= points_to_track_.size( ) ||
+          track.point_indexes_[ p ] >=
+          points_to_track_[ idImage ]->getKeypoints( ).size( ) )
+          CV_Error( CV_StsError, "Tracks of " + filename +
+          " don't correspond to the loaded points!" );
+      }
+    }
+    tracks_.swap( tracks );
+    tracks_index_valid_ = false;
+  }
+
   void SequenceAnalyzer::constructImagesGraph( )
   {
     images_graph_.initStructure( points_to_track_.size( ) );
@@ -705,7 +1027,7 @@ namespace OpencvSfM{
         (float)pixelProjection[ cpt ][1], 1.0 ) );
     }
     cv::Mat outImg;
-    cv::drawKeypoints( images_[i], keypoints, outImg );
+    cv::drawKeypoints( getImage( i ), keypoints, outImg );
     cv::imshow( "Keypoints", outImg );
     cv::waitKey( 0 );
     cv::destroyWindow( "Keypoints" );
@@ -736,10 +1058,8 @@ namespace OpencvSfM{
       status.push_back( 1 );
     }
 
-    //free some memory:
-    point_matcher->clear();
-    point_matcher1->clear();
-
+    //the matchers belong to the caller (for instance the matchers cache),
+    //they are not cleared here.
     if( srcP.size()< mininum_points_matches )
       return matches_i_j;
     cv::Mat fundam = cv::findFundamentalMat( srcP, destP, status, cv::FM_RANSAC, 1 );
@@ -833,6 +1153,7 @@ namespace OpencvSfM{
       }
     }
     motion_estim.points_to_track_ = new_ptt;
+    motion_estim.tracks_index_valid_ = false;//points indexes have changed
     for( size_t i=0; i<motion_estim.points_to_track_.size(); i++ )
     {
       Ptr<PointsToTrack> ptt = Ptr<PointsToTrack>(
@@ -5,13 +5,17 @@
 #include "PointsToTrackWithImage.h"
 #include "MotionProcessor.h"
 #include "PointsMatcher.h"
+#include "MatchersCache.h"
 #include "PointOfView.h"
 //#include "libmv_mapping.h"
 #include "TracksOfPoints.h"
+#include "TracksIndex.h"
 #include "opencv2/calib3d/calib3d.hpp"
 
 namespace OpencvSfM{
   struct MatchingThread;
+  struct MatchingContext;
+  class FeaturesPipeline;
 
   /**
   * \brief This class tries to match points in the entire sequence.
@@ -25,6 +29,7 @@ namespace OpencvSfM{
   class SFM_EXPORTS SequenceAnalyzer
   {
     friend struct MatchingThread;
+    friend struct MatchingContext;
   protected:
     static int mininum_points_matches;///<Minimum points detected into an image to keep this estimation (set to 20)
     static int mininum_image_matches;///<Minimum images connections in a track to keep this estimation (usually set to 2)
@@ -41,9 +46,15 @@ namespace OpencvSfM{
     */
     std::vector< cv::Ptr< PointsToTrack > > points_to_track_;
     /**
-    * List of input images
+    * List of input images (empty matrices in streaming mode, see getImage)
     */
     std::vector<cv::Mat> images_;
+    std::vector<cv::Size> images_size_;///<size of each image, only used in streaming mode
+    /**
+    * In streaming mode, source of images: they are read again when needed
+    * instead of being kept in memory (shared with the points of images).
+    */
+    cv::Ptr<FramesReader> image_source_;
     /**
     * The matcher algorithm we should use to find matches.
     */
@@ -54,11 +65,22 @@ namespace OpencvSfM{
     */
     std::vector< cv::Ptr< PointsMatcher > > matches_;
     /**
+    * Trained matchers of each picture, shared by every pair of images using
+    * this picture so each matcher is trained only once.
+    */
+    cv::Ptr<MatchersCache> matchers_cache_;
+    /**
     * List of each tracks found. A track is a connected set of matching
     * keypoints across multiple images
     */
     std::vector<TrackOfPoints> tracks_;
     /**
+    * Index of tracks_ to find quickly the tracks of an image or of a point.
+    * Only valid if tracks_index_valid_ is true, see getTracksIndex( ).
+    */
+    TracksIndex tracks_index_;
+    bool tracks_index_valid_;///<false if tracks_ may have changed since the index was built
+    /**
     * Graph of images relations ( value ( i,j ) correspond to the numbers
     * of matches between theses two images
     */
@@ -70,6 +92,66 @@ namespace OpencvSfM{
     * This matrix is uper-triangular, that is [2][1] exist, but [1][2] not...
     */
     std::vector< std::vector< cv::Ptr< cv::Mat > > > list_fundamental_;
+    /**
+    * If not 0, each image is only matched with its nb_candidates_ most
+    * similar images (found using a vocabulary tree) instead of every images.
+    */
+    unsigned int nb_candidates_;
+    /**
+    * If not 0, images are frames of a video: each frame is only matched
+    * with the temporal_window_ previous frames, plus loop closure candidates.
+    */
+    unsigned int temporal_window_;
+    unsigned int nb_loop_candidates_;///<number of loop closure candidates of each key frame
+    /**
+    * If true, the points of a pair are matched in one direction only: once
+    * the fundamental matrix is estimated, the reverse check and the
+    * unmatched points use only the points close to the epipolar lines
+    * (false by default, see setGuidedMatching).
+    */
+    bool guided_matching_;
+
+    /**
+    * Find the pairs of images computeMatches has to match: every pairs if
+    * nb_candidates_ is 0, else the union of the nb_candidates_ most similar
+    * images of each image, scored by a TF-IDF vocabulary tree.
+    * If temporal_window_ is not 0, see selectSequentialPairs.
+    * If pairsSelectionNeedsDescriptors( ), the descriptors of every image
+    * have to be computed before (they are not freed, the matching uses them
+    * next).
+    * @param pairs output, list of pairs ( i, j ) with i < j, sorted
+    */
+    void selectPairsToMatch(
+      std::vector< std::pair< unsigned int, unsigned int > >& pairs );
+    /**
+    * Check if selectPairsToMatch uses the descriptors (vocabulary tree).
+    * Else, the descriptors of an image are computed only when its first pair
+    * is matched, and freed after its last one.
+    * @return true if the descriptors of every image are needed at once
+    */
+    inline bool pairsSelectionNeedsDescriptors( ) const
+    {
+      return temporal_window_ == 0 && nb_candidates_ > 0 &&
+        nb_candidates_ + 1 < points_to_track_.size( );
+    }
+    /**
+    * Find the pairs of frames to match in a video: each frame with the
+    * temporal_window_ previous frames, and each key frame (one every
+    * temporal_window_ frames) with its nb_loop_candidates_ most similar
+    * older key frames, compared using thumbnails of the images.
+    * The number of pairs grows linearly with the number of frames.
+    * @param pairs output, list of pairs ( i, j ) with i < j, sorted
+    */
+    void selectSequentialPairs(
+      std::vector< std::pair< unsigned int, unsigned int > >& pairs );
+    /**
+    * Load every frames of a pipeline (used by constructors)
+    * @param pipeline pipeline not yet started
+    * @param streaming if true, images are released once their points are computed
+    * @param printProgress if true, the statistics of the pipeline are printed
+    */
+    void loadSequence( FeaturesPipeline& pipeline, bool streaming,
+      bool printProgress );
   public:
     /**
     * Constructor taking a MotionProcessor to load images and a features detector
@@ -78,11 +160,33 @@ namespace OpencvSfM{
     * @param feature_detector Algorithm to use for features detection ( see http://opencv.willowgarage.com/documentation/cpp/common_interfaces_for_feature_detection_and_descriptor_extraction.html#featuredetector )
     * @param descriptor_extractor Algorithm to use for descriptors detection ( see http://opencv.willowgarage.com/documentation/cpp/common_interfaces_for_feature_detection_and_descriptor_extraction.html#descriptorextractor )
     * @param match_algorithm algorithm to match points of each images
+    * @param streaming if true, images and descriptors are released once
+    * points and colors are computed. Images are read again from
+    * input_sequence only when needed (see getImage), for instance to compute
+    * the descriptors again before the matching. Frames of a webcam can't be
+    * read again, they are kept. The peak memory usage is then reported.
+    * @param printProgress if true, the statistics of the loading are printed
+    * @param max_keypoints keypoints budget of each image, spread over a 4x4
+    * grid (see setKeypointsBudget), 0 to use the detector alone
     */
     SequenceAnalyzer( MotionProcessor input_sequence,
       cv::Ptr<cv::FeatureDetector> feature_detector,
       cv::Ptr<cv::DescriptorExtractor> descriptor_extractor,
-      cv::Ptr<PointsMatcher> match_algorithm );
+      cv::Ptr<PointsMatcher> match_algorithm, bool streaming = false,
+      bool printProgress = false, unsigned int max_keypoints = 0 );
+    /**
+    * Constructor taking a FeaturesPipeline to load images and compute
+    * their points in several threads (see FeaturesPipeline::setNbThreads).
+    * The keypoints budget of the pipeline (FeaturesPipeline::setKeypointsBudget)
+    * is also used by addImageToPipeline.
+    * @param pipeline pipeline not yet started
+    * @param match_algorithm algorithm to match points of each images
+    * @param streaming if true, images and descriptors are released once their points are computed (see above)
+    * @param printProgress if true, the statistics of the pipeline are printed once every frames are loaded
+    */
+    SequenceAnalyzer( FeaturesPipeline& pipeline,
+      cv::Ptr<PointsMatcher> match_algorithm, bool streaming = false,
+      bool printProgress = false );
     /**
     * Constructor with a features detector, descriptor and matcher.
     * @param feature_detector Algorithm to use for features detection ( see http://opencv.willowgarage.com/documentation/cpp/common_interfaces_for_feature_detection_and_descriptor_extraction.html#featuredetector )
@@ -113,6 +217,16 @@ namespace OpencvSfM{
     SequenceAnalyzer( cv::FileNode file,
       std::vector<cv::Mat> *images = NULL,
       cv::Ptr<PointsMatcher> match_algorithm = NULL );
+    /**
+    * Constructor taking a list of images and a binary FeaturesStore
+    * (see writeFeatures). Descriptors are used without copy.
+    * @param store previously opened binary file with points of each image
+    * @param images input images. Points should be in the same order!
+    * @param match_algorithm algorithm to match points of each images
+    */
+    SequenceAnalyzer( cv::Ptr<FeaturesStore> store,
+      std::vector<cv::Mat> *images = NULL,
+      cv::Ptr<PointsMatcher> match_algorithm = NULL );
 
     /**
     * Destructor of SequenceAnalyzer (nothing is released!)
@@ -141,6 +255,9 @@ namespace OpencvSfM{
     * It first compute missing features descriptor, then train each matcher.
     * Finally compute tracks of keypoints ( a track is a connected set of
     * matching keypoints across multiple images )
+    * Each pair of images is a task of a work-stealing TaskScheduler, the
+    * tasks add their matches to a lock-free ConcurrentTracksBuilder and tracks
+    * are created once every pair is matched.
     * @param  nbMaxThread st to a lower value if you experience out of memory exception.
     * Indeed, if you have a lot of features, each thread will compute
     * the descriptor for their working image, which can be really big...
@@ -166,8 +283,46 @@ namespace OpencvSfM{
       }
     /**
     * This method can be used to get the tracks
+    * As the tracks can be modified using the returned reference, the index
+    * of tracks will be rebuilt on next call to getTracksIndex( ).
+    */
+    inline std::vector<TrackOfPoints> &getTracks( ){
+      tracks_index_valid_ = false;
+      return tracks_;};
+    /**
+    * This method can be used to read the tracks without invalidating the
+    * index of tracks
+    */
+    inline const std::vector<TrackOfPoints> &getTracks( ) const{
+      return tracks_;};
+    /**
+    * Change the 3D position of a track. The points of the track are not
+    * changed, so the index of tracks stays valid.
+    * @param idx_track index of the track
+    * @param point new 3D position
     */
-    inline std::vector<TrackOfPoints> &getTracks( ){return tracks_;};
+    inline void set3DPosition( unsigned int idx_track, const cv::Vec3d& point ){
+      tracks_[ idx_track ].set3DPosition( point );};
+    /**
+    * Get the index of the tracks (tracks of an image, track of a point...).
+    * The index is rebuilt here if the tracks may have changed.
+    * @return index of tracks, valid until the tracks change
+    */
+    inline const TracksIndex& getTracksIndex( )
+    {
+      if( !tracks_index_valid_ )
+      {
+        tracks_index_.build( tracks_ );
+        tracks_index_valid_ = true;
+      }
+      return tracks_index_;
+    };
+    /**
+    * Is the index of tracks up to date (i.e. will getTracksIndex( ) return
+    * it without rebuilding it)?
+    * @return false if the tracks may have changed since the index was built
+    */
+    inline bool isTracksIndexValid( ) const { return tracks_index_valid_; };
     /**
     * This method can be used to get the points
     */
@@ -220,6 +375,27 @@ namespace OpencvSfM{
     */
     static void write( cv::FileStorage& fs, const SequenceAnalyzer& points );
 
+    /**
+    * Save the points of each image into a binary FeaturesStore. Tracks
+    * are not saved: use writeTracks for them.
+    * @param filename name of the file to create
+    */
+    void writeFeatures( const std::string& filename ) const;
+    /**
+    * Save the tracks into a binary file (see TrackStore::write). Tracks
+    * only store (image, point) indexes, so the points should be saved
+    * too (see writeFeatures).
+    * @param filename name of the file to create
+    */
+    void writeTracks( const std::string& filename ) const;
+    /**
+    * Load the tracks from a binary file (see writeTracks), in a time
+    * linear with the number of observations. Points should already be
+    * loaded (for instance using the FeaturesStore constructor).
+    * @param filename name of the file to open
+    */
+    void readTracks( const std::string& filename );
+
     /**
     * Use this function to know how many images are stored into tracks...
     * @return numbers of images (and cameras) stored into tracks.
@@ -241,11 +417,21 @@ namespace OpencvSfM{
     }
 
     /**
-    * get the ith image. No checks are performed!
+    * get the ith image. In streaming mode, the image is read again from
+    * the input sequence (not thread safe, and the image is not cached).
     * @param idx index of the wanted image
-    * @return Matrix of the wanted image
+    * @return Matrix of the wanted image (empty if it can't be read again)
     */
-    inline cv::Mat getImage( int idx ) { return images_[ idx ]; };
+    cv::Mat getImage( int idx );
+    /**
+    * get the size of the ith image, without reading it in streaming mode.
+    * @param idx index of the wanted image
+    * @return size of the wanted image
+    */
+    inline cv::Size getImageSize( unsigned int idx ) const
+    {
+      return idx < images_size_.size( ) ? images_size_[ idx ] : images_[ idx ].size( );
+    };
 
     /**
     * This function add matches to tracks
@@ -255,6 +441,14 @@ namespace OpencvSfM{
     */
     void addMatches( std::vector<cv::DMatch> &newMatches,
       unsigned int img1, unsigned int img2 );
+    /**
+    * Add a point to a track and keep the index of tracks up to date
+    * @param idx_track index of the track
+    * @param image index of the image
+    * @param point index of the point in the image
+    */
+    void addMatchToTrack( unsigned int idx_track,
+      unsigned int image, unsigned int point );
 
     /**
     * This function add new Tracks
@@ -295,6 +489,96 @@ namespace OpencvSfM{
     */
     inline cv::Ptr<PointsMatcher> getMatchAlgo()
     { return match_algorithm_->clone( true ); };
+    /**
+    * Get the cache of trained matchers of this sequence (for instance
+    * to change its memory budget).
+    * @return cache of trained matchers
+    */
+    inline cv::Ptr<MatchersCache> getMatchersCache()
+    { return matchers_cache_; };
+    /**
+    * Set the number of candidate images matched with each image. The
+    * candidates are the most similar images found using a vocabulary tree,
+    * so large unordered collections don't need O( n^2 ) matchings.
+    * @param nb_candidates 0 to match every pairs of images (default)
+    */
+    inline void setNbCandidates( unsigned int nb_candidates )
+    { nb_candidates_ = nb_candidates; };
+    /**
+    * Get the number of candidate images matched with each image
+    * @return number of candidates (0 if every pairs are matched)
+    */
+    inline unsigned int getNbCandidates( ) const
+    { return nb_candidates_; };
+    /**
+    * Match each frame only with the previous ones, for video sequences.
+    * This mode is enabled by default when the sequence is loaded from a
+    * video or a webcam, and has priority over setNbCandidates.
+    * @param window number of previous frames matched with each frame (0 to disable)
+    * @param nb_loop_candidates number of older key frames matched with each key frame to close loops
+    */
+    inline void setTemporalWindow( unsigned int window,
+      unsigned int nb_loop_candidates = 2 )
+    {
+      temporal_window_ = window;
+      nb_loop_candidates_ = nb_loop_candidates;
+    };
+    /**
+    * Get the number of previous frames matched with each frame
+    * @return size of the temporal window (0 if disabled)
+    */
+    inline unsigned int getTemporalWindow( ) const
+    { return temporal_window_; };
+    /**
+    * Get the number of loop closure candidates of each key frame
+    * @return number of loop closure candidates
+    */
+    inline unsigned int getNbLoopCandidates( ) const
+    { return nb_loop_candidates_; };
+    /**
+    * Enable or disable the guided matching: the points of the second image
+    * are matched with every points of the first one, then, once the
+    * fundamental matrix is estimated, the reciprocity of these matches is
+    * checked and each unmatched point is compared only with the points
+    * close to its epipolar line (instead of matching every points in the
+    * other direction too). Disabled by default: callers have to enable it.
+    * @param guided true to enable the guided matching
+    */
+    inline void setGuidedMatching( bool guided )
+    { guided_matching_ = guided; };
+    /**
+    * Is the guided matching enabled?
+    * @return true if the guided matching is enabled
+    */
+    inline bool isGuidedMatching( ) const
+    { return guided_matching_; };
+    /**
+    * Get the fundamental matrix estimated between two images by
+    * computeMatches (x_img1^T * F * x_img2 = 0)
+    * @param img1 index of the first image
+    * @param img2 index of the second image (img2 > img1)
+    * @return the fundamental matrix, empty if the images don't match
+    */
+    inline cv::Ptr<cv::Mat> getFundamental( unsigned int img1, unsigned int img2 ) const
+    {
+      if( img1 >= img2 || img1 >= list_fundamental_.size( ) ||
+        img2 - img1 >= list_fundamental_[ img1 ].size( ) )
+        return cv::Ptr<cv::Mat>( );
+      return list_fundamental_[ img1 ][ img2 - img1 ];
+    };
+    /**
+    * Bound the number of keypoints detected in each image added later with
+    * addImageToPipeline or addImageToTracks: the detector is wrapped into a
+    * BucketedFeatureDetector which spreads the keypoints over a grid.
+    * Images loaded by the constructors are already detected: use the
+    * max_keypoints parameter of the constructor, or
+    * FeaturesPipeline::setKeypointsBudget, to bound them.
+    * @param max_keypoints keypoints budget of each image (0 to use the detector alone)
+    * @param grid_rows number of cells in a column
+    * @param grid_cols number of cells in a row
+    */
+    void setKeypointsBudget( unsigned int max_keypoints,
+      int grid_rows = 4, int grid_cols = 4 );
 
     /**
     * This will find matches between two points matchers
@@ -4,52 +4,78 @@
 #include "PointOfView.h"
 #include "PointsToTrack.h"
 #include "Camera.h"
+#include "BatchTriangulator.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
 
 namespace OpencvSfM{
   using std::vector;
   using cv::Ptr;
 
-  vector<char> StructureEstimator::computeStructure( unsigned int max_error )
-  {
-    vector<char> output_mask;
-    vector<TrackOfPoints>& tracks = sequence_->getTracks( );
-    vector< Ptr< PointsToTrack > > points_to_track = sequence_->getPoints( );
+  static const size_t TRACKS_BY_CHUNK = 256;
 
-    //for each points:
-    vector<TrackOfPoints>::size_type key_size = tracks.size( );
-    vector<PointOfView>::size_type num_camera = cameras_->size( );
-    int idImage=-1, idPoint=-1;
-    vector<TrackOfPoints>::size_type i;
+  //update the 3D positions of the triangulated tracks (points of the tracks
+  //don't change, so the index of tracks stays valid):
+  static void setPositions( SequenceAnalyzer* sequence,
+    const vector<size_t>& selected, const vector<cv::Vec3d>& points,
+    const vector<double>& distances )
+  {
+    for( size_t cpt = 0; cpt < selected.size( ); ++cpt )
+      if( distances[ cpt ] < 1e20 )
+        sequence->set3DPosition( selected[ cpt ], points[ cpt ] );
+  }
 
-    for ( i=0; i < key_size; i++ )
+  //remove the outliers of the tracks [ begin, end ):
+  static void removeOutliersChunk( const BatchTriangulator* triangulator,
+    vector<PointOfView>* cameras, const vector< Ptr< PointsToTrack > >* points_to_track,
+    vector<TrackOfPoints>* tracks, double max_error, size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
     {
-      TrackOfPoints &track = tracks[ i ];
-      unsigned int nviews = track.getNbTrack( );
+      TrackOfPoints &track = ( *tracks )[ i ];
+      CV_DbgAssert( track.getNbTrack( ) <= cameras->size( ) );
 
-      CV_DbgAssert( nviews <= cameras_->size( ) );
-
-      cv::Vec3d point_final;
-      double distance=track.triangulateRobust( *cameras_,points_to_track, point_final );
-      //double distance=track.triangulateLinear( *cameras_,points_to_track, point_final );
+      if( track.get3DPosition( ).empty( ) )
+      {
+        cv::Vec3d point_final;
+        triangulator->triangulate( track, point_final, i );
+        if( track.get3DPosition( ).empty( ) )
+          continue;//less than 2 views...
+      }
 
-      //tests:
+      track.removeOutliers( *cameras, *points_to_track, max_error );
+    }
+  }
 
+  vector<char> StructureEstimator::computeStructure( unsigned int max_error )
+  {
+    vector<char> output_mask;
+    vector<TrackOfPoints>& tracks = sequence_->getTracks( );
+    vector< Ptr< PointsToTrack > > points_to_track = sequence_->getPoints( );
 
-      //////////////////////////////////////////////////////////////////////////
+    //triangulate every tracks in one pass:
+    BatchTriangulator triangulator( *cameras_, points_to_track, seed_ );
+    triangulator.setNbThreads( nb_threads_ );
+    vector<double> distances;
+    triangulator.triangulate( tracks, distances );
 
-      //this is used to take only correct 3D points:
-      output_mask.push_back( ( distance<max_error ) );
-    }
+    //this is used to take only correct 3D points:
+    for ( size_t i=0; i < distances.size( ); i++ )
+      output_mask.push_back( ( distances[ i ]<max_error ) );
     return output_mask;
   }
 
   std::vector< TrackOfPoints > StructureEstimator::computeStructure(
-    const std::vector<int>& list_of_images, unsigned int max_error )
+    const std::vector<int>& list_of_images, unsigned int max_error,
+    StructureIndex* structure_index )
   {
     CV_Assert( list_of_images.size( ) > 1 );
 
     std::vector< TrackOfPoints > points3D;
-    vector<TrackOfPoints>& tracks = sequence_->getTracks( );
+    const SequenceAnalyzer& sequence = *sequence_;
+    const vector<TrackOfPoints>& tracks = sequence.getTracks( );
     vector< Ptr< PointsToTrack > > &points_to_track = sequence_->getPoints( );
 
     //for each points:
@@ -59,37 +85,138 @@ namespace OpencvSfM{
     vector<TrackOfPoints>::size_type i;
     vector<int>::size_type images_size =list_of_images.size( );
 
-    for ( i=0; i < key_size; i++ )
+    //count the wanted images seen by each track, using only the tracks of
+    //these images:
+    const TracksIndex& index = sequence_->getTracksIndex( );
+    vector<unsigned int> candidates;
+    for( size_t it_img = 0; it_img<images_size ; ++it_img )
     {
-      TrackOfPoints &track = tracks[ i ];
-      int nbLinks = 0;
-      for( size_t it_img = 0; it_img<images_size ; ++it_img )
-        if( track.containImage( list_of_images[ it_img ] ) )
-          nbLinks++;
+      const vector<TracksIndex::Observation>& observations =
+        index.getObservations( list_of_images[ it_img ] );
+      for( size_t cpt = 0; cpt < observations.size( ); ++cpt )
+        candidates.push_back( observations[ cpt ].track );
+    }
+    //keep the same order than tracks:
+    std::sort( candidates.begin( ), candidates.end( ) );
 
+    //keep the tracks seen by at least 2 wanted images:
+    vector<size_t> selected;
+    size_t nb_candidates = candidates.size( );
+    for ( size_t cpt = 0; cpt < nb_candidates; )
+    {
+      i = candidates[ cpt ];
+      int nbLinks = 0;
+      while( cpt < nb_candidates && candidates[ cpt ] == i )
+      {
+        nbLinks++;
+        cpt++;
+      }
       if( nbLinks > 1 )
+        selected.push_back( i );
+    }
+
+    //tracks are independent, triangulate them by chunks using only the
+    //points of the wanted images:
+    BatchTriangulator triangulator( *cameras_, points_to_track, seed_ );
+    triangulator.setNbThreads( nb_threads_ );
+    vector<cv::Vec3d> points;
+    vector<double> distances;
+    triangulator.triangulate( tracks, selected, list_of_images, points,
+      distances );
+    setPositions( sequence_, selected, points, distances );
+
+    if( structure_index != NULL )
+    {
+      structure_index->sequence_track.clear( );
+      structure_index->position.assign( tracks.size( ), -1 );
+    }
+    for( size_t cpt = 0; cpt < selected.size( ); ++cpt )
+      if( distances[ cpt ]<max_error )
       {
-        unsigned int nviews = track.getNbTrack( );
-        vector<bool> mask;
-        for( unsigned int j=0; j<nviews; ++j )
+        if( structure_index != NULL )
         {
-          if( std::find( list_of_images.begin( ),list_of_images.end( ),
-            track.getImageIndex( j ) ) != list_of_images.end( ) )
-            mask.push_back( true );
-          else
-            mask.push_back( false );
+          structure_index->position[ selected[ cpt ] ] = points3D.size( );
+          structure_index->sequence_track.push_back( selected[ cpt ] );
         }
+        points3D.push_back( tracks[ selected[ cpt ] ] );//only keep correct points
+      }
+    return points3D;
+  }
 
-        cv::Vec3d point_final;
-        double distance=track.triangulateRobust( *cameras_,points_to_track, point_final,
-          4, mask );
+  void StructureEstimator::updateStructure(
+    const std::vector<int>& list_of_images, int new_image,
+    std::vector< TrackOfPoints >& points3D, StructureIndex& structure_index,
+    unsigned int max_error )
+  {
+    CV_Assert( structure_index.sequence_track.size( ) == points3D.size( ) );
+    const SequenceAnalyzer& sequence = *sequence_;
+    const vector<TrackOfPoints>& tracks = sequence.getTracks( );
+    vector< Ptr< PointsToTrack > > &points_to_track = sequence_->getPoints( );
+    vector<int>& position = structure_index.position;
+    if( position.size( ) < tracks.size( ) )
+      position.resize( tracks.size( ), -1 );
+
+    //mask of the wanted images, built once:
+    vector<bool> wanted_image( points_to_track.size( ), false );
+    for( size_t it_img = 0; it_img < list_of_images.size( ); ++it_img )
+      wanted_image[ list_of_images[ it_img ] ] = true;
+
+    //only the tracks of the new image seen by at least 2 wanted images
+    //(good points are counted, like the index used by computeStructure):
+    const vector<TracksIndex::Observation>& observations =
+      sequence_->getTracksIndex( ).getObservations( new_image );
+    vector<size_t> selected;
+    for( size_t cpt = 0; cpt < observations.size( ); ++cpt )
+    {
+      unsigned int i = observations[ cpt ].track;
+      const TrackOfPoints& track = tracks[ i ];
+      unsigned int nb_points = track.getNbPoints( );
+      int nbLinks = 0;
+      for( unsigned int p = 0; p < nb_points; ++p )
+        if( track.isGoodPoint( p ) && wanted_image[ track.getImageIndex( p ) ] )
+          nbLinks++;
+      if( nbLinks > 1 )
+        selected.push_back( i );
+    }
 
-        if( distance<max_error )
-          points3D.push_back( track );//only keep correct points
-      }
+    BatchTriangulator triangulator( *cameras_, points_to_track, seed_ );
+    triangulator.setNbThreads( nb_threads_ );
+    vector<cv::Vec3d> points;
+    vector<double> distances;
+    triangulator.triangulate( tracks, selected, list_of_images, points,
+      distances );
+    setPositions( sequence_, selected, points, distances );
 
+    //merge the new tracks into the structure:
+    for( size_t cpt = 0; cpt < selected.size( ); ++cpt )
+    {
+      unsigned int i = selected[ cpt ];
+      int pos = position[ i ];
+      if( distances[ cpt ]<max_error )
+      {
+        if( pos >= 0 )
+          points3D[ pos ] = tracks[ i ];
+        else
+        {
+          position[ i ] = points3D.size( );
+          structure_index.sequence_track.push_back( i );
+          points3D.push_back( tracks[ i ] );
+        }
+      }
+      else if( pos >= 0 )
+      {//not correct anymore, replace it by the last track:
+        unsigned int last = points3D.size( ) - 1;
+        if( ( unsigned int )pos != last )
+        {
+          points3D[ pos ] = points3D[ last ];
+          structure_index.sequence_track[ pos ] = structure_index.sequence_track[ last ];
+          position[ structure_index.sequence_track[ pos ] ] = pos;
+        }
+        points3D.pop_back( );
+        structure_index.sequence_track.pop_back( );
+        position[ i ] = -1;
+      }
     }
-    return points3D;
   }
 
   void StructureEstimator::removeOutliersTracks( double max_error,
@@ -101,29 +228,12 @@ namespace OpencvSfM{
     vector<TrackOfPoints>& tracks = *list_of_tracks;
     vector< Ptr< PointsToTrack > > &points_to_track = sequence_->getPoints( );
 
-    //for each points:
-    vector<TrackOfPoints>::size_type key_size = tracks.size( );
-    vector<PointOfView>::size_type num_camera = cameras_->size( );
-    int idImage=-1, idPoint=-1;
-    vector<TrackOfPoints>::size_type i;
-
-    for ( i=0; i < key_size; i++ )
-    {
-      TrackOfPoints &track = tracks[ i ];
-      unsigned int nviews = track.getNbTrack( );
-
-      CV_DbgAssert( nviews <= cameras_->size( ) );
-
-      cv::Ptr<cv::Vec3d> point_final = track.get3DPosition();
-      if(point_final.empty())
-      {
-        cv::Vec3d *pt = new cv::Vec3d;
-        track.triangulateRobust( *cameras_,points_to_track, *pt );
-        point_final = cv::Ptr<cv::Vec3d>( pt );
-      }
-
-      track.removeOutliers( *cameras_, points_to_track, max_error );
-    }
+    //tracks are independent, process them by chunks:
+    BatchTriangulator triangulator( *cameras_, points_to_track, seed_ );
+    TaskScheduler scheduler( nb_threads_ );
+    scheduler.parallelFor( tracks.size( ), TRACKS_BY_CHUNK, boost::bind(
+      &removeOutliersChunk, &triangulator, cameras_, &points_to_track,
+      &tracks, max_error, _1, _2 ) );
 
   }
 }
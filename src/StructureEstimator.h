@@ -9,6 +9,18 @@ namespace OpencvSfM{
   class SFM_EXPORTS SequenceAnalyzer;
   class SFM_EXPORTS PointOfView;
   class SFM_EXPORTS TrackOfPoints;
+
+  /**
+  * \brief Links between a list of triangulated tracks (a copy of some
+  * tracks of the sequence) and the tracks of the sequence. Used by
+  * StructureEstimator::updateStructure to find a track in O(1).
+  */
+  struct StructureIndex
+  {
+    std::vector<unsigned int> sequence_track;///<Index into the sequence of each triangulated track
+    std::vector<int> position;///<Position of each track of the sequence into the triangulated list (-1 if not triangulated)
+  };
+
   /**
   * \brief This class tries to find the 3D structure
   * using a sequence and cameras fully parameterized
@@ -19,6 +31,8 @@ namespace OpencvSfM{
     SequenceAnalyzer *sequence_;///<Object containing all 2D information of this sequence
     std::vector<PointOfView>* cameras_;///<List of cameras (intra and extern parameters...)
     int max_repro_error_;///<Maximum reprojection error allowed
+    unsigned int nb_threads_;///<Number of threads (0 for every cores)
+    unsigned int seed_;///<Seed of the random generators used by triangulation
 
   public:
     /**
@@ -30,12 +44,26 @@ namespace OpencvSfM{
     StructureEstimator( SequenceAnalyzer *sequence,
       std::vector<PointOfView>* cameras,int max_repro_error=10 )
       :sequence_( sequence ),cameras_( cameras ),
-      max_repro_error_( max_repro_error ){};
+      max_repro_error_( max_repro_error ), nb_threads_( 0 ), seed_( 0 ){};
 
     /**
     * Destructor will not release datas as they where given by address!
     */
     ~StructureEstimator(){sequence_=NULL;cameras_=NULL;};
+
+    /**
+    * Change the number of threads used to process the tracks. Results
+    * don't depend on the number of threads.
+    * @param nb_threads number of threads (0 to use every cores)
+    */
+    inline void setNbThreads( unsigned int nb_threads )
+    { nb_threads_ = nb_threads; };
+    /**
+    * Change the seed of the random generators used by the robust
+    * triangulation (each track has its own random stream)
+    * @param seed new seed
+    */
+    inline void setSeed( unsigned int seed ) { seed_ = seed; };
     
     /**
     * Project previously 2D points matches using cameras parameters
@@ -47,11 +75,30 @@ namespace OpencvSfM{
     * Project previously 2D points matches for only two views
     * @param list_of_images list of image indexes to use
     * @param max_error maximum error allowed.
+    * @param structure_index [out] if not NULL, links between the output and
+    * the tracks of the sequence (needed by updateStructure)
     * @return output of tracks triangulated ( contain 3D point )
     */
     std::vector< TrackOfPoints > computeStructure(
       const std::vector<int>& list_of_images,
-       unsigned int max_error = 10 );
+       unsigned int max_error = 10, StructureIndex* structure_index = NULL );
+    /**
+    * Update a structure computed with computeStructure( list_of_images )
+    * when a new image is added to list_of_images. Only the tracks seen by
+    * the new image can change: they are triangulated again, then updated,
+    * added to or removed from points3D (removed tracks are replaced by the
+    * last one). The other tracks keep their 3D points and masks, so the
+    * cost depends on the points of the new image, not on the size of the
+    * structure.
+    * @param list_of_images list of image indexes to use (with new_image)
+    * @param new_image index of the image just added
+    * @param points3D [in/out] tracks triangulated
+    * @param structure_index [in/out] links between points3D and the sequence
+    * @param max_error maximum error allowed.
+    */
+    void updateStructure( const std::vector<int>& list_of_images,
+      int new_image, std::vector< TrackOfPoints >& points3D,
+      StructureIndex& structure_index, unsigned int max_error = 10 );
     /**
     * Remove points from track when projection error > max_error 
     * @param max_error maximum error of back projection allowed
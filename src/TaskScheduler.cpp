@@ -0,0 +1,180 @@
+#include "TaskScheduler.h"
+
+#include <opencv2/core/core.hpp>
+#include <boost/bind.hpp>
+#include <exception>
+
+namespace OpencvSfM{
+
+  using std::vector;
+
+  TaskScheduler::TaskScheduler( unsigned int nb_workers )
+  {
+    if( nb_workers == 0 )
+      nb_workers = boost::thread::hardware_concurrency( );
+    if( nb_workers == 0 )
+      nb_workers = 1;
+
+    nb_queued_ = 0;
+    nb_pending_ = 0;
+    next_queue_ = 0;
+    stop_ = false;
+    joined_ = false;
+
+    for( unsigned int i = 0; i < nb_workers; ++i )
+      queues_.push_back( new WorkerQueue( ) );
+    for( unsigned int i = 0; i < nb_workers; ++i )
+      workers_.create_thread(
+      boost::bind( &TaskScheduler::workerLoop, this, i ) );
+  }
+
+  TaskScheduler::~TaskScheduler( )
+  {
+    try{
+      join( );
+    }catch( ... )
+    {
+      //can't throw from destructor, the error was already reported by wait( )
+    }
+    for( size_t i = 0; i < queues_.size( ); ++i )
+      delete queues_[ i ];
+  }
+
+  void TaskScheduler::submit( const Task& task )
+  {
+    unsigned int id_queue;
+    {
+      boost::mutex::scoped_lock lock( state_lock_ );
+      if( stop_ )
+        CV_Error( CV_StsError, "TaskScheduler: can't submit after join( )!" );
+      nb_pending_++;
+      id_queue = next_queue_;
+      next_queue_ = ( next_queue_ + 1 ) % queues_.size( );
+    }
+    {
+      boost::mutex::scoped_lock lock( queues_[ id_queue ]->lock );
+      queues_[ id_queue ]->tasks.push_back( task );
+    }
+    {
+      boost::mutex::scoped_lock lock( state_lock_ );
+      nb_queued_++;
+    }
+    work_available_.notify_one( );
+  }
+
+  void TaskScheduler::wait( )
+  {
+    boost::mutex::scoped_lock lock( state_lock_ );
+    while( nb_pending_ > 0 )
+      work_done_.wait( lock );
+
+    if( !first_error_.empty( ) )
+    {
+      std::string error = "TaskScheduler: a task failed: " + first_error_;
+      first_error_.clear( );
+      CV_Error( CV_StsError, error.c_str( ) );
+    }
+  }
+
+  void TaskScheduler::parallelFor( size_t nb_items, size_t chunk_size,
+    const RangeTask& body )
+  {
+    if( chunk_size == 0 )
+      chunk_size = 1;
+    for( size_t begin = 0; begin < nb_items; begin += chunk_size )
+      submit( boost::bind( body, begin, MIN( begin + chunk_size, nb_items ) ) );
+    wait( );
+  }
+
+  void TaskScheduler::join( )
+  {
+    if( joined_ )
+      return;
+    {
+      boost::mutex::scoped_lock lock( state_lock_ );
+      while( nb_pending_ > 0 )
+        work_done_.wait( lock );
+      stop_ = true;
+    }
+    work_available_.notify_all( );
+    workers_.join_all( );
+    joined_ = true;
+
+    //report errors, if any:
+    wait( );
+  }
+
+  bool TaskScheduler::popTask( unsigned int id, Task& task )
+  {
+    unsigned int nb_queues = queues_.size( );
+    //first our own deque, newest task first (better cache reuse):
+    {
+      WorkerQueue& q = *queues_[ id ];
+      boost::mutex::scoped_lock lock( q.lock );
+      if( !q.tasks.empty( ) )
+      {
+        task = q.tasks.back( );
+        q.tasks.pop_back( );
+        return true;
+      }
+    }
+    //then steal the oldest task of an other worker:
+    for( unsigned int k = 1; k < nb_queues; ++k )
+    {
+      WorkerQueue& q = *queues_[ ( id + k ) % nb_queues ];
+      boost::mutex::scoped_lock lock( q.lock );
+      if( !q.tasks.empty( ) )
+      {
+        task = q.tasks.front( );
+        q.tasks.pop_front( );
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void TaskScheduler::workerLoop( unsigned int id )
+  {
+    while( true )
+    {
+      Task task;
+      if( popTask( id, task ) )
+      {
+        {
+          boost::mutex::scoped_lock lock( state_lock_ );
+          nb_queued_--;
+        }
+        std::string error;
+        try{
+          task( );
+        }catch( std::exception& e )
+        {
+          error = e.what( );
+          if( error.empty( ) )
+            error = "unknown error";
+        }catch( ... )
+        {
+          error = "unknown error";
+        }
+
+        boost::mutex::scoped_lock lock( state_lock_ );
+        if( !error.empty( ) && first_error_.empty( ) )
+          first_error_ = error;
+        nb_pending_--;
+        if( nb_pending_ == 0 )
+          work_done_.notify_all( );
+      }
+      else
+      {
+        boost::mutex::scoped_lock lock( state_lock_ );
+        //nb_queued_ can be > 0 while a task is not yet visible in the
+        //deques (see submit), in this case just try again:
+        while( nb_queued_ <= 0 && !stop_ )
+          work_available_.wait( lock );
+        if( stop_ && nb_queued_ <= 0 )
+          return;
+      }
+    }
+  }
+
+}
@@ -0,0 +1,118 @@
+#ifndef _GSOC_SFM_TASK_SCHEDULER_H
+#define _GSOC_SFM_TASK_SCHEDULER_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace OpencvSfM{
+
+  /**
+  * \brief A small pool of threads which balance the load using work stealing.
+  *
+  * Each worker owns a deque of tasks. A worker takes its own tasks from the
+  * back of its deque and, when it is empty, steals the oldest task of
+  * another worker. This way, even if the tasks have very different costs
+  * (like matching image 0 against every other images), no core stay idle
+  * while there is still work to do.
+  *
+  * Tasks are simple functors (anything convertible to boost::function< void ( ) >)
+  * and should not throw: if they do, the first error message is kept and
+  * reported by wait( ) using CV_Error.
+  */
+  class SFM_EXPORTS TaskScheduler
+  {
+  public:
+    typedef boost::function< void ( ) > Task;///<Unit of work executed by a worker
+    typedef boost::function< void ( size_t, size_t ) > RangeTask;///<Work on the items [ begin, end )
+
+    /**
+    * Create the pool and start the workers.
+    * @param nb_workers number of threads to use. If 0, use as many
+    * threads as the hardware can run concurrently.
+    */
+    TaskScheduler( unsigned int nb_workers = 0 );
+    /**
+    * Destructor: wait for the remaining tasks and join every worker.
+    */
+    ~TaskScheduler( );
+
+    /**
+    * Add a new task to the pool. Tasks are spread over the workers' deques
+    * in a round-robin way, idle workers will steal them if needed.
+    * @param task functor to execute
+    */
+    void submit( const Task& task );
+    /**
+    * Block until every submitted task is finished. The workers are still
+    * alive after this call, so new tasks can be submitted.
+    */
+    void wait( );
+    /**
+    * Split the items [ 0, nb_items ) into chunks, run body on each chunk
+    * and wait for every chunk. Chunks don't depend on the number of
+    * workers, so a deterministic body gives the same results whatever the
+    * size of the pool.
+    * @param nb_items number of items to process
+    * @param chunk_size number of items of each chunk
+    * @param body functor called with the range of each chunk
+    */
+    void parallelFor( size_t nb_items, size_t chunk_size, const RangeTask& body );
+    /**
+    * Wait for every task then stop and join the workers. After this call,
+    * no tasks can be submitted anymore.
+    */
+    void join( );
+
+    /**
+    * Get the number of threads of this pool
+    * @return number of workers
+    */
+    inline unsigned int getNbWorkers( ) const { return queues_.size( ); };
+
+  protected:
+    /**
+    * \brief The deque of tasks owned by one worker.
+    */
+    struct WorkerQueue
+    {
+      boost::mutex lock;///<Protect tasks against thieves
+      std::deque<Task> tasks;///<Tasks waiting to be executed
+    };
+
+    /**
+    * Main loop of each worker thread
+    * @param id index of the worker (and of its deque)
+    */
+    void workerLoop( unsigned int id );
+    /**
+    * Try to get a task, first from the worker's own deque (newest task),
+    * then from the other deques (oldest task).
+    * @param id index of the worker
+    * @param task [out] task to run
+    * @return true if a task was found
+    */
+    bool popTask( unsigned int id, Task& task );
+
+    std::vector< WorkerQueue* > queues_;///<One deque per worker
+    boost::thread_group workers_;///<The threads of this pool
+    boost::mutex state_lock_;///<Protect the counters and the stop flag
+    boost::condition_variable work_available_;///<Wake up sleeping workers
+    boost::condition_variable work_done_;///<Wake up threads blocked in wait( )
+    long nb_queued_;///<Number of tasks waiting in the deques
+    long nb_pending_;///<Number of tasks submitted but not finished
+    unsigned int next_queue_;///<Deque which will receive the next task
+    bool stop_;///<Set when the workers have to quit
+    bool joined_;///<Set once the workers are joined
+    std::string first_error_;///<Message of the first task which failed
+  };
+
+}
+
+#endif
@@ -0,0 +1,287 @@
+#include "TrackStore.h"
+
+#include <numeric>
+#include <fstream>
+#include <boost/cstdint.hpp>
+
+namespace OpencvSfM{
+
+  using std::vector;
+  using boost::uint8_t;
+  using boost::uint32_t;
+
+  //header: magic, version, number of tracks, number of observations:
+  static const char track_store_magic[ 4 ] = { 'S', 'F', 'M', 'T' };
+  static const uint32_t track_store_version = 1;
+
+  template<typename T>
+  static void writeArray( std::ofstream& out, const vector<T>& values )
+  {
+    if( !values.empty( ) )
+      out.write( ( const char* )&values[ 0 ], values.size( ) * sizeof( T ) );
+  }
+  template<typename T>
+  static void readArray( std::ifstream& in, vector<T>& values, size_t size )
+  {
+    values.resize( size );
+    if( !values.empty( ) )
+      in.read( ( char* )&values[ 0 ], values.size( ) * sizeof( T ) );
+  }
+  //vector<bool> is a bitset, store one byte per value:
+  static void writeBits( std::ofstream& out, const vector<bool>& values )
+  {
+    vector<uint8_t> bytes( values.begin( ), values.end( ) );
+    writeArray( out, bytes );
+  }
+  static void readBits( std::ifstream& in, vector<bool>& values, size_t size )
+  {
+    vector<uint8_t> bytes;
+    readArray( in, bytes, size );
+    values.assign( bytes.begin( ), bytes.end( ) );
+  }
+
+  TrackStore::TrackView::TrackView( const TrackStore* store, unsigned int idx )
+    :store_( store ),idx_( idx )
+  {
+    first_ = store->offsets_[ idx ];
+    end_ = store->offsets_[ idx + 1 ];
+  }
+
+  unsigned int TrackStore::TrackView::getNbTrack( ) const
+  {
+    if( getConsistance( ) < 0 )
+      return 0;
+    unsigned int nb_good = 0;
+    for( unsigned int i = first_; i < end_; ++i )
+      if( store_->good_values_[ i ] )
+        nb_good++;
+    return nb_good;
+  }
+
+  bool TrackStore::TrackView::containImage( const int image_wanted ) const
+  {
+    //as in TrackOfPoints, only the first point of the image is tested:
+    for( unsigned int i = first_; i < end_; ++i )
+      if( store_->images_[ i ] == image_wanted )
+        return store_->good_values_[ i ];
+    return false;
+  }
+
+  bool TrackStore::TrackView::containPoint( const int image_src,
+    const int point_idx1 ) const
+  {
+    for( unsigned int i = first_; i < end_; ++i )
+      if( store_->images_[ i ] == image_src &&
+        store_->points_[ i ] == ( unsigned int )point_idx1 )
+        return store_->good_values_[ i ];
+    return false;
+  }
+
+  int TrackStore::TrackView::getPointIndex( const unsigned int image ) const
+  {
+    for( unsigned int i = first_; i < end_; ++i )
+      if( store_->images_[ i ] == image )
+        return store_->points_[ i ];
+    return -1;
+  }
+
+  void TrackStore::TrackView::getMatch( const unsigned int index,
+    int &idImage, int &idPoint ) const
+  {
+    if( first_ + index < end_ )
+    {
+      idImage = store_->images_[ first_ + index ];
+      idPoint = store_->points_[ first_ + index ];
+    }
+  }
+
+  cv::DMatch TrackStore::TrackView::toDMatch( const int img1,
+    const int img2 ) const
+  {
+    cv::DMatch outMatch;
+    char nbFound=0;
+    for( unsigned int i = first_; i < end_ && nbFound < 2; ++i )
+    {
+      if ( store_->images_[ i ] == img1 )
+      {
+        nbFound++;
+        outMatch.trainIdx = store_->points_[ i ];
+      }
+      if ( store_->images_[ i ] == img2 )
+      {
+        nbFound++;
+        outMatch.queryIdx = store_->points_[ i ];
+      }
+    }
+    return outMatch;
+  }
+
+  TrackOfPoints TrackStore::TrackView::toTrackOfPoints( ) const
+  {
+    return store_->toTrackOfPoints( idx_ );
+  }
+
+  TrackOfPoints TrackStore::toTrackOfPoints( unsigned int idx ) const
+  {
+    TrackOfPoints track;
+    for( unsigned int i = offsets_[ idx ]; i < offsets_[ idx + 1 ]; ++i )
+    {
+      track.images_indexes_.push_back( images_[ i ] );
+      track.point_indexes_.push_back( points_[ i ] );
+      track.good_values.push_back( good_values_[ i ] );
+    }
+    track.track_consistance = consistances_[ idx ];
+    track.color = colors_[ idx ];
+    if( has_position_[ idx ] )
+      track.set3DPosition( positions_[ idx ] );
+    return track;
+  }
+
+  TrackStore::TrackStore( const vector<TrackOfPoints>& tracks )
+  {
+    offsets_.push_back( 0 );
+    unsigned int nb_observations = 0;
+    for( size_t t = 0; t < tracks.size( ); ++t )
+      nb_observations += tracks[ t ].images_indexes_.size( );
+    reserve( tracks.size( ), nb_observations );
+
+    for( size_t t = 0; t < tracks.size( ); ++t )
+      push_back( tracks[ t ] );
+  }
+
+  void TrackStore::reserve( unsigned int nb_tracks,
+    unsigned int nb_observations )
+  {
+    offsets_.reserve( nb_tracks + 1 );
+    positions_.reserve( nb_tracks );
+    has_position_.reserve( nb_tracks );
+    colors_.reserve( nb_tracks );
+    consistances_.reserve( nb_tracks );
+    images_.reserve( nb_observations );
+    points_.reserve( nb_observations );
+    good_values_.reserve( nb_observations );
+  }
+
+  void TrackStore::push_back( const TrackOfPoints& track )
+  {
+    size_t nb_points = track.images_indexes_.size( );
+    for( size_t i = 0; i < nb_points; ++i )
+    {
+      CV_Assert( track.images_indexes_[ i ] <= 0xFFFF );
+      images_.push_back( ( unsigned short )track.images_indexes_[ i ] );
+      points_.push_back( track.point_indexes_[ i ] );
+      good_values_.push_back( track.good_values[ i ] );
+    }
+    offsets_.push_back( images_.size( ) );
+
+    if( track.point3D.empty( ) )
+    {
+      positions_.push_back( cv::Vec3d( 0, 0, 0 ) );
+      has_position_.push_back( false );
+    }
+    else
+    {
+      positions_.push_back( *track.point3D );
+      has_position_.push_back( true );
+    }
+    colors_.push_back( track.color );
+    consistances_.push_back( track.track_consistance );
+  }
+
+  void TrackStore::clear( )
+  {
+    offsets_.assign( 1, 0 );
+    images_.clear( );
+    points_.clear( );
+    good_values_.clear( );
+    positions_.clear( );
+    has_position_.clear( );
+    colors_.clear( );
+    consistances_.clear( );
+  }
+
+  void TrackStore::toTracks( vector<TrackOfPoints>& tracks ) const
+  {
+    tracks.clear( );
+    tracks.reserve( size( ) );
+    for( unsigned int t = 0; t < size( ); ++t )
+      tracks.push_back( toTrackOfPoints( t ) );
+  }
+
+  size_t TrackStore::getMemoryUsage( ) const
+  {
+    return offsets_.capacity( ) * sizeof( unsigned int ) +
+      images_.capacity( ) * sizeof( unsigned short ) +
+      points_.capacity( ) * sizeof( unsigned int ) +
+      good_values_.capacity( ) / 8 +
+      positions_.capacity( ) * sizeof( cv::Vec3d ) +
+      has_position_.capacity( ) / 8 +
+      colors_.capacity( ) * sizeof( unsigned int ) +
+      consistances_.capacity( ) * sizeof( int ) + sizeof( TrackStore );
+  }
+
+  void TrackStore::write( const std::string& filename ) const
+  {
+    std::ofstream out( filename.c_str( ), std::ios::out | std::ios::binary );
+    if( !out )
+      CV_Error( CV_StsError, "TrackStore: can't create " + filename );
+    uint32_t header[ 3 ] = { track_store_version, size( ), getNbObservations( ) };
+    out.write( track_store_magic, 4 );
+    out.write( ( const char* )header, sizeof( header ) );
+    writeArray( out, offsets_ );
+    writeArray( out, images_ );
+    writeArray( out, points_ );
+    writeBits( out, good_values_ );
+    writeArray( out, positions_ );
+    writeBits( out, has_position_ );
+    writeArray( out, colors_ );
+    writeArray( out, consistances_ );
+    if( !out )
+      CV_Error( CV_StsError, "TrackStore: can't write " + filename );
+  }
+
+  void TrackStore::read( const std::string& filename )
+  {
+    std::ifstream in( filename.c_str( ), std::ios::in | std::ios::binary );
+    if( !in )
+      CV_Error( CV_StsError, "TrackStore: can't open " + filename );
+    char magic[ 4 ] = { 0 };
+    uint32_t header[ 3 ] = { 0 };
+    in.read( magic, 4 );
+    in.read( ( char* )header, sizeof( header ) );
+    if( !in || std::string( magic, 4 ) != std::string( track_store_magic, 4 ) )
+      CV_Error( CV_StsError, "TrackStore: " + filename + " is not a track file!" );
+    if( header[ 0 ] != track_store_version )
+      CV_Error( CV_StsError, "TrackStore: " + filename + " has an unsupported version!" );
+
+    //check the sizes before allocating the arrays:
+    in.seekg( 0, std::ios::end );
+    size_t file_size = ( size_t )in.tellg( ), nb_tracks = header[ 1 ],
+      nb_observations = header[ 2 ];
+    size_t expected_size = 4 + sizeof( header ) +
+      ( nb_tracks + 1 ) * sizeof( unsigned int ) +
+      nb_observations * ( sizeof( unsigned short ) + sizeof( unsigned int ) + 1 ) +
+      nb_tracks * ( sizeof( cv::Vec3d ) + 1 + sizeof( unsigned int ) + sizeof( int ) );
+    if( file_size != expected_size )
+      CV_Error( CV_StsError, "TrackStore: " + filename + " is corrupted!" );
+    in.seekg( 4 + sizeof( header ), std::ios::beg );
+
+    readArray( in, offsets_, nb_tracks + 1 );
+    readArray( in, images_, nb_observations );
+    readArray( in, points_, nb_observations );
+    readBits( in, good_values_, nb_observations );
+    readArray( in, positions_, nb_tracks );
+    readBits( in, has_position_, nb_tracks );
+    readArray( in, colors_, nb_tracks );
+    readArray( in, consistances_, nb_tracks );
+    bool valid = in && offsets_[ 0 ] == 0 && offsets_[ nb_tracks ] == nb_observations;
+    for( size_t t = 0; valid && t < nb_tracks; ++t )
+      valid = offsets_[ t ] <= offsets_[ t + 1 ];
+    if( !valid )
+    {
+      clear( );
+      CV_Error( CV_StsError, "TrackStore: " + filename + " is corrupted!" );
+    }
+  }
+
+}
@@ -0,0 +1,266 @@
+#ifndef _GSOC_SFM_TRACK_STORE_H
+#define _GSOC_SFM_TRACK_STORE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <string>
+#include "opencv2/core/core.hpp"
+#include "opencv2/features2d/features2d.hpp"
+
+#include "TracksOfPoints.h"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Compact storage of a list of tracks (compressed sparse rows).
+  *
+  * A TrackOfPoints owns three vectors and a pointer to its 3D position, so
+  * a small track costs several allocations. Here every track of the list
+  * shares the same arrays:
+  * - offsets_[ t ] is the index of the first observation of track t,
+  * - images_ and points_ store the observations (16 bits for image indexes,
+  * 32 bits for point indexes),
+  * - good_values_ is a bitset of the good observations,
+  * - positions_ store the 3D points contiguously.
+  *
+  * That is about 6 bytes per observation and 40 bytes per track, so 10M
+  * observations fit in a few hundred MB. Use operator[ ] to get a
+  * TrackView, which has the same read-only interface than TrackOfPoints.
+  */
+  class SFM_EXPORTS TrackStore
+  {
+  public:
+    /**
+    * \brief Read-only view on a track of a TrackStore, with the same
+    * interface than TrackOfPoints. A view is valid until the store changes.
+    */
+    class SFM_EXPORTS TrackView
+    {
+    protected:
+      const TrackStore* store_;///<Store containing the track
+      unsigned int idx_;///<Index of the track into the store
+      unsigned int first_;///<Index of first observation
+      unsigned int end_;///<Index after the last observation
+    public:
+      /**
+      * Create a view on a track
+      * @param store Store containing the track
+      * @param idx Index of the track into the store
+      */
+      TrackView( const TrackStore* store, unsigned int idx );
+
+      /**
+      * cast operator to use this object as a 3D point!
+      */
+      inline operator const cv::Vec3d&( ) const {
+        return store_->positions_[ idx_ ];
+      };
+      /**
+      * Get the number of points of this track, including the bad ones
+      * @return number of points stored into this track
+      */
+      inline unsigned int getNbPoints( ) const { return end_ - first_; };
+      /**
+      * Get the number of good points of this track
+      * @return 0 if inconsistent, number of good points else
+      */
+      unsigned int getNbTrack( ) const;
+      /**
+      * Is the nth point of this track good?
+      * @param index which point
+      * @return true if this point is good
+      */
+      inline bool isGood( unsigned int index ) const {
+        return store_->good_values_[ first_ + index ];
+      };
+      /**
+      * This function is used to know if the track contains the image
+      * @param image_wanted index of query image
+      * @return true if this track contain a good point from the query image
+      */
+      bool containImage( const int image_wanted ) const;
+      /**
+      * This function is used to know if the track contains the query point
+      * @param image_src index of query image
+      * @param point_idx1 index of point in query image
+      * @return true if this track contain the point from the query image
+      */
+      bool containPoint( const int image_src, const int point_idx1 ) const;
+      /**
+      * use this function to get the index point of the wanted image
+      * @param image index of wanted image
+      * @return index of point (-1 if not found)
+      */
+      int getPointIndex( const unsigned int image ) const;
+      /**
+      * use this function to get the image corresponding to the nth entry
+      * of this track
+      * @param idx index of wanted point
+      * @return number of image
+      */
+      inline int getImageIndex( const unsigned int idx ) const {
+        return store_->images_[ first_ + idx ];
+      };
+      /**
+      * use this function to get the n^th match value from this track
+      * @param index which match
+      * @param idImage out value of the image index
+      * @param idPoint out value of the point index
+      */
+      void getMatch( const unsigned int index,
+        int &idImage, int &idPoint ) const;
+      /**
+      * use this function to create a DMatch value from this track
+      * @param img1 train match image
+      * @param img2 query match image
+      * @return DMatch value
+      */
+      cv::DMatch toDMatch( const int img1,const int img2 ) const;
+      /**
+      * Use this function to get the color of this track
+      * @return color of this track (ARGB packed into a int)
+      */
+      inline unsigned int getColor( ) const {
+        return store_->colors_[ idx_ ];
+      };
+      /**
+      * Get the consistance of this track (<0 if inconsistent)
+      * @return consistance of this track
+      */
+      inline int getConsistance( ) const {
+        return store_->consistances_[ idx_ ];
+      };
+      /**
+      * Is the 3D position of this track available?
+      * @return true if this track has a 3D position
+      */
+      inline bool has3DPosition( ) const {
+        return store_->has_position_[ idx_ ];
+      };
+      /**
+      * Create a TrackOfPoints from this view (for algorithms needing one)
+      * @return a copy of this track
+      */
+      TrackOfPoints toTrackOfPoints( ) const;
+    };
+
+    /**
+    * Create an empty store
+    */
+    TrackStore( ){ offsets_.push_back( 0 ); };
+    /**
+    * Create a store from a list of tracks
+    * @param tracks tracks to copy into this store
+    */
+    TrackStore( const std::vector<TrackOfPoints>& tracks );
+
+    /**
+    * Reserve memory
+    * @param nb_tracks number of tracks
+    * @param nb_observations total number of points of the tracks
+    */
+    void reserve( unsigned int nb_tracks, unsigned int nb_observations );
+    /**
+    * Add a track at the end of this store
+    * @param track new track
+    */
+    void push_back( const TrackOfPoints& track );
+    /**
+    * Remove every track
+    */
+    void clear( );
+    /**
+    * Get the number of tracks
+    * @return number of tracks
+    */
+    inline unsigned int size( ) const { return offsets_.size( ) - 1; };
+    /**
+    * Get the number of observations of every tracks
+    * @return number of observations
+    */
+    inline unsigned int getNbObservations( ) const { return images_.size( ); };
+    /**
+    * Get a view on a track
+    * @param idx index of the track
+    * @return view on the wanted track
+    */
+    inline TrackView operator[ ]( unsigned int idx ) const {
+      return TrackView( this, idx );
+    };
+
+    /**
+    * Change the 3D position of a track
+    * @param idx index of the track
+    * @param point new 3D position
+    */
+    inline void set3DPosition( unsigned int idx, const cv::Vec3d& point )
+    {
+      positions_[ idx ] = point;
+      has_position_[ idx ] = true;
+    };
+    /**
+    * Set a point of a track good or not
+    * @param idx index of the track
+    * @param index index of the point into the track
+    * @param is_good new value
+    */
+    inline void setGood( unsigned int idx, unsigned int index, bool is_good )
+    {
+      good_values_[ offsets_[ idx ] + index ] = is_good;
+    };
+    /**
+    * Change the color of a track
+    * @param idx index of the track
+    * @param color new color (ARGB packed into a int)
+    */
+    inline void setColor( unsigned int idx, unsigned int color )
+    {
+      colors_[ idx ] = color;
+    };
+
+    /**
+    * Create a TrackOfPoints from a track of this store
+    * @param idx index of the track
+    * @return a copy of the track
+    */
+    TrackOfPoints toTrackOfPoints( unsigned int idx ) const;
+    /**
+    * Copy the tracks of this store into a list of TrackOfPoints
+    * @param tracks [out] list of tracks (previous tracks are removed)
+    */
+    void toTracks( std::vector<TrackOfPoints>& tracks ) const;
+    /**
+    * Get the memory used by this store
+    * @return number of bytes
+    */
+    size_t getMemoryUsage( ) const;
+
+    /**
+    * Save the tracks into a binary file. Only the (image, point) indexes
+    * of observations are stored: keypoints should be saved separately
+    * (see FeaturesStore). Values use the byte order of the machine.
+    * @param filename name of the file to create
+    */
+    void write( const std::string& filename ) const;
+    /**
+    * Load tracks saved by write, in a time linear with the number of
+    * observations (previous tracks are removed).
+    * @param filename name of the file to open
+    */
+    void read( const std::string& filename );
+
+  protected:
+    std::vector<unsigned int> offsets_;///<First observation of each track (size( )+1 values)
+    std::vector<unsigned short> images_;///<Image of each observation
+    std::vector<unsigned int> points_;///<Point of each observation
+    std::vector<bool> good_values_;///<Bitset of good observations
+    std::vector<cv::Vec3d> positions_;///<3D position of each track
+    std::vector<bool> has_position_;///<Bitset of tracks having a 3D position
+    std::vector<unsigned int> colors_;///<Color of each track
+    std::vector<int> consistances_;///<Consistance of each track
+  };
+
+}
+
+#endif
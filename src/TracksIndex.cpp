@@ -0,0 +1,108 @@
+#include "TracksIndex.h"
+
+#include <algorithm>
+
+namespace OpencvSfM{
+
+  using std::vector;
+
+  //used to keep the lists of observations sorted by track:
+  static inline bool compareTrack( const TracksIndex::Observation& o1,
+    const TracksIndex::Observation& o2 )
+  {
+    return o1.track < o2.track;
+  }
+
+  void TracksIndex::clear( )
+  {
+    point_to_track_.clear( );
+    image_to_tracks_.clear( );
+  }
+
+  void TracksIndex::build( const vector<TrackOfPoints>& tracks )
+  {
+    clear( );
+    size_t nb_points = 0;
+    for( size_t t = 0; t < tracks.size( ); ++t )
+      nb_points += tracks[ t ].getNbTrack( );
+    point_to_track_.rehash( nb_points );
+
+    for( size_t t = 0; t < tracks.size( ); ++t )
+      addTrack( tracks[ t ], t );
+  }
+
+  void TracksIndex::addTrack( const TrackOfPoints& track,
+    unsigned int idx_track )
+  {
+    size_t nb_points = track.images_indexes_.size( );
+    for( size_t i = 0; i < nb_points; ++i )
+      if( track.good_values[ i ] )
+        addPoint( idx_track, track.images_indexes_[ i ],
+          track.point_indexes_[ i ] );
+  }
+
+  void TracksIndex::addPoint( unsigned int idx_track, unsigned int image,
+    unsigned int point )
+  {
+    //keep the first track if the point is in several tracks:
+    std::pair< boost::unordered_map< boost::uint64_t, unsigned int >::iterator,
+      bool > inserted = point_to_track_.insert(
+      std::make_pair( key( image, point ), idx_track ) );
+    if( !inserted.second && inserted.first->second > idx_track )
+      inserted.first->second = idx_track;
+
+    if( image >= image_to_tracks_.size( ) )
+      image_to_tracks_.resize( image + 1 );
+    vector<Observation>& list_img = image_to_tracks_[ image ];
+    Observation obs( idx_track, point );
+    if( list_img.empty( ) || list_img.back( ).track <= idx_track )
+      list_img.push_back( obs );
+    else
+      list_img.insert( std::upper_bound( list_img.begin( ), list_img.end( ),
+        obs, compareTrack ), obs );
+  }
+
+  int TracksIndex::getTrack( unsigned int image, unsigned int point ) const
+  {
+    boost::unordered_map< boost::uint64_t, unsigned int >::const_iterator it =
+      point_to_track_.find( key( image, point ) );
+    if( it == point_to_track_.end( ) )
+      return -1;
+    return it->second;
+  }
+
+  const vector<TracksIndex::Observation>& TracksIndex::getObservations(
+    unsigned int image ) const
+  {
+    static const vector<Observation> no_observation;
+    if( image >= image_to_tracks_.size( ) )
+      return no_observation;
+    return image_to_tracks_[ image ];
+  }
+
+  void TracksIndex::getTracksBetween( unsigned int img1, unsigned int img2,
+    vector<unsigned int>& tracks ) const
+  {
+    tracks.clear( );
+    const vector<Observation>& list1 = getObservations( img1 );
+    const vector<Observation>& list2 = getObservations( img2 );
+    //both lists are sorted by track, so merge them:
+    vector<Observation>::const_iterator it1 = list1.begin( ),
+      it2 = list2.begin( );
+    while( it1 != list1.end( ) && it2 != list2.end( ) )
+    {
+      if( it1->track < it2->track )
+        it1++;
+      else if( it2->track < it1->track )
+        it2++;
+      else
+      {
+        if( tracks.empty( ) || tracks.back( ) != it1->track )
+          tracks.push_back( it1->track );
+        it1++;
+        it2++;
+      }
+    }
+  }
+
+}
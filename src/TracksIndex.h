@@ -0,0 +1,124 @@
+#ifndef _GSOC_SFM_TRACKS_INDEX_H
+#define _GSOC_SFM_TRACKS_INDEX_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "TracksOfPoints.h"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief Index of a list of tracks to quickly find which tracks use a
+  * 2D point or an image.
+  *
+  * TrackOfPoints::containPoint, containImage and getPointIndex are linear
+  * scans, so looping over every track to find the ones seeing an image is
+  * O(all tracks). With this index, a per-image query costs O(tracks in
+  * this image) and a per-point query is a hash lookup.
+  *
+  * Only good points are indexed (like containPoint and containImage). The
+  * index has to be updated (or rebuilt) each time the tracks change.
+  */
+  class SFM_EXPORTS TracksIndex
+  {
+  public:
+    /**
+    * \brief A good point of a track seen in an image.
+    */
+    struct Observation
+    {
+      unsigned int track;///<Index of the track
+      unsigned int point;///<Index of the point in the image
+
+      Observation( unsigned int t, unsigned int p ):track( t ),point( p ){};
+    };
+
+    /**
+    * Create an empty index
+    */
+    TracksIndex( ){};
+    /**
+    * Create the index of a list of tracks
+    * @param tracks list of tracks to index
+    */
+    TracksIndex( const std::vector<TrackOfPoints>& tracks ){ build( tracks ); };
+
+    /**
+    * Remove every entries and index a list of tracks
+    * @param tracks list of tracks to index
+    */
+    void build( const std::vector<TrackOfPoints>& tracks );
+    /**
+    * Remove every entries of this index
+    */
+    void clear( );
+    /**
+    * Add every good points of a track to the index
+    * @param track the new track
+    * @param idx_track index of this track in the list of tracks
+    */
+    void addTrack( const TrackOfPoints& track, unsigned int idx_track );
+    /**
+    * Add a good point of a track to the index
+    * @param idx_track index of the track
+    * @param image index of the image
+    * @param point index of the point in the image
+    */
+    void addPoint( unsigned int idx_track, unsigned int image,
+      unsigned int point );
+
+    /**
+    * Find the first track containing a point
+    * @param image index of the image
+    * @param point index of the point in the image
+    * @return index of the track or -1 if no track contains this point
+    */
+    int getTrack( unsigned int image, unsigned int point ) const;
+    /**
+    * Get the good points of an image used by the tracks
+    * @param image index of the image
+    * @return list of (track, point), sorted by track index
+    */
+    const std::vector<Observation>& getObservations( unsigned int image ) const;
+    /**
+    * Get the number of tracks having a good point in an image
+    * @param image index of the image
+    * @return number of tracks seeing this image
+    */
+    inline unsigned int getNbTracks( unsigned int image ) const
+    {
+      return image < image_to_tracks_.size( ) ?
+        image_to_tracks_[ image ].size( ) : 0;
+    };
+    /**
+    * Get the tracks having a good point in the two images
+    * @param img1 first image
+    * @param img2 second image
+    * @param tracks [out] sorted indexes of the tracks seeing img1 and img2
+    */
+    void getTracksBetween( unsigned int img1, unsigned int img2,
+      std::vector<unsigned int>& tracks ) const;
+
+  protected:
+    /**
+    * Compute the key of a 2D point
+    * @param image index of the image
+    * @param point index of the point in the image
+    * @return key of this point
+    */
+    static inline boost::uint64_t key( unsigned int image, unsigned int point )
+    {
+      return ( ( boost::uint64_t )image << 32 ) | ( boost::uint64_t )point;
+    };
+
+    boost::unordered_map< boost::uint64_t, unsigned int > point_to_track_;///<(image, point) to first track
+    std::vector< std::vector<Observation> > image_to_tracks_;///<for each image, points used by tracks
+  };
+
+}
+
+#endif
@@ -5,6 +5,10 @@
 #include "PointOfView.h"
 #include "Camera.h"
 
+#include <algorithm>
+#include <functional>
+#include <boost/cstdint.hpp>
+
 namespace OpencvSfM{
   using cv::KeyPoint;
   using std::vector;
@@ -92,65 +96,146 @@ namespace OpencvSfM{
     return track_consistance>=0;
   }
 
-  void TrackOfPoints::fusionDuplicates( std::vector<TrackOfPoints>& tracks )
+  //used to sort the points of every tracks by (image, point):
+  struct PointKeyOrder
   {
-    //add to tracks_ the new matches:
+    const vector<boost::uint64_t>& keys;
+    PointKeyOrder( const vector<boost::uint64_t>& k ):keys( k ){};
+    bool operator()( unsigned int idx1, unsigned int idx2 ) const
+    {
+      return keys[ idx1 ] < keys[ idx2 ];
+    }
+  };
 
-    size_t i = 0,
-      match_it_end = tracks.size( );
+  //root of a set of tracks (with path halving):
+  static unsigned int findSet( vector<unsigned int>& parent, unsigned int t )
+  {
+    while( parent[ t ] != t )
+    {
+      parent[ t ] = parent[ parent[ t ] ];
+      t = parent[ t ];
+    }
+    return t;
+  }
 
-    while ( i < match_it_end )
+  void TrackOfPoints::fusionDuplicates( std::vector<TrackOfPoints>& tracks )
+  {
+    //Tracks sharing an (image, point) are found using the list of every
+    //points sorted by (image, point), then joined with a disjoint-set:
+    //each set of connected tracks becomes one track having every points
+    //of the set.
+    size_t nb_tracks = tracks.size( ), nb_points = 0;
+    vector<unsigned int> first_point( nb_tracks + 1 );
+    for( size_t i = 0; i < nb_tracks; ++i )
     {
-      TrackOfPoints &point_matcher = tracks[i];
+      first_point[ i ] = nb_points;
+      nb_points += tracks[ i ].point_indexes_.size( );
+    }
+    first_point[ nb_tracks ] = nb_points;
 
-      size_t j = i+1;//if j<i, already tested, and if i==j, don't have to...
-      while ( j < match_it_end )
+    //sort every points by (image, point) to group the identical ones:
+    vector<boost::uint64_t> keys( nb_points );
+    vector<unsigned int> track_of_point( nb_points ), sorted( nb_points );
+    for( size_t i = 0; i < nb_tracks; ++i )
+      for( unsigned int p = first_point[ i ]; p < first_point[ i + 1 ]; ++p )
       {
-        TrackOfPoints &point_matcher1 = tracks[j];
-        //look for a commun point:
-        bool have_commun = false;
-        size_t nbT1 = point_matcher.point_indexes_.size(),
-          nbT2 = point_matcher1.point_indexes_.size();
-        for(size_t i1 = 0; i1<nbT2 && !have_commun; ++i1 )
-        {
+        unsigned int i1 = p - first_point[ i ];
+        keys[ p ] = ( ( boost::uint64_t )tracks[ i ].images_indexes_[ i1 ] << 32 ) |
+          ( boost::uint64_t )tracks[ i ].point_indexes_[ i1 ];
+        track_of_point[ p ] = i;
+        sorted[ p ] = p;
+      }
+    std::sort( sorted.begin( ), sorted.end( ), PointKeyOrder( keys ) );
+
+    //join the tracks of each group of identical points (the root of a set
+    //is its first track, so merged tracks keep the order of the vector):
+    vector<unsigned int> parent( nb_tracks ), group_of_point( nb_points );
+    for( size_t i = 0; i < nb_tracks; ++i )
+      parent[ i ] = i;
+    unsigned int nb_groups = 0;
+    for( size_t s = 0; s < nb_points; ++s )
+    {
+      if( s == 0 || keys[ sorted[ s ] ] != keys[ sorted[ s - 1 ] ] )
+        nb_groups++;
+      else
+      {
+        unsigned int root1 = findSet( parent, track_of_point[ sorted[ s - 1 ] ] );
+        unsigned int root2 = findSet( parent, track_of_point[ sorted[ s ] ] );
+        if( root1 < root2 )
+          parent[ root2 ] = root1;
+        else if( root2 < root1 )
+          parent[ root1 ] = root2;
+      }
+      group_of_point[ sorted[ s ] ] = nb_groups - 1;
+    }
 
-          for(size_t j1 = 0; j1<nbT1 && !have_commun; ++j1 )
-          {
-            have_commun = 
-              ( point_matcher1.images_indexes_[ i1 ] == 
-              point_matcher.images_indexes_[ j1 ] ) &&
-              ( point_matcher1.point_indexes_[ i1 ] == 
-              point_matcher.point_indexes_[ j1 ] );
-          }
-        }
-        if( have_commun )
+    //list of the other tracks of each set, in the order of the vector:
+    const unsigned int no_track = ( unsigned int )-1;
+    vector<unsigned int> next_track( nb_tracks, no_track ), last_track( nb_tracks );
+    for( size_t i = 0; i < nb_tracks; ++i )
+    {
+      unsigned int root = findSet( parent, i );
+      last_track[ i ] = i;
+      if( root != i )
+      {
+        next_track[ last_track[ root ] ] = i;
+        last_track[ root ] = i;
+      }
+    }
+
+    //merge each set into its first track, then move it to its final
+    //position (the other tracks of the set are after it, so they are not
+    //overwritten before being read):
+    vector<unsigned int> group_owner( nb_groups, no_track );
+    size_t nb_kept = 0;
+    for( size_t i = 0; i < nb_tracks; ++i )
+    {
+      if( parent[ i ] != i )
+        continue;
+      TrackOfPoints &point_matcher = tracks[ i ];
+      for( unsigned int p = first_point[ i ]; p < first_point[ i + 1 ]; ++p )
+        group_owner[ group_of_point[ p ] ] = i;
+      for( unsigned int j = next_track[ i ]; j != no_track; j = next_track[ j ] )
+      {
+        const TrackOfPoints &point_matcher1 = tracks[ j ];
+        if( point_matcher1.track_consistance < 0 )
+          point_matcher.track_consistance = -1;
+        for( unsigned int p = first_point[ j ]; p < first_point[ j + 1 ]; ++p )
         {
-          //should mix and remove this track:
-          for(size_t i1 = 0; i1<nbT2 && !have_commun; ++i1 )
-          {//mix all points match:
-            point_matcher.addMatch( point_matcher1.images_indexes_[ i1 ],
-              point_matcher1.point_indexes_[ i1 ] );
+          if( group_owner[ group_of_point[ p ] ] == i )
+            continue;//already in the merged track
+          group_owner[ group_of_point[ p ] ] = i;
+          unsigned int i1 = p - first_point[ j ];
+          int img = point_matcher1.images_indexes_[ i1 ],
+            pt = point_matcher1.point_indexes_[ i1 ];
+          size_t nb_before = point_matcher.point_indexes_.size( );
+          point_matcher.addMatch( img, pt );
+          if( point_matcher.point_indexes_.size( ) == nb_before )
+          {//an other point of the same image: the track is now inconsistent,
+            //the point is kept as a bad one (like addMatch does next):
+            point_matcher.images_indexes_.push_back( img );
+            point_matcher.point_indexes_.push_back( pt );
+            point_matcher.good_values.push_back( false );
           }
-          int R, G, B;
-          R = (point_matcher1.color>>16) & 0x000000FF;
-          G = (point_matcher1.color>>8) & 0x000000FF;
-          B = (point_matcher1.color) & 0x000000FF;
-          R += (point_matcher.color>>16) & 0x000000FF;
-          G += (point_matcher.color>>8) & 0x000000FF;
-          B += (point_matcher.color) & 0x000000FF;
-          R /= 2; G /= 2; B /= 2;
-          point_matcher.color = (unsigned int)(
-            ((R<<16) & 0x00FF0000) | ((R<<8) & 0x0000FF00)| (B & 0x000000FF));
-          //remove this track:
-          match_it_end--;
-          tracks[ j ] = tracks[ match_it_end ];
-          tracks.pop_back();
-          j--;
+          else if( !point_matcher1.good_values[ i1 ] )
+            point_matcher.good_values.back( ) = false;
         }
-        j++;
+        int R, G, B;
+        R = (point_matcher1.color>>16) & 0x000000FF;
+        G = (point_matcher1.color>>8) & 0x000000FF;
+        B = (point_matcher1.color) & 0x000000FF;
+        R += (point_matcher.color>>16) & 0x000000FF;
+        G += (point_matcher.color>>8) & 0x000000FF;
+        B += (point_matcher.color) & 0x000000FF;
+        R /= 2; G /= 2; B /= 2;
+        point_matcher.color = (unsigned int)(
+          ((R<<16) & 0x00FF0000) | ((R<<8) & 0x0000FF00)| (B & 0x000000FF));
       }
-      i++;
+      if( nb_kept != i )
+        tracks[ nb_kept ] = tracks[ i ];
+      nb_kept++;
     }
+    tracks.erase( tracks.begin( ) + nb_kept, tracks.end( ) );
   }
 
   bool TrackOfPoints::containPoint( const int image_src,
@@ -299,9 +384,9 @@ namespace OpencvSfM{
   double TrackOfPoints::triangulateRobust( std::vector<PointOfView>& cameras,
     const std::vector< cv::Ptr< PointsToTrack > > &points_to_track,
     cv::Vec3d& points3D, double reproj_error,
-    const std::vector<bool> &masksValues )
+    const std::vector<bool> &masksValues, cv::RNG* random_generator )
   {
-    cv::RNG& rng = cv::theRNG( );
+    cv::RNG& rng = random_generator != NULL ? *random_generator : cv::theRNG( );
     unsigned int nviews = images_indexes_.size( );
     double distance=0, best_distance=1e20;
     vector<bool> masks;
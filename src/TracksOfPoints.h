@@ -23,6 +23,9 @@ namespace OpencvSfM{
   class SFM_EXPORTS TrackOfPoints
   {
     friend class SequenceAnalyzer;
+    friend class ConcurrentTracksBuilder;
+    friend class TracksIndex;
+    friend class TrackStore;
 
   protected:
     cv::Ptr<cv::Vec3d> point3D;///<The corresponding 3D coordinates. If not available, Ptr is empty.
@@ -88,6 +91,23 @@ namespace OpencvSfM{
     good_values.begin( ), good_values.end( ), 0 );
     };
     /**
+    * This function is used to get the number of points of this track,
+    * including the points which are not good
+    * @return number of points stored into this track
+    */
+    inline unsigned int getNbPoints( ) const
+    {
+      return images_indexes_.size( );
+    };
+    /**
+    * This function is used to get the consistance of this track
+    * @return <0 if inconsistent, number of redundant matches else
+    */
+    inline int getConsistance( ) const
+    {
+      return track_consistance;
+    };
+    /**
     * use this function to create a DMatch value from this track
     * @param img1 train match image
     * @param img2 query match image
@@ -125,6 +145,16 @@ namespace OpencvSfM{
     {
       return images_indexes_[ idx ];
     };
+    /**
+    * use this function to know if the nth entry of this track is good
+    * (the bad entries are ignored by getNbTrack and containImage)
+    * @param idx index of wanted point
+    * @return false if the point was marked as wrong
+    */
+    inline bool isGoodPoint( const unsigned int idx ) const
+    {
+      return good_values[ idx ];
+    };
     
     /**
     * Using cameras and 2D points, try to find the 3D coordinates
@@ -145,12 +175,15 @@ namespace OpencvSfM{
     * @param points3D 3D coordinates of the best estimation
     * @param reproj_error Threshold used to reject outliners
     * @param masks used to knwo which point this function have to use.
+    * @param random_generator random generator to use (if NULL, cv::theRNG( ) is used,
+    * which is shared by every callers of the thread)
     */
     double triangulateRobust( std::vector<PointOfView>& cameras,
       const std::vector< cv::Ptr< PointsToTrack > > &points_to_track,
       cv::Vec3d& points3D,
       double reproj_error = 4,
-      const std::vector<bool> &masks = std::vector<bool>( ) );
+      const std::vector<bool> &masks = std::vector<bool>( ),
+      cv::RNG* random_generator = NULL );
     
     /**
     * From the list of points of this track, remove each 2D points when
@@ -167,6 +200,11 @@ namespace OpencvSfM{
 
     /**
     * Remove tracks having points in commun (mix them and set them inconsistant if needed...)
+    * Each set of tracks connected by common points is replaced by one track,
+    * at the position of its first track, having every points of the set
+    * (colors are averaged). Tracks sharing an (image, point) are found using
+    * a sorted list of every points and joined with a disjoint-set, so this
+    * runs in near-linear time.
     * @param tracks list of tracks to analyze
     */
     static void fusionDuplicates( std::vector<TrackOfPoints>& tracks );
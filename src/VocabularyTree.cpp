@@ -0,0 +1,308 @@
+#include "VocabularyTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace OpencvSfM{
+
+  using cv::Mat;
+  using std::vector;
+  using std::pair;
+
+  static inline float distance2( const float* a, const float* b,
+    unsigned int dim )
+  {
+    float dist = 0;
+    for( unsigned int d = 0; d < dim; ++d )
+    {
+      float diff = a[ d ] - b[ d ];
+      dist += diff * diff;
+    }
+    return dist;
+  }
+
+  //used to sort images by decreasing score (then by index):
+  static inline bool compareScores( const pair< float, unsigned int >& s1,
+    const pair< float, unsigned int >& s2 )
+  {
+    return s1.first > s2.first ||
+      ( s1.first == s2.first && s1.second < s2.second );
+  }
+
+  VocabularyTree::VocabularyTree( unsigned int branching, unsigned int depth )
+  {
+    branching_ = MAX( branching, 2 );
+    depth_ = depth;
+    nb_words_ = 0;
+    dim_ = 0;
+  }
+
+  Mat VocabularyTree::convertDescriptors( const Mat& descriptors )
+  {
+    Mat out;
+    if( descriptors.empty( ) )
+      return out;
+    if( descriptors.depth( ) == CV_8U )
+    {//binary descriptors: one float for each bit
+      out = Mat::zeros( descriptors.rows, descriptors.cols * 8, CV_32F );
+      for( int r = 0; r < descriptors.rows; ++r )
+      {
+        const uchar* in_row = descriptors.ptr<uchar>( r );
+        float* out_row = out.ptr<float>( r );
+        for( int c = 0; c < descriptors.cols; ++c )
+          for( int b = 0; b < 8; ++b )
+            out_row[ c * 8 + b ] = ( float )( ( in_row[ c ] >> b ) & 1 );
+      }
+    }
+    else
+      descriptors.convertTo( out, CV_32F );
+    return out;
+  }
+
+  void VocabularyTree::build( const Mat& descriptors, unsigned int nb_iterations )
+  {
+    if( descriptors.type( ) != CV_32F )
+      CV_Error( CV_StsUnsupportedFormat,
+        "Vocabulary tree needs CV_32F descriptors (see convertDescriptors)!" );
+
+    dim_ = descriptors.cols;
+    nb_words_ = 0;
+    //the root (its center is not used):
+    centers_.assign( dim_, 0.0f );
+    first_child_.assign( 1, -1 );
+    nb_children_.assign( 1, 0 );
+    word_of_node_.assign( 1, -1 );
+    images_words_.clear( );
+    images_weights_.clear( );
+    idf_.clear( );
+    inverted_file_.clear( );
+
+    vector<int> rows( descriptors.rows );
+    for( int r = 0; r < descriptors.rows; ++r )
+      rows[ r ] = r;
+    buildNode( 0, descriptors, rows, 0, nb_iterations );
+  }
+
+  void VocabularyTree::buildNode( unsigned int node, const Mat& descriptors,
+    vector<int>& rows, unsigned int level, unsigned int nb_iterations )
+  {
+    size_t nb_rows = rows.size( );
+    if( level >= depth_ || nb_rows <= branching_ )
+    {//this node is a leaf:
+      word_of_node_[ node ] = nb_words_++;
+      return;
+    }
+
+    //k-means++ initialization (deterministic, seeded with the node index):
+    unsigned int k = branching_;
+    cv::RNG rng( 0x5F3759DF + node );
+    vector<float> centers( k * dim_ );
+    vector<float> min_dist( nb_rows, FLT_MAX );
+    int first = rows[ rng.uniform( 0, ( int )nb_rows ) ];
+    std::copy( descriptors.ptr<float>( first ),
+      descriptors.ptr<float>( first ) + dim_, centers.begin( ) );
+    for( unsigned int c = 1; c < k; ++c )
+    {
+      double sum = 0;
+      for( size_t i = 0; i < nb_rows; ++i )
+      {
+        float dist = distance2( descriptors.ptr<float>( rows[ i ] ),
+          &centers[ ( c - 1 ) * dim_ ], dim_ );
+        min_dist[ i ] = std::min( min_dist[ i ], dist );
+        sum += min_dist[ i ];
+      }
+      double target = rng.uniform( 0.0, 1.0 ) * sum;
+      size_t chosen = 0;
+      for( sum = min_dist[ 0 ]; sum < target && chosen + 1 < nb_rows; )
+        sum += min_dist[ ++chosen ];
+      std::copy( descriptors.ptr<float>( rows[ chosen ] ),
+        descriptors.ptr<float>( rows[ chosen ] ) + dim_,
+        centers.begin( ) + c * dim_ );
+    }
+
+    //Lloyd iterations:
+    vector<int> labels( nb_rows, -1 );
+    vector<double> sums( k * dim_ );
+    vector<unsigned int> counts( k );
+    for( unsigned int it = 0; it < nb_iterations; ++it )
+    {
+      bool changed = false;
+      for( size_t i = 0; i < nb_rows; ++i )
+      {
+        const float* desc = descriptors.ptr<float>( rows[ i ] );
+        int best = 0;
+        float best_dist = FLT_MAX;
+        for( unsigned int c = 0; c < k; ++c )
+        {
+          float dist = distance2( desc, &centers[ c * dim_ ], dim_ );
+          if( dist < best_dist )
+          {
+            best_dist = dist;
+            best = c;
+          }
+        }
+        changed = changed || labels[ i ] != best;
+        labels[ i ] = best;
+      }
+      if( !changed )
+        break;
+
+      std::fill( sums.begin( ), sums.end( ), 0.0 );
+      std::fill( counts.begin( ), counts.end( ), 0 );
+      for( size_t i = 0; i < nb_rows; ++i )
+      {
+        const float* desc = descriptors.ptr<float>( rows[ i ] );
+        double* sum = &sums[ labels[ i ] * dim_ ];
+        for( unsigned int d = 0; d < dim_; ++d )
+          sum[ d ] += desc[ d ];
+        counts[ labels[ i ] ]++;
+      }
+      for( unsigned int c = 0; c < k; ++c )
+        if( counts[ c ] > 0 )//else keep the previous center
+          for( unsigned int d = 0; d < dim_; ++d )
+            centers[ c * dim_ + d ] = ( float )( sums[ c * dim_ + d ] / counts[ c ] );
+    }
+
+    //create the children:
+    unsigned int first_child = ( unsigned int )first_child_.size( );
+    first_child_[ node ] = first_child;
+    nb_children_[ node ] = k;
+    centers_.insert( centers_.end( ), centers.begin( ), centers.end( ) );
+    first_child_.resize( first_child + k, -1 );
+    nb_children_.resize( first_child + k, 0 );
+    word_of_node_.resize( first_child + k, -1 );
+
+    vector< vector<int> > rows_of_child( k );
+    for( size_t i = 0; i < nb_rows; ++i )
+      rows_of_child[ labels[ i ] ].push_back( rows[ i ] );
+    vector<int>( ).swap( rows );//free memory before recursion
+
+    for( unsigned int c = 0; c < k; ++c )
+      buildNode( first_child + c, descriptors, rows_of_child[ c ],
+        level + 1, nb_iterations );
+  }
+
+  void VocabularyTree::quantize( const Mat& descriptors,
+    vector<unsigned int>& words ) const
+  {
+    if( first_child_.empty( ) )
+      CV_Error( CV_StsError, "The vocabulary tree is not built!" );
+    if( descriptors.empty( ) )
+      return;
+    if( descriptors.type( ) != CV_32F || ( unsigned int )descriptors.cols != dim_ )
+      CV_Error( CV_StsBadArg, "Descriptors don't have the format of the tree!" );
+
+    for( int r = 0; r < descriptors.rows; ++r )
+    {
+      const float* desc = descriptors.ptr<float>( r );
+      unsigned int node = 0;
+      while( first_child_[ node ] >= 0 )
+      {
+        unsigned int child = first_child_[ node ],
+          best = child;
+        float best_dist = FLT_MAX;
+        for( unsigned int c = 0; c < nb_children_[ node ]; ++c )
+        {
+          float dist = distance2( desc, &centers_[ ( child + c ) * dim_ ], dim_ );
+          if( dist < best_dist )
+          {
+            best_dist = dist;
+            best = child + c;
+          }
+        }
+        node = best;
+      }
+      words.push_back( word_of_node_[ node ] );
+    }
+  }
+
+  unsigned int VocabularyTree::addImage( const Mat& descriptors )
+  {
+    vector<unsigned int> words;
+    quantize( descriptors, words );
+    std::sort( words.begin( ), words.end( ) );
+
+    //term frequencies (weighted later by computeWeights):
+    vector< pair< unsigned int, float > > histogram;
+    for( size_t i = 0; i < words.size( ); ++i )
+    {
+      if( histogram.empty( ) || histogram.back( ).first != words[ i ] )
+        histogram.push_back( std::make_pair( words[ i ], 0.0f ) );
+      histogram.back( ).second += 1.0f;
+    }
+    images_words_.push_back( histogram );
+    return ( unsigned int )images_words_.size( ) - 1;
+  }
+
+  void VocabularyTree::computeWeights( )
+  {
+    size_t nb_images = images_words_.size( );
+    vector<unsigned int> nb_images_of_word( nb_words_, 0 );
+    for( size_t i = 0; i < nb_images; ++i )
+      for( size_t w = 0; w < images_words_[ i ].size( ); ++w )
+        nb_images_of_word[ images_words_[ i ][ w ].first ]++;
+
+    //words seen in every images have a null weight:
+    idf_.assign( nb_words_, 0.0f );
+    for( unsigned int w = 0; w < nb_words_; ++w )
+      if( nb_images_of_word[ w ] > 0 )
+        idf_[ w ] = ( float )log( ( double )nb_images / nb_images_of_word[ w ] );
+
+    inverted_file_.assign( nb_words_, vector< pair< unsigned int, float > >( ) );
+    images_weights_ = images_words_;
+    for( size_t i = 0; i < nb_images; ++i )
+    {
+      vector< pair< unsigned int, float > >& histogram = images_weights_[ i ];
+      float sum = 0;
+      for( size_t w = 0; w < histogram.size( ); ++w )
+      {//term frequency * inverse document frequency:
+        histogram[ w ].second *= idf_[ histogram[ w ].first ];
+        sum += histogram[ w ].second;
+      }
+      for( size_t w = 0; w < histogram.size( ); ++w )
+      {
+        if( sum > 0 )
+          histogram[ w ].second /= sum;
+        if( histogram[ w ].second > 0 )
+          inverted_file_[ histogram[ w ].first ].push_back(
+            std::make_pair( ( unsigned int )i, histogram[ w ].second ) );
+      }
+    }
+  }
+
+  void VocabularyTree::computeScores( unsigned int image,
+    vector<float>& scores ) const
+  {
+    CV_Assert( image < images_weights_.size( ) &&
+      inverted_file_.size( ) == nb_words_ );
+    scores.assign( images_weights_.size( ), 0.0f );
+    const vector< pair< unsigned int, float > >& histogram = images_weights_[ image ];
+    for( size_t w = 0; w < histogram.size( ); ++w )
+    {
+      const vector< pair< unsigned int, float > >& images =
+        inverted_file_[ histogram[ w ].first ];
+      for( size_t i = 0; i < images.size( ); ++i )
+        scores[ images[ i ].first ] +=
+          std::min( histogram[ w ].second, images[ i ].second );
+    }
+  }
+
+  void VocabularyTree::getBestImages( unsigned int image,
+    unsigned int nb_images, vector<unsigned int>& best ) const
+  {
+    vector<float> scores;
+    computeScores( image, scores );
+    vector< pair< float, unsigned int > > candidates;
+    for( unsigned int i = 0; i < scores.size( ); ++i )
+      if( i != image && scores[ i ] > 0 )
+        candidates.push_back( std::make_pair( scores[ i ], i ) );
+    size_t nb_best = std::min( ( size_t )nb_images, candidates.size( ) );
+    std::partial_sort( candidates.begin( ), candidates.begin( ) + nb_best,
+      candidates.end( ), compareScores );
+    best.clear( );
+    for( size_t i = 0; i < nb_best; ++i )
+      best.push_back( candidates[ i ].second );
+  }
+
+}
@@ -0,0 +1,121 @@
+#ifndef _GSOC_SFM_VOCABULARY_TREE_H
+#define _GSOC_SFM_VOCABULARY_TREE_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+#include <vector>
+#include <utility>
+#include "opencv2/core/core.hpp"
+
+namespace OpencvSfM{
+
+  /**
+  * \brief A vocabulary tree used to find quickly similar images.
+  * It follow ideas proposed by David Nister and Henrik Stewenius:
+  * Scalable Recognition with a Vocabulary Tree
+  *
+  * The tree is built using hierarchical k-means on a sample of the
+  * descriptors of every images. Each leaf is a visual word. Each image is
+  * then described by its TF-IDF weighted histogram of words (L1
+  * normalized), stored into an inverted file. The similarity between two
+  * images is the intersection of their histograms (between 0 and 1).
+  *
+  * Binary descriptors (CV_8U, ORB, BRIEF...) are converted to a vector of
+  * bits, so the L2 distance used by k-means is the Hamming distance.
+  */
+  class SFM_EXPORTS VocabularyTree
+  {
+  public:
+    /**
+    * Create an empty tree
+    * @param branching number of children of each node
+    * @param depth number of levels of the tree (branching^depth words at most)
+    */
+    VocabularyTree( unsigned int branching = 8, unsigned int depth = 4 );
+
+    /**
+    * Convert descriptors to the format used by the tree (CV_32F). Binary
+    * descriptors are converted to one float (0 or 1) for each bit.
+    * @param descriptors input descriptors (one per row)
+    * @return converted descriptors
+    */
+    static cv::Mat convertDescriptors( const cv::Mat& descriptors );
+
+    /**
+    * Build the tree (hierarchical k-means) and remove every image.
+    * @param descriptors training descriptors (one per row, see convertDescriptors)
+    * @param nb_iterations number of k-means iterations for each node
+    */
+    void build( const cv::Mat& descriptors, unsigned int nb_iterations = 10 );
+    /**
+    * Find the visual word of each descriptor
+    * @param descriptors descriptors to quantize (see convertDescriptors)
+    * @param words output, the word of each descriptor
+    */
+    void quantize( const cv::Mat& descriptors,
+      std::vector<unsigned int>& words ) const;
+    /**
+    * Get the number of visual words (leaves) of the tree
+    * @return number of words
+    */
+    inline unsigned int getNbWords( ) const { return nb_words_; };
+
+    /**
+    * Add an image to the database. computeWeights( ) has to be called
+    * once every images are added.
+    * @param descriptors descriptors of the image (see convertDescriptors)
+    * @return index of the image in the database
+    */
+    unsigned int addImage( const cv::Mat& descriptors );
+    /**
+    * Get the number of images of the database
+    * @return number of images
+    */
+    inline unsigned int getNbImages( ) const
+    { return ( unsigned int )images_words_.size( ); };
+    /**
+    * Compute the IDF weight of each word, the weighted histogram of each
+    * image and the inverted file.
+    */
+    void computeWeights( );
+    /**
+    * Compute the similarity between an image and every other images
+    * @param image index of the image
+    * @param scores output, similarity with each image (0 if no word in commun)
+    */
+    void computeScores( unsigned int image, std::vector<float>& scores ) const;
+    /**
+    * Find the images which are the most similar to an image
+    * @param image index of the image
+    * @param nb_images number of wanted images
+    * @param best output, indexes of the most similar images (image is excluded), best first
+    */
+    void getBestImages( unsigned int image, unsigned int nb_images,
+      std::vector<unsigned int>& best ) const;
+
+  protected:
+    /**
+    * Run k-means on a subset of the descriptors and create the children
+    * of a node. Recursively called for each child.
+    */
+    void buildNode( unsigned int node, const cv::Mat& descriptors,
+      std::vector<int>& rows, unsigned int level, unsigned int nb_iterations );
+
+    unsigned int branching_;///<number of children of each node
+    unsigned int depth_;///<number of levels of the tree
+    unsigned int nb_words_;///<number of leaves
+    unsigned int dim_;///<size of descriptors
+    std::vector<float> centers_;///<center of each node (dim_ values per node)
+    std::vector<int> first_child_;///<index of the first child of each node (-1 for leaves)
+    std::vector<unsigned int> nb_children_;///<number of children of each node
+    std::vector<int> word_of_node_;///<word of each leaf (-1 for other nodes)
+
+    std::vector< std::vector< std::pair< unsigned int, float > > > images_words_;///<sorted (word, count) of each image
+    std::vector< std::vector< std::pair< unsigned int, float > > > images_weights_;///<sorted (word, TF-IDF weight) of each image
+    std::vector<float> idf_;///<weight of each word
+    std::vector< std::vector< std::pair< unsigned int, float > > > inverted_file_;///<(image, weight) of each word
+  };
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef _GSOC_SFM_ATOMIC_OPS_H
+#define _GSOC_SFM_ATOMIC_OPS_H 1
+
+#include "macro.h" //SFM_EXPORTS
+
+//////////////////////////////////////////////////////////////////////////
+//Minimal set of atomic operations used by lock-free structures.
+//We can't use C++11 atomics, so use compiler intrinsics instead.
+//////////////////////////////////////////////////////////////////////////
+
+#if defined _MSC_VER
+#include <intrin.h>
+#pragma intrinsic( _InterlockedCompareExchange, _InterlockedExchangeAdd, _ReadWriteBarrier )
+#endif
+
+namespace OpencvSfM{
+
+#if defined _MSC_VER
+  typedef long atomic_int;///<32 bits integer usable with atomic operations
+
+  /**
+  * If *ptr is equal to expected, replace it by desired.
+  * @return the value of *ptr before the operation
+  */
+  inline atomic_int atomicCompareAndSwap( volatile atomic_int* ptr,
+    atomic_int expected, atomic_int desired )
+  {
+    return _InterlockedCompareExchange( ptr, desired, expected );
+  }
+  /**
+  * Add val to *ptr.
+  * @return the value of *ptr before the operation
+  */
+  inline atomic_int atomicAdd( volatile atomic_int* ptr, atomic_int val )
+  {
+    return _InterlockedExchangeAdd( ptr, val );
+  }
+  /**
+  * Full memory barrier (no reads or writes can be moved across it)
+  */
+  inline void memoryBarrier( )
+  {
+    //interlocked operations are full barriers:
+    volatile long barrier = 0;
+    _InterlockedCompareExchange( &barrier, 0, 0 );
+  }
+#else
+  typedef int atomic_int;///<32 bits integer usable with atomic operations
+
+  /**
+  * If *ptr is equal to expected, replace it by desired.
+  * @return the value of *ptr before the operation
+  */
+  inline atomic_int atomicCompareAndSwap( volatile atomic_int* ptr,
+    atomic_int expected, atomic_int desired )
+  {
+    return __sync_val_compare_and_swap( ptr, expected, desired );
+  }
+  /**
+  * Add val to *ptr.
+  * @return the value of *ptr before the operation
+  */
+  inline atomic_int atomicAdd( volatile atomic_int* ptr, atomic_int val )
+  {
+    return __sync_fetch_and_add( ptr, val );
+  }
+  /**
+  * Full memory barrier (no reads or writes can be moved across it)
+  */
+  inline void memoryBarrier( )
+  {
+    __sync_synchronize( );
+  }
+#endif
+
+}
+
+#endif
@@ -74,4 +74,12 @@ NEW_TUTO( Cam_creation, "Learn what you can do with a pinhole distorded camera",
     cout<<" ( was "<<points[ i ][ 0 ]<<" "<<points[ i ][ 1 ]<<" )"<<endl;
   }
 
+  //same conversion, using the batch version (in place, no allocation):
+  camera->normImageToPixelBatch( &pointsImgCoord[ 0 ], &pointsImgCoord[ 0 ], 6 );
+  cout<<"Same conversion using the batch version:"<<endl;
+  for( int i=0;i<6;i++ )
+  {
+    cout<<pointsImgCoord[ i ][ 0 ]<<" "<<pointsImgCoord[ i ][ 1 ]<<endl;
+  }
+
 }
@@ -0,0 +1,100 @@
+
+#include "config_SFM.h"
+#include "../src/SequenceAnalyzer.h"
+#include "../src/FeaturesStore.h"
+
+#include <fstream>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto loads the tracks saved by Track_creation and Reconstruction
+//in YAML, saves them using the binary format (FeaturesStore for points and
+//SequenceAnalyzer::writeTracks for tracks) and compares the loading time.
+//Every field of the tracks read back must be identical: points, colors,
+//consistance, good/bad flag of each point and 3D positions.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+#define POINT_METHOD "SIFT"
+
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+NEW_TUTO( Binary_Tracks, "Save and load tracks using a binary format",
+  "Load YAML tracks, save them in binary files and compare the loading time of both formats." )
+{
+  vector<string> yaml_files;
+  yaml_files.push_back( FROM_SRC_ROOT( "Medias/tracks_points_"POINT_METHOD"/motion_tracks.yml" ) );
+  yaml_files.push_back( FROM_SRC_ROOT( "Medias/motion_tracks_triangulated.yml" ) );
+  string points_file = FROM_SRC_ROOT( "Medias/test_tracks_points.sfmf" );
+  string tracks_file = FROM_SRC_ROOT( "Medias/test_tracks.sfmt" );
+
+  for( size_t f = 0; f < yaml_files.size( ); ++f )
+  {
+    std::ifstream test_file_exist( yaml_files[ f ].c_str( ) );
+    if( !test_file_exist.is_open( ) )
+    {
+      cout<<yaml_files[ f ]<<" not found, run Track_creation and Reconstruction first"<<endl;
+      continue;
+    }
+    test_file_exist.close( );
+
+    double t = ( double )getTickCount( );
+    FileStorage fsRead( yaml_files[ f ], FileStorage::READ );
+    SequenceAnalyzer sequence_yaml( fsRead.getFirstTopLevelNode( ) );
+    fsRead.release( );
+    double time_yaml = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+
+    sequence_yaml.writeFeatures( points_file );
+    sequence_yaml.writeTracks( tracks_file );
+
+    t = ( double )getTickCount( );
+    SequenceAnalyzer sequence_binary(
+      Ptr<FeaturesStore>( new FeaturesStore( points_file ) ) );
+    sequence_binary.readTracks( tracks_file );
+    double time_binary = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+
+    vector<TrackOfPoints>& tracks_yaml = sequence_yaml.getTracks( );
+    vector<TrackOfPoints>& tracks_binary = sequence_binary.getTracks( );
+    unsigned int nb_observations = 0, nb_bad_observations = 0,
+      nb_inconsistent = 0;
+    if( tracks_yaml.size( ) != tracks_binary.size( ) )
+      CV_Error( CV_StsError, "Not the same number of tracks!" );
+    for( size_t i = 0; i < tracks_yaml.size( ); ++i )
+    {
+      TrackOfPoints& track = tracks_yaml[ i ];
+      TrackOfPoints& track_binary = tracks_binary[ i ];
+      if( track.getNbPoints( ) != track_binary.getNbPoints( ) ||
+        track.getColor( ) != track_binary.getColor( ) ||
+        track.getConsistance( ) != track_binary.getConsistance( ) ||
+        track.getNbTrack( ) != track_binary.getNbTrack( ) ||
+        track.get3DPosition( ).empty( ) != track_binary.get3DPosition( ).empty( ) ||
+        ( !track.get3DPosition( ).empty( ) &&
+        norm( *track.get3DPosition( ) - *track_binary.get3DPosition( ) ) > 0 ) )
+        CV_Error( CV_StsError, "Not the same tracks!" );
+      for( unsigned int j = 0; j < track.getNbPoints( ); ++j )
+      {
+        int img, point, img_binary, point_binary;
+        track.getMatch( j, img, point );
+        track_binary.getMatch( j, img_binary, point_binary );
+        Point2f pt = sequence_yaml.getPoints( )[ img ]->getKeypoint( point ).pt,
+          pt_binary = sequence_binary.getPoints( )[ img_binary ]->getKeypoint( point_binary ).pt;
+        if( img != img_binary || pt != pt_binary )
+          CV_Error( CV_StsError, "Not the same points!" );
+        if( track.isGoodPoint( j ) != track_binary.isGoodPoint( j ) )
+          CV_Error( CV_StsError, "Not the same good/bad flags!" );
+        if( !track.isGoodPoint( j ) )
+          nb_bad_observations++;
+        nb_observations++;
+      }
+      if( track.getConsistance( ) < 0 )
+        nb_inconsistent++;
+    }
+    cout<<yaml_files[ f ]<<": "<<tracks_yaml.size( )<<" tracks ("<<
+      nb_inconsistent<<" inconsistent), "<<nb_observations<<
+      " observations ("<<nb_bad_observations<<" bad)"<<endl;
+    cout<<"YAML: "<<time_yaml<<" s, binary: "<<time_binary<<" s, speedup "<<
+      time_yaml / time_binary<<endl;
+  }
+}
@@ -0,0 +1,79 @@
+
+#include "config_SFM.h"
+#include "../src/PointsToTrackWithImage.h"
+#include "../src/BucketedFeatureDetector.h"
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto compares the keypoints found on a whole image with the ones
+//found by a BucketedFeatureDetector: number of points, time and coverage
+//of the image (number of cells of a 8x8 grid containing points).
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+static int computeCoverage( const Mat& image, const vector<KeyPoint>& keypoints )
+{
+  vector<bool> cells( 64, false );
+  for( size_t i = 0; i < keypoints.size( ); ++i )
+  {
+    int x = ( int )( keypoints[ i ].pt.x * 8 / image.cols ),
+      y = ( int )( keypoints[ i ].pt.y * 8 / image.rows );
+    cells[ MIN( y, 7 ) * 8 + MIN( x, 7 ) ] = true;
+  }
+  return ( int )std::count( cells.begin( ), cells.end( ), true );
+}
+
+NEW_TUTO( Bucketed_Detection, "Spread keypoints over the image",
+  "Detect FAST keypoints on the whole image, then using a grid of cells with a budget of keypoints, and compare coverage and time." )
+{
+  Mat image = imread( FROM_SRC_ROOT( "Medias/temple/temple0001.png" ), 0 );
+  if( image.empty( ) )
+  {
+    cout<<"test can not be run... can't find images..."<<endl;
+    return;
+  }
+  Ptr<FeatureDetector> fast = FeatureDetector::create( "FAST" );
+  vector<KeyPoint> keypoints;
+  double t = ( double )getTickCount( );
+  fast->detect( image, keypoints );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  cout<<"Whole image: "<<keypoints.size( )<<" points in "<<t<<" s, "<<
+    computeCoverage( image, keypoints )<<"/64 cells covered"<<endl;
+
+  unsigned int budget = MAX( ( unsigned int )keypoints.size( ) / 4, 100 );
+  Ptr<FeatureDetector> bucketed( new BucketedFeatureDetector( fast, budget, 4, 4 ) );
+  t = ( double )getTickCount( );
+  bucketed->detect( image, keypoints );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  cout<<"Bucketed (budget "<<budget<<"): "<<keypoints.size( )<<" points in "<<
+    t<<" s, "<<computeCoverage( image, keypoints )<<"/64 cells covered"<<endl;
+  if( keypoints.size( ) > budget )
+    CV_Error( CV_StsError, "Budget of keypoints not respected!" );
+
+  //with an adjuster, each cell changes its threshold for the next images
+  //(here the same image is used as a static sequence):
+  Ptr<FeatureDetector> adaptive( new BucketedFeatureDetector(
+    Ptr<FeatureDetector>( new FastAdjuster( 5 ) ), budget, 4, 4 ) );
+  for( int frame = 0; frame < 5; ++frame )
+  {
+    t = ( double )getTickCount( );
+    adaptive->detect( image, keypoints );
+    t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+    cout<<"Adaptive thresholds, frame "<<frame<<": "<<keypoints.size( )<<
+      " points in "<<t<<" s"<<endl;
+    if( keypoints.size( ) > budget )
+      CV_Error( CV_StsError, "Budget of keypoints not respected!" );
+  }
+
+  //the same detector can be used for every images of a sequence:
+  PointsToTrackWithImage points( 0, image, bucketed,
+    DescriptorExtractor::create( "SURF" ) );
+  points.computeKeypointsAndDesc( );
+  cout<<points.getKeypoints( ).size( )<<" points with descriptors"<<endl;
+}
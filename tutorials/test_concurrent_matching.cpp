@@ -0,0 +1,166 @@
+
+#include "config_SFM.h"
+#include "../src/PointsToTrackWithImage.h"
+#include "../src/MotionProcessor.h"
+#include "../src/SequenceAnalyzer.h"
+#include "../src/PointsMatcher.h"
+
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <utility>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto checks that two sequences can be matched at the same time in
+//one process: each matching session has its own context, so the tracks
+//must be exactly the same than when sequences are matched one after the other.
+//It also checks that a trained matcher can be searched by several threads
+//at the same time (searches don't lock the matcher).
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+typedef vector< pair< int, vector< pair< int, int > > > > CanonicalTracks;
+
+static vector<Mat> loadFirstImages( string directory, unsigned int nb_max )
+{
+  MotionProcessor mp;
+  vector<Mat> images;
+  mp.setInputSource( FROM_SRC_ROOT( directory ), IS_DIRECTORY );
+  mp.setProperty( CV_CAP_PROP_CONVERT_RGB, 0 );
+  Mat imgTmp=mp.getFrame( );
+  while ( !imgTmp.empty( ) && images.size( ) < nb_max )
+  {
+    images.push_back( imgTmp );
+    imgTmp=mp.getFrame( );
+  }
+  return images;
+}
+
+static Ptr<SequenceAnalyzer> createSequence( vector<Mat>& images )
+{
+  vector< Ptr< PointsToTrack > > points;
+  for( unsigned int i = 0; i < images.size( ); ++i )
+  {
+    Ptr<PointsToTrack> ptt = Ptr<PointsToTrack>( new PointsToTrackWithImage(
+      i, images[ i ], "SURF", "SURF" ) );
+    ptt->computeKeypointsAndDesc( );
+    points.push_back( ptt );
+  }
+  return Ptr<SequenceAnalyzer>( new SequenceAnalyzer( points, &images,
+    PointsMatcher::create( "FlannBased" ) ) );
+}
+
+//tracks are stored in a different order from one run to another,
+//so sort them before comparison:
+static CanonicalTracks canonicalTracks( SequenceAnalyzer& sequence )
+{
+  CanonicalTracks out;
+  vector<TrackOfPoints>& tracks = sequence.getTracks( );
+  for( size_t t = 0; t < tracks.size( ); ++t )
+  {
+    vector< pair< int, int > > points;
+    unsigned int nb_images = sequence.getPoints( ).size( );
+    for( unsigned int img = 0; img < nb_images; ++img )
+      if( tracks[ t ].containImage( img ) )
+        points.push_back( make_pair( ( int )img, tracks[ t ].getPointIndex( img ) ) );
+    out.push_back( make_pair( ( int )tracks[ t ].getNbTrack( ), points ) );
+  }
+  sort( out.begin( ), out.end( ) );
+  return out;
+}
+
+struct MatchSequence
+{
+  SequenceAnalyzer* sequence;
+  void operator()( )
+  {
+    //only one worker per sequence to have a deterministic order of matches:
+    sequence->computeMatches( 1, false );
+  }
+};
+
+struct SearchMatcher
+{
+  Ptr<PointsMatcher> matcher;
+  Ptr<PointsToTrack> query;
+  vector<DMatch>* matches;
+  void operator()( )
+  {
+    matcher->match( query, *matches );
+  }
+};
+
+NEW_TUTO( Concurrent_Matching, "Match two sequences at the same time",
+  "Two SequenceAnalyzer compute their matches in two threads, the tracks are compared with the ones computed sequentially." )
+{
+  vector<Mat> images_house = loadFirstImages( "Medias/modelHouse/", 4 );
+  vector<Mat> images_temple = loadFirstImages( "Medias/temple/", 4 );
+  if( images_house.empty( ) || images_temple.empty( ) )
+  {
+    cout<<"test can not be run... can't find images..."<<endl;
+    return;
+  }
+
+  cout<<"Match the two sequences one after the other..."<<endl;
+  Ptr<SequenceAnalyzer> house_seq = createSequence( images_house );
+  Ptr<SequenceAnalyzer> temple_seq = createSequence( images_temple );
+  house_seq->computeMatches( 1, false );
+  temple_seq->computeMatches( 1, false );
+  CanonicalTracks house_ref = canonicalTracks( *house_seq );
+  CanonicalTracks temple_ref = canonicalTracks( *temple_seq );
+
+  cout<<"Now match them concurrently..."<<endl;
+  Ptr<SequenceAnalyzer> house_seq1 = createSequence( images_house );
+  Ptr<SequenceAnalyzer> temple_seq1 = createSequence( images_temple );
+  MatchSequence match_house, match_temple;
+  match_house.sequence = house_seq1;
+  match_temple.sequence = temple_seq1;
+  boost::thread thread_house( match_house );
+  boost::thread thread_temple( match_temple );
+  thread_house.join( );
+  thread_temple.join( );
+
+  bool same_house = ( canonicalTracks( *house_seq1 ) == house_ref );
+  bool same_temple = ( canonicalTracks( *temple_seq1 ) == temple_ref );
+  cout<<"house: "<<house_ref.size( )<<" tracks, "<<
+    ( same_house ? "identical" : "DIFFERENT" )<<endl;
+  cout<<"temple: "<<temple_ref.size( )<<" tracks, "<<
+    ( same_temple ? "identical" : "DIFFERENT" )<<endl;
+  if( !same_house || !same_temple )
+    CV_Error( CV_StsError, "Concurrent matching gives different tracks!" );
+
+  cout<<"Search one trained matcher from several threads..."<<endl;
+  vector< Ptr< PointsToTrack > >& house_points = house_seq->getPoints( );
+  Ptr<PointsMatcher> shared_matcher = PointsMatcher::create( "FlannBased" );
+  shared_matcher->add( house_points[ 0 ] );
+  shared_matcher->train( );
+  unsigned int nb_queries = house_points.size( ) - 1;
+  vector< vector<DMatch> > serial_matches( nb_queries ),
+    concurrent_matches( nb_queries );
+  for( unsigned int q = 0; q < nb_queries; ++q )
+    shared_matcher->match( house_points[ q + 1 ], serial_matches[ q ] );
+  boost::thread_group searches;
+  for( unsigned int q = 0; q < nb_queries; ++q )
+  {
+    SearchMatcher search;
+    search.matcher = shared_matcher;
+    search.query = house_points[ q + 1 ];
+    search.matches = &concurrent_matches[ q ];
+    searches.create_thread( search );
+  }
+  searches.join_all( );
+  for( unsigned int q = 0; q < nb_queries; ++q )
+  {
+    bool same = serial_matches[ q ].size( ) == concurrent_matches[ q ].size( );
+    for( size_t m = 0; same && m < serial_matches[ q ].size( ); ++m )
+      same = serial_matches[ q ][ m ].queryIdx == concurrent_matches[ q ][ m ].queryIdx &&
+        serial_matches[ q ][ m ].trainIdx == concurrent_matches[ q ][ m ].trainIdx;
+    if( !same )
+      CV_Error( CV_StsError, "Concurrent searches give different matches!" );
+  }
+  cout<<"Concurrent matching is OK!"<<endl;
+}
@@ -0,0 +1,110 @@
+
+#include "config_SFM.h"
+#include "../src/CameraPinholeDistor.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto compares the conversions of CameraPinholeDistor with OpenCV:
+//undistortion using cv::undistortPoints or the lookup table (for several
+//steps of the grid), and distortion using cv::projectPoints or the batch
+//conversion of the camera. Errors are given in pixels.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+NEW_TUTO( Distortion_Maps, "Speed and accuracy of distortion conversions",
+  "Compare undistortion maps and batch distortion with OpenCV functions." )
+{
+  RNG rng( 12345 );
+  const int nb_points = 200000, img_w = 640, img_h = 480;
+  Mat K = ( Mat_<double>( 3, 3 ) << 800, 0, 320, 0, 800, 240, 0, 0, 1 );
+  Vec6d radial_dist( -0.28, 0.09, 0.01, 0.02, 0.003, 0.0005 );
+  Vec2d tangential_dist( 0.001, -0.0007 );
+  //same coefficients, OpenCV order ( k_1, k_2, p_1, p_2, k_3, k_4, k_5, k_6 ):
+  Mat dist_coeffs = ( Mat_<double>( 8, 1 ) << radial_dist[ 0 ], radial_dist[ 1 ],
+    tangential_dist[ 0 ], tangential_dist[ 1 ], radial_dist[ 2 ],
+    radial_dist[ 3 ], radial_dist[ 4 ], radial_dist[ 5 ] );
+  CameraPinholeDistor camera( K, radial_dist, 6, tangential_dist, img_w, img_h );
+
+  vector<Vec2d> pixels( nb_points );
+  for( int i = 0; i < nb_points; ++i )
+    pixels[ i ] = Vec2d( rng.uniform( 0.0, ( double )img_w ),
+      rng.uniform( 0.0, ( double )img_h ) );
+
+  //undistortion:
+  double t = ( double )getTickCount( );
+  vector<Vec2d> normalized = camera.pixelToNormImageCoordinates( pixels );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  cout<<"cv::undistortPoints: "<<nb_points / t<<" points/s"<<endl;
+
+  int steps[ ] = { 1, 4, 16 };
+  for( int s = 0; s < 3; ++s )
+  {
+    t = ( double )getTickCount( );
+    camera.buildUndistortionMap( steps[ s ] );
+    double t_build = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+    t = ( double )getTickCount( );
+    vector<Vec2d> normalized_map = camera.pixelToNormImageCoordinates( pixels );
+    t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+    double max_error = 0, mean_error = 0;
+    for( int i = 0; i < nb_points; ++i )
+    {
+      double error = norm( normalized_map[ i ] - normalized[ i ] ) * K.at<double>( 0, 0 );
+      max_error = MAX( max_error, error );
+      mean_error += error;
+    }
+    cout<<"Lookup table (step "<<steps[ s ]<<", built in "<<t_build<<" s): "<<
+      nb_points / t<<" points/s, error mean "<<mean_error / nb_points<<
+      " max "<<max_error<<endl;
+  }
+
+  //changing the intra parameters (even using the base class) rebuilds the
+  //lookup table:
+  camera.buildUndistortionMap( 4 );
+  Mat K2 = ( Mat_<double>( 3, 3 ) << 820, 0, 330, 0, 820, 250, 0, 0, 1 );
+  CameraPinhole& base_camera = camera;
+  base_camera.updateIntrinsicMatrix( K2 );
+  CameraPinholeDistor new_camera( K2, radial_dist, 6, tangential_dist,
+    img_w, img_h );
+  vector<Vec2d> expected = new_camera.pixelToNormImageCoordinates( pixels );
+  vector<Vec2d> updated = camera.pixelToNormImageCoordinates( pixels );
+  double max_update_error = 0;
+  for( int i = 0; i < nb_points; ++i )
+    max_update_error = MAX( max_update_error,
+      norm( updated[ i ] - expected[ i ] ) * K2.at<double>( 0, 0 ) );
+  cout<<"Lookup table after updateIntrinsicMatrix: max error "<<
+    max_update_error<<endl;
+  if( max_update_error > 0.1 )
+    CV_Error( CV_StsError, "The lookup table was not rebuilt!" );
+  camera.releaseUndistortionMap( );
+
+  //distortion:
+  vector<Point3d> rays( nb_points );
+  for( int i = 0; i < nb_points; ++i )
+    rays[ i ] = Point3d( normalized[ i ][ 0 ], normalized[ i ][ 1 ], 1.0 );
+  vector<Point2d> projected;
+  t = ( double )getTickCount( );
+  projectPoints( rays, Mat::zeros( 3, 1, CV_64F ), Mat::zeros( 3, 1, CV_64F ),
+    K, dist_coeffs, projected );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  cout<<"cv::projectPoints: "<<nb_points / t<<" points/s"<<endl;
+
+  vector<Vec2d> distorted( nb_points );
+  t = ( double )getTickCount( );
+  camera.normImageToPixelBatch( &normalized[ 0 ], &distorted[ 0 ], nb_points );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  double max_error = 0, max_roundtrip = 0;
+  for( int i = 0; i < nb_points; ++i )
+  {
+    max_error = MAX( max_error, norm( distorted[ i ] -
+      Vec2d( projected[ i ].x, projected[ i ].y ) ) );
+    max_roundtrip = MAX( max_roundtrip, norm( distorted[ i ] - pixels[ i ] ) );
+  }
+  cout<<"CameraPinholeDistor::normImageToPixelBatch: "<<nb_points / t<<
+    " points/s, max error "<<max_error<<" (round trip: "<<max_roundtrip<<")"<<endl;
+}
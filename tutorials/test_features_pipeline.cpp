@@ -0,0 +1,94 @@
+
+#include "config_SFM.h"
+#include "../src/PointsToTrackWithImage.h"
+#include "../src/MotionProcessor.h"
+#include "../src/FeaturesPipeline.h"
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto compares the sequential loading of a directory of images
+//(getFrame then keypoints and descriptors computation) with the
+//multi-threaded FeaturesPipeline: both must give exactly the same
+//keypoints and descriptors.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+static bool sameKeypoints( const vector<KeyPoint>& kpts1,
+  const vector<KeyPoint>& kpts2 )
+{
+  if( kpts1.size( ) != kpts2.size( ) )
+    return false;
+  for( size_t i = 0; i < kpts1.size( ); ++i )
+    if( kpts1[ i ].pt != kpts2[ i ].pt || kpts1[ i ].size != kpts2[ i ].size ||
+      kpts1[ i ].angle != kpts2[ i ].angle ||
+      kpts1[ i ].response != kpts2[ i ].response ||
+      kpts1[ i ].octave != kpts2[ i ].octave )
+      return false;
+  return true;
+}
+
+static bool sameDescriptors( const Mat& desc1, const Mat& desc2 )
+{
+  if( desc1.size( ) != desc2.size( ) || desc1.type( ) != desc2.type( ) )
+    return false;
+  return desc1.empty( ) || norm( desc1, desc2, NORM_INF ) == 0;
+}
+
+NEW_TUTO( Features_Pipeline, "Multi-threaded loading of images",
+  "Load the temple images sequentially, then using FeaturesPipeline, and compare the points and the time." )
+{
+  MotionProcessor mp;
+  if( !mp.setInputSource( FROM_SRC_ROOT( "Medias/temple/" ), IS_DIRECTORY ) )
+  {
+    cout<<"test can not be run... can't find images..."<<endl;
+    return;
+  }
+  mp.setProperty( CV_CAP_PROP_CONVERT_RGB, 0 );
+  Ptr<FeatureDetector> detector = FeatureDetector::create( "SURF" );
+  Ptr<DescriptorExtractor> extractor = DescriptorExtractor::create( "SURF" );
+
+  //sequential loading:
+  vector< vector<KeyPoint> > keypoints;
+  vector< Mat > descriptors;
+  double t = ( double )getTickCount( );
+  MotionProcessor sequential( mp );
+  Mat img = sequential.getFrame( );
+  while( !img.empty( ) )
+  {
+    PointsToTrackWithImage points( keypoints.size( ), img, detector, extractor );
+    points.computeKeypointsAndDesc( );
+    keypoints.push_back( points.getKeypoints( ) );
+    descriptors.push_back( points.getDescriptors( ).clone( ) );
+    img = sequential.getFrame( );
+  }
+  double time_sequential = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  cout<<"Sequential loading of "<<keypoints.size( )<<" images: "<<
+    time_sequential<<" s"<<endl;
+
+  //multi-threaded loading:
+  FeaturesPipeline pipeline( mp, detector, extractor );
+  t = ( double )getTickCount( );
+  pipeline.start( );
+  Ptr<PointsToTrack> points;
+  unsigned int nb_images = 0;
+  while( pipeline.getNextFrame( img, points ) )
+  {
+    if( nb_images >= keypoints.size( ) ||
+      !sameKeypoints( points->getKeypoints( ), keypoints[ nb_images ] ) )
+      CV_Error( CV_StsError, "Not the same keypoints!" );
+    if( !sameDescriptors( points->getDescriptors( ), descriptors[ nb_images ] ) )
+      CV_Error( CV_StsError, "Not the same descriptors!" );
+    nb_images++;
+  }
+  double time_pipeline = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  if( nb_images != keypoints.size( ) )
+    CV_Error( CV_StsError, "Not the same number of images!" );
+  cout<<"FeaturesPipeline: "<<time_pipeline<<" s, speedup "<<
+    time_sequential / time_pipeline<<endl;
+  pipeline.printStatistics( cout );
+  cout<<"FeaturesPipeline is OK!"<<endl;
+}
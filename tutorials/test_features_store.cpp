@@ -0,0 +1,89 @@
+
+#include "config_SFM.h"
+#include "../src/PointsToTrackWithImage.h"
+#include "../src/MotionProcessor.h"
+#include "../src/PointsMatcher.h"
+#include "../src/FeaturesStore.h"
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto saves the points of the temple images using YAML and using the
+//binary FeaturesStore, then compares the loading time and the points.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+NEW_TUTO( Features_Store, "Save and load points using a binary file",
+  "Compute points of the temple images, save them in YAML and in a FeaturesStore, then compare the loading time." )
+{
+  MotionProcessor mp;
+  if( !mp.setInputSource( FROM_SRC_ROOT( "Medias/temple/" ), IS_DIRECTORY ) )
+  {
+    cout<<"test can not be run... can't find images..."<<endl;
+    return;
+  }
+  mp.setProperty( CV_CAP_PROP_CONVERT_RGB, 0 );
+  Ptr<FeatureDetector> detector = FeatureDetector::create( "SURF" );
+  Ptr<DescriptorExtractor> extractor = DescriptorExtractor::create( "SURF" );
+
+  Ptr<DescriptorMatcher> matcher( new FlannBasedMatcher( ) );
+  PointsMatcher points( matcher );
+  vector< Ptr<PointsToTrack> > points_computed;
+  Mat img = mp.getFrame( );
+  while( !img.empty( ) )
+  {
+    Ptr<PointsToTrack> ptt( new PointsToTrackWithImage( points_computed.size( ),
+      img, detector, extractor ) );
+    ptt->computeKeypointsAndDesc( );
+    points.add( ptt );
+    points_computed.push_back( ptt );
+    img = mp.getFrame( );
+  }
+  int nb_images = ( int )points_computed.size( );
+
+  string yaml_file = FROM_SRC_ROOT( "Medias/test_points.yml" );
+  string binary_file = FROM_SRC_ROOT( "Medias/test_points.sfmf" );
+  FileStorage fsOut( yaml_file, FileStorage::WRITE );
+  if( !fsOut.isOpened( ) )
+  {
+    cout<<"can't save points in "<<yaml_file<<endl;
+    return;
+  }
+  PointsMatcher::write( fsOut, points );
+  fsOut.release( );
+  PointsMatcher::write( binary_file, points );
+
+  double t = ( double )getTickCount( );
+  PointsMatcher points_yaml( matcher->clone( true ) );
+  FileStorage fsRead( yaml_file, FileStorage::READ );
+  PointsMatcher::read( fsRead.getFirstTopLevelNode( ), points_yaml );
+  fsRead.release( );
+  double time_yaml = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+
+  t = ( double )getTickCount( );
+  Ptr<FeaturesStore> store( new FeaturesStore( binary_file ) );
+  PointsMatcher points_binary( matcher->clone( true ) );
+  PointsMatcher::read( store, points_binary );
+  double time_binary = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  cout<<"Loading of "<<nb_images<<" images: YAML "<<time_yaml<<" s, binary "<<
+    time_binary<<" s"<<endl;
+
+  //descriptors are read from the mapped file without copy:
+  if( ( int )store->getNbImages( ) != nb_images )
+    CV_Error( CV_StsError, "Not the same number of images!" );
+  for( int i = 0; i < nb_images; ++i )
+  {
+    PointsToTrack p_binary;
+    PointsToTrack::read( store, i, p_binary );
+    Mat desc = points_computed[ i ]->getDescriptors( ),
+      desc_binary = p_binary.getDescriptors( );
+    if( p_binary.getIndexImage( ) != i ||
+      p_binary.getKeypoints( ).size( ) != points_computed[ i ]->getKeypoints( ).size( ) ||
+      desc.size( ) != desc_binary.size( ) || norm( desc, desc_binary, NORM_INF ) > 0 )
+      CV_Error( CV_StsError, "Not the same points!" );
+  }
+  cout<<"FeaturesStore is OK!"<<endl;
+}
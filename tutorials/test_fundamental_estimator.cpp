@@ -0,0 +1,93 @@
+
+#include "config_SFM.h"
+#include "../src/FundamentalEstimator.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto creates synthetic matches between two views (with outliers)
+//and compares cv::findFundamentalMat (RANSAC) with FundamentalEstimator.
+//The quality given to the estimator is noisy, like descriptor distances:
+//outliers are more likely to have a bad quality, but not always.
+//With a noise of 0.3 pixel and a threshold of 1 pixel, almost every match
+//must be well classified and the number of inliers must be close to the
+//true one (at most 2% of errors are accepted).
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+NEW_TUTO( Fundamental_Estimator, "Robust estimation of fundamental matrix",
+  "Compare RANSAC from OpenCV with PROSAC and adaptive termination on synthetic matches." )
+{
+  RNG rng( 12345 );
+  const int nb_points = 2000;
+  const double outliers_ratio = 0.5;
+  //two pinhole cameras, the second one is translated and rotated:
+  Mat K = ( Mat_<double>( 3, 3 ) << 800, 0, 512, 0, 800, 384, 0, 0, 1 );
+  Mat rvec = ( Mat_<double>( 3, 1 ) << 0.05, -0.2, 0.02 ), R;
+  Rodrigues( rvec, R );
+  Mat T = ( Mat_<double>( 3, 1 ) << -1.0, 0.1, 0.05 );
+
+  vector<Point2f> points1, points2;
+  vector<float> quality;
+  vector<bool> is_inlier;
+  int nb_true_inliers = 0;
+  for( int i = 0; i < nb_points; ++i )
+  {
+    Mat X = ( Mat_<double>( 3, 1 ) << rng.uniform( -4.0, 4.0 ),
+      rng.uniform( -3.0, 3.0 ), rng.uniform( 6.0, 15.0 ) );
+    Mat p1 = K * X, p2 = K * ( R * X + T );
+    Point2f pt1( ( float )( p1.at<double>( 0 ) / p1.at<double>( 2 ) ),
+      ( float )( p1.at<double>( 1 ) / p1.at<double>( 2 ) ) );
+    Point2f pt2( ( float )( p2.at<double>( 0 ) / p2.at<double>( 2 ) ),
+      ( float )( p2.at<double>( 1 ) / p2.at<double>( 2 ) ) );
+    bool inlier = rng.uniform( 0.0, 1.0 ) > outliers_ratio;
+    if( inlier )
+    {
+      pt2.x += ( float )rng.gaussian( 0.3 );
+      pt2.y += ( float )rng.gaussian( 0.3 );
+    }
+    else
+      pt2 = Point2f( rng.uniform( 0.f, 1024.f ), rng.uniform( 0.f, 768.f ) );
+    points1.push_back( pt1 );
+    points2.push_back( pt2 );
+    is_inlier.push_back( inlier );
+    if( inlier )
+      nb_true_inliers++;
+    quality.push_back( rng.uniform( 0.f, 1.f ) + ( inlier ? 0.f : 0.5f ) );
+  }
+
+  vector<uchar> status;
+  double t = ( double )getTickCount( );
+  findFundamentalMat( points1, points2, status, FM_RANSAC, 1.0 );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  int nb_inliers = countNonZero( Mat( status ) );
+  cout<<"OpenCV RANSAC: "<<nb_inliers<<" inliers in "<<t<<" s"<<endl;
+
+  FundamentalEstimator estimator( 1.0 );
+  t = ( double )getTickCount( );
+  Mat F = estimator.estimate( points1, points2, status, quality );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  int nb_wrong = 0;
+  for( int i = 0; i < nb_points; ++i )
+    if( ( status[ i ] != 0 ) != is_inlier[ i ] )
+      nb_wrong++;
+  cout<<"FundamentalEstimator: "<<estimator.getNbInliers( )<<" inliers in "<<
+    t<<" s, "<<estimator.getNbIterations( )<<" iterations ("<<
+    estimator.getNbRejected( )<<" models rejected by the pre-check), "<<
+    nb_wrong<<" matches wrongly classified"<<endl;
+  if( F.empty( ) )
+    CV_Error( CV_StsError, "No fundamental matrix found!" );
+  const int max_errors = nb_points / 50;
+  if( nb_wrong > max_errors )
+    CV_Error( CV_StsError, "Too many matches wrongly classified!" );
+  if( abs( ( int )estimator.getNbInliers( ) - nb_true_inliers ) > max_errors )
+    CV_Error( CV_StsError, "Wrong number of inliers!" );
+  if( estimator.getNbInliers( ) != ( unsigned int )countNonZero( Mat( status ) ) )
+    CV_Error( CV_StsError, "Inliers count and status differ!" );
+  cout<<"FundamentalEstimator is OK ("<<nb_true_inliers<<" true inliers)"<<endl;
+}
@@ -0,0 +1,196 @@
+
+#include "config_SFM.h"
+#include "../src/TracksOfPoints.h"
+
+#include <boost/unordered_set.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto compares the speed of TrackOfPoints::fusionDuplicates with a
+//quadratic version (each pair of tracks is tested), using synthetic
+//tracks. Both must find the same sets of connected tracks, and the merged
+//tracks must keep every observation of the duplicated ones.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+static bool haveCommunPoint( const TrackOfPoints& track1,
+  const TrackOfPoints& track2 )
+{
+  for( unsigned int i1 = 0; i1 < track1.getNbPoints( ); ++i1 )
+  {
+    int img1, pt1;
+    track1.getMatch( i1, img1, pt1 );
+    for( unsigned int i2 = 0; i2 < track2.getNbPoints( ); ++i2 )
+    {
+      int img2, pt2;
+      track2.getMatch( i2, img2, pt2 );
+      if( img1 == img2 && pt1 == pt2 )
+        return true;
+    }
+  }
+  return false;
+}
+
+//number of sets of connected tracks, testing each pair of tracks:
+static size_t countConnectedTracksQuadratic( const vector<TrackOfPoints>& tracks )
+{
+  vector<bool> visited( tracks.size( ), false );
+  size_t nb_sets = 0;
+  for( size_t t = 0; t < tracks.size( ); ++t )
+  {
+    if( visited[ t ] )
+      continue;
+    nb_sets++;
+    visited[ t ] = true;
+    vector<size_t> to_visit( 1, t );
+    while( !to_visit.empty( ) )
+    {
+      size_t current = to_visit.back( );
+      to_visit.pop_back( );
+      for( size_t other = 0; other < tracks.size( ); ++other )
+        if( !visited[ other ] && haveCommunPoint( tracks[ current ], tracks[ other ] ) )
+        {
+          visited[ other ] = true;
+          to_visit.push_back( other );
+        }
+    }
+  }
+  return nb_sets;
+}
+
+//random tracks of 2 to 4 views, some of them share points:
+static vector<TrackOfPoints> createSyntheticTracks( unsigned int nb_tracks,
+  unsigned int nb_images, RNG& rng )
+{
+  vector<TrackOfPoints> tracks( nb_tracks );
+  //about 10% of tracks have a point in commun with an other track:
+  unsigned int nb_points_per_image = ( nb_tracks * 3 * 10 ) / nb_images;
+  for( unsigned int t = 0; t < nb_tracks; ++t )
+  {
+    unsigned int nb_views = 2 + rng.uniform( 0, 3 );
+    unsigned int first_img = rng.uniform( 0, ( int )nb_images );
+    for( unsigned int v = 0; v < nb_views; ++v )
+      tracks[ t ].addMatch( ( first_img + v ) % nb_images,
+        rng.uniform( 0, ( int )nb_points_per_image ) );
+    tracks[ t ].setColor( ( unsigned int )rng.next( ) & 0x00FFFFFF );
+  }
+  return tracks;
+}
+
+//every (image, point) of the tracks:
+static boost::unordered_set< pair< int, int > > observationsOf(
+  const vector<TrackOfPoints>& tracks )
+{
+  boost::unordered_set< pair< int, int > > points;
+  for( size_t t = 0; t < tracks.size( ); ++t )
+    for( unsigned int p = 0; p < tracks[ t ].getNbPoints( ); ++p )
+    {
+      int img, pt;
+      tracks[ t ].getMatch( p, img, pt );
+      points.insert( make_pair( img, pt ) );
+    }
+  return points;
+}
+
+//check that two tracks never share a point:
+static bool haveDuplicates( const vector<TrackOfPoints>& tracks )
+{
+  boost::unordered_set< pair< int, int > > points;
+  for( size_t t = 0; t < tracks.size( ); ++t )
+  {
+    boost::unordered_set< pair< int, int > > points_of_track;
+    for( unsigned int p = 0; p < tracks[ t ].getNbPoints( ); ++p )
+    {
+      int img, pt;
+      tracks[ t ].getMatch( p, img, pt );
+      points_of_track.insert( make_pair( img, pt ) );
+    }
+    boost::unordered_set< pair< int, int > >::iterator it =
+      points_of_track.begin( );
+    for( ; it != points_of_track.end( ); ++it )
+      if( !points.insert( *it ).second )
+        return true;
+  }
+  return false;
+}
+
+//two duplicated tracks, each one has an observation the other doesn't have:
+static void checkMergedObservations( )
+{
+  vector<TrackOfPoints> tracks( 3 );
+  tracks[ 0 ].addMatch( 0, 10 );
+  tracks[ 0 ].addMatch( 1, 20 );
+  tracks[ 0 ].setColor( 0x00202060 );
+  tracks[ 1 ].addMatch( 5, 50 );
+  tracks[ 1 ].addMatch( 6, 60 );
+  tracks[ 2 ].addMatch( 1, 20 );
+  tracks[ 2 ].addMatch( 2, 30 );
+  tracks[ 2 ].setColor( 0x00404080 );
+  TrackOfPoints::fusionDuplicates( tracks );
+  if( tracks.size( ) != 2 || tracks[ 0 ].getNbPoints( ) != 3 ||
+    !tracks[ 0 ].containPoint( 0, 10 ) || !tracks[ 0 ].containPoint( 1, 20 ) ||
+    !tracks[ 0 ].containPoint( 2, 30 ) || !tracks[ 1 ].containPoint( 5, 50 ) )
+    CV_Error( CV_StsError, "Observations of duplicated tracks are lost!" );
+  if( tracks[ 0 ].getColor( ) != 0x00303070 || tracks[ 0 ].getConsistance( ) < 0 )
+    CV_Error( CV_StsError, "Wrong color or consistance of the merged track!" );
+
+  //an other point of the same image makes the merged track inconsistent:
+  tracks.resize( 2 );
+  tracks[ 0 ] = TrackOfPoints( );
+  tracks[ 0 ].addMatch( 0, 10 );
+  tracks[ 0 ].addMatch( 1, 20 );
+  tracks[ 1 ] = TrackOfPoints( );
+  tracks[ 1 ].addMatch( 1, 20 );
+  tracks[ 1 ].addMatch( 0, 11 );
+  TrackOfPoints::fusionDuplicates( tracks );
+  if( tracks.size( ) != 1 || tracks[ 0 ].getNbPoints( ) != 3 ||
+    tracks[ 0 ].getConsistance( ) >= 0 || tracks[ 0 ].isGoodPoint( 2 ) )
+    CV_Error( CV_StsError, "The merged track should be inconsistent!" );
+}
+
+NEW_TUTO( Fusion_Duplicates, "Benchmark of tracks fusion",
+  "Compare fusionDuplicates with a quadratic version on synthetic tracks." )
+{
+  checkMergedObservations( );
+  RNG rng( 0x12345678 );
+  unsigned int nb_images = 50;
+  unsigned int sizes[ ] = { 1000, 5000, 10000, 500000 };
+  unsigned int max_size_quadratic = 10000;//the old version is too slow after
+
+  for( size_t s = 0; s < sizeof( sizes ) / sizeof( sizes[ 0 ] ); ++s )
+  {
+    vector<TrackOfPoints> tracks = createSyntheticTracks( sizes[ s ],
+      nb_images, rng );
+    cout<<sizes[ s ]<<" tracks:"<<endl;
+
+    size_t nb_sets = 0;
+    if( sizes[ s ] <= max_size_quadratic )
+    {
+      double t = ( double )getTickCount( );
+      nb_sets = countConnectedTracksQuadratic( tracks );
+      t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+      cout<<"  quadratic version: "<<t<<" s, "<<nb_sets<<
+        " tracks left"<<endl;
+    }
+
+    boost::unordered_set< pair< int, int > > observations =
+      observationsOf( tracks );
+    double t = ( double )getTickCount( );
+    TrackOfPoints::fusionDuplicates( tracks );
+    t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+    cout<<"  disjoint-set version: "<<t<<" s, "<<tracks.size( )<<
+      " tracks left"<<endl;
+
+    if( sizes[ s ] <= max_size_quadratic && tracks.size( ) != nb_sets )
+      CV_Error( CV_StsError, "Tracks are different from the quadratic version!" );
+    if( observationsOf( tracks ) != observations )
+      CV_Error( CV_StsError, "Some observations are lost!" );
+    if( haveDuplicates( tracks ) )
+      CV_Error( CV_StsError, "Some tracks still share points!" );
+  }
+  cout<<"fusionDuplicates is OK!"<<endl;
+}
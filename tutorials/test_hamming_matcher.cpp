@@ -0,0 +1,99 @@
+
+#include "config_SFM.h"
+#include "../src/PointsToTrackWithImage.h"
+#include "../src/MotionProcessor.h"
+#include "../src/PointsMatcher.h"
+#include "../src/PointsMatcherHamming.h"
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto compares the speed of PointsMatcherHamming with the OpenCV
+//brute force matcher, using ORB features of the model house images.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+//mean time (in ms) of a match between query and the trained points:
+static double timeMatch( Ptr<PointsMatcher> matcher, Ptr<PointsToTrack> query,
+  vector<DMatch>& matches, int nb_runs )
+{
+  matcher->train( );
+  double t = ( double )getTickCount( );
+  for( int run = 0; run < nb_runs; ++run )
+  {
+    matches.clear( );
+    matcher->match( query, matches );
+  }
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  return t * 1000.0 / nb_runs;
+}
+
+NEW_TUTO( Hamming_Matcher, "Benchmark of the SIMD Hamming matcher",
+  "Compare PointsMatcherHamming with BruteForce-Hamming on ORB features of the model house." )
+{
+  MotionProcessor mp;
+  mp.setInputSource( FROM_SRC_ROOT( "Medias/modelHouse/" ), IS_DIRECTORY );
+  mp.setProperty( CV_CAP_PROP_CONVERT_RGB, 0 );
+  Mat img1 = mp.getFrame( ), img2 = mp.getFrame( );
+  if( img1.empty( ) || img2.empty( ) )
+  {
+    cout<<"test can not be run... can't find images..."<<endl;
+    return;
+  }
+
+  Ptr<PointsToTrack> points1 = Ptr<PointsToTrack>(
+    new PointsToTrackWithImage( 0, img1, "ORB", "ORB" ) );
+  Ptr<PointsToTrack> points2 = Ptr<PointsToTrack>(
+    new PointsToTrackWithImage( 1, img2, "ORB", "ORB" ) );
+  //descriptors are kept in memory during the benchmark:
+  points1->computeKeypointsAndDesc( );
+  points2->computeKeypointsAndDesc( );
+  cout<<points1->getKeypoints( ).size( )<<" and "<<
+    points2->getKeypoints( ).size( )<<" ORB points"<<endl;
+  int nb_runs = 20;
+
+  Ptr<PointsMatcher> opencv_matcher = PointsMatcher::create( "BruteForce-Hamming" );
+  opencv_matcher->add( points1 );
+  vector<DMatch> opencv_matches;
+  double opencv_time = timeMatch( opencv_matcher, points2, opencv_matches, nb_runs );
+  cout<<"BruteForce-Hamming: "<<opencv_time<<" ms"<<endl;
+
+  //without filters, the matches must be the same:
+  for( int k = PointsMatcherHamming::KERNEL_SCALAR;
+    k <= PointsMatcherHamming::KERNEL_AVX512; ++k )
+  {
+    PointsMatcherHamming::KernelType kernel = ( PointsMatcherHamming::KernelType )k;
+    if( !PointsMatcherHamming::isKernelSupported( kernel ) )
+    {
+      cout<<PointsMatcherHamming::getKernelName( kernel )<<
+        " kernel is not available on this CPU"<<endl;
+      continue;
+    }
+    Ptr<PointsMatcher> matcher = Ptr<PointsMatcher>(
+      new PointsMatcherHamming( 1.0f, false, kernel ) );
+    matcher->add( points1 );
+    vector<DMatch> matches;
+    double t = timeMatch( matcher, points2, matches, nb_runs );
+    cout<<"PointsMatcherHamming ("<<PointsMatcherHamming::getKernelName( kernel )<<
+      "): "<<t<<" ms, speedup "<<opencv_time / t<<endl;
+
+    if( matches.size( ) != opencv_matches.size( ) )
+      CV_Error( CV_StsError, "Not the same number of matches!" );
+    for( size_t m = 0; m < matches.size( ); ++m )
+      if( matches[ m ].queryIdx != opencv_matches[ m ].queryIdx ||
+        matches[ m ].distance != opencv_matches[ m ].distance )
+        CV_Error( CV_StsError, "Not the same matches!" );
+  }
+
+  //and with the ratio test and the mutual check:
+  Ptr<PointsMatcher> matcher = PointsMatcherHamming::create( );
+  matcher->add( points1 );
+  vector<DMatch> matches;
+  double t = timeMatch( matcher, points2, matches, nb_runs );
+  cout<<"PointsMatcherHamming with ratio test and mutual check: "<<t<<
+    " ms, "<<matches.size( )<<" matches kept on "<<opencv_matches.size( )<<endl;
+  cout<<"PointsMatcherHamming is OK!"<<endl;
+}
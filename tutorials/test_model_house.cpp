@@ -6,6 +6,8 @@
 #include "../src/Visualizer.h"
 #include "../src/MatcherSparseFlow.h"
 #include "../src/bundle_related.h"
+#include "../src/BatchTriangulator.h"
+#include "../src/TrackStore.h"
 
 //////////////////////////////////////////////////////////////////////////
 //This file will not be in the final version of API, consider it like a tuto/draft...
@@ -27,6 +29,53 @@ using namespace std;
 #define DEBUG_MESSAGE "To be able to run this tuto, please download model house dataset here :\n"\
 "http://www.robots.ox.ac.uk/~vgg/data/data-mview.html"<<endl
 
+//triangulate the tracks, remove the bad ones and then the outliers:
+static vector<char> computeStructure( StructureEstimator& structure,
+  vector<TrackOfPoints>& tracks )
+{
+  vector<char> mask =  structure.computeStructure( );
+  //remove bad points:
+  for(unsigned int d = 0, d_idx=0;d<mask.size(); d++,d_idx++)
+    if(mask[d]==0)
+    {
+      //remove this bad match:
+      tracks[d_idx] = tracks[tracks.size()-1];
+      d_idx--;
+      tracks.pop_back();
+    }
+  structure.removeOutliersTracks(2);
+  return mask;
+}
+
+//same points, flags and 3D positions:
+static bool sameTracks( vector<TrackOfPoints>& tracks1,
+  vector<TrackOfPoints>& tracks2 )
+{
+  if( tracks1.size( ) != tracks2.size( ) )
+    return false;
+  for( size_t t = 0; t < tracks1.size( ); ++t )
+  {
+    TrackOfPoints &track1 = tracks1[ t ], &track2 = tracks2[ t ];
+    if( track1.getNbPoints( ) != track2.getNbPoints( ) ||
+      track1.getConsistance( ) != track2.getConsistance( ) )
+      return false;
+    for( unsigned int p = 0; p < track1.getNbPoints( ); ++p )
+    {
+      int img1, pt1, img2, pt2;
+      track1.getMatch( p, img1, pt1 );
+      track2.getMatch( p, img2, pt2 );
+      if( img1 != img2 || pt1 != pt2 ||
+        track1.isGoodPoint( p ) != track2.isGoodPoint( p ) )
+        return false;
+    }
+    Ptr<Vec3d> point1 = track1.get3DPosition( ), point2 = track2.get3DPosition( );
+    if( point1.empty( ) != point2.empty( ) ||
+      ( !point1.empty( ) && *point1 != *point2 ) )
+      return false;
+  }
+  return true;
+}
+
 NEW_TUTO( Model_House_test, "Using Model house data, run a SFM algorithm",
   "To be able to run this tuto, please download model house dataset here :\n"
   "http://www.robots.ox.ac.uk/~vgg/data/data-mview.html")
@@ -138,19 +187,53 @@ NEW_TUTO( Model_House_test, "Using Model house data, run a SFM algorithm",
     {
       cout<<"numbers of correct tracks loaded:"<<tracks.size( )<<endl;
 
+      //throughput of the two triangulation methods:
+      vector< Ptr<PointsToTrack> >& points_to_track = motion_estim.getPoints( );
+      vector<TrackOfPoints> tracks_copy = tracks;
+      double t = ( double )getTickCount( );
+      for( size_t i = 0; i < tracks_copy.size( ); ++i )
+      {
+        cv::Vec3d point;
+        tracks_copy[ i ].triangulateRobust( cameras, points_to_track, point );
+      }
+      t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+      cout<<"TrackOfPoints::triangulateRobust: "<<tracks_copy.size( ) / t<<
+        " tracks/s"<<endl;
+      TrackStore store( tracks );
+      vector<double> errors;
+      BatchTriangulator triangulator( cameras, points_to_track );
+      t = ( double )getTickCount( );
+      triangulator.triangulate( store, errors );
+      t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+      cout<<"BatchTriangulator: "<<store.size( ) / t<<" tracks/s"<<endl;
+      //results don't depend on the number of threads:
+      TrackStore store_single( tracks );
+      vector<double> errors_single;
+      triangulator.setNbThreads( 1 );
+      triangulator.triangulate( store_single, errors_single );
+      for( unsigned int i = 0; i < store.size( ); ++i )
+        if( errors[ i ] != errors_single[ i ] ||
+          ( const Vec3d& )store[ i ] != ( const Vec3d& )store_single[ i ] )
+          CV_Error( CV_StsError, "Triangulation depends on the number of threads!" );
+
       cout<<"triangulation of points."<<endl;
+      //structure computed with only one thread, from the same tracks:
+      vector<TrackOfPoints> tracks_input = tracks;
+      StructureEstimator structure_single ( &motion_estim, &cameras );
+      structure_single.setNbThreads( 1 );
+      vector<char> mask_single = computeStructure( structure_single, tracks );
+      vector<TrackOfPoints> tracks_single = tracks;
+      tracks = tracks_input;
+
       StructureEstimator structure ( &motion_estim, &cameras );
-      vector<char> mask =  structure.computeStructure( );
-      //remove bad points:
-      for(unsigned int d = 0, d_idx=0;d<mask.size(); d++,d_idx++)
-        if(mask[d]==0)
-        {
-          //remove this bad match:
-          tracks[d_idx] = tracks[tracks.size()-1];
-          d_idx--;
-          tracks.pop_back();
-        }
-        structure.removeOutliersTracks(2);
+      t = ( double )getTickCount( );
+      vector<char> mask = computeStructure( structure, tracks );
+      t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+      cout<<"StructureEstimator: "<<tracks_input.size( ) / t<<" tracks/s"<<endl;
+      //computeStructure and removeOutliersTracks don't depend on the
+      //number of threads:
+      if( mask != mask_single || !sameTracks( tracks, tracks_single ) )
+        CV_Error( CV_StsError, "Structure depends on the number of threads!" );
     }
 
     if(rep!="0")
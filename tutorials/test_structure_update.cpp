@@ -0,0 +1,104 @@
+
+#include "config_SFM.h"
+#include "../src/SequenceAnalyzer.h"
+#include "../src/StructureEstimator.h"
+#include "../src/PointOfView.h"
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto builds the structure of a synthetic sequence incrementally:
+//computeStructure on the first two images, then updateStructure each time
+//a new image is added (like EuclideanEstimator::computeReconstruction).
+//The index of tracks is built once at the beginning: the structure
+//estimator only changes the 3D positions of the tracks, so the index must
+//still be valid after each step (it is not rebuilt over every tracks).
+//Triangulated points are compared with the ground truth.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+NEW_TUTO( Structure_Update, "Incremental structure and index of tracks",
+  "Update the structure image after image and check the index of tracks is not rebuilt." )
+{
+  RNG rng( 0x13579 );
+  const unsigned int nb_images = 8, nb_tracks = 3000;
+
+  //cameras on a line, looking at the points:
+  Mat_<double> K = ( Mat_<double>( 3, 3 ) << 800, 0, 320, 0, 800, 240, 0, 0, 1 );
+  vector<PointOfView> cameras;
+  vector< Mat_<double> > projections;
+  for( unsigned int i = 0; i < nb_images; ++i )
+  {
+    Mat_<double> Rt = ( Mat_<double>( 3, 4 ) << 1, 0, 0, -0.2 * i,
+      0, 1, 0, 0, 0, 0, 1, 5 );
+    Mat_<double> P = K * Rt;
+    projections.push_back( P );
+    cameras.push_back( PointOfView( P ) );
+  }
+
+  //each track is seen by consecutive images:
+  vector< vector<KeyPoint> > keypoints( nb_images );
+  vector<TrackOfPoints> tracks;
+  vector<Vec3d> ground_truth;
+  for( unsigned int t = 0; t < nb_tracks; ++t )
+  {
+    Vec3d point( rng.uniform( -1.0, 2.0 ), rng.uniform( -1.0, 1.0 ),
+      rng.uniform( -1.0, 1.0 ) );
+    unsigned int first = rng.uniform( 0, ( int )nb_images - 1 );
+    unsigned int nb_views = 2 + rng.uniform( 0, ( int )( nb_images - first - 1 ) );
+    TrackOfPoints track;
+    for( unsigned int i = first; i < first + nb_views; ++i )
+    {
+      Mat_<double> proj = projections[ i ] *
+        ( Mat_<double>( 4, 1 ) << point[ 0 ], point[ 1 ], point[ 2 ], 1 );
+      track.addMatch( i, keypoints[ i ].size( ) );
+      keypoints[ i ].push_back( KeyPoint( ( float )( proj( 0 ) / proj( 2 ) ),
+        ( float )( proj( 1 ) / proj( 2 ) ), 1 ) );
+    }
+    tracks.push_back( track );
+    ground_truth.push_back( point );
+  }
+  vector< Ptr< PointsToTrack > > points;
+  for( unsigned int i = 0; i < nb_images; ++i )
+    points.push_back( Ptr< PointsToTrack >( new PointsToTrack( i, keypoints[ i ] ) ) );
+  SequenceAnalyzer sequence( points );
+  sequence.getTracks( ) = tracks;
+
+  //build the index once:
+  sequence.getTracksIndex( );
+  StructureEstimator structure( &sequence, &cameras );
+  StructureIndex structure_index;
+  vector<int> images_computed;
+  images_computed.push_back( 0 );
+  images_computed.push_back( 1 );
+  vector<TrackOfPoints> points3D = structure.computeStructure( images_computed,
+    2, &structure_index );
+  if( !sequence.isTracksIndexValid( ) )
+    CV_Error( CV_StsError, "computeStructure invalidated the index of tracks!" );
+  cout<<"2 images: "<<points3D.size( )<<" points"<<endl;
+
+  for( unsigned int i = 2; i < nb_images; ++i )
+  {
+    images_computed.push_back( i );
+    structure.updateStructure( images_computed, i, points3D, structure_index, 2 );
+    if( !sequence.isTracksIndexValid( ) )
+      CV_Error( CV_StsError, "updateStructure invalidated the index of tracks!" );
+    cout<<i + 1<<" images: "<<points3D.size( )<<" points"<<endl;
+  }
+
+  //every track of the structure is at its true position:
+  double max_error = 0;
+  for( size_t p = 0; p < points3D.size( ); ++p )
+  {
+    Ptr<Vec3d> point = points3D[ p ].get3DPosition( );
+    Vec3d truth = ground_truth[ structure_index.sequence_track[ p ] ];
+    max_error = MAX( max_error, norm( *point - truth ) );
+  }
+  cout<<"max distance to the ground truth: "<<max_error<<endl;
+  if( max_error > 1e-3 )
+    CV_Error( CV_StsError, "Wrong structure!" );
+  cout<<"Index of tracks was built only once!"<<endl;
+}
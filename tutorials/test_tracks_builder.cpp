@@ -0,0 +1,211 @@
+
+#include "config_SFM.h"
+#include "../src/SequenceAnalyzer.h"
+#include "../src/ConcurrentTracksBuilder.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto builds tracks from the same synthetic matches in two ways:
+//SequenceAnalyzer::addMatches (pairs added one after the other) followed
+//by TrackOfPoints::fusionDuplicates, and ConcurrentTracksBuilder. Tracks
+//are compared one by one.
+//With clean matches, both give exactly the same tracks. With wrong
+//matches, two tracks can be linked by a match: addMatches only adds the
+//point to the first track, and the points of the other track are then
+//lost by fusionDuplicates, while ConcurrentTracksBuilder keeps the whole
+//connected component. Inconsistent tracks can also keep different points.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+typedef vector< pair< int, int > > PointsOfTrack;
+typedef vector< pair< PointsOfTrack, int > > CanonicalTracks;
+
+//sorted points and consistance of each track, sorted:
+static CanonicalTracks canonicalTracks( const vector<TrackOfPoints>& tracks )
+{
+  CanonicalTracks out;
+  for( size_t t = 0; t < tracks.size( ); ++t )
+  {
+    PointsOfTrack points;
+    for( unsigned int p = 0; p < tracks[ t ].getNbPoints( ); ++p )
+    {
+      int img, pt;
+      tracks[ t ].getMatch( p, img, pt );
+      points.push_back( make_pair( img, pt ) );
+    }
+    sort( points.begin( ), points.end( ) );
+    out.push_back( make_pair( points, tracks[ t ].getConsistance( ) ) );
+  }
+  sort( out.begin( ), out.end( ) );
+  return out;
+}
+
+//matches of each pair ( i < j ), created from random ground truth tracks:
+static vector< vector< vector<DMatch> > > createMatches( unsigned int nb_images,
+  unsigned int nb_points, unsigned int nb_tracks, double wrong_ratio, RNG& rng )
+{
+  vector< vector< vector<DMatch> > > matches( nb_images,
+    vector< vector<DMatch> >( nb_images ) );
+  vector< vector<int> > free_points( nb_images );
+  for( unsigned int i = 0; i < nb_images; ++i )
+  {
+    for( unsigned int p = 0; p < nb_points; ++p )
+      free_points[ i ].push_back( p );
+    for( unsigned int p = 0; p < nb_points; ++p )
+      swap( free_points[ i ][ p ], free_points[ i ][ rng.uniform( 0, ( int )nb_points ) ] );
+  }
+  for( unsigned int t = 0; t < nb_tracks; ++t )
+  {
+    vector<int> point_of_image( nb_images, -1 );
+    unsigned int nb_views = 2 + rng.uniform( 0, 4 );
+    for( unsigned int v = 0; v < nb_views; ++v )
+    {
+      unsigned int img = rng.uniform( 0, ( int )nb_images );
+      if( point_of_image[ img ] < 0 && !free_points[ img ].empty( ) )
+      {
+        point_of_image[ img ] = free_points[ img ].back( );
+        free_points[ img ].pop_back( );
+      }
+    }
+    for( unsigned int i = 0; i < nb_images; ++i )
+      for( unsigned int j = i + 1; j < nb_images; ++j )
+        if( point_of_image[ i ] >= 0 && point_of_image[ j ] >= 0 )
+          matches[ i ][ j ].push_back( DMatch( point_of_image[ j ],
+            point_of_image[ i ], 0 ) );
+  }
+  for( unsigned int i = 0; i < nb_images; ++i )
+    for( unsigned int j = i + 1; j < nb_images; ++j )
+    {
+      unsigned int nb_wrong = ( unsigned int )( matches[ i ][ j ].size( ) * wrong_ratio );
+      for( unsigned int w = 0; w < nb_wrong; ++w )
+        matches[ i ][ j ].push_back( DMatch( rng.uniform( 0, ( int )nb_points ),
+          rng.uniform( 0, ( int )nb_points ), 0 ) );
+    }
+  return matches;
+}
+
+//connected components of the matches graph (serial union-find):
+static int findRoot( map< pair< int, int >, pair< int, int > >& parent,
+  pair< int, int > node )
+{
+  if( parent.find( node ) == parent.end( ) )
+    parent[ node ] = node;
+  while( parent[ node ] != node )
+    node = parent[ node ];
+  return node.first * 1000000 + node.second;
+}
+
+static void compareTracks( const vector< vector< vector<DMatch> > >& matches,
+  unsigned int nb_points, bool must_be_identical )
+{
+  unsigned int nb_images = matches.size( );
+  vector< Ptr< PointsToTrack > > points;
+  for( unsigned int i = 0; i < nb_images; ++i )
+    points.push_back( Ptr< PointsToTrack >( new PointsToTrack( i,
+      vector<KeyPoint>( nb_points ) ) ) );
+
+  //previous way:
+  SequenceAnalyzer sequence( points );
+  for( unsigned int i = 0; i < nb_images; ++i )
+    for( unsigned int j = i + 1; j < nb_images; ++j )
+    {
+      vector<DMatch> matches_i_j = matches[ i ][ j ];
+      sequence.addMatches( matches_i_j, i, j );
+    }
+  TrackOfPoints::fusionDuplicates( sequence.getTracks( ) );
+  CanonicalTracks old_tracks = canonicalTracks( sequence.getTracks( ) );
+
+  //union-find:
+  ConcurrentTracksBuilder builder( vector<unsigned int>( nb_images, nb_points ) );
+  for( unsigned int i = 0; i < nb_images; ++i )
+    for( unsigned int j = i + 1; j < nb_images; ++j )
+      builder.addMatches( matches[ i ][ j ], i, j );
+  vector<TrackOfPoints> tracks;
+  builder.buildTracks( tracks );
+  CanonicalTracks new_tracks = canonicalTracks( tracks );
+
+  //reference components:
+  map< pair< int, int >, pair< int, int > > parent;
+  for( unsigned int i = 0; i < nb_images; ++i )
+    for( unsigned int j = i + 1; j < nb_images; ++j )
+      for( size_t m = 0; m < matches[ i ][ j ].size( ); ++m )
+      {
+        pair< int, int > node1( i, matches[ i ][ j ][ m ].trainIdx ),
+          node2( j, matches[ i ][ j ][ m ].queryIdx );
+        findRoot( parent, node1 );
+        findRoot( parent, node2 );
+        while( parent[ node1 ] != node1 ) node1 = parent[ node1 ];
+        while( parent[ node2 ] != node2 ) node2 = parent[ node2 ];
+        if( node1 != node2 )
+          parent[ max( node1, node2 ) ] = min( node1, node2 );
+      }
+  map< int, PointsOfTrack > components;
+  map< pair< int, int >, pair< int, int > >::iterator it = parent.begin( );
+  for( ; it != parent.end( ); ++it )
+    components[ findRoot( parent, it->first ) ].push_back( it->first );
+
+  //every consistent track is a component, and there is one track by component:
+  if( new_tracks.size( ) != components.size( ) )
+    CV_Error( CV_StsError, "Wrong number of tracks!" );
+  for( size_t t = 0; t < new_tracks.size( ); ++t )
+  {
+    const PointsOfTrack& track = new_tracks[ t ].first;
+    PointsOfTrack& component = components[ findRoot( parent, track[ 0 ] ) ];
+    sort( component.begin( ), component.end( ) );
+    if( new_tracks[ t ].second >= 0 && track != component )
+      CV_Error( CV_StsError, "A track is not a connected component!" );
+  }
+
+  //compare with the previous way, track by track:
+  unsigned int nb_identical = 0, nb_smaller = 0, nb_consistance = 0;
+  for( size_t t = 0; t < old_tracks.size( ); ++t )
+  {
+    const PointsOfTrack& track = old_tracks[ t ].first;
+    int root = findRoot( parent, track[ 0 ] );
+    //every point of the old track is in the same component:
+    for( size_t p = 1; p < track.size( ); ++p )
+      if( findRoot( parent, track[ p ] ) != root )
+        CV_Error( CV_StsError, "An old track is split between components!" );
+    if( binary_search( new_tracks.begin( ), new_tracks.end( ), old_tracks[ t ] ) )
+      nb_identical++;
+    else
+    {
+      PointsOfTrack unique_points = track;
+      unique_points.erase( unique( unique_points.begin( ), unique_points.end( ) ),
+        unique_points.end( ) );
+      if( unique_points.size( ) < components[ root ].size( ) )
+        nb_smaller++;
+      else
+        nb_consistance++;
+    }
+  }
+  cout<<"  addMatches + fusionDuplicates: "<<old_tracks.size( )<<
+    " tracks, ConcurrentTracksBuilder: "<<new_tracks.size( )<<" tracks"<<endl;
+  cout<<"  identical tracks: "<<nb_identical<<", old tracks with less points: "<<
+    nb_smaller<<", same points but different consistance: "<<nb_consistance<<endl;
+  if( must_be_identical && old_tracks != new_tracks )
+    CV_Error( CV_StsError, "Tracks are not identical!" );
+}
+
+NEW_TUTO( Tracks_Builder, "Compare the two ways of building tracks",
+  "Tracks are built with addMatches + fusionDuplicates and with the lock-free union-find on the same matches." )
+{
+  RNG rng( 0x2468ace );
+  const unsigned int nb_images = 8, nb_points = 2000, nb_tracks = 1500;
+
+  cout<<"Clean matches:"<<endl;
+  compareTracks( createMatches( nb_images, nb_points, nb_tracks, 0.0, rng ),
+    nb_points, true );
+  cout<<"With 5% of wrong matches:"<<endl;
+  compareTracks( createMatches( nb_images, nb_points, nb_tracks, 0.05, rng ),
+    nb_points, false );
+  cout<<"Tracks builder is OK!"<<endl;
+}
@@ -0,0 +1,116 @@
+
+#include "config_SFM.h"
+#include "../src/PointsToTrackWithImage.h"
+#include "../src/MotionProcessor.h"
+#include "../src/SequenceAnalyzer.h"
+#include "../src/PointsMatcher.h"
+
+#include <map>
+#include <utility>
+
+//////////////////////////////////////////////////////////////////////////
+//This tuto shows the recall and the speed of the matching when only the
+//most similar images (found using a vocabulary tree) are matched, compared
+//with the matching of every pairs of images.
+//////////////////////////////////////////////////////////////////////////
+
+#include "test_data_sets.h"
+using namespace cv;
+using namespace OpencvSfM;
+using namespace OpencvSfM::tutorials;
+using namespace std;
+
+typedef map< pair< int, int >, int > PairsCount;
+
+//number of tracks shared by each pair of images:
+static PairsCount countSharedTracks( SequenceAnalyzer& sequence )
+{
+  PairsCount out;
+  vector<TrackOfPoints>& tracks = sequence.getTracks( );
+  unsigned int nb_images = sequence.getPoints( ).size( );
+  for( size_t t = 0; t < tracks.size( ); ++t )
+  {
+    vector<int> images;
+    for( unsigned int img = 0; img < nb_images; ++img )
+      if( tracks[ t ].containImage( img ) )
+        images.push_back( img );
+    for( size_t i = 0; i < images.size( ); ++i )
+      for( size_t j = i + 1; j < images.size( ); ++j )
+        out[ make_pair( images[ i ], images[ j ] ) ]++;
+  }
+  return out;
+}
+
+//time (in s) of computeMatches:
+static double matchSequence( vector< Ptr< PointsToTrack > >& points,
+  vector<Mat>& images, unsigned int nb_candidates, PairsCount& shared )
+{
+  SequenceAnalyzer sequence( points, &images,
+    PointsMatcher::create( "FlannBased" ) );
+  sequence.setNbCandidates( nb_candidates );
+  double t = ( double )getTickCount( );
+  sequence.computeMatches( 64, false );
+  t = ( ( double )getTickCount( ) - t ) / getTickFrequency( );
+  shared = countSharedTracks( sequence );
+  return t;
+}
+
+static void benchmark( string directory, unsigned int nb_max_images )
+{
+  MotionProcessor mp;
+  vector<Mat> images;
+  mp.setInputSource( FROM_SRC_ROOT( directory ), IS_DIRECTORY );
+  mp.setProperty( CV_CAP_PROP_CONVERT_RGB, 0 );
+  Mat imgTmp = mp.getFrame( );
+  while ( !imgTmp.empty( ) && images.size( ) < nb_max_images )
+  {
+    images.push_back( imgTmp );
+    imgTmp = mp.getFrame( );
+  }
+  if( images.size( ) < 4 )
+  {
+    cout<<"can't find images in "<<directory<<endl;
+    return;
+  }
+
+  vector< Ptr< PointsToTrack > > points;
+  for( unsigned int i = 0; i < images.size( ); ++i )
+  {
+    Ptr<PointsToTrack> ptt = Ptr<PointsToTrack>( new PointsToTrackWithImage(
+      i, images[ i ], "SURF", "SURF" ) );
+    ptt->computeKeypointsAndDesc( );
+    points.push_back( ptt );
+  }
+  cout<<directory<<" ("<<images.size( )<<" images):"<<endl;
+
+  //a pair of images is connected if it shares enough tracks:
+  int min_shared_tracks = 20;
+  PairsCount reference;
+  double time_all = matchSequence( points, images, 0, reference );
+  int nb_connected = 0;
+  for( PairsCount::iterator it = reference.begin( ); it != reference.end( ); ++it )
+    if( it->second >= min_shared_tracks )
+      nb_connected++;
+  cout<<"  every pairs: "<<time_all<<" s, "<<nb_connected<<" connected pairs"<<endl;
+
+  unsigned int candidates[ ] = { 2, 4, 8 };
+  for( size_t c = 0; c < sizeof( candidates ) / sizeof( candidates[ 0 ] ); ++c )
+  {
+    PairsCount shared;
+    double t = matchSequence( points, images, candidates[ c ], shared );
+    int nb_found = 0;
+    for( PairsCount::iterator it = reference.begin( ); it != reference.end( ); ++it )
+      if( it->second >= min_shared_tracks &&
+        shared[ it->first ] >= min_shared_tracks )
+        nb_found++;
+    cout<<"  K = "<<candidates[ c ]<<": "<<t<<" s (speedup "<<time_all / t<<
+      "), recall "<<( nb_connected > 0 ? ( double )nb_found / nb_connected : 1.0 )<<endl;
+  }
+}
+
+NEW_TUTO( Vocabulary_Pairs, "Recall and speed of the vocabulary tree",
+  "Match only the K most similar images of each image and compare with the matching of every pairs." )
+{
+  benchmark( "Medias/templeSparseRing/", 16 );
+  benchmark( "Medias/temple/", 48 );
+}